@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CallScheduler.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <vector>
+
+#include <android-base/logging.h>
+#include <android-base/parseint.h>
+#include <android-base/strings.h>
+
+using ::android::base::ParseUint;
+using ::android::base::Split;
+using ::android::base::Trim;
+
+namespace nos {
+namespace citadeld {
+
+namespace {
+
+// Tags are kept as integers so scale the cost up before dividing by the weight
+// to keep the precision of heavily weighted flows.
+constexpr uint64_t kWeightScale = 1024;
+
+template <typename Duration>
+uint64_t ToMicros(Duration d) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+}
+
+} // namespace
+
+CallScheduler::CallScheduler(uint32_t defaultWeight)
+        : _defaultWeight(std::max<uint32_t>(defaultWeight, 1)) {}
+
+void CallScheduler::SetWeight(uid_t uid, uint32_t weight) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    weight = std::max<uint32_t>(weight, 1);
+    _weights[uid] = weight;
+    auto it = _flows.find(uid);
+    if (it != _flows.end()) {
+        it->second.stats.weight = weight;
+    }
+}
+
+bool CallScheduler::ParseWeights(const std::string& config) {
+    bool ok = true;
+    for (const std::string& entry : Split(config, ",")) {
+        const std::string trimmed = Trim(entry);
+        if (trimmed.empty()) {
+            continue;
+        }
+        const std::vector<std::string> parts = Split(trimmed, ":");
+        uid_t uid;
+        uint32_t weight;
+        if (parts.size() != 2 || !ParseUint(Trim(parts[0]), &uid) ||
+            !ParseUint(Trim(parts[1]), &weight) || weight == 0) {
+            LOG(ERROR) << "Ignoring malformed UID weight \"" << trimmed << "\"";
+            ok = false;
+            continue;
+        }
+        SetWeight(uid, weight);
+    }
+    return ok;
+}
+
+uint32_t CallScheduler::Run(uid_t uid, uint64_t cost,
+                            const std::function<uint32_t()>& fn) {
+    acquire(uid, cost);
+    const uint32_t rv = fn();
+    release();
+    return rv;
+}
+
+size_t CallScheduler::Waiting() const {
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _queue.size();
+}
+
+std::map<uid_t, CallScheduler::FlowStats> CallScheduler::Stats() const {
+    std::unique_lock<std::mutex> lock(_mutex);
+    std::map<uid_t, FlowStats> stats;
+    for (const auto& flow : _flows) {
+        stats.emplace(flow.first, flow.second.stats);
+    }
+    return stats;
+}
+
+void CallScheduler::Dump(std::ostream& out) const {
+    const std::map<uid_t, FlowStats> stats = Stats();
+
+    uint64_t totalCost = 0;
+    uint64_t totalWeight = 0;
+    for (const auto& flow : stats) {
+        totalCost += flow.second.cost;
+        totalWeight += flow.second.weight;
+    }
+
+    out << "Scheduler flows (uid weight calls cost share fair-share "
+           "avg-wait-us max-wait-us):\n";
+    for (const auto& flow : stats) {
+        const FlowStats& s = flow.second;
+        const double share = totalCost == 0 ? 0.0 : 100.0 * s.cost / totalCost;
+        const double fair = totalWeight == 0 ? 0.0 : 100.0 * s.weight / totalWeight;
+        const uint64_t avgWait = s.calls == 0 ? 0 : ToMicros(s.total_wait) / s.calls;
+        out << "  " << flow.first << " " << s.weight << " " << s.calls << " "
+            << s.cost << " " << std::fixed << std::setprecision(1) << share
+            << "% " << fair << "% " << avgWait << " " << ToMicros(s.max_wait)
+            << "\n";
+    }
+}
+
+CallScheduler::Flow& CallScheduler::flowFor(uid_t uid) {
+    auto it = _flows.find(uid);
+    if (it == _flows.end()) {
+        it = _flows.emplace(uid, Flow{}).first;
+        auto weight = _weights.find(uid);
+        it->second.stats.weight =
+                (weight == _weights.end()) ? _defaultWeight : weight->second;
+    }
+    return it->second;
+}
+
+void CallScheduler::acquire(uid_t uid, uint64_t cost) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    Flow& flow = flowFor(uid);
+
+    // A flow that has been idle starts at the current virtual time rather than
+    // where it left off, so it can't bank credit while idle.
+    const uint64_t start = std::max(_virtualTime, flow.finish_tag);
+    flow.finish_tag = start + (std::max<uint64_t>(cost, 1) * kWeightScale) /
+                                      flow.stats.weight;
+
+    const Ticket ticket{start, _nextSequence++};
+    _queue.insert(ticket);
+
+    const Clock::time_point enqueued = Clock::now();
+    _cv.wait(lock, [&] { return !_busy && *_queue.begin() == ticket; });
+    const Clock::duration wait = Clock::now() - enqueued;
+
+    _queue.erase(_queue.begin());
+    _busy = true;
+    _virtualTime = start;
+
+    flow.stats.calls++;
+    flow.stats.cost += cost;
+    flow.stats.total_wait += wait;
+    flow.stats.max_wait = std::max(flow.stats.max_wait, wait);
+}
+
+void CallScheduler::release() {
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _busy = false;
+    }
+    _cv.notify_all();
+}
+
+} // namespace citadeld
+} // namespace nos
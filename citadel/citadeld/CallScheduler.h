@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NOS_CITADELD_CALL_SCHEDULER_H
+#define NOS_CITADELD_CALL_SCHEDULER_H
+
+#include <sys/types.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <set>
+#include <string>
+#include <utility>
+
+namespace nos {
+namespace citadeld {
+
+/**
+ * Weighted fair queuing of calls onto the single Citadel link.
+ *
+ * Every caller is identified by its UID and each UID is a separate flow. Calls
+ * are admitted in order of their start-time fair queuing tag, so a flow with
+ * weight 2 gets twice the share of the link of a flow with weight 1 when both
+ * are backlogged, and an idle flow is never penalized for the time it didn't
+ * use. Only one call is on the link at a time.
+ */
+class CallScheduler {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    struct FlowStats {
+        uint32_t weight = 0;
+        uint64_t calls = 0;
+        uint64_t cost = 0;
+        Clock::duration total_wait = Clock::duration::zero();
+        Clock::duration max_wait = Clock::duration::zero();
+    };
+
+    explicit CallScheduler(uint32_t defaultWeight = 1);
+    ~CallScheduler() = default;
+
+    /** Set the weight of a UID's flow. A weight of 0 is treated as 1. */
+    void SetWeight(uid_t uid, uint32_t weight);
+
+    /**
+     * Parse weights of the form "uid:weight[,uid:weight...]" and apply them.
+     * Returns false if any entry was malformed; the valid entries are still
+     * applied.
+     */
+    bool ParseWeights(const std::string& config);
+
+    /**
+     * Wait for the flow's turn on the link then run fn while holding it. The
+     * cost is in the same units for all flows; bytes moved is a good proxy.
+     */
+    uint32_t Run(uid_t uid, uint64_t cost, const std::function<uint32_t()>& fn);
+
+    /** Number of calls waiting for their turn on the link. */
+    size_t Waiting() const;
+
+    /** Snapshot of the per-UID accounting. */
+    std::map<uid_t, FlowStats> Stats() const;
+
+    /** Write a human readable table of the per-UID accounting. */
+    void Dump(std::ostream& out) const;
+
+  private:
+    struct Flow {
+        FlowStats stats;
+        uint64_t finish_tag = 0;
+    };
+
+    // Ordered by start tag with the sequence number breaking ties in FIFO
+    // order.
+    using Ticket = std::pair<uint64_t, uint64_t>;
+
+    Flow& flowFor(uid_t uid);
+    void acquire(uid_t uid, uint64_t cost);
+    void release();
+
+    const uint32_t _defaultWeight;
+    mutable std::mutex _mutex;
+    std::condition_variable _cv;
+    std::map<uid_t, Flow> _flows;
+    std::map<uid_t, uint32_t> _weights;
+    std::set<Ticket> _queue;
+    uint64_t _virtualTime = 0;
+    uint64_t _nextSequence = 0;
+    bool _busy = false;
+};
+
+} // namespace citadeld
+} // namespace nos
+
+#endif // NOS_CITADELD_CALL_SCHEDULER_H
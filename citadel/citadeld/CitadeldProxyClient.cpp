@@ -16,38 +16,212 @@
 
 #include <nos/CitadeldProxyClient.h>
 
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <memory>
+
 #include <android-base/logging.h>
 #include <binder/IServiceManager.h>
 #include <binder/ProcessState.h>
 
+#include <android/hardware/citadel/BnCitadeldCallback.h>
+
 #include <application.h>
 
+#include "ServiceRegistrar.h"
+
 using ::android::defaultServiceManager;
 using ::android::sp;
+using ::android::wp;
+using ::android::IBinder;
+using ::android::IInterface;
 using ::android::IServiceManager;
 using ::android::ProcessState;
+using ::android::status_t;
 
 using ::android::binder::Status;
 
+using ::android::hardware::citadel::BnCitadeldCallback;
 using ::android::hardware::citadel::ICitadeld;
 
+using ::nos::citadeld::PendingAsyncCalls;
+using ::nos::citadeld::ServiceRegistrar;
+
 namespace nos {
 
+namespace {
+
+using namespace std::chrono_literals;
+
+// How long Open() waits for citadeld, the same as getService() used to.
+constexpr auto kOpenTimeout = 5000ms;
+
+// How long a call waits for citadeld to come back before giving up. It
+// normally restarts well within this.
+constexpr auto kReconnectTimeout = 1000ms;
+
+// citadeld if it has been published yet. The registrar polls this until it
+// has.
+sp<IBinder> FindCitadeld() {
+    return defaultServiceManager()->checkService(ICitadeld::descriptor);
+}
+
+bool IsDeadObject(const Status& status) {
+    return status.exceptionCode() == Status::EX_TRANSACTION_FAILED &&
+           status.transactionError() == ::android::DEAD_OBJECT;
+}
+
+} // namespace
+
+namespace citadeld {
+
+// The async calls still waiting for their result, so those made to a citadeld
+// that has died can be failed rather than waiting forever. Each call is
+// completed once, by whichever of its result or the failure comes first.
+class PendingAsyncCalls {
+  public:
+    using CallAppCallback = CitadeldProxyClient::CallAppCallback;
+
+    uint64_t Add(const wp<IBinder>& citadeld, CallAppCallback callback) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        const uint64_t id = ++_lastId;
+        _calls.emplace(id, Call{citadeld, std::move(callback)});
+        return id;
+    }
+
+    void Complete(uint64_t id, uint32_t appStatus,
+                  const std::vector<uint8_t>& response) {
+        CallAppCallback callback;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            auto it = _calls.find(id);
+            if (it == _calls.end()) {
+                return;
+            }
+            callback = std::move(it->second.callback);
+            _calls.erase(it);
+        }
+        callback(appStatus, response);
+    }
+
+    void FailAll(const wp<IBinder>& citadeld) {
+        std::vector<CallAppCallback> failed;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            for (auto it = _calls.begin(); it != _calls.end();) {
+                if (it->second.citadeld == citadeld) {
+                    failed.push_back(std::move(it->second.callback));
+                    it = _calls.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+        if (!failed.empty()) {
+            LOG(ERROR) << "citadeld died with " << failed.size()
+                       << " async call(s) pending";
+        }
+        for (const auto& callback : failed) {
+            callback(APP_ERROR_IO, {});
+        }
+    }
+
+  private:
+    struct Call {
+        wp<IBinder> citadeld;
+        CallAppCallback callback;
+    };
+
+    std::mutex _mutex;
+    uint64_t _lastId = 0;
+    std::map<uint64_t, Call> _calls;
+};
+
+} // namespace citadeld
+
+namespace {
+
+class CallAppCallbackBinder : public BnCitadeldCallback {
+  public:
+    CallAppCallbackBinder(std::shared_ptr<PendingAsyncCalls> calls, uint64_t id)
+        : _calls(std::move(calls)), _id(id) {}
+
+    Status onCallAppComplete(int32_t appStatus,
+                             const std::vector<uint8_t>& response) override {
+        _calls->Complete(_id, static_cast<uint32_t>(appStatus), response);
+        return Status::ok();
+    }
+
+  private:
+    const std::shared_ptr<PendingAsyncCalls> _calls;
+    const uint64_t _id;
+};
+
+} // namespace
+
+class CitadeldProxyClient::DeathRecipient : public IBinder::DeathRecipient {
+  public:
+    explicit DeathRecipient(CitadeldProxyClient* client) : _client(client) {}
+
+    void binderDied(const wp<IBinder>& who) override {
+        LOG(WARNING) << "citadeld died";
+        // Their results were lost with it
+        _client->_asyncCalls->FailAll(who);
+        std::unique_lock<std::mutex> lock(_client->_mutex);
+        const sp<ICitadeld> citadeld = _client->_citadeld;
+        lock.unlock();
+        if (citadeld != nullptr) {
+            _client->serviceLost(citadeld);
+        }
+    }
+
+  private:
+    CitadeldProxyClient* const _client;
+};
+
+CitadeldProxyClient::CitadeldProxyClient() : CitadeldProxyClient(FindCitadeld) {}
+
+CitadeldProxyClient::CitadeldProxyClient(ServiceLookup lookup)
+        : _lookup(std::move(lookup)),
+          _deathRecipient(new DeathRecipient(this)),
+          _asyncCalls(std::make_shared<PendingAsyncCalls>()) {}
+
+CitadeldProxyClient::CitadeldProxyClient(sp<ICitadeld> citadeld)
+        : _citadeld(std::move(citadeld)),
+          _asyncCalls(std::make_shared<PendingAsyncCalls>()) {}
+
 CitadeldProxyClient::~CitadeldProxyClient() {
+    // Stop reconnecting first, or it could connect again after Close()
+    _registrar.reset();
     Close();
 }
 
 void CitadeldProxyClient::Open() {
+    if (_lookup == nullptr) {
+        return;
+    }
     // Ensure this process is using the vndbinder
     ProcessState::initWithDriver("/dev/vndbinder");
-    _citadeld = ICitadeld::asInterface(defaultServiceManager()->getService(ICitadeld::descriptor));
+    if (_registrar == nullptr) {
+        _registrar.reset(new ServiceRegistrar(
+                _lookup, std::bind(&CitadeldProxyClient::connect, this,
+                                   std::placeholders::_1)));
+    }
+    _registrar->RequestRegistration();
+    waitForCitadeld(kOpenTimeout);
 }
 
 void CitadeldProxyClient::Close() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (_citadeld != nullptr && _deathRecipient != nullptr) {
+        IInterface::asBinder(_citadeld)->unlinkToDeath(_deathRecipient);
+    }
     _citadeld.clear();
 }
 
 bool CitadeldProxyClient::IsOpen() const {
+    std::unique_lock<std::mutex> lock(_mutex);
     return _citadeld != nullptr;
 }
 
@@ -55,25 +229,196 @@ uint32_t CitadeldProxyClient::CallApp(uint32_t appId, uint16_t arg,
                                       const std::vector<uint8_t>& request,
                                       std::vector<uint8_t>* _response) {
     // Binder doesn't pass a nullptr or the capacity so resolve the response
-    // buffer size before making the call. The response vector may be the same
-    // as the request vector so the response cannot be directly resized.
-    std::vector<uint8_t> response(_response == nullptr ? 0 : _response->capacity());
+    // buffer size before making the call. The response is read into the
+    // caller's storage, which it fits in. The response vector may be the same
+    // as the request vector so then the request is copied before resizing.
+    uint32_t appStatus;
+    if (_response == nullptr) {
+        std::vector<uint8_t> none;
+        return transactCallApp(appId, arg, request, &none, &appStatus)
+                ? appStatus : APP_ERROR_IO;
+    }
+
+    std::vector<uint8_t> requestCopy;
+    const std::vector<uint8_t>* sent = &request;
+    if (_response == &request) {
+        requestCopy = request;
+        sent = &requestCopy;
+    }
+    _response->resize(_response->capacity());
+    if (!transactCallApp(appId, arg, *sent, _response, &appStatus)) {
+        _response->clear();
+        return APP_ERROR_IO;
+    }
+    return appStatus;
+}
+
+uint32_t CitadeldProxyClient::CallApp(uint32_t appId, uint16_t arg,
+                                      const uint8_t* request,
+                                      uint32_t requestLen, uint8_t* _response,
+                                      uint32_t* _responseLen) {
+    const std::vector<uint8_t> requestVec(request, request + requestLen);
+    std::vector<uint8_t> response(_responseLen == nullptr ? 0 : *_responseLen);
 
     uint32_t appStatus;
-    Status status = _citadeld->callApp(appId, arg, request, &response,
-                                       reinterpret_cast<int32_t*>(&appStatus));
-    if (status.isOk()) {
-        if (_response != nullptr) {
-            *_response = std::move(response);
+    if (!transactCallApp(appId, arg, requestVec, &response, &appStatus)) {
+        return APP_ERROR_IO;
+    }
+    if (_responseLen != nullptr) {
+        // The proxy never reads more than was asked for
+        const uint32_t responseLen = std::min<size_t>(response.size(), *_responseLen);
+        if (responseLen != 0) {
+            memcpy(_response, response.data(), responseLen);
+        }
+        *_responseLen = responseLen;
+    }
+    return appStatus;
+}
+
+void CitadeldProxyClient::CallAppAsync(uint32_t appId, uint16_t arg,
+                                       const std::vector<uint8_t>& request,
+                                       uint32_t responseSize,
+                                       CallAppCallback callback) {
+    const sp<ICitadeld> citadeld = waitForCitadeld(kReconnectTimeout);
+    if (citadeld == nullptr) {
+        LOG(ERROR) << "Failed to call app via citadeld: not connected";
+        callback(APP_ERROR_IO, {});
+        return;
+    }
+
+    // The result comes back as a call into this process
+    ProcessState::self()->startThreadPool();
+
+    const uint64_t id = _asyncCalls->Add(IInterface::asBinder(citadeld),
+                                         std::move(callback));
+    Status status = citadeld->callAppAsync(appId, arg, request, responseSize,
+                                           new CallAppCallbackBinder(_asyncCalls, id));
+    if (!status.isOk()) {
+        LOG(ERROR) << "Failed to call app via citadeld: " << status.toString8();
+        if (IsDeadObject(status)) {
+            serviceLost(citadeld);
         }
-        return appStatus;
+        _asyncCalls->Complete(id, APP_ERROR_IO, {});
+    }
+}
+
+std::future<CitadeldProxyClient::CallAppResult> CitadeldProxyClient::CallAppAsync(
+        uint32_t appId, uint16_t arg, const std::vector<uint8_t>& request,
+        uint32_t responseSize) {
+    auto result = std::make_shared<std::promise<CallAppResult>>();
+    CallAppAsync(appId, arg, request, responseSize,
+                 [result](uint32_t appStatus, const std::vector<uint8_t>& response) {
+                     result->set_value(CallAppResult{appStatus, response});
+                 });
+    return result->get_future();
+}
+
+void CitadeldProxyClient::SetIdempotentCalls(IdempotencyPredicate idempotent) {
+    _idempotent = std::move(idempotent);
+}
+
+uint64_t CitadeldProxyClient::Reconnects() const {
+    if (_registrar == nullptr) {
+        return 0;
+    }
+    // The first registration is the initial connection
+    const uint64_t registrations = _registrar->registrations();
+    return registrations == 0 ? 0 : registrations - 1;
+}
+
+std::chrono::steady_clock::duration CitadeldProxyClient::LastReconnectLatency() const {
+    if (Reconnects() == 0) {
+        return std::chrono::steady_clock::duration::zero();
     }
-    LOG(ERROR) << "Failed to call app via citadeld: " << status.toString8();
-    return APP_ERROR_IO;
+    return _registrar->lastLatency();
 }
 
-ICitadeld& CitadeldProxyClient::Citadeld() {
-    return *_citadeld.get();
+sp<ICitadeld> CitadeldProxyClient::Citadeld() {
+    return waitForCitadeld(kReconnectTimeout);
+}
+
+bool CitadeldProxyClient::connect(const sp<IBinder>& binder) {
+    // A local binder can't die on its own
+    if (binder->localBinder() == nullptr) {
+        const status_t err = binder->linkToDeath(_deathRecipient);
+        if (err == ::android::DEAD_OBJECT) {
+            // We found the old instance before it was unpublished
+            return false;
+        }
+        if (err != ::android::OK) {
+            LOG(ERROR) << "linkToDeath() returned " << err
+                       << " - we will NOT be notified on citadeld death";
+        }
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _citadeld = ICitadeld::asInterface(binder);
+    }
+    _connected.notify_all();
+    return true;
+}
+
+void CitadeldProxyClient::serviceLost(const sp<ICitadeld>& citadeld) {
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        // Someone else may have already noticed and reconnected
+        if (_citadeld != citadeld) {
+            return;
+        }
+        _citadeld.clear();
+    }
+    if (_registrar != nullptr) {
+        _registrar->RequestRegistration();
+    }
+}
+
+sp<ICitadeld> CitadeldProxyClient::waitForCitadeld(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (_citadeld == nullptr && _registrar != nullptr) {
+        _connected.wait_for(lock, timeout, [this] { return _citadeld != nullptr; });
+    }
+    return _citadeld;
+}
+
+bool CitadeldProxyClient::transactCallApp(uint32_t appId, uint16_t arg,
+                                          const std::vector<uint8_t>& request,
+                                          std::vector<uint8_t>* response,
+                                          uint32_t* appStatus) {
+    // If citadeld is known to be gone the call waits for it to come back, as
+    // the call can't have been made. A call that fails because citadeld died
+    // may have been in flight so is only made again if it is idempotent.
+    const bool idempotent = _idempotent != nullptr && _idempotent(appId, arg);
+    const size_t capacity = response->size();
+    for (int attempt = 0;; ++attempt) {
+        const sp<ICitadeld> citadeld = waitForCitadeld(kReconnectTimeout);
+        if (citadeld == nullptr) {
+            LOG(ERROR) << "Failed to call app via citadeld: not connected";
+            return false;
+        }
+
+        // The generated proxy's reply parcel, and with it the binder buffer,
+        // is freed before this returns.
+        response->resize(capacity);
+        const Status status = citadeld->callApp(
+                appId, arg, request, response,
+                reinterpret_cast<int32_t*>(appStatus));
+        if (status.isOk()) {
+            return true;
+        }
+        if (!IsDeadObject(status)) {
+            LOG(ERROR) << "Failed to call app via citadeld: " << status.toString8();
+            return false;
+        }
+
+        serviceLost(citadeld);
+        if (!idempotent || attempt > 0) {
+            LOG(ERROR) << "citadeld died during call to app " << appId;
+            return false;
+        }
+        LOG(WARNING) << "citadeld died during call to app " << appId
+                     << "; retrying";
+    }
 }
 
 } // namespace nos
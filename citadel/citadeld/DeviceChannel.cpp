@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "DeviceChannel.h"
+
+#include <utility>
+
+#include <android-base/logging.h>
+
+namespace nos {
+namespace citadeld {
+
+namespace {
+
+// Rough fixed cost, in bytes, of a transaction on the link regardless of its
+// payload. This stops a flood of tiny calls from being treated as free.
+constexpr uint64_t kTransactionOverhead = 64;
+
+} // namespace
+
+DeviceChannel::DeviceChannel(std::string name,
+                             std::unique_ptr<NuggetClientInterface> client,
+                             const nos_device* device)
+        : _name(std::move(name)), _client(std::move(client)), _device(device) {}
+
+DeviceChannel::~DeviceChannel() {
+    {
+        std::unique_lock<std::mutex> lock(_stopMutex);
+        _stopping = true;
+    }
+    _stopCv.notify_all();
+    if (_ioThread.joinable()) {
+        _ioThread.join();
+    }
+}
+
+uint32_t DeviceChannel::CallApp(uid_t uid, uint32_t appId, uint16_t arg,
+                                const std::vector<uint8_t>& request,
+                                std::vector<uint8_t>* response) {
+    const uint64_t cost = kTransactionOverhead + request.size() +
+                          (response == nullptr ? 0 : response->capacity());
+    return _scheduler.Run(uid, cost, [&] {
+        return _client->CallApp(appId, arg, request, response);
+    });
+}
+
+void DeviceChannel::StartIoThread(std::function<void(DeviceChannel&)> fn) {
+    if (_ioThread.joinable()) {
+        LOG(ERROR) << "I/O thread for " << _name << " is already running";
+        return;
+    }
+    _ioThread = std::thread(fn, std::ref(*this));
+}
+
+bool DeviceChannel::stopping() const {
+    std::unique_lock<std::mutex> lock(_stopMutex);
+    return _stopping;
+}
+
+bool DeviceChannel::WaitForStop(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(_stopMutex);
+    return _stopCv.wait_for(lock, timeout, [this] { return _stopping; });
+}
+
+void DeviceChannel::Dump(std::ostream& out) const {
+    out << "Device " << _name << ":\n";
+    _scheduler.Dump(out);
+    _events.Dump(out);
+}
+
+} // namespace citadeld
+} // namespace nos
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NOS_CITADELD_DEVICE_CHANNEL_H
+#define NOS_CITADELD_DEVICE_CHANNEL_H
+
+#include <sys/types.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <nos/NuggetClientInterface.h>
+#include <nos/device.h>
+
+#include "CallScheduler.h"
+#include "EventDecoder.h"
+
+namespace nos {
+namespace citadeld {
+
+/**
+ * One device managed by citadeld and everything that is needed to drive it.
+ *
+ * Each device is a separate link so gets its own scheduler; calls to
+ * different devices never wait for each other. A device may also have an I/O
+ * thread for work that isn't driven by a caller, such as fetching events when
+ * the device raises an interrupt.
+ */
+class DeviceChannel {
+  public:
+    /**
+     * The client must already be open. The raw device is only needed for
+     * operations that bypass the transport, e.g. reset and interrupts, and is
+     * null for simulated devices.
+     */
+    DeviceChannel(std::string name, std::unique_ptr<NuggetClientInterface> client,
+                  const nos_device* device = nullptr);
+    ~DeviceChannel();
+
+    const std::string& name() const { return _name; }
+    const nos_device* device() const { return _device; }
+    CallScheduler& scheduler() { return _scheduler; }
+    EventDecoder& events() { return _events; }
+
+    /**
+     * Call an app once it is the caller's turn on this device's link. The call
+     * is made on the caller's thread, not the I/O thread.
+     */
+    uint32_t CallApp(uid_t uid, uint32_t appId, uint16_t arg,
+                     const std::vector<uint8_t>& request,
+                     std::vector<uint8_t>* response);
+
+    /**
+     * Start the device's I/O thread running fn. It is only started once. fn
+     * must return soon after stopping() becomes true, which happens when the
+     * channel is destroyed.
+     */
+    void StartIoThread(std::function<void(DeviceChannel&)> fn);
+
+    /** Whether the I/O thread has been asked to return. */
+    bool stopping() const;
+
+    /** Wait up to timeout for the I/O thread to be asked to return. */
+    bool WaitForStop(std::chrono::milliseconds timeout);
+
+    void Dump(std::ostream& out) const;
+
+  private:
+    const std::string _name;
+    const std::unique_ptr<NuggetClientInterface> _client;
+    const nos_device* const _device;
+    CallScheduler _scheduler;
+    EventDecoder _events;
+    mutable std::mutex _stopMutex;
+    std::condition_variable _stopCv;
+    bool _stopping = false;
+    std::thread _ioThread;
+};
+
+} // namespace citadeld
+} // namespace nos
+
+#endif // NOS_CITADELD_DEVICE_CHANNEL_H
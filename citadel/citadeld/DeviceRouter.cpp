@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "DeviceRouter.h"
+
+#include <vector>
+
+#include <android-base/logging.h>
+#include <android-base/parseint.h>
+#include <android-base/strings.h>
+
+using ::android::base::ParseUint;
+using ::android::base::Split;
+using ::android::base::Trim;
+
+namespace nos {
+namespace citadeld {
+
+bool DeviceRouter::RouteUid(uid_t uid, size_t device) {
+    if (device >= _deviceCount) {
+        return false;
+    }
+    _uidRoutes[uid] = device;
+    return true;
+}
+
+bool DeviceRouter::RouteApp(uint32_t appId, size_t device) {
+    if (device >= _deviceCount) {
+        return false;
+    }
+    _appRoutes[appId] = device;
+    return true;
+}
+
+bool DeviceRouter::ParseRoutes(const std::string& config) {
+    bool ok = true;
+    for (const std::string& entry : Split(config, ",")) {
+        const std::string trimmed = Trim(entry);
+        if (trimmed.empty()) {
+            continue;
+        }
+        const std::vector<std::string> route = Split(trimmed, "=");
+        const std::vector<std::string> key =
+                Split(route.empty() ? "" : route[0], ":");
+        uint32_t id;
+        size_t device;
+        bool routed = false;
+        if (route.size() == 2 && key.size() == 2 &&
+            ParseUint(Trim(key[1]), &id) && ParseUint(Trim(route[1]), &device)) {
+            const std::string kind = Trim(key[0]);
+            if (kind == "uid") {
+                routed = RouteUid(id, device);
+            } else if (kind == "app") {
+                routed = RouteApp(id, device);
+            }
+        }
+        if (!routed) {
+            LOG(ERROR) << "Ignoring invalid device route \"" << trimmed << "\"";
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+size_t DeviceRouter::Route(uid_t uid, uint32_t appId) const {
+    auto uidRoute = _uidRoutes.find(uid);
+    if (uidRoute != _uidRoutes.end()) {
+        return uidRoute->second;
+    }
+    auto appRoute = _appRoutes.find(appId);
+    if (appRoute != _appRoutes.end()) {
+        return appRoute->second;
+    }
+    return 0;
+}
+
+} // namespace citadeld
+} // namespace nos
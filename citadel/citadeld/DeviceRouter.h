@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NOS_CITADELD_DEVICE_ROUTER_H
+#define NOS_CITADELD_DEVICE_ROUTER_H
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace nos {
+namespace citadeld {
+
+/**
+ * Decides which device a call is sent to.
+ *
+ * A caller can be pinned to a device by UID, e.g. to give each test harness
+ * on a bring-up rig a device of its own, and an app can be pinned by its ID.
+ * UID routes take precedence over app routes. Anything that isn't routed goes
+ * to the first device.
+ */
+class DeviceRouter {
+  public:
+    explicit DeviceRouter(size_t deviceCount) : _deviceCount(deviceCount) {}
+
+    /** Route calls from a UID to a device. Fails if there is no such device. */
+    bool RouteUid(uid_t uid, size_t device);
+
+    /** Route calls to an app to a device. Fails if there is no such device. */
+    bool RouteApp(uint32_t appId, size_t device);
+
+    /**
+     * Parse routes of the form "uid:<uid>=<device>" or "app:<id>=<device>"
+     * separated by commas. Returns false if any entry was malformed; the valid
+     * entries are still applied.
+     */
+    bool ParseRoutes(const std::string& config);
+
+    /** The index of the device to send the call to. */
+    size_t Route(uid_t uid, uint32_t appId) const;
+
+  private:
+    const size_t _deviceCount;
+    std::map<uid_t, size_t> _uidRoutes;
+    std::map<uint32_t, size_t> _appRoutes;
+};
+
+} // namespace citadeld
+} // namespace nos
+
+#endif // NOS_CITADELD_DEVICE_ROUTER_H
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <nos/DirectDeviceClient.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#include <android-base/logging.h>
+#include <android-base/properties.h>
+
+#include <nos/CitadeldProxyClient.h>
+#include <nos/NuggetClient.h>
+
+using ::android::base::GetProperty;
+
+namespace nos {
+
+namespace {
+
+// Names the one HAL service that owns the device on recovery, factory and
+// bench images. Direct clients only serialize calls within their own process
+// so no more than one process may use the device.
+constexpr char PROPERTY_DIRECT_DEVICE[] = "ro.vendor.nos.direct_device";
+
+// Overrides the property so the tools can be pointed either way on the bench
+constexpr char ENV_DIRECT_DEVICE[] = "NOS_DIRECT_DEVICE";
+
+} // namespace
+
+DirectDeviceClient::DirectDeviceClient(const std::string& deviceName)
+        : _client(new NuggetClient(deviceName)) {}
+
+DirectDeviceClient::DirectDeviceClient(
+        std::unique_ptr<NuggetClientInterface> client)
+        : _client(std::move(client)) {}
+
+DirectDeviceClient::~DirectDeviceClient() {
+    Close();
+}
+
+void DirectDeviceClient::Open() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _client->Open();
+}
+
+void DirectDeviceClient::Close() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _client->Close();
+}
+
+bool DirectDeviceClient::IsOpen() const {
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _client->IsOpen();
+}
+
+uint32_t DirectDeviceClient::CallApp(uint32_t appId, uint16_t arg,
+                                     const std::vector<uint8_t>& request,
+                                     std::vector<uint8_t>* response) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _client->CallApp(appId, arg, request, response);
+}
+
+bool UseDirectDevice(const std::string& service) {
+    const char* env = getenv(ENV_DIRECT_DEVICE);
+    if (env != nullptr && env[0] != '\0') {
+        return strcmp(env, "1") == 0 || strcmp(env, "true") == 0;
+    }
+    const std::string owner = GetProperty(PROPERTY_DIRECT_DEVICE, "");
+    if (owner.empty()) {
+        return false;
+    }
+    if (owner != service) {
+        LOG(WARNING) << "Citadel is owned by " << owner << ", not " << service
+                     << "; its calls will fail";
+        return false;
+    }
+    return true;
+}
+
+std::unique_ptr<NuggetClientInterface> MakeCitadelClient(
+        const std::string& service,
+        std::function<bool(uint32_t appId, uint16_t arg)> idempotent) {
+    if (UseDirectDevice(service)) {
+        LOG(INFO) << "Talking to Citadel directly";
+        return std::unique_ptr<NuggetClientInterface>(new DirectDeviceClient());
+    }
+    std::unique_ptr<CitadeldProxyClient> client(new CitadeldProxyClient());
+    client->SetIdempotentCalls(std::move(idempotent));
+    return client;
+}
+
+} // namespace nos
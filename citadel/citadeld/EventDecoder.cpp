@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "EventDecoder.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+
+namespace nos {
+namespace citadeld {
+
+namespace {
+
+using EventType = EventDecoder::EventType;
+
+const EventType kEventTypes[] = {
+    {EVENT_ALERT, "alert", {"intr_sts0", "intr_sts1", "intr_sts2"}},
+    {EVENT_REBOOTED, "rebooted", {"rstsrc", "exitpd", "which"}},
+    {EVENT_UPGRADED, "upgraded", {"w0", "w1", "w2"}},
+};
+
+const char* const kUnknownFields[EventDecoder::kNumFields] = {"w0", "w1", "w2"};
+
+void FormatUptime(uint64_t uptime_usecs, std::ostream& out) {
+    const uint64_t secs = uptime_usecs / 1000000UL;
+    const uint64_t usecs = uptime_usecs - (secs * 1000000UL);
+    const char fill = out.fill('0');
+    out << secs << "." << std::setw(6) << usecs;
+    out.fill(fill);
+}
+
+} // namespace
+
+const EventType* EventDecoder::Lookup(uint32_t id) {
+    for (const EventType& type : kEventTypes) {
+        if (type.id == id) {
+            return &type;
+        }
+    }
+    return nullptr;
+}
+
+EventDecoder::DecodedEvent EventDecoder::Decode(const struct event_record& evt) {
+    DecodedEvent decoded;
+    decoded.reset_count = evt.reset_count;
+    decoded.uptime_usecs = evt.uptime_usecs;
+    decoded.id = evt.id;
+    decoded.type = Lookup(evt.id);
+    static_assert(sizeof(decoded.fields) <= sizeof(evt.u.raw.w),
+                  "event_record payload is smaller than expected");
+    memcpy(decoded.fields, evt.u.raw.w, sizeof(decoded.fields));
+    return decoded;
+}
+
+void EventDecoder::Format(const DecodedEvent& evt, std::ostream& out) {
+    const char* const* fields =
+            evt.type == nullptr ? kUnknownFields : evt.type->fields;
+    out << "event_record " << evt.reset_count << "/";
+    FormatUptime(evt.uptime_usecs, out);
+    out << " ";
+    if (evt.type == nullptr) {
+        out << "unknown(" << evt.id << ")";
+    } else {
+        out << evt.type->name;
+    }
+    const std::ios_base::fmtflags flags = out.flags();
+    const char fill = out.fill('0');
+    for (size_t i = 0; i < kNumFields; ++i) {
+        out << " " << fields[i] << "=0x" << std::hex << std::setw(8)
+            << evt.fields[i];
+    }
+    out.fill(fill);
+    out.flags(flags);
+}
+
+EventDecoder::DecodedEvent EventDecoder::Record(const struct event_record& evt) {
+    const DecodedEvent decoded = Decode(evt);
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    TypeStats& stats = _stats[decoded.id];
+    stats.count++;
+    stats.last_reset_count = decoded.reset_count;
+    stats.last_uptime_usecs = decoded.uptime_usecs;
+    _recent[_nextRecent] = decoded;
+    _nextRecent = (_nextRecent + 1) % kRecentEvents;
+    _total++;
+    return decoded;
+}
+
+std::map<uint32_t, EventDecoder::TypeStats> EventDecoder::Stats() const {
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _stats;
+}
+
+void EventDecoder::Dump(std::ostream& out) const {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    out << "Events (id name count last-seen):\n";
+    for (const auto& entry : _stats) {
+        const EventType* type = Lookup(entry.first);
+        out << "  " << entry.first << " "
+            << (type == nullptr ? "unknown" : type->name) << " "
+            << entry.second.count << " " << entry.second.last_reset_count
+            << "/";
+        FormatUptime(entry.second.last_uptime_usecs, out);
+        out << "\n";
+    }
+
+    const size_t recent = std::min<uint64_t>(_total, kRecentEvents);
+    out << "Most recent " << recent << " events:\n";
+    for (size_t i = 0; i < recent; ++i) {
+        const size_t index = (_nextRecent + kRecentEvents - recent + i) %
+                             kRecentEvents;
+        out << "  ";
+        Format(_recent[index], out);
+        out << "\n";
+    }
+}
+
+} // namespace citadeld
+} // namespace nos
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NOS_CITADELD_EVENT_DECODER_H
+#define NOS_CITADELD_EVENT_DECODER_H
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+
+#include <citadel_events.h>
+
+namespace nos {
+namespace citadeld {
+
+/**
+ * Decodes the event_records fetched from Citadel and keeps count of them.
+ *
+ * Events arrive in storms when Citadel raises alerts so recording one is kept
+ * cheap: the id is looked up in a table to type the payload and the result is
+ * stored in a small ring of recent events. Nothing is turned into text until
+ * someone asks for a dump.
+ */
+class EventDecoder {
+  public:
+    static constexpr size_t kNumFields = 3;
+    static constexpr size_t kRecentEvents = 32;
+
+    /** How to interpret the payload of one kind of event. */
+    struct EventType {
+        uint32_t id;
+        const char* name;
+        const char* fields[kNumFields];
+    };
+
+    struct DecodedEvent {
+        uint64_t reset_count;
+        uint64_t uptime_usecs;
+        uint32_t id;
+        const EventType* type;  // null if the id isn't known
+        uint32_t fields[kNumFields];
+    };
+
+    struct TypeStats {
+        uint64_t count = 0;
+        uint64_t last_reset_count = 0;
+        uint64_t last_uptime_usecs = 0;
+    };
+
+    /** The description of an event id, or null if it isn't known. */
+    static const EventType* Lookup(uint32_t id);
+
+    /** Decode an event without recording it. */
+    static DecodedEvent Decode(const struct event_record& evt);
+
+    /** Write an event in the same form as citadeld used to log them. */
+    static void Format(const DecodedEvent& evt, std::ostream& out);
+
+    /** Decode an event and account for it. */
+    DecodedEvent Record(const struct event_record& evt);
+
+    /** Stats for each event id that has been seen. */
+    std::map<uint32_t, TypeStats> Stats() const;
+
+    /** Write the per-type stats and the most recent events. */
+    void Dump(std::ostream& out) const;
+
+  private:
+    mutable std::mutex _mutex;
+    std::map<uint32_t, TypeStats> _stats;
+    std::array<DecodedEvent, kRecentEvents> _recent;
+    size_t _nextRecent = 0;
+    uint64_t _total = 0;
+};
+
+} // namespace citadeld
+} // namespace nos
+
+#endif // NOS_CITADELD_EVENT_DECODER_H
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ServiceRegistrar.h"
+
+#include <algorithm>
+
+#include <android-base/logging.h>
+
+using ::android::IBinder;
+using ::android::sp;
+
+namespace nos {
+namespace citadeld {
+
+namespace {
+
+using namespace std::chrono_literals;
+
+// Until the service is published we look for it again after these delays,
+// doubling each time. The service normally comes back within a few polls.
+constexpr auto kMinPollDelay = 5ms;
+constexpr auto kMaxPollDelay = 100ms;
+
+// If the service is found but won't take our registration, back off before
+// trying again so we don't spin on a service that is still starting up.
+constexpr auto kMinRetryDelay = 10ms;
+constexpr auto kMaxRetryDelay = 1000ms;
+
+} // namespace
+
+ServiceRegistrar::ServiceRegistrar(Lookup lookup, Register reg)
+        : _state(std::make_shared<State>(std::move(lookup), std::move(reg))),
+          _thread(&ServiceRegistrar::worker, _state) {}
+
+ServiceRegistrar::~ServiceRegistrar() {
+    {
+        std::unique_lock<std::mutex> lock(_state->mutex);
+        _state->stopping = true;
+    }
+    _state->cv.notify_all();
+    _thread.join();
+}
+
+void ServiceRegistrar::RequestRegistration() {
+    {
+        std::unique_lock<std::mutex> lock(_state->mutex);
+        if (!_state->requested) {
+            _state->requested = true;
+            _state->requestTime = Clock::now();
+        }
+    }
+    _state->cv.notify_all();
+}
+
+uint64_t ServiceRegistrar::registrations() const {
+    std::unique_lock<std::mutex> lock(_state->mutex);
+    return _state->registrations;
+}
+
+ServiceRegistrar::Clock::duration ServiceRegistrar::lastLatency() const {
+    std::unique_lock<std::mutex> lock(_state->mutex);
+    return _state->lastLatency;
+}
+
+void ServiceRegistrar::worker(std::shared_ptr<State> state) {
+    std::chrono::milliseconds pollDelay = kMinPollDelay;
+    std::chrono::milliseconds retryDelay = kMinRetryDelay;
+    std::unique_lock<std::mutex> lock(state->mutex);
+    while (true) {
+        state->cv.wait(lock, [&] { return state->requested || state->stopping; });
+        if (state->stopping) {
+            return;
+        }
+
+        // Don't hold the lock while asking for the service so new requests
+        // can still be made; they are folded into this one.
+        lock.unlock();
+        const sp<IBinder> service = state->lookup();
+        lock.lock();
+        if (state->stopping) {
+            return;
+        }
+        if (service == nullptr) {
+            state->cv.wait_for(lock, pollDelay,
+                               [&] { return state->stopping; });
+            pollDelay = std::min(pollDelay * 2, kMaxPollDelay);
+            continue;
+        }
+        pollDelay = kMinPollDelay;
+
+        // A request made while registering means the service may have gone
+        // again, so it starts another round rather than being folded in.
+        const Clock::time_point requestTime = state->requestTime;
+        state->requested = false;
+        lock.unlock();
+        const bool registered = state->reg(service);
+        lock.lock();
+
+        if (registered) {
+            state->registrations++;
+            state->lastLatency = Clock::now() - requestTime;
+            retryDelay = kMinRetryDelay;
+            LOG(INFO) << "Registered with service after "
+                      << std::chrono::duration_cast<std::chrono::milliseconds>(
+                                 state->lastLatency).count()
+                      << "ms";
+        } else {
+            if (!state->requested) {
+                state->requested = true;
+                state->requestTime = requestTime;
+            }
+            LOG(WARNING) << "Service registration failed; retrying in "
+                         << retryDelay.count() << "ms";
+            state->cv.wait_for(lock, retryDelay,
+                               [&] { return state->stopping; });
+            retryDelay = std::min(retryDelay * 2, kMaxRetryDelay);
+        }
+    }
+}
+
+} // namespace citadeld
+} // namespace nos
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NOS_CITADELD_SERVICE_REGISTRAR_H
+#define NOS_CITADELD_SERVICE_REGISTRAR_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include <binder/IBinder.h>
+
+namespace nos {
+namespace citadeld {
+
+/**
+ * Keeps us registered with a service that may come and go.
+ *
+ * A worker thread sleeps until a registration is requested, then looks the
+ * service up until it has been published and hands it to the register
+ * function. Requests are cheap and non-blocking so they can be made straight
+ * from IBinder::DeathRecipient::binderDied().
+ *
+ * The lookup shouldn't block, e.g. IServiceManager::checkService(). The
+ * service manager can't tell us when a service is published so it is polled,
+ * often at first and backing off to every 100ms, so we re-register soon after
+ * the service comes back. The register function is never called once
+ * the destructor returns.
+ */
+class ServiceRegistrar {
+  public:
+    using Clock = std::chrono::steady_clock;
+    using Lookup = std::function<::android::sp<::android::IBinder>()>;
+    using Register = std::function<bool(const ::android::sp<::android::IBinder>&)>;
+
+    ServiceRegistrar(Lookup lookup, Register reg);
+    ~ServiceRegistrar();
+
+    /** Ask for the service to be looked up and registered with (again). */
+    void RequestRegistration();
+
+    /** Number of successful registrations. */
+    uint64_t registrations() const;
+
+    /** Time from the last request to the registration that satisfied it. */
+    Clock::duration lastLatency() const;
+
+  private:
+    // Everything the worker uses
+    struct State {
+        State(Lookup lookup, Register reg)
+                : lookup(std::move(lookup)), reg(std::move(reg)) {}
+
+        const Lookup lookup;
+        const Register reg;
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool requested = false;
+        bool stopping = false;
+        Clock::time_point requestTime;
+        uint64_t registrations = 0;
+        Clock::duration lastLatency = Clock::duration::zero();
+    };
+
+    static void worker(std::shared_ptr<State> state);
+
+    const std::shared_ptr<State> _state;
+    std::thread _thread;
+};
+
+} // namespace citadeld
+} // namespace nos
+
+#endif // NOS_CITADELD_SERVICE_REGISTRAR_H
@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "StateSnapshot.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/unique_fd.h>
+
+using ::android::base::ReadFileToString;
+using ::android::base::unique_fd;
+using ::android::base::WriteFully;
+
+namespace nos {
+namespace citadeld {
+
+namespace {
+
+constexpr uint32_t kMagic = 0x53445443; // "CTDS"
+
+// Nothing we keep comes close to this; anything bigger is corrupt.
+constexpr uint32_t kMaxPayloadSize = 64 * 1024;
+
+struct __attribute__((packed)) SnapshotHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;
+    uint32_t payload_size;
+    uint32_t checksum;
+    uint64_t reset_count;
+};
+
+struct __attribute__((packed)) SectionHeader {
+    uint16_t tag;
+    uint16_t reserved;
+    uint32_t length;
+};
+
+uint32_t Fnv1a(const uint8_t* data, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+} // namespace
+
+void StateSnapshot::Put(Section section, const void* data, size_t len) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    _sections[section].assign(bytes, bytes + len);
+}
+
+bool StateSnapshot::Get(Section section, void* data, size_t len) const {
+    auto it = _sections.find(section);
+    if (it == _sections.end() || it->second.size() != len) {
+        return false;
+    }
+    memcpy(data, it->second.data(), len);
+    return true;
+}
+
+std::vector<uint8_t> StateSnapshot::Serialize() const {
+    std::vector<uint8_t> bytes(sizeof(SnapshotHeader));
+    for (const auto& section : _sections) {
+        const SectionHeader sh{section.first, 0,
+                               static_cast<uint32_t>(section.second.size())};
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(&sh);
+        bytes.insert(bytes.end(), p, p + sizeof(sh));
+        bytes.insert(bytes.end(), section.second.begin(), section.second.end());
+    }
+
+    SnapshotHeader header;
+    header.magic = kMagic;
+    header.version = kVersion;
+    header.header_size = sizeof(SnapshotHeader);
+    header.payload_size = bytes.size() - sizeof(SnapshotHeader);
+    header.checksum = Fnv1a(bytes.data() + sizeof(SnapshotHeader),
+                            header.payload_size);
+    header.reset_count = _resetCount;
+    memcpy(bytes.data(), &header, sizeof(header));
+    return bytes;
+}
+
+bool StateSnapshot::Parse(const std::vector<uint8_t>& bytes,
+                          StateSnapshot* out) {
+    SnapshotHeader header;
+    if (bytes.size() < sizeof(header)) {
+        LOG(WARNING) << "State snapshot is truncated";
+        return false;
+    }
+    memcpy(&header, bytes.data(), sizeof(header));
+    if (header.magic != kMagic || header.version != kVersion) {
+        LOG(WARNING) << "State snapshot has unknown format " << header.magic
+                     << " v" << header.version;
+        return false;
+    }
+    if (header.header_size < sizeof(header) ||
+        header.payload_size > kMaxPayloadSize ||
+        bytes.size() != size_t(header.header_size) + header.payload_size) {
+        LOG(WARNING) << "State snapshot has inconsistent sizes";
+        return false;
+    }
+
+    const uint8_t* p = bytes.data() + header.header_size;
+    const uint8_t* const end = p + header.payload_size;
+    if (Fnv1a(p, header.payload_size) != header.checksum) {
+        LOG(WARNING) << "State snapshot checksum mismatch";
+        return false;
+    }
+
+    StateSnapshot snapshot(header.reset_count);
+    while (p < end) {
+        SectionHeader sh;
+        if (size_t(end - p) < sizeof(sh)) {
+            return false;
+        }
+        memcpy(&sh, p, sizeof(sh));
+        p += sizeof(sh);
+        if (size_t(end - p) < sh.length) {
+            return false;
+        }
+        snapshot._sections[sh.tag].assign(p, p + sh.length);
+        p += sh.length;
+    }
+
+    *out = std::move(snapshot);
+    return true;
+}
+
+bool StateSnapshot::WriteToFile(const std::string& path) const {
+    const std::vector<uint8_t> bytes = Serialize();
+    const std::string tmp = path + ".tmp";
+
+    unique_fd fd(TEMP_FAILURE_RETRY(
+            open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600)));
+    if (fd == -1) {
+        PLOG(ERROR) << "Failed to open " << tmp;
+        return false;
+    }
+    if (!WriteFully(fd, bytes.data(), bytes.size()) || fsync(fd) != 0) {
+        PLOG(ERROR) << "Failed to write " << tmp;
+        unlink(tmp.c_str());
+        return false;
+    }
+    fd.reset();
+
+    if (rename(tmp.c_str(), path.c_str()) != 0) {
+        PLOG(ERROR) << "Failed to replace " << path;
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool StateSnapshot::ReadFromFile(const std::string& path, StateSnapshot* out) {
+    std::string contents;
+    if (!ReadFileToString(path, &contents)) {
+        return false;
+    }
+    return Parse(std::vector<uint8_t>(contents.begin(), contents.end()), out);
+}
+
+} // namespace citadeld
+} // namespace nos
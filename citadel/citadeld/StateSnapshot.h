@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NOS_CITADELD_STATE_SNAPSHOT_H
+#define NOS_CITADELD_STATE_SNAPSHOT_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace nos {
+namespace citadeld {
+
+/**
+ * The state citadeld keeps about Citadel, saved so that a restarted daemon
+ * can pick up where it left off instead of starting cold.
+ *
+ * The file is a fixed header followed by tagged sections:
+ *
+ *     header:  magic "CTDS", u16 version, u16 header size, u32 payload size,
+ *              u32 payload checksum (FNV-1a), u64 Citadel reset count
+ *     section: u16 tag, u16 reserved, u32 length, length bytes of data
+ *
+ * All fields are little-endian. The version is only bumped for incompatible
+ * changes; new state is added as a new section tag and readers skip tags they
+ * don't know. A snapshot is only meaningful for the Citadel boot it was taken
+ * in, hence the reset count.
+ */
+class StateSnapshot {
+  public:
+    static constexpr uint16_t kVersion = 1;
+
+    enum Section : uint16_t {
+        LOW_POWER_STATS = 1,
+        EVENT_CURSOR = 2,
+    };
+
+    StateSnapshot() = default;
+    explicit StateSnapshot(uint64_t resetCount) : _resetCount(resetCount) {}
+
+    uint64_t resetCount() const { return _resetCount; }
+
+    /** Store a section, replacing any previous data with the same tag. */
+    void Put(Section section, const void* data, size_t len);
+
+    /** Copy out a section. Fails if it is absent or not exactly len bytes. */
+    bool Get(Section section, void* data, size_t len) const;
+
+    std::vector<uint8_t> Serialize() const;
+    static bool Parse(const std::vector<uint8_t>& bytes, StateSnapshot* out);
+
+    /** Atomically replace the file at path with this snapshot. */
+    bool WriteToFile(const std::string& path) const;
+    static bool ReadFromFile(const std::string& path, StateSnapshot* out);
+
+  private:
+    uint64_t _resetCount = 0;
+    std::map<uint16_t, std::vector<uint8_t>> _sections;
+};
+
+} // namespace citadeld
+} // namespace nos
+
+#endif // NOS_CITADELD_STATE_SNAPSHOT_H
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "WorkQueue.h"
+
+#include <utility>
+
+namespace nos {
+namespace citadeld {
+
+WorkQueue::WorkQueue(size_t threads, size_t maxPending)
+        : _maxPending(maxPending) {
+    for (size_t i = 0; i < threads; ++i) {
+        _threads.emplace_back(&WorkQueue::worker, this);
+    }
+}
+
+WorkQueue::~WorkQueue() {
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _cv.notify_all();
+    for (std::thread& thread : _threads) {
+        thread.join();
+    }
+}
+
+bool WorkQueue::Post(std::function<void()> work) {
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_work.size() >= _maxPending) {
+            return false;
+        }
+        _work.push_back(std::move(work));
+    }
+    _cv.notify_one();
+    return true;
+}
+
+void WorkQueue::worker() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+        _cv.wait(lock, [this] { return !_work.empty() || _stopping; });
+        if (_work.empty()) {
+            return;
+        }
+        std::function<void()> work = std::move(_work.front());
+        _work.pop_front();
+        lock.unlock();
+        work();
+        lock.lock();
+    }
+}
+
+} // namespace citadeld
+} // namespace nos
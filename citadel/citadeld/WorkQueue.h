@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NOS_CITADELD_WORK_QUEUE_H
+#define NOS_CITADELD_WORK_QUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace nos {
+namespace citadeld {
+
+/**
+ * A fixed pool of threads that run posted work in the order it was posted.
+ *
+ * This is for work that mustn't hold up the thread that posts it, e.g. oneway
+ * binder calls which are delivered one at a time.
+ */
+class WorkQueue {
+  public:
+    /** At most maxPending pieces of work may wait for a thread. */
+    explicit WorkQueue(size_t threads,
+                       size_t maxPending = std::numeric_limits<size_t>::max());
+    /** Finishes the work already posted then stops the threads. */
+    ~WorkQueue();
+
+    /** Returns false, without queuing the work, if too much is waiting. */
+    bool Post(std::function<void()> work);
+
+  private:
+    void worker();
+
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::deque<std::function<void()>> _work;
+    const size_t _maxPending;
+    bool _stopping = false;
+    std::vector<std::thread> _threads;
+};
+
+} // namespace citadeld
+} // namespace nos
+
+#endif // NOS_CITADELD_WORK_QUEUE_H
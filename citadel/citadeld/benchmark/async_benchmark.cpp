@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <nos/CitadeldProxyClient.h>
+#include <WorkQueue.h>
+
+#include <android/hardware/citadel/BnCitadeld.h>
+
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using ::android::sp;
+using ::android::binder::Status;
+using ::android::hardware::citadel::BnCitadeld;
+using ::android::hardware::citadel::ICitadeldCallback;
+
+using ::nos::CitadeldProxyClient;
+using ::nos::citadeld::WorkQueue;
+
+using namespace std::chrono_literals;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Each call to an app takes about as long as a short Keymaster command does on
+// the device. The response echoes the request.
+constexpr auto kDeviceTime = 5ms;
+
+class SlowCitadeld : public BnCitadeld {
+  public:
+    SlowCitadeld() : _calls(1) {}
+
+    Status callApp(int32_t appId, int32_t /* arg */,
+                   const std::vector<uint8_t>& request,
+                   std::vector<uint8_t>* response,
+                   int32_t* _aidl_return) override {
+        std::this_thread::sleep_for(kDeviceTime);
+        response->assign(request.begin(), request.end());
+        *_aidl_return = appId;
+        return Status::ok();
+    }
+
+    Status callAppAsync(int32_t appId, int32_t arg,
+                        const std::vector<uint8_t>& request,
+                        int32_t /* responseSize */,
+                        const sp<ICitadeldCallback>& callback) override {
+        _calls.Post([=] {
+            std::vector<uint8_t> response;
+            int32_t appStatus;
+            callApp(appId, arg, request, &response, &appStatus);
+            callback->onCallAppComplete(appStatus, response);
+        });
+        return Status::ok();
+    }
+
+    Status reset(bool* _aidl_return) override {
+        *_aidl_return = true;
+        return Status::ok();
+    }
+
+    Status getCachedStats(std::vector<uint8_t>* response) override {
+        response->clear();
+        return Status::ok();
+    }
+
+  private:
+    WorkQueue _calls;
+};
+
+// Stands in for the work the HAL does between calls, e.g. translating
+// parameters for the next request and assembling the certificate chain.
+void LocalWork(Clock::duration duration) {
+    const Clock::time_point end = Clock::now() + duration;
+    while (Clock::now() < end) {
+    }
+}
+
+// Attestation takes three calls to the device with local work between each.
+constexpr int kAttestSteps = 3;
+
+void BM_AttestSync(benchmark::State& state) {
+    CitadeldProxyClient client(new SlowCitadeld);
+    for (auto _ : state) {
+        for (int i = 0; i < kAttestSteps; ++i) {
+            std::vector<uint8_t> response;
+            response.reserve(16);
+            client.CallApp(i, 0, {1, 2, 3}, &response);
+            LocalWork(kDeviceTime);
+        }
+    }
+}
+BENCHMARK(BM_AttestSync)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// The local work overlaps the device call, so this should take about half
+// as long as BM_AttestSync.
+void BM_AttestAsync(benchmark::State& state) {
+    CitadeldProxyClient client(new SlowCitadeld);
+    for (auto _ : state) {
+        for (int i = 0; i < kAttestSteps; ++i) {
+            auto result = client.CallAppAsync(i, 0, {1, 2, 3}, 16);
+            LocalWork(kDeviceTime);
+            result.get();
+        }
+    }
+}
+BENCHMARK(BM_AttestAsync)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <DeviceChannel.h>
+
+#include <nos/NuggetClientInterface.h>
+
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using ::nos::NuggetClientInterface;
+using ::nos::citadeld::DeviceChannel;
+
+using namespace std::chrono_literals;
+
+namespace {
+
+// Stands in for a device where each transaction occupies the link for 1ms,
+// like the SPI bus does for a real one.
+class SlowDevice : public NuggetClientInterface {
+  public:
+    ~SlowDevice() override = default;
+
+    void Open() override {}
+    void Close() override {}
+    bool IsOpen() const override { return true; }
+    uint32_t CallApp(uint32_t /* appId */, uint16_t /* arg */,
+                     const std::vector<uint8_t>& /* request */,
+                     std::vector<uint8_t>* /* response */) override {
+        std::this_thread::sleep_for(1ms);
+        return 0;
+    }
+};
+
+// Two callers per device each make a batch of calls to their own device. The
+// argument is the number of devices; calls per second should grow with it.
+void BM_DeviceCalls(benchmark::State& state) {
+    constexpr size_t kCallersPerDevice = 2;
+    constexpr int kCallsPerCaller = 20;
+    std::vector<std::unique_ptr<DeviceChannel>> devices;
+    for (int64_t i = 0; i < state.range(0); ++i) {
+        devices.emplace_back(new DeviceChannel(
+                "sim" + std::to_string(i),
+                std::unique_ptr<NuggetClientInterface>(new SlowDevice)));
+    }
+
+    for (auto _ : state) {
+        std::vector<std::thread> callers;
+        for (size_t i = 0; i < devices.size() * kCallersPerDevice; ++i) {
+            callers.emplace_back([&, i] {
+                const uid_t uid = 1000 + i;
+                const std::vector<uint8_t> request(32);
+                DeviceChannel& device = *devices[i % devices.size()];
+                for (int call = 0; call < kCallsPerCaller; ++call) {
+                    std::vector<uint8_t> response;
+                    device.CallApp(uid, 0, 0, request, &response);
+                }
+            });
+        }
+        for (auto& caller : callers) {
+            caller.join();
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * devices.size() *
+                            kCallersPerDevice * kCallsPerCaller);
+}
+BENCHMARK(BM_DeviceCalls)->Arg(1)->Arg(4)->UseRealTime();
+
+} // namespace
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <nos/CitadeldProxyClient.h>
+
+#include <binder/Binder.h>
+#include <binder/Parcel.h>
+
+#include <application.h>
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <mutex>
+
+using ::android::BBinder;
+using ::android::IBinder;
+using ::android::Parcel;
+using ::android::sp;
+using ::android::status_t;
+
+using ::nos::CitadeldProxyClient;
+
+namespace {
+
+// Answers every callApp() with success until it is killed, after which it
+// fails calls as if its process had died.
+class KillableCitadeld : public BBinder {
+  public:
+    void Kill() { _dead = true; }
+
+  protected:
+    status_t onTransact(uint32_t code, const Parcel& data, Parcel* reply,
+                        uint32_t flags) override {
+        if (_dead) {
+            return ::android::DEAD_OBJECT;
+        }
+        if (code != IBinder::FIRST_CALL_TRANSACTION) {
+            return BBinder::onTransact(code, data, reply, flags);
+        }
+        reply->writeNoException();
+        reply->writeInt32(APP_SUCCESS);
+        return reply->writeInt32(0);  // empty response
+    }
+
+  private:
+    std::atomic<bool> _dead{false};
+};
+
+// Hands out whichever citadeld was started last.
+class Citadelds {
+  public:
+    Citadelds() : _current(new KillableCitadeld) {}
+
+    sp<IBinder> Current() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _current;
+    }
+
+    // Publish a new citadeld then kill the old one
+    void Restart() {
+        sp<KillableCitadeld> old;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            old = _current;
+            _current = new KillableCitadeld;
+        }
+        old->Kill();
+    }
+
+  private:
+    std::mutex _mutex;
+    sp<KillableCitadeld> _current;
+};
+
+// Time for an idempotent call that finds citadeld has died to reconnect and
+// be retried.
+void BM_Reconnect(benchmark::State& state) {
+    Citadelds citadelds;
+    CitadeldProxyClient client([&] { return citadelds.Current(); });
+    client.SetIdempotentCalls([](uint32_t, uint16_t) { return true; });
+    client.Open();
+    for (auto _ : state) {
+        state.PauseTiming();
+        citadelds.Restart();
+        state.ResumeTiming();
+        if (client.CallApp(1, 0, nullptr, 0, nullptr, nullptr) != APP_SUCCESS) {
+            state.SkipWithError("Call failed after reconnecting");
+            break;
+        }
+    }
+    state.counters["reconnects"] = client.Reconnects();
+}
+BENCHMARK(BM_Reconnect)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+} // namespace
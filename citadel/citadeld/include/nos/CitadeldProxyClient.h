@@ -17,7 +17,14 @@
 #ifndef NOS_CITADELD_PROXY_CLIENT_H
 #define NOS_CITADELD_PROXY_CLIENT_H
 
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <utility>
 #include <vector>
 
 #include <nos/NuggetClientInterface.h>
@@ -26,17 +33,40 @@
 
 namespace nos {
 
+namespace citadeld {
+class PendingAsyncCalls;
+class ServiceRegistrar;
+} // namespace citadeld
+
 using ::android::hardware::citadel::ICitadeld;
 
 /**
  * Implementation of NuggetClient to proxy calls via the citadeld synchronizing
  * daemon which coordinates communication between the HALs and Citadel.
+ *
+ * If citadeld dies, the client looks it up again in the background. Calls
+ * made in the meantime wait a short while for it to come back. A call that
+ * was in flight when it died is only retried if the caller has said that it
+ * is idempotent.
  */
 class CitadeldProxyClient : public NuggetClientInterface {
-    ::android::sp<ICitadeld> _citadeld;
-
 public:
-    CitadeldProxyClient() = default;
+    using ServiceLookup = std::function<::android::sp<::android::IBinder>()>;
+    using IdempotencyPredicate = std::function<bool(uint32_t appId, uint16_t arg)>;
+
+    /** Connect to the citadeld service on vndbinder. */
+    CitadeldProxyClient();
+    /**
+     * Connect to whatever the lookup returns and reconnect in the same way.
+     * The lookup returns null, rather than blocking, until the service has
+     * been published.
+     */
+    explicit CitadeldProxyClient(ServiceLookup lookup);
+    /**
+     * Use a citadeld that is already connected, e.g. one in this process.
+     * It is never reconnected.
+     */
+    explicit CitadeldProxyClient(::android::sp<ICitadeld> citadeld);
     ~CitadeldProxyClient() override;
 
     void Open() override;
@@ -46,7 +76,79 @@ public:
                      const std::vector<uint8_t>& request,
                      std::vector<uint8_t>* response) override;
 
-    ICitadeld& Citadeld();
+    /**
+     * Call an app with the request and response in caller-owned buffers. On
+     * entry *responseLen is the size of the response buffer and on return the
+     * number of bytes written. responseLen may be null if no response is
+     * expected.
+     */
+    uint32_t CallApp(uint32_t appId, uint16_t arg,
+                     const uint8_t* request, uint32_t requestLen,
+                     uint8_t* response, uint32_t* responseLen);
+
+    using CallAppCallback =
+            std::function<void(uint32_t appStatus,
+                               const std::vector<uint8_t>& response)>;
+
+    struct CallAppResult {
+        uint32_t appStatus;
+        std::vector<uint8_t> response;
+    };
+
+    /**
+     * Start a call to an app and return without waiting for it to complete.
+     * The callback is run once with the result on one of this process's
+     * binder threads, which are started if they haven't been already. If
+     * citadeld dies before the result comes back it gets APP_ERROR_IO. The
+     * response will be at most responseSize bytes.
+     */
+    void CallAppAsync(uint32_t appId, uint16_t arg,
+                      const std::vector<uint8_t>& request,
+                      uint32_t responseSize, CallAppCallback callback);
+
+    /** As above but the result is delivered through a future. */
+    std::future<CallAppResult> CallAppAsync(uint32_t appId, uint16_t arg,
+                                            const std::vector<uint8_t>& request,
+                                            uint32_t responseSize);
+
+    /**
+     * Say which calls can safely be made again if citadeld dies while they
+     * are in flight. Set this before making any calls.
+     */
+    void SetIdempotentCalls(IdempotencyPredicate idempotent);
+
+    /** Number of times the client has reconnected to citadeld. */
+    uint64_t Reconnects() const;
+
+    /** Time between losing citadeld and the last reconnection. */
+    std::chrono::steady_clock::duration LastReconnectLatency() const;
+
+    /**
+     * The citadeld currently connected to, waiting briefly for it to come back
+     * if it has died. This is null if it doesn't.
+     */
+    ::android::sp<ICitadeld> Citadeld();
+
+private:
+    class DeathRecipient;
+
+    bool connect(const ::android::sp<::android::IBinder>& binder);
+    void serviceLost(const ::android::sp<ICitadeld>& citadeld);
+    ::android::sp<ICitadeld> waitForCitadeld(std::chrono::milliseconds timeout);
+    bool transactCallApp(uint32_t appId, uint16_t arg,
+                         const std::vector<uint8_t>& request,
+                         std::vector<uint8_t>* response, uint32_t* appStatus);
+
+    mutable std::mutex _mutex;
+    std::condition_variable _connected;
+    ::android::sp<ICitadeld> _citadeld;
+    const ServiceLookup _lookup;
+    IdempotencyPredicate _idempotent;
+    ::android::sp<DeathRecipient> _deathRecipient;
+    // Shared with the callbacks, which may outlive the client
+    const std::shared_ptr<citadeld::PendingAsyncCalls> _asyncCalls;
+    // Last so it is destroyed, and stops calling connect(), first
+    std::unique_ptr<citadeld::ServiceRegistrar> _registrar;
 };
 
 } // namespace nos
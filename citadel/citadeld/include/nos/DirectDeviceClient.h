@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NOS_DIRECT_DEVICE_CLIENT_H
+#define NOS_DIRECT_DEVICE_CLIENT_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <nos/NuggetClientInterface.h>
+
+namespace nos {
+
+/**
+ * Talks to Citadel from this process rather than via citadeld, serializing
+ * calls with a lock of its own.
+ *
+ * This is for images where a single process uses Citadel, e.g. recovery,
+ * factory and bench builds. It does not coordinate with anything else so
+ * citadeld and the other HALs must not be using the device at the same time.
+ */
+class DirectDeviceClient : public NuggetClientInterface {
+public:
+    /** Open the named Citadel device; the empty name is the default one. */
+    explicit DirectDeviceClient(const std::string& deviceName = "");
+    /** Serialize calls to an existing client. */
+    explicit DirectDeviceClient(std::unique_ptr<NuggetClientInterface> client);
+    ~DirectDeviceClient() override;
+
+    void Open() override;
+    void Close() override;
+    bool IsOpen() const override;
+    uint32_t CallApp(uint32_t appId, uint16_t arg,
+                     const std::vector<uint8_t>& request,
+                     std::vector<uint8_t>* response) override;
+
+private:
+    mutable std::mutex _mutex;
+    const std::unique_ptr<NuggetClientInterface> _client;
+};
+
+/**
+ * Whether the named HAL service should talk to Citadel directly instead of via
+ * citadeld. Only the one service named by ro.vendor.nos.direct_device does, and
+ * citadeld is stopped when that is set, so nothing else uses the device. The
+ * NOS_DIRECT_DEVICE environment variable overrides the property.
+ */
+bool UseDirectDevice(const std::string& service);
+
+/**
+ * Create the client the named HAL service uses to talk to Citadel. This is a
+ * DirectDeviceClient if UseDirectDevice(service) and a CitadeldProxyClient
+ * otherwise. It still needs to be opened. The calls the predicate accepts are
+ * retried if citadeld dies while they are in flight.
+ */
+std::unique_ptr<NuggetClientInterface> MakeCitadelClient(
+        const std::string& service,
+        std::function<bool(uint32_t appId, uint16_t arg)> idempotent = nullptr);
+
+} // namespace nos
+
+#endif // NOS_DIRECT_DEVICE_CLIENT_H
@@ -0,0 +1,350 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NOS_INTERCEPTORS_H
+#define NOS_INTERCEPTORS_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <android-base/logging.h>
+#include <android-base/properties.h>
+#include <utils/Trace.h>
+
+#include <application.h>
+#include <nos/NuggetClientInterface.h>
+
+/**
+ * Middleware for NuggetClientInterface::CallApp().
+ *
+ * An interceptor is any movable type with a member
+ *
+ *   template <typename Next>
+ *   uint32_t CallApp(uint32_t appId, uint16_t arg,
+ *                    const std::vector<uint8_t>& request,
+ *                    std::vector<uint8_t>* response, Next&& next);
+ *
+ * that does its work around next(appId, arg, request, response), which runs
+ * the rest of the chain and then the client. The chain is resolved at compile
+ * time so the calls are inlined, and an empty chain is a direct call to the
+ * client.
+ */
+
+namespace nos {
+
+template <typename... Interceptors>
+class InterceptedClient : public NuggetClientInterface {
+public:
+    explicit InterceptedClient(NuggetClientInterface& client,
+                               Interceptors... interceptors)
+            : _client(client), _interceptors(std::move(interceptors)...) {}
+    ~InterceptedClient() override = default;
+
+    void Open() override { _client.Open(); }
+    void Close() override { _client.Close(); }
+    bool IsOpen() const override { return _client.IsOpen(); }
+    uint32_t CallApp(uint32_t appId, uint16_t arg,
+                     const std::vector<uint8_t>& request,
+                     std::vector<uint8_t>* response) override {
+        return call<0>(appId, arg, request, response);
+    }
+
+    /** The I'th interceptor, the first being outermost. */
+    template <size_t I>
+    auto& interceptor() { return std::get<I>(_interceptors); }
+
+private:
+    template <size_t I>
+    uint32_t call(uint32_t appId, uint16_t arg,
+                  const std::vector<uint8_t>& request,
+                  std::vector<uint8_t>* response) {
+        if constexpr (I == sizeof...(Interceptors)) {
+            return _client.CallApp(appId, arg, request, response);
+        } else {
+            return std::get<I>(_interceptors).CallApp(
+                    appId, arg, request, response,
+                    [this](uint32_t appId, uint16_t arg,
+                           const std::vector<uint8_t>& request,
+                           std::vector<uint8_t>* response) {
+                        return call<I + 1>(appId, arg, request, response);
+                    });
+        }
+    }
+
+    NuggetClientInterface& _client;
+    std::tuple<Interceptors...> _interceptors;
+};
+
+/** Wrap a client in a chain of interceptors, the first being outermost. */
+template <typename... Interceptors>
+InterceptedClient<Interceptors...> Intercept(NuggetClientInterface& client,
+                                             Interceptors... interceptors) {
+    return InterceptedClient<Interceptors...>(client, std::move(interceptors)...);
+}
+
+/** Marks each call in systrace as "<name> <arg>". */
+class TraceInterceptor {
+public:
+    explicit TraceInterceptor(const char* name) : _name(name) {}
+
+    template <typename Next>
+    uint32_t CallApp(uint32_t appId, uint16_t arg,
+                     const std::vector<uint8_t>& request,
+                     std::vector<uint8_t>* response, Next&& next) {
+        char label[64];
+        snprintf(label, sizeof(label), "%s %u", _name, arg);
+        ::android::ScopedTrace trace(ATRACE_TAG_HAL, label);
+        return next(appId, arg, request, response);
+    }
+
+private:
+    const char* _name;
+};
+
+/** Keeps call count and timings, and logs calls slower than a threshold. */
+class TimingInterceptor {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit TimingInterceptor(Clock::duration slowCall)
+            : _slowCall(slowCall), _stats(new Stats) {}
+
+    template <typename Next>
+    uint32_t CallApp(uint32_t appId, uint16_t arg,
+                     const std::vector<uint8_t>& request,
+                     std::vector<uint8_t>* response, Next&& next) {
+        const Clock::time_point start = Clock::now();
+        const uint32_t status = next(appId, arg, request, response);
+        const Clock::duration elapsed = Clock::now() - start;
+
+        std::unique_lock<std::mutex> lock(_stats->mutex);
+        _stats->calls++;
+        _stats->total += elapsed;
+        _stats->max = std::max(_stats->max, elapsed);
+        lock.unlock();
+        if (elapsed > _slowCall) {
+            LOG(WARNING) << "Call to app " << appId << " arg " << arg << " took "
+                         << std::chrono::duration_cast<std::chrono::milliseconds>(
+                                    elapsed).count() << "ms";
+        }
+        return status;
+    }
+
+    uint64_t calls() const {
+        std::unique_lock<std::mutex> lock(_stats->mutex);
+        return _stats->calls;
+    }
+    Clock::duration totalTime() const {
+        std::unique_lock<std::mutex> lock(_stats->mutex);
+        return _stats->total;
+    }
+    Clock::duration maxTime() const {
+        std::unique_lock<std::mutex> lock(_stats->mutex);
+        return _stats->max;
+    }
+
+private:
+    struct Stats {
+        std::mutex mutex;
+        uint64_t calls = 0;
+        Clock::duration total = Clock::duration::zero();
+        Clock::duration max = Clock::duration::zero();
+    };
+
+    Clock::duration _slowCall;
+    std::unique_ptr<Stats> _stats;
+};
+
+/**
+ * Repeats calls that Citadel turned away because it was busy. Those never
+ * started so repeating them is safe whatever the call does.
+ */
+class RetryInterceptor {
+public:
+    RetryInterceptor(uint32_t attempts, std::chrono::milliseconds backoff)
+            : _attempts(attempts), _backoff(backoff) {}
+
+    template <typename Next>
+    uint32_t CallApp(uint32_t appId, uint16_t arg,
+                     const std::vector<uint8_t>& request,
+                     std::vector<uint8_t>* response, Next&& next) {
+        uint32_t status = next(appId, arg, request, response);
+        for (uint32_t i = 1; i < _attempts && status == APP_ERROR_BUSY; ++i) {
+            std::this_thread::sleep_for(_backoff * i);
+            status = next(appId, arg, request, response);
+        }
+        return status;
+    }
+
+private:
+    uint32_t _attempts;
+    std::chrono::milliseconds _backoff;
+};
+
+/**
+ * Fails every Nth call with the given status without passing it on, to
+ * exercise the HALs' error paths. An interval of 0 disables it.
+ */
+class FaultInjectionInterceptor {
+public:
+    explicit FaultInjectionInterceptor(uint32_t every,
+                                       uint32_t status = APP_ERROR_IO)
+            : _every(every), _status(status),
+              _calls(new std::atomic<uint32_t>(0)) {}
+
+    /**
+     * Takes the interval from vendor.nos.inject_fault_every, which is only
+     * honoured on debuggable builds.
+     */
+    static FaultInjectionInterceptor FromProperties() {
+        uint32_t every = 0;
+        if (::android::base::GetBoolProperty("ro.debuggable", false)) {
+            every = ::android::base::GetUintProperty<uint32_t>(
+                    "vendor.nos.inject_fault_every", 0);
+        }
+        if (every != 0) {
+            LOG(WARNING) << "Failing every " << every << " calls to Citadel";
+        }
+        return FaultInjectionInterceptor(every);
+    }
+
+    template <typename Next>
+    uint32_t CallApp(uint32_t appId, uint16_t arg,
+                     const std::vector<uint8_t>& request,
+                     std::vector<uint8_t>* response, Next&& next) {
+        if (_every != 0 && ++*_calls % _every == 0) {
+            return _status;
+        }
+        return next(appId, arg, request, response);
+    }
+
+private:
+    uint32_t _every;
+    uint32_t _status;
+    std::unique_ptr<std::atomic<uint32_t>> _calls;
+};
+
+/** Spaces calls at least an interval apart, delaying those that come early. */
+class RateLimitInterceptor {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit RateLimitInterceptor(Clock::duration interval)
+            : _interval(interval), _state(new State) {}
+
+    template <typename Next>
+    uint32_t CallApp(uint32_t appId, uint16_t arg,
+                     const std::vector<uint8_t>& request,
+                     std::vector<uint8_t>* response, Next&& next) {
+        Clock::time_point slot;
+        {
+            std::unique_lock<std::mutex> lock(_state->mutex);
+            slot = std::max(Clock::now(), _state->next);
+            _state->next = slot + _interval;
+        }
+        std::this_thread::sleep_until(slot);
+        return next(appId, arg, request, response);
+    }
+
+private:
+    struct State {
+        std::mutex mutex;
+        Clock::time_point next;
+    };
+
+    Clock::duration _interval;
+    std::unique_ptr<State> _state;
+};
+
+/**
+ * Remembers the responses to successful calls that the predicate says
+ * always give the same response for the same request, e.g. version queries.
+ */
+template <typename Predicate>
+class CacheInterceptor {
+public:
+    explicit CacheInterceptor(Predicate cacheable)
+            : _cacheable(std::move(cacheable)), _state(new State) {}
+
+    template <typename Next>
+    uint32_t CallApp(uint32_t appId, uint16_t arg,
+                     const std::vector<uint8_t>& request,
+                     std::vector<uint8_t>* response, Next&& next) {
+        if (response == nullptr || !_cacheable(appId, arg)) {
+            return next(appId, arg, request, response);
+        }
+
+        Key key(appId, arg, request);
+        {
+            std::unique_lock<std::mutex> lock(_state->mutex);
+            auto it = _state->responses.find(key);
+            if (it != _state->responses.end()) {
+                *response = it->second;
+                return APP_SUCCESS;
+            }
+        }
+        const uint32_t status = next(appId, arg, request, response);
+        if (status == APP_SUCCESS) {
+            std::unique_lock<std::mutex> lock(_state->mutex);
+            _state->responses.emplace(std::move(key), *response);
+        }
+        return status;
+    }
+
+private:
+    using Key = std::tuple<uint32_t, uint16_t, std::vector<uint8_t>>;
+    struct State {
+        std::mutex mutex;
+        std::map<Key, std::vector<uint8_t>> responses;
+    };
+
+    Predicate _cacheable;
+    std::unique_ptr<State> _state;
+};
+
+template <typename Predicate>
+CacheInterceptor<Predicate> MakeCacheInterceptor(Predicate cacheable) {
+    return CacheInterceptor<Predicate>(std::move(cacheable));
+}
+
+/**
+ * The chain the HAL services put around their client. Calls are traced and
+ * timed, those Citadel was too busy to take are retried and, on debuggable
+ * builds, faults can be injected.
+ */
+inline auto InterceptHalCalls(NuggetClientInterface& client, const char* name) {
+    // Key generation is the slowest thing Citadel does and takes seconds
+    constexpr std::chrono::seconds kSlowCall{10};
+    constexpr uint32_t kBusyAttempts = 3;
+    constexpr std::chrono::milliseconds kBusyBackoff{5};
+    return Intercept(client, TraceInterceptor(name), TimingInterceptor(kSlowCall),
+                     RetryInterceptor(kBusyAttempts, kBusyBackoff),
+                     FaultInjectionInterceptor::FromProperties());
+}
+
+} // namespace nos
+
+#endif // NOS_INTERCEPTORS_H
@@ -18,13 +18,18 @@
 #include <chrono>
 #include <condition_variable>
 #include <functional>
-#include <future>
-#include <iomanip>
 #include <limits>
+#include <memory>
 #include <mutex>
+#include <sstream>
 #include <thread>
 
+#include <unistd.h>
+
 #include <android-base/logging.h>
+#include <android-base/properties.h>
+#include <android-base/file.h>
+#include <android-base/strings.h>
 #include <binder/IBinder.h>
 #include <binder/IPCThreadState.h>
 #include <binder/IServiceManager.h>
@@ -36,6 +41,12 @@
 
 #include <android/hardware/citadel/BnCitadeld.h>
 
+#include "DeviceChannel.h"
+#include "DeviceRouter.h"
+#include "ServiceRegistrar.h"
+#include "StateSnapshot.h"
+#include "WorkQueue.h"
+
 #include <android/vendor/powerstats/BnPixelPowerStatsCallback.h>
 #include <android/vendor/powerstats/BnPixelPowerStatsProvider.h>
 #include <android/vendor/powerstats/StateResidencyData.h>
@@ -48,12 +59,24 @@ using ::android::ProcessState;
 using ::android::sp;
 using ::android::status_t;
 using ::android::wp;
+using ::android::Vector;
+using ::android::String16;
+using ::android::base::GetProperty;
+using ::android::base::Split;
+using ::android::base::Trim;
+using ::android::base::WriteStringToFd;
 using ::android::binder::Status;
 
 using ::nos::NuggetClient;
+using ::nos::citadeld::DeviceChannel;
+using ::nos::citadeld::DeviceRouter;
+using ::nos::citadeld::ServiceRegistrar;
+using ::nos::citadeld::StateSnapshot;
+using ::nos::citadeld::WorkQueue;
 
 using ::android::hardware::citadel::BnCitadeld;
 using ::android::hardware::citadel::ICitadeld;
+using ::android::hardware::citadel::ICitadeldCallback;
 
 using android::IBinder;
 using android::vendor::powerstats::BnPixelPowerStatsCallback;
@@ -64,9 +87,51 @@ namespace {
 
 using namespace std::chrono_literals;
 
+// Comma separated list of uid:weight pairs for the call scheduler. UIDs not
+// listed get a weight of 1.
+constexpr char PROPERTY_UID_WEIGHTS[] = "ro.vendor.citadeld.uid_weights";
+
+// Comma separated list of the devices to manage. The first is the primary
+// device whose stats are reported and which is reset. When unset, only the
+// default device is used.
+constexpr char PROPERTY_DEVICES[] = "ro.vendor.citadeld.devices";
+
+// Comma separated list of uid:<uid>=<device> and app:<id>=<device> routes,
+// where <device> is an index into the device list. Anything not routed goes to
+// the primary device.
+constexpr char PROPERTY_DEVICE_ROUTES[] = "ro.vendor.citadeld.device_routes";
+
+// Names the HAL service that talks to the device itself on images without
+// citadeld. When set citadeld must not touch the device.
+constexpr char PROPERTY_DIRECT_DEVICE[] = "ro.vendor.nos.direct_device";
+
+// Number of threads making the calls started by callAppAsync(). Calls wait in
+// the device's scheduler like any other so this only needs to be enough to
+// keep the devices busy.
+constexpr size_t kAsyncCallThreads = 4;
+
+// Calls from callAppAsync() waiting for one of those threads. Beyond this the
+// caller is told the device is busy rather than queuing without bound.
+constexpr size_t kMaxPendingAsyncCalls = 64;
+
+// The largest response callAppAsync() will make room for. The result goes
+// back in a oneway transaction, which has to fit in the caller's async binder
+// buffer, and no app on the device answers with anywhere near this much.
+constexpr int32_t kMaxAsyncResponseSize = 64 * 1024;
+
+// Longest the event dispatcher waits for an interrupt before checking whether
+// its device is being torn down.
+constexpr int kEventWaitTimeoutMs = 10000;
+
+// Where the cached state is checkpointed so a restarted citadeld comes back
+// warm. The directory is created by citadeld.rc.
+constexpr char STATE_SNAPSHOT_PATH[] = "/data/vendor/citadeld/state";
+
 // This attaches a timer to a function call. Call .schedule() to start the
 // timer, and the function will be called (once) after the time has elapsed. If
 // you call .schedule() again before that happens, it just restarts the timer.
+// .schedule_if_idle() leaves a running timer alone instead, so the call still
+// happens however often it is scheduled.
 // There's no way to cancel the function call after it's scheduled; you can only
 // postpone it.
 class DeferredCallback {
@@ -82,6 +147,18 @@ class DeferredCallback {
     void schedule() {
         std::unique_lock<std::mutex> _lock(_cv_mutex);
         _armed = true;
+        _deadline = std::chrono::steady_clock::now() + _delay;
+        _cv.notify_one();
+    }
+
+    // start the timer unless it is already running
+    void schedule_if_idle() {
+        std::unique_lock<std::mutex> _lock(_cv_mutex);
+        if (_armed) {
+            return;
+        }
+        _armed = true;
+        _deadline = std::chrono::steady_clock::now() + _delay;
         _cv.notify_one();
     }
 
@@ -91,9 +168,13 @@ class DeferredCallback {
         while (true) {
             if (!_armed) {
                 _cv.wait(_lock);
+                continue;
             }
-            auto timeout = std::chrono::steady_clock::now() + _delay;
-            if (_cv.wait_until(_lock, timeout) == std::cv_status::timeout) {
+            // Woken early when the timer is restarted, so wait again for the
+            // new deadline
+            const auto deadline = _deadline;
+            if (_cv.wait_until(_lock, deadline) == std::cv_status::timeout &&
+                _deadline == deadline) {
                 _func();
                 _armed = false;
             }
@@ -101,11 +182,13 @@ class DeferredCallback {
     }
 
     bool _armed;
+    std::chrono::steady_clock::time_point _deadline;
     const std::chrono::milliseconds _delay;
     const std::function<void()> _func;
-    std::thread _waiter_thread;
     std::mutex _cv_mutex;
     std::condition_variable _cv;
+    // Last, so the members it uses exist before it starts
+    std::thread _waiter_thread;
 };
 
 // This provides a Binder interface for the powerstats service to fetch our
@@ -115,7 +198,10 @@ class StatsDelegate : public BnPixelPowerStatsCallback,
                       public IBinder::DeathRecipient {
   public:
     StatsDelegate(std::function<Status(std::vector<StateResidencyData>*)> fn)
-        : func_(fn) {}
+        : func_(fn),
+          registrar_(FindPowerStatsService,
+                     std::bind(&StatsDelegate::registerWithPowerStats, this,
+                               std::placeholders::_1)) {}
 
     // methods from BnPixelPowerStatsCallback
     virtual Status getStats(std::vector<StateResidencyData>* stats) override {
@@ -130,12 +216,15 @@ class StatsDelegate : public BnPixelPowerStatsCallback,
         if (service != nullptr) {
             service->unlinkToDeath(this);
         }
-        sp<IBinder> powerstats_service = WaitForPowerStatsService();
-        registerWithPowerStats(powerstats_service);
+        // Don't tie up this binder thread waiting for powerstats to come back
+        registrar_.RequestRegistration();
     }
 
     // post-creation init (Binder calls inside constructor are troublesome)
-    void registerWithPowerStats(sp<IBinder>& powerstats_service) {
+    void start() { registrar_.RequestRegistration(); }
+
+  private:
+    bool registerWithPowerStats(const sp<IBinder>& powerstats_service) {
         sp<IPixelPowerStatsProvider> powerstats_provider =
                 android::interface_cast<IPixelPowerStatsProvider>(
                         powerstats_service);
@@ -152,45 +241,51 @@ class StatsDelegate : public BnPixelPowerStatsCallback,
         Status status = powerstats_provider->registerCallback("Citadel", this);
         if (!status.isOk()) {
             LOG(ERROR) << "failed to register callback: " << status.toString8();
-        }
-    }
-
-    // static helper function
-    static sp<IBinder> WaitForPowerStatsService() {
-        LOG(INFO) << "waiting for powerstats service to appear";
-        sp<IBinder> svc;
-        while (true) {
-            svc = defaultServiceManager()->checkService(
-                    android::String16("power.stats-vendor"));
-            if (svc != nullptr) {
-                LOG(INFO) << "A wild powerstats service has appeared!";
-                return svc;
+            if (ret == android::OK) {
+                asBinder(powerstats_provider)->unlinkToDeath(this);
             }
-            sleep(1);
+            return false;
         }
+        return true;
     }
 
-    // Creates a new StatsDelegate only after a powerstats service becomes
-    // available for it to register with.
-    static sp<StatsDelegate> MakeOne(
-            std::function<Status(std::vector<StateResidencyData>*)> fn) {
-        sp<IBinder> powerstats_service =
-                StatsDelegate::WaitForPowerStatsService();
-        sp<StatsDelegate> sd = new StatsDelegate(fn);
-        sd->registerWithPowerStats(powerstats_service);
-        return sd;
+    // The powerstats service if it has been published yet. The registrar
+    // polls this until it has.
+    static sp<IBinder> FindPowerStatsService() {
+        sp<IBinder> svc = defaultServiceManager()->checkService(
+                android::String16("power.stats-vendor"));
+        if (svc != nullptr) {
+            LOG(INFO) << "A wild powerstats service has appeared!";
+        }
+        return svc;
     }
 
-  private:
     const std::function<Status(std::vector<StateResidencyData>*)> func_;
+    ServiceRegistrar registrar_;
 };
 
 class CitadelProxy : public BnCitadeld {
   public:
-    CitadelProxy(NuggetClient& client)
-        : _client{client},
-          _event_thread(std::bind(&CitadelProxy::dispatchEvents, this)),
-          _stats_collection(500ms, std::bind(&CitadelProxy::cacheStats, this)) {
+    CitadelProxy(std::vector<std::unique_ptr<DeviceChannel>>& devices)
+        : _devices{devices},
+          _router{devices.size()},
+          _stats_collection(500ms, std::bind(&CitadelProxy::cacheStats, this)),
+          _checkpoint(5s, std::bind(&CitadelProxy::saveState, this)),
+          _async_calls(kAsyncCallThreads, kMaxPendingAsyncCalls) {
+        const std::string weights = GetProperty(PROPERTY_UID_WEIGHTS, "");
+        for (auto& device : _devices) {
+            device->scheduler().ParseWeights(weights);
+        }
+        _router.ParseRoutes(GetProperty(PROPERTY_DEVICE_ROUTES, ""));
+        restoreState();
+        // Start handling events once we know which ones we've already seen
+        for (auto& device : _devices) {
+            if (device->device() != nullptr) {
+                device->StartIoThread(
+                        std::bind(&CitadelProxy::dispatchEvents, this,
+                                  std::placeholders::_1));
+            }
+        }
     }
     ~CitadelProxy() override = default;
 
@@ -200,33 +295,73 @@ class CitadelProxy : public BnCitadeld {
                    const std::vector<uint8_t>& request,
                    std::vector<uint8_t>* const response,
                    int32_t* const _aidl_return) override {
-        // AIDL doesn't support integers less than 32-bit so validate it before
-        // casting
-        if (_appId < 0 || _appId > kMaxAppId) {
-            LOG(ERROR) << "App ID " << _appId << " is outside the app ID range";
-            return Status::fromExceptionCode(Status::EX_ILLEGAL_ARGUMENT);
-        }
-        if (_arg < 0 || _arg > std::numeric_limits<uint16_t>::max()) {
-            LOG(ERROR) << "Argument " << _arg
-                       << " is outside the unsigned 16-bit range";
+        if (!validateCall(_appId, _arg)) {
             return Status::fromExceptionCode(Status::EX_ILLEGAL_ARGUMENT);
         }
 
         const uint8_t appId = static_cast<uint32_t>(_appId);
         const uint16_t arg = static_cast<uint16_t>(_arg);
+        const uid_t uid = IPCThreadState::self()->getCallingUid();
         uint32_t* const appStatus = reinterpret_cast<uint32_t*>(_aidl_return);
-        *appStatus = lockedCallApp(appId, arg, request, response);
+        DeviceChannel& device = *_devices[_router.Route(uid, appId)];
+        *appStatus = device.CallApp(uid, appId, arg, request, response);
 
         _stats_collection.schedule();
 
         return Status::ok();
     }
 
+    Status callAppAsync(const int32_t _appId, const int32_t _arg,
+                        const std::vector<uint8_t>& request,
+                        const int32_t responseSize,
+                        const sp<ICitadeldCallback>& callback) override {
+        if (callback == nullptr) {
+            return Status::fromExceptionCode(Status::EX_NULL_POINTER);
+        }
+        if (!validateCall(_appId, _arg) || responseSize < 0) {
+            // The caller doesn't see exceptions from oneway calls so the
+            // error is reported through the callback instead
+            callback->onCallAppComplete(APP_ERROR_BOGUS_ARGS, {});
+            return Status::ok();
+        }
+        if (responseSize > kMaxAsyncResponseSize) {
+            callback->onCallAppComplete(APP_ERROR_TOO_MUCH, {});
+            return Status::ok();
+        }
+
+        const uint8_t appId = static_cast<uint32_t>(_appId);
+        const uint16_t arg = static_cast<uint16_t>(_arg);
+        const uid_t uid = IPCThreadState::self()->getCallingUid();
+
+        // Oneway calls are delivered one at a time so make the call on
+        // another thread to let the next one be delivered.
+        const bool queued = _async_calls.Post([=] {
+            std::vector<uint8_t> response;
+            response.reserve(responseSize);
+            DeviceChannel& device = *_devices[_router.Route(uid, appId)];
+            const uint32_t appStatus =
+                    device.CallApp(uid, appId, arg, request, &response);
+            _stats_collection.schedule();
+
+            const Status status = callback->onCallAppComplete(appStatus, response);
+            if (!status.isOk()) {
+                LOG(WARNING) << "Failed to deliver async callApp result: "
+                             << status.toString8();
+            }
+        });
+        if (!queued) {
+            LOG(WARNING) << "Too many async calls waiting; rejecting one from "
+                         << uid;
+            callback->onCallAppComplete(APP_ERROR_BUSY, {});
+        }
+        return Status::ok();
+    }
+
     Status reset(bool* const _aidl_return) override {
         // This doesn't use the transport API to talk to any app so doesn't need
-        // to hold any app locks.
-        const nos_device& device = *_client.Device();
-        *_aidl_return = (device.ops.reset(device.ctx) == 0);
+        // to wait for a turn on the link.
+        const nos_device* device = primary().device();
+        *_aidl_return = device != nullptr && device->ops.reset(device->ctx) == 0;
         return Status::ok();
     }
 
@@ -266,57 +401,185 @@ class CitadelProxy : public BnCitadeld {
         return Status::ok();
     }
 
+    // methods from BBinder
+
+    status_t dump(int fd, const Vector<String16>& /* args */) override {
+        std::stringstream ss;
+        for (const auto& device : _devices) {
+            device->Dump(ss);
+        }
+        return WriteStringToFd(ss.str(), fd) ? OK : android::UNKNOWN_ERROR;
+    }
+
 private:
     static constexpr auto kMaxAppId = std::numeric_limits<uint8_t>::max();
 
-    NuggetClient& _client;
-    std::thread _event_thread;
-    std::mutex _appLocks[kMaxAppId + 1];
-    struct nugget_app_low_power_stats _stats;
-    DeferredCallback _stats_collection;
+    // The last event_record we have handled. Citadel keeps its records until
+    // they are fetched, but if we are killed part way through a batch we may
+    // see some of them again after a restart.
+    struct EventCursor {
+        uint64_t reset_count;
+        uint64_t uptime_usecs;
+        uint64_t events_seen;
+    };
+
+    std::vector<std::unique_ptr<DeviceChannel>>& _devices;
+    DeviceRouter _router;
+    struct nugget_app_low_power_stats _stats = {};
+    EventCursor _event_cursor = {};
     std::mutex _stats_mutex;
+    DeferredCallback _stats_collection;
+    DeferredCallback _checkpoint;
+    WorkQueue _async_calls;
+
+    DeviceChannel& primary() { return *_devices.front(); }
+
+    // AIDL doesn't support integers less than 32-bit so validate them before
+    // casting
+    static bool validateCall(int32_t appId, int32_t arg) {
+        if (appId < 0 || appId > kMaxAppId) {
+            LOG(ERROR) << "App ID " << appId << " is outside the app ID range";
+            return false;
+        }
+        if (arg < 0 || arg > std::numeric_limits<uint16_t>::max()) {
+            LOG(ERROR) << "Argument " << arg
+                       << " is outside the unsigned 16-bit range";
+            return false;
+        }
+        return true;
+    }
 
-    // Make the call to the app while holding the lock for that app
-    uint32_t lockedCallApp(uint32_t appId, uint16_t arg,
+    // Calls made by citadeld itself are accounted against its own UID. All
+    // callers share the device's link so this also serializes calls to each
+    // app.
+    uint32_t lockedCallApp(DeviceChannel& device, uint32_t appId, uint16_t arg,
                            const std::vector<uint8_t>& request,
                            std::vector<uint8_t>* response) {
-        std::unique_lock<std::mutex> lock(_appLocks[appId]);
-        return _client.CallApp(appId, arg, request, response);
+        return device.CallApp(getuid(), appId, arg, request, response);
     }
 
-    void cacheStats(void) {
+    bool cacheStats(void) {
         std::vector<uint8_t> buffer;
 
         buffer.reserve(sizeof(_stats));
-        uint32_t rv = lockedCallApp(APP_ID_NUGGET,
+        uint32_t rv = lockedCallApp(primary(), APP_ID_NUGGET,
                                     NUGGET_PARAM_GET_LOW_POWER_STATS, buffer,
                                     &buffer);
         if (rv == APP_SUCCESS) {
             std::unique_lock<std::mutex> lock(_stats_mutex);
             memcpy(&_stats, buffer.data(),
                    std::min(sizeof(_stats), buffer.size()));
+            _checkpoint.schedule_if_idle();
         }
+        return rv == APP_SUCCESS;
     }
 
-    [[noreturn]] void dispatchEvents(void) {
-        LOG(INFO) << "Event dispatcher startup.";
+    // Reload the state saved by a previous instance of citadeld. It costs a
+    // single transaction to fetch the current stats, which also tells us
+    // whether Citadel has reset since the snapshot was taken and so whether
+    // the rest of it can still be trusted.
+    void restoreState(void) {
+        const bool fresh = cacheStats();
+
+        StateSnapshot snapshot;
+        if (!StateSnapshot::ReadFromFile(STATE_SNAPSHOT_PATH, &snapshot)) {
+            LOG(INFO) << "No usable state snapshot; starting cold";
+            return;
+        }
 
-        const nos_device& device = *_client.Device();
+        std::unique_lock<std::mutex> lock(_stats_mutex);
+        if (!fresh) {
+            // Serving the last stats we saw is better than serving zeros, but
+            // without a reset count we can't trust anything else. The file's
+            // format version was checked when it was read; the stats must also
+            // be the size this build uses and agree with the snapshot's own
+            // reset count.
+            struct nugget_app_low_power_stats stats;
+            if (!snapshot.Get(StateSnapshot::LOW_POWER_STATS, &stats,
+                              sizeof(stats)) ||
+                stats.hard_reset_count != snapshot.resetCount()) {
+                LOG(WARNING) << "Failed to fetch stats and the snapshot's copy "
+                                "doesn't match this build; starting cold";
+                return;
+            }
+            LOG(WARNING) << "Failed to fetch stats; using the snapshot's copy";
+            _stats = stats;
+            return;
+        }
+        if (snapshot.resetCount() != _stats.hard_reset_count) {
+            LOG(INFO) << "Citadel has reset since the state snapshot was taken ("
+                      << snapshot.resetCount() << " -> "
+                      << _stats.hard_reset_count << "); discarding it";
+            return;
+        }
 
-        while (true) {
+        EventCursor cursor;
+        if (snapshot.Get(StateSnapshot::EVENT_CURSOR, &cursor, sizeof(cursor))) {
+            _event_cursor = cursor;
+        }
+        LOG(INFO) << "Restored state snapshot; " << _event_cursor.events_seen
+                  << " events already handled";
+    }
 
-            const int wait_rv = device.ops.wait_for_interrupt(device.ctx, -1);
-            if (wait_rv <= 0) {
+    // Checkpoint the cached state. Called a while after the first change since
+    // the last checkpoint, so a burst of activity only results in one write
+    // and steady activity in one every few seconds rather than none.
+    void saveState(void) {
+        StateSnapshot snapshot;
+        {
+            std::unique_lock<std::mutex> lock(_stats_mutex);
+            snapshot = StateSnapshot(_stats.hard_reset_count);
+            snapshot.Put(StateSnapshot::LOW_POWER_STATS, &_stats, sizeof(_stats));
+            snapshot.Put(StateSnapshot::EVENT_CURSOR, &_event_cursor,
+                         sizeof(_event_cursor));
+        }
+        snapshot.WriteToFile(STATE_SNAPSHOT_PATH);
+    }
+
+    // Returns false if the event was handled before, e.g. by a previous
+    // instance of citadeld that didn't get to the end of a batch.
+    bool advanceEventCursor(const struct event_record& evt) {
+        std::unique_lock<std::mutex> lock(_stats_mutex);
+        if (evt.reset_count == _event_cursor.reset_count &&
+            evt.uptime_usecs <= _event_cursor.uptime_usecs &&
+            _event_cursor.events_seen != 0) {
+            return false;
+        }
+        _event_cursor.reset_count = evt.reset_count;
+        _event_cursor.uptime_usecs = evt.uptime_usecs;
+        _event_cursor.events_seen++;
+        _checkpoint.schedule_if_idle();
+        return true;
+    }
+
+    void dispatchEvents(DeviceChannel& channel) {
+        LOG(INFO) << "Event dispatcher startup for " << channel.name();
+
+        const nos_device& device = *channel.device();
+        // The event cursor is only kept for the primary device
+        const bool isPrimary = &channel == &primary();
+
+        while (!channel.stopping()) {
+
+            // The interrupt ends the wait at once; the timeout only bounds
+            // how long the channel waits for this thread when torn down.
+            const int wait_rv = device.ops.wait_for_interrupt(
+                    device.ctx, kEventWaitTimeoutMs);
+            if (wait_rv == 0) {
+                continue;
+            }
+            if (wait_rv < 0) {
                 LOG(WARNING) << "device.ops.wait_for_interrupt: " << wait_rv;
                 continue;
             }
 
             // CTDL_AP_IRQ is asserted, fetch all the event_records from Citadel
+            size_t recorded = 0;
             while (true) {
                 struct event_record evt;
                 std::vector<uint8_t> buffer;
                 buffer.reserve(sizeof(evt));
-                const uint32_t rv = lockedCallApp(APP_ID_NUGGET,
+                const uint32_t rv = lockedCallApp(channel, APP_ID_NUGGET,
                                                   NUGGET_PARAM_GET_EVENT_RECORD,
                                                   buffer, &buffer);
                 if (rv != APP_SUCCESS) {
@@ -329,18 +592,20 @@ private:
                     break;
                 }
 
-                // TODO(b/34946126): Do something more than just log it
+                // TODO(b/34946126): Do something more than just count it.
+                // The events are formatted when citadeld is dumped.
                 memcpy(&evt, buffer.data(), sizeof(evt));
-                const uint64_t secs = evt.uptime_usecs / 1000000UL;
-                const uint64_t usecs = evt.uptime_usecs - (secs * 1000000UL);
-                LOG(INFO) << std::setfill('0') << std::internal
-                          << "event_record " << evt.reset_count << "/"
-                          << secs << "." << std::setw(6) << usecs
-                          << " " << evt.id
-                          << std::hex
-                          << " 0x" << std::setw(8) << evt.u.raw.w[0]
-                          << " 0x" << std::setw(8) << evt.u.raw.w[1]
-                          << " 0x" << std::setw(8) << evt.u.raw.w[2];
+                if (isPrimary && !advanceEventCursor(evt)) {
+                    continue;
+                }
+                channel.events().Record(evt);
+                recorded++;
+            }
+            // One line per burst, which the back-off below limits to one a
+            // second per device
+            if (recorded != 0) {
+                LOG(INFO) << channel.name() << ": recorded " << recorded
+                          << " event_record(s)";
             }
 
             // TODO: Add a more intelligent back-off (and other action?) here
@@ -353,7 +618,7 @@ private:
             // doesn't actually have any events for us, then a) that's probably
             // a bug, and b) we shouldn't spin madly here just querying it over
             // and over.
-            sleep(1);
+            channel.WaitForStop(1s);
         }
     }
 };
@@ -363,18 +628,45 @@ private:
 int main() {
     LOG(INFO) << "Starting citadeld";
 
+    // init stops us in direct mode but idle rather than exit in case we were
+    // started before that happens, so that we aren't restarted
+    const std::string directOwner = GetProperty(PROPERTY_DIRECT_DEVICE, "");
+    if (!directOwner.empty()) {
+        LOG(ERROR) << "Citadel is owned by " << directOwner
+                   << " directly; not opening it";
+        for (;;) {
+            pause();
+        }
+    }
+
     // Connect to Citadel
-    NuggetClient citadel;
-    citadel.Open();
-    if (!citadel.IsOpen()) {
-        LOG(FATAL) << "Failed to open Citadel client";
+    std::vector<std::unique_ptr<DeviceChannel>> devices;
+    std::vector<std::string> names;
+    for (const std::string& name : Split(GetProperty(PROPERTY_DEVICES, ""), ",")) {
+        if (!Trim(name).empty()) {
+            names.push_back(Trim(name));
+        }
+    }
+    if (names.empty()) {
+        names.push_back("");  // the default device
+    }
+    for (const std::string& name : names) {
+        std::unique_ptr<NuggetClient> citadel(new NuggetClient(name));
+        citadel->Open();
+        if (!citadel->IsOpen()) {
+            // Routes refer to devices by position so they all have to be there
+            LOG(FATAL) << "Failed to open Citadel client for \"" << name << "\"";
+        }
+        const nos_device* device = citadel->Device();
+        devices.emplace_back(new DeviceChannel(
+                name.empty() ? "default" : name, std::move(citadel), device));
     }
 
     // Citadel HALs will communicate with this daemon via /dev/vndbinder as this
     // is vendor code
     ProcessState::initWithDriver("/dev/vndbinder");
 
-    sp<CitadelProxy> proxy = new CitadelProxy(citadel);
+    sp<CitadelProxy> proxy = new CitadelProxy(devices);
     const status_t status = defaultServiceManager()->addService(ICitadeld::descriptor, proxy);
     if (status != OK) {
         LOG(FATAL) << "Failed to register citadeld as a service (status " << status << ")";
@@ -387,10 +679,10 @@ int main() {
     std::function<Status(std::vector<StateResidencyData>*)> fn =
             std::bind(&CitadelProxy::onGetStats, proxy, std::placeholders::_1);
 
-    // Use a separate thread to wait for the powerstats service to appear, so
-    // the Citadel proxy can start working ASAP.
-    std::future<sp<StatsDelegate>> sd =
-            std::async(std::launch::async, StatsDelegate::MakeOne, fn);
+    // The delegate waits for the powerstats service to appear on its own
+    // thread, so the Citadel proxy can start working ASAP.
+    sp<StatsDelegate> sd = new StatsDelegate(fn);
+    sd->start();
 
     // Start handling binder requests with multiple threads
     ProcessState::self()->startThreadPool();
@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <CallScheduler.h>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using ::nos::citadeld::CallScheduler;
+
+namespace {
+
+constexpr uid_t kHeavy = 1001;
+constexpr uid_t kLight = 1002;
+constexpr uid_t kHolder = 1003;
+
+// Holds the link until released so that calls can be queued behind it.
+class LinkHolder {
+  public:
+    explicit LinkHolder(CallScheduler* scheduler)
+            : _thread([this, scheduler] {
+                  scheduler->Run(kHolder, 1, [this] {
+                      std::unique_lock<std::mutex> lock(_mutex);
+                      _holding = true;
+                      _cv.notify_all();
+                      _cv.wait(lock, [this] { return _released; });
+                      return 0u;
+                  });
+              }) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv.wait(lock, [this] { return _holding; });
+    }
+
+    ~LinkHolder() { Release(); }
+
+    void Release() {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _released = true;
+        }
+        _cv.notify_all();
+        if (_thread.joinable()) {
+            _thread.join();
+        }
+    }
+
+  private:
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    bool _holding = false;
+    bool _released = false;
+    std::thread _thread;
+};
+
+// Queues a call of cost 1 for each UID behind one that holds the link, so
+// the order they are dispatched in only depends on their tags, then returns
+// that order.
+std::vector<uid_t> DispatchOrder(CallScheduler* scheduler,
+                                 const std::vector<uid_t>& uids) {
+    LinkHolder holder(scheduler);
+    std::mutex mutex;
+    std::vector<uid_t> order;
+    std::vector<std::thread> callers;
+    for (uid_t uid : uids) {
+        callers.emplace_back([&, uid] {
+            scheduler->Run(uid, 1, [&] {
+                std::unique_lock<std::mutex> lock(mutex);
+                order.push_back(uid);
+                return 0u;
+            });
+        });
+    }
+    while (scheduler->Waiting() < uids.size()) {
+        std::this_thread::yield();
+    }
+    holder.Release();
+    for (auto& caller : callers) {
+        caller.join();
+    }
+    return order;
+}
+
+TEST(CallSchedulerTest, ParseWeights) {
+    CallScheduler scheduler;
+    EXPECT_TRUE(scheduler.ParseWeights("1001:2, 1002:1"));
+    EXPECT_FALSE(scheduler.ParseWeights("1004:0,nope,1005:3"));
+
+    for (uid_t uid : {1001, 1002, 1003, 1004, 1005}) {
+        scheduler.Run(uid, 1, [] { return 0u; });
+    }
+    const auto stats = scheduler.Stats();
+    EXPECT_EQ(stats.at(1001).weight, 2u);
+    EXPECT_EQ(stats.at(1002).weight, 1u);
+    // Unconfigured and malformed entries get the default
+    EXPECT_EQ(stats.at(1003).weight, 1u);
+    EXPECT_EQ(stats.at(1004).weight, 1u);
+    EXPECT_EQ(stats.at(1005).weight, 3u);
+}
+
+TEST(CallSchedulerTest, BackloggedFlowsShareByWeight) {
+    CallScheduler scheduler;
+    // As read from ro.vendor.citadeld.uid_weights
+    ASSERT_TRUE(scheduler.ParseWeights("1001:2,1002:1"));
+
+    const std::vector<uid_t> order = DispatchOrder(
+            &scheduler,
+            {kHeavy, kHeavy, kHeavy, kHeavy, kHeavy, kHeavy,
+             kLight, kLight, kLight});
+
+    // Every three calls, the flow with twice the weight gets two of them.
+    // Calls with the same tag may go in either order.
+    ASSERT_EQ(order.size(), 9u);
+    int heavy = 0;
+    for (size_t i = 0; i < order.size(); ++i) {
+        heavy += order[i] == kHeavy;
+        if (i % 3 == 2) {
+            EXPECT_EQ(heavy, 2 * (int(i) + 1) / 3) << "after " << i + 1;
+        }
+    }
+
+    const auto stats = scheduler.Stats();
+    EXPECT_EQ(stats.at(kHeavy).calls, 6u);
+    EXPECT_EQ(stats.at(kHeavy).cost, 6u);
+    EXPECT_EQ(stats.at(kLight).calls, 3u);
+    EXPECT_EQ(stats.at(kLight).cost, 3u);
+}
+
+TEST(CallSchedulerTest, IdleFlowDoesNotBankCredit) {
+    CallScheduler scheduler;
+    ASSERT_TRUE(scheduler.ParseWeights("1001:2,1002:1"));
+
+    // The light flow has the link to itself for a while first
+    for (int i = 0; i < 10; ++i) {
+        scheduler.Run(kLight, 1, [] { return 0u; });
+    }
+    const std::vector<uid_t> order = DispatchOrder(
+            &scheduler,
+            {kHeavy, kHeavy, kHeavy, kHeavy, kHeavy, kHeavy,
+             kLight, kLight, kLight});
+
+    // The heavy flow's time idle doesn't let it run all of its calls first;
+    // the light flow still gets its share after one call of its own.
+    ASSERT_EQ(order.size(), 9u);
+    const auto light = std::find(order.begin(), order.end(), kLight);
+    EXPECT_LE(light - order.begin(), 3);
+}
+
+}  // namespace
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <nos/CitadeldProxyClient.h>
+#include <WorkQueue.h>
+
+#include <android/hardware/citadel/BnCitadeld.h>
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+
+using ::android::sp;
+using ::android::binder::Status;
+using ::android::hardware::citadel::BnCitadeld;
+using ::android::hardware::citadel::ICitadeldCallback;
+
+using ::nos::CitadeldProxyClient;
+using ::nos::citadeld::WorkQueue;
+
+using namespace std::chrono_literals;
+
+namespace {
+
+// The response echoes the request and the app status is the app ID. Calls
+// don't complete until the given future is ready, if there is one.
+class FakeCitadeld : public BnCitadeld {
+  public:
+    explicit FakeCitadeld(std::shared_future<void> released = {})
+            : _released(released), _calls(1) {}
+
+    Status callApp(int32_t appId, int32_t /* arg */,
+                   const std::vector<uint8_t>& request,
+                   std::vector<uint8_t>* response,
+                   int32_t* _aidl_return) override {
+        if (_released.valid()) {
+            _released.wait();
+        }
+        response->assign(request.begin(), request.end());
+        *_aidl_return = appId;
+        return Status::ok();
+    }
+
+    Status callAppAsync(int32_t appId, int32_t arg,
+                        const std::vector<uint8_t>& request,
+                        int32_t /* responseSize */,
+                        const sp<ICitadeldCallback>& callback) override {
+        _calls.Post([=] {
+            std::vector<uint8_t> response;
+            int32_t appStatus;
+            callApp(appId, arg, request, &response, &appStatus);
+            callback->onCallAppComplete(appStatus, response);
+        });
+        return Status::ok();
+    }
+
+    Status reset(bool* _aidl_return) override {
+        *_aidl_return = true;
+        return Status::ok();
+    }
+
+    Status getCachedStats(std::vector<uint8_t>* response) override {
+        response->clear();
+        return Status::ok();
+    }
+
+  private:
+    std::shared_future<void> _released;
+    WorkQueue _calls;
+};
+
+TEST(CitadeldAsyncTest, FutureDeliversResult) {
+    CitadeldProxyClient client(new FakeCitadeld);
+    auto result = client.CallAppAsync(7, 0, {4, 5, 6}, 16);
+    ASSERT_EQ(result.wait_for(1s), std::future_status::ready);
+    const CitadeldProxyClient::CallAppResult r = result.get();
+    EXPECT_EQ(r.appStatus, 7u);
+    EXPECT_EQ(r.response, (std::vector<uint8_t>{4, 5, 6}));
+}
+
+TEST(CitadeldAsyncTest, CallbackRunsOnce) {
+    CitadeldProxyClient client(new FakeCitadeld);
+    std::promise<uint32_t> done;
+    client.CallAppAsync(3, 0, {}, 0,
+                        [&](uint32_t appStatus, const std::vector<uint8_t>&) {
+                            done.set_value(appStatus);
+                        });
+    auto status = done.get_future();
+    ASSERT_EQ(status.wait_for(1s), std::future_status::ready);
+    EXPECT_EQ(status.get(), 3u);
+}
+
+TEST(CitadeldAsyncTest, ReturnsBeforeTheCallCompletes) {
+    // The device doesn't answer until the caller has carried on
+    std::promise<void> carriedOn;
+    std::shared_future<void> released = carriedOn.get_future().share();
+    CitadeldProxyClient client(new FakeCitadeld(released));
+
+    auto result = client.CallAppAsync(2, 0, {1}, 16);
+    EXPECT_EQ(result.wait_for(0s), std::future_status::timeout);
+    carriedOn.set_value();
+    ASSERT_EQ(result.wait_for(1s), std::future_status::ready);
+    EXPECT_EQ(result.get().appStatus, 2u);
+}
+
+TEST(WorkQueueTest, PendingWorkIsBounded) {
+    WorkQueue queue(1, 1);
+    std::promise<void> started;
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    ASSERT_TRUE(queue.Post([&] {
+        started.set_value();
+        released.wait();
+    }));
+    started.get_future().wait();
+
+    // The one thread is busy so one more may wait, but no more than that
+    int ran = 0;
+    EXPECT_TRUE(queue.Post([&] { ran++; }));
+    EXPECT_FALSE(queue.Post([&] { ran++; }));
+    release.set_value();
+    // Wait for the queued work to drain
+    std::promise<void> drained;
+    while (!queue.Post([&] { drained.set_value(); })) {
+        std::this_thread::yield();
+    }
+    drained.get_future().wait();
+    EXPECT_EQ(ran, 1);
+}
+
+} // namespace
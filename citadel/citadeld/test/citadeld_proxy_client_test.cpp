@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <nos/CitadeldProxyClient.h>
+
+#include <binder/Binder.h>
+#include <binder/Parcel.h>
+
+#include <application.h>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+using ::android::BBinder;
+using ::android::IBinder;
+using ::android::Parcel;
+using ::android::sp;
+using ::android::status_t;
+
+using ::android::hardware::citadel::ICitadeld;
+
+using ::nos::CitadeldProxyClient;
+
+namespace {
+
+// Unmarshals callApp() by hand, checking the request the way the generated
+// stub does. The app status is the app ID and the response echoes as much of
+// the request as fits.
+class EchoCitadeld : public BBinder {
+  public:
+    // Act as if the process hosting this has died
+    void Kill() { _dead = true; }
+
+    uint32_t calls() const { return _calls; }
+    int32_t lastRequestLen() const { return _lastRequestLen; }
+
+  protected:
+    status_t onTransact(uint32_t code, const Parcel& data, Parcel* reply,
+                        uint32_t flags) override {
+        if (_dead) {
+            return ::android::DEAD_OBJECT;
+        }
+        if (code != IBinder::FIRST_CALL_TRANSACTION) {
+            return BBinder::onTransact(code, data, reply, flags);
+        }
+        _calls++;
+        if (!data.enforceInterface(ICitadeld::descriptor)) {
+            return ::android::PERMISSION_DENIED;
+        }
+        const int32_t appId = data.readInt32();
+        data.readInt32();  // arg
+        const int32_t requestLen = data.readInt32();
+        _lastRequestLen = requestLen;
+        // A null array, which the stub rejects for a vector<byte>
+        if (requestLen < 0) {
+            return ::android::UNEXPECTED_NULL;
+        }
+        const void* request = data.readInplace(requestLen);
+        const int32_t capacity = data.readInt32();
+
+        reply->writeNoException();
+        reply->writeInt32(appId);
+        return reply->writeByteArray(std::min(requestLen, capacity),
+                                     static_cast<const uint8_t*>(request));
+    }
+
+  private:
+    std::atomic<bool> _dead{false};
+    std::atomic<uint32_t> _calls{0};
+    std::atomic<int32_t> _lastRequestLen{0};
+};
+
+// Hands out whichever citadeld was published last.
+class FakeServiceManager {
+  public:
+    sp<IBinder> CheckService() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _service;
+    }
+
+    void AddService(const sp<IBinder>& service) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _service = service;
+    }
+
+  private:
+    std::mutex _mutex;
+    sp<IBinder> _service;
+};
+
+class CitadeldProxyClientTest : public testing::Test {
+  protected:
+    CitadeldProxyClientTest()
+        : citadeld(new EchoCitadeld),
+          client(ICitadeld::asInterface(sp<IBinder>(citadeld))) {}
+
+    sp<EchoCitadeld> citadeld;
+    CitadeldProxyClient client;
+};
+
+TEST_F(CitadeldProxyClientTest, BufferCallEchoes) {
+    const uint8_t request[] = {1, 2, 3, 4, 5};
+    uint8_t response[3];
+    uint32_t responseLen = sizeof(response);
+    EXPECT_EQ(client.CallApp(7, 0, request, sizeof(request), response,
+                             &responseLen), 7u);
+    ASSERT_EQ(responseLen, 3u);
+    EXPECT_EQ(memcmp(response, request, responseLen), 0);
+}
+
+TEST_F(CitadeldProxyClientTest, EmptyRequestIsAnEmptyArray) {
+    EXPECT_EQ(client.CallApp(8, 0, nullptr, 0, nullptr, nullptr), 8u);
+    EXPECT_EQ(citadeld->lastRequestLen(), 0);
+
+    std::vector<uint8_t> response;
+    EXPECT_EQ(client.CallApp(9, 0, std::vector<uint8_t>{}, &response), 9u);
+    EXPECT_EQ(citadeld->lastRequestLen(), 0);
+    EXPECT_TRUE(response.empty());
+}
+
+TEST_F(CitadeldProxyClientTest, VectorCallKeepsCallerStorage) {
+    std::vector<uint8_t> buffer = {9, 8, 7};
+    buffer.reserve(64);
+    const uint8_t* const storage = buffer.data();
+
+    // The same vector is used for the request and the response
+    EXPECT_EQ(client.CallApp(3, 0, buffer, &buffer), 3u);
+    EXPECT_EQ(buffer, (std::vector<uint8_t>{9, 8, 7}));
+    EXPECT_EQ(buffer.data(), storage);
+}
+
+class CitadeldProxyClientReconnectTest : public testing::Test {
+  protected:
+    CitadeldProxyClientReconnectTest()
+        : first(new EchoCitadeld),
+          client([this] { return serviceManager.CheckService(); }) {
+        serviceManager.AddService(first);
+        // Pretend app 1 is read-only
+        client.SetIdempotentCalls(
+                [](uint32_t appId, uint16_t /* arg */) { return appId == 1; });
+        client.Open();
+    }
+
+    // Kill the current citadeld and publish a new one
+    sp<EchoCitadeld> Restart() {
+        sp<EchoCitadeld> second = new EchoCitadeld;
+        serviceManager.AddService(second);
+        first->Kill();
+        return second;
+    }
+
+    FakeServiceManager serviceManager;
+    sp<EchoCitadeld> first;
+    CitadeldProxyClient client;
+};
+
+TEST_F(CitadeldProxyClientReconnectTest, IdempotentCallIsRetried) {
+    ASSERT_TRUE(client.IsOpen());
+    std::vector<uint8_t> response;
+    response.reserve(8);
+    EXPECT_EQ(client.CallApp(1, 0, {1}, &response), 1u);
+    EXPECT_EQ(client.Reconnects(), 0u);
+
+    sp<EchoCitadeld> second = Restart();
+    EXPECT_EQ(client.CallApp(1, 0, {1}, &response), 1u);
+    EXPECT_EQ(second->calls(), 1u);
+    EXPECT_EQ(client.Reconnects(), 1u);
+    EXPECT_GT(client.LastReconnectLatency(),
+              std::chrono::steady_clock::duration::zero());
+}
+
+TEST_F(CitadeldProxyClientReconnectTest, OtherCallsAreNotRetried) {
+    std::vector<uint8_t> response;
+    response.reserve(8);
+    sp<EchoCitadeld> second = Restart();
+    EXPECT_EQ(client.CallApp(2, 0, {1}, &response), APP_ERROR_IO);
+    EXPECT_EQ(second->calls(), 0u);
+
+    // Later calls wait for the reconnection rather than failing
+    EXPECT_EQ(client.CallApp(2, 0, {1}, &response), 2u);
+    EXPECT_EQ(second->calls(), 1u);
+    EXPECT_EQ(client.Reconnects(), 1u);
+}
+
+} // namespace
@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <DeviceChannel.h>
+#include <DeviceRouter.h>
+
+#include <nos/NuggetClientInterface.h>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using ::nos::NuggetClientInterface;
+using ::nos::citadeld::DeviceChannel;
+using ::nos::citadeld::DeviceRouter;
+
+using namespace std::chrono_literals;
+
+namespace {
+
+// Stands in for a device where only one transaction can be on the link at a
+// time. Each call waits for the gate, if there is one, before completing.
+class SimulatedDevice : public NuggetClientInterface {
+  public:
+    explicit SimulatedDevice(std::function<void()> gate = nullptr)
+            : _gate(std::move(gate)) {}
+    ~SimulatedDevice() override = default;
+
+    void Open() override {}
+    void Close() override {}
+    bool IsOpen() const override { return true; }
+    uint32_t CallApp(uint32_t /* appId */, uint16_t /* arg */,
+                     const std::vector<uint8_t>& /* request */,
+                     std::vector<uint8_t>* /* response */) override {
+        if (_active.fetch_add(1) != 0) {
+            _overlapped = true;
+        }
+        if (_gate) {
+            _gate();
+        } else {
+            std::this_thread::yield();
+        }
+        _active--;
+        _calls++;
+        return 0;
+    }
+
+    uint64_t calls() const { return _calls; }
+    bool overlapped() const { return _overlapped; }
+
+  private:
+    const std::function<void()> _gate;
+    std::atomic<int> _active{0};
+    std::atomic<uint64_t> _calls{0};
+    std::atomic<bool> _overlapped{false};
+};
+
+std::vector<std::unique_ptr<DeviceChannel>> MakeDevices(
+        size_t count, std::vector<SimulatedDevice*>* sims,
+        std::function<void()> gate = nullptr) {
+    std::vector<std::unique_ptr<DeviceChannel>> devices;
+    for (size_t i = 0; i < count; ++i) {
+        SimulatedDevice* sim = new SimulatedDevice(gate);
+        sims->push_back(sim);
+        devices.emplace_back(new DeviceChannel(
+                "sim" + std::to_string(i),
+                std::unique_ptr<NuggetClientInterface>(sim)));
+    }
+    return devices;
+}
+
+// Each device has two callers pinned to it that each make the given number of
+// calls back to back.
+void RunCalls(std::vector<std::unique_ptr<DeviceChannel>>& devices,
+              int callsPerCaller) {
+    constexpr size_t kCallersPerDevice = 2;
+    DeviceRouter router(devices.size());
+    for (size_t i = 0; i < devices.size() * kCallersPerDevice; ++i) {
+        EXPECT_TRUE(router.RouteUid(1000 + i, i % devices.size()));
+    }
+
+    std::vector<std::thread> callers;
+    for (size_t i = 0; i < devices.size() * kCallersPerDevice; ++i) {
+        callers.emplace_back([&, i] {
+            const uid_t uid = 1000 + i;
+            const std::vector<uint8_t> request(32);
+            for (int call = 0; call < callsPerCaller; ++call) {
+                std::vector<uint8_t> response;
+                devices[router.Route(uid, 0)]->CallApp(uid, 0, 0, request,
+                                                       &response);
+            }
+        });
+    }
+    for (auto& caller : callers) {
+        caller.join();
+    }
+}
+
+TEST(DeviceRouterTest, UidRouteWinsOverAppRoute) {
+    DeviceRouter router(3);
+    ASSERT_TRUE(router.ParseRoutes("app:2=1, uid:1000=2"));
+    EXPECT_EQ(router.Route(1000, 2), 2u);
+    EXPECT_EQ(router.Route(1001, 2), 1u);
+    EXPECT_EQ(router.Route(1001, 3), 0u);
+}
+
+TEST(DeviceRouterTest, InvalidRoutesAreIgnored) {
+    DeviceRouter router(2);
+    EXPECT_FALSE(router.ParseRoutes("app:1=2,uid:5,pid:1=1,app:x=1,app:4=1"));
+    EXPECT_EQ(router.Route(0, 1), 0u);
+    EXPECT_EQ(router.Route(5, 0), 0u);
+    EXPECT_EQ(router.Route(0, 4), 1u);
+}
+
+TEST(DeviceChannelTest, CallsOnOneDeviceAreSerialized) {
+    std::vector<SimulatedDevice*> sims;
+    auto devices = MakeDevices(4, &sims);
+    RunCalls(devices, 50);
+
+    for (size_t i = 0; i < devices.size(); ++i) {
+        EXPECT_FALSE(sims[i]->overlapped()) << devices[i]->name();
+        EXPECT_EQ(sims[i]->calls(), 2u * 50) << devices[i]->name();
+    }
+}
+
+TEST(DeviceChannelTest, DevicesRunCallsInParallel) {
+    constexpr size_t kDevices = 4;
+    // Each device's first call waits for a call to be in flight on every
+    // device, which only happens if calls to different devices don't wait
+    // for each other. The timeout is only reached if they do.
+    std::mutex mutex;
+    std::condition_variable arrived;
+    size_t waiting = 0;
+    bool together = false;
+    auto gate = [&] {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (++waiting == kDevices) {
+            together = true;
+            arrived.notify_all();
+        }
+        arrived.wait_for(lock, 10s, [&] { return together; });
+    };
+    std::vector<SimulatedDevice*> sims;
+    auto devices = MakeDevices(kDevices, &sims, gate);
+    RunCalls(devices, 1);
+
+    EXPECT_TRUE(together);
+    for (size_t i = 0; i < devices.size(); ++i) {
+        EXPECT_FALSE(sims[i]->overlapped()) << devices[i]->name();
+    }
+}
+
+TEST(DeviceChannelTest, DestructionStopsIoThread) {
+    std::atomic<bool> returned{false};
+    {
+        DeviceChannel channel("sim", std::unique_ptr<NuggetClientInterface>(
+                                             new SimulatedDevice()));
+        channel.StartIoThread([&](DeviceChannel& self) {
+            while (!self.WaitForStop(1h)) {
+            }
+            returned = true;
+        });
+        EXPECT_FALSE(channel.stopping());
+    }
+    EXPECT_TRUE(returned);
+}
+
+} // namespace
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <nos/DirectDeviceClient.h>
+
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using ::nos::DirectDeviceClient;
+using ::nos::MakeCitadelClient;
+using ::nos::NuggetClientInterface;
+using ::nos::UseDirectDevice;
+
+using namespace std::chrono_literals;
+
+namespace {
+
+// Notices if a second call reaches the device while one is in progress.
+class ExclusiveDevice : public NuggetClientInterface {
+  public:
+    ExclusiveDevice(std::atomic<bool>* overlapped, std::atomic<int>* calls)
+            : _overlapped(overlapped), _calls(calls) {}
+
+    void Open() override { _open = true; }
+    void Close() override { _open = false; }
+    bool IsOpen() const override { return _open; }
+    uint32_t CallApp(uint32_t appId, uint16_t /* arg */,
+                     const std::vector<uint8_t>& request,
+                     std::vector<uint8_t>* response) override {
+        if (_active.fetch_add(1) != 0) {
+            *_overlapped = true;
+        }
+        std::this_thread::sleep_for(100us);
+        if (response != nullptr) {
+            *response = request;
+        }
+        _active--;
+        (*_calls)++;
+        return appId;
+    }
+
+  private:
+    std::atomic<bool>* const _overlapped;
+    std::atomic<int>* const _calls;
+    std::atomic<int> _active{0};
+    bool _open = false;
+};
+
+TEST(DirectDeviceClientTest, CallsAreSerialized) {
+    std::atomic<bool> overlapped{false};
+    std::atomic<int> calls{0};
+    DirectDeviceClient client(std::unique_ptr<NuggetClientInterface>(
+            new ExclusiveDevice(&overlapped, &calls)));
+    client.Open();
+    ASSERT_TRUE(client.IsOpen());
+
+    constexpr int kThreads = 4;
+    constexpr int kCallsPerThread = 50;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&client, t] {
+            for (int i = 0; i < kCallsPerThread; ++i) {
+                std::vector<uint8_t> response;
+                EXPECT_EQ(client.CallApp(t, 0, {uint8_t(i)}, &response),
+                          uint32_t(t));
+                EXPECT_EQ(response, std::vector<uint8_t>{uint8_t(i)});
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_FALSE(overlapped);
+    EXPECT_EQ(calls, kThreads * kCallsPerThread);
+    client.Close();
+    EXPECT_FALSE(client.IsOpen());
+}
+
+TEST(DirectDeviceClientTest, EnvironmentSelectsClient) {
+    setenv("NOS_DIRECT_DEVICE", "1", 1);
+    EXPECT_TRUE(UseDirectDevice("keymaster"));
+    std::unique_ptr<NuggetClientInterface> client =
+            MakeCitadelClient("keymaster");
+    EXPECT_NE(dynamic_cast<DirectDeviceClient*>(client.get()), nullptr);
+
+    // The property doesn't name an owner in tests so this falls back to
+    // citadeld
+    setenv("NOS_DIRECT_DEVICE", "0", 1);
+    EXPECT_FALSE(UseDirectDevice("keymaster"));
+    unsetenv("NOS_DIRECT_DEVICE");
+    EXPECT_FALSE(UseDirectDevice("keymaster"));
+}
+
+} // namespace
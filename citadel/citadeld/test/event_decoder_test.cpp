@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <EventDecoder.h>
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <sstream>
+#include <string>
+
+using ::nos::citadeld::EventDecoder;
+
+namespace {
+
+struct event_record MakeEvent(uint32_t id, uint64_t uptime_usecs,
+                              uint32_t w0 = 0) {
+    struct event_record evt;
+    memset(&evt, 0, sizeof(evt));
+    evt.reset_count = 3;
+    evt.uptime_usecs = uptime_usecs;
+    evt.id = id;
+    evt.u.raw.w[0] = w0;
+    return evt;
+}
+
+TEST(EventDecoderTest, DecodesKnownTypes) {
+    const EventDecoder::DecodedEvent evt =
+            EventDecoder::Decode(MakeEvent(EVENT_ALERT, 1500000, 0x80));
+    ASSERT_NE(evt.type, nullptr);
+    EXPECT_EQ(std::string(evt.type->name), "alert");
+    EXPECT_EQ(evt.fields[0], 0x80u);
+
+    std::ostringstream out;
+    EventDecoder::Format(evt, out);
+    EXPECT_EQ(out.str(), "event_record 3/1.500000 alert intr_sts0=0x00000080 "
+                         "intr_sts1=0x00000000 intr_sts2=0x00000000");
+}
+
+TEST(EventDecoderTest, UnknownTypesAreKept) {
+    EventDecoder decoder;
+    const EventDecoder::DecodedEvent evt = decoder.Record(MakeEvent(1234, 1));
+    EXPECT_EQ(evt.type, nullptr);
+    EXPECT_EQ(decoder.Stats()[1234].count, 1u);
+
+    std::ostringstream out;
+    EventDecoder::Format(evt, out);
+    EXPECT_NE(out.str().find("unknown(1234)"), std::string::npos);
+}
+
+TEST(EventDecoderTest, CountsPerType) {
+    EventDecoder decoder;
+    for (uint64_t i = 0; i < 100; ++i) {
+        decoder.Record(MakeEvent(EVENT_ALERT, i));
+    }
+    decoder.Record(MakeEvent(EVENT_REBOOTED, 200));
+
+    auto stats = decoder.Stats();
+    EXPECT_EQ(stats.size(), 2u);
+    EXPECT_EQ(stats[EVENT_ALERT].count, 100u);
+    EXPECT_EQ(stats[EVENT_ALERT].last_uptime_usecs, 99u);
+    EXPECT_EQ(stats[EVENT_REBOOTED].count, 1u);
+    EXPECT_EQ(stats[EVENT_REBOOTED].last_reset_count, 3u);
+}
+
+TEST(EventDecoderTest, DumpShowsOnlyRecentEvents) {
+    EventDecoder decoder;
+    for (uint64_t i = 0; i < EventDecoder::kRecentEvents + 5; ++i) {
+        decoder.Record(MakeEvent(EVENT_ALERT, i * 1000000));
+    }
+
+    std::ostringstream out;
+    decoder.Dump(out);
+    const std::string dump = out.str();
+    // The oldest events have been dropped and the newest is last
+    EXPECT_EQ(dump.find("3/4.000000 alert"), std::string::npos);
+    EXPECT_NE(dump.find("3/5.000000 alert"), std::string::npos);
+    EXPECT_NE(dump.find("3/36.000000 alert"), std::string::npos);
+    EXPECT_LT(dump.find("3/5.000000 alert"), dump.find("3/36.000000 alert"));
+}
+
+} // namespace
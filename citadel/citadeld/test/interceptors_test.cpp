@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <nos/Interceptors.h>
+
+#include <application.h>
+#include <nos/NuggetClientInterface.h>
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <deque>
+#include <string>
+#include <vector>
+
+using ::nos::FaultInjectionInterceptor;
+using ::nos::Intercept;
+using ::nos::MakeCacheInterceptor;
+using ::nos::NuggetClientInterface;
+using ::nos::RateLimitInterceptor;
+using ::nos::RetryInterceptor;
+using ::nos::TimingInterceptor;
+
+using namespace std::chrono_literals;
+
+namespace {
+
+// Replies with queued statuses, then success, echoing the request.
+class ScriptedDevice : public NuggetClientInterface {
+  public:
+    void Open() override {}
+    void Close() override {}
+    bool IsOpen() const override { return true; }
+    uint32_t CallApp(uint32_t /* appId */, uint16_t /* arg */,
+                     const std::vector<uint8_t>& request,
+                     std::vector<uint8_t>* response) override {
+        calls++;
+        if (response != nullptr) {
+            *response = request;
+        }
+        if (statuses.empty()) {
+            return APP_SUCCESS;
+        }
+        const uint32_t status = statuses.front();
+        statuses.pop_front();
+        return status;
+    }
+
+    std::deque<uint32_t> statuses;
+    uint32_t calls = 0;
+};
+
+// Records the order in which it sees calls go in and out.
+class Recorder {
+  public:
+    Recorder(char name, std::string* log) : _name(name), _log(log) {}
+
+    template <typename Next>
+    uint32_t CallApp(uint32_t appId, uint16_t arg,
+                     const std::vector<uint8_t>& request,
+                     std::vector<uint8_t>* response, Next&& next) {
+        _log->push_back(_name);
+        const uint32_t status = next(appId, arg, request, response);
+        _log->push_back(_name);
+        return status;
+    }
+
+  private:
+    char _name;
+    std::string* _log;
+};
+
+TEST(InterceptorsTest, EmptyChainCallsClient) {
+    ScriptedDevice device;
+    auto client = Intercept(device);
+    std::vector<uint8_t> response;
+    EXPECT_EQ(client.CallApp(1, 2, {3}, &response), APP_SUCCESS);
+    EXPECT_EQ(response, std::vector<uint8_t>{3});
+    EXPECT_EQ(device.calls, 1u);
+}
+
+TEST(InterceptorsTest, FirstInterceptorIsOutermost) {
+    ScriptedDevice device;
+    std::string log;
+    auto client = Intercept(device, Recorder('a', &log), Recorder('b', &log));
+    client.CallApp(1, 0, {}, nullptr);
+    EXPECT_EQ(log, "abba");
+}
+
+TEST(InterceptorsTest, BusyCallsAreRetried) {
+    ScriptedDevice device;
+    auto client = Intercept(device, TimingInterceptor(1s),
+                            RetryInterceptor(3, 1ms));
+    device.statuses = {APP_ERROR_BUSY, APP_ERROR_BUSY};
+    EXPECT_EQ(client.CallApp(1, 0, {}, nullptr), APP_SUCCESS);
+    EXPECT_EQ(device.calls, 3u);
+    // Timing is outside the retries so sees one call
+    EXPECT_EQ(client.interceptor<0>().calls(), 1u);
+
+    // Other errors and exhausted retries are returned
+    device.statuses = {APP_ERROR_INTERNAL};
+    EXPECT_EQ(client.CallApp(1, 0, {}, nullptr), APP_ERROR_INTERNAL);
+    device.statuses = {APP_ERROR_BUSY, APP_ERROR_BUSY, APP_ERROR_BUSY};
+    EXPECT_EQ(client.CallApp(1, 0, {}, nullptr), APP_ERROR_BUSY);
+    EXPECT_EQ(device.calls, 7u);
+}
+
+TEST(InterceptorsTest, FaultsAreInjected) {
+    ScriptedDevice device;
+    auto client = Intercept(device, FaultInjectionInterceptor(3));
+    uint32_t failures = 0;
+    for (int i = 0; i < 9; ++i) {
+        failures += client.CallApp(1, 0, {}, nullptr) == APP_ERROR_IO;
+    }
+    EXPECT_EQ(failures, 3u);
+    EXPECT_EQ(device.calls, 6u);
+}
+
+TEST(InterceptorsTest, CacheableResponsesAreReused) {
+    ScriptedDevice device;
+    auto client = Intercept(device, MakeCacheInterceptor(
+            [](uint32_t /* appId */, uint16_t arg) { return arg == 1; }));
+    std::vector<uint8_t> response;
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_EQ(client.CallApp(1, 1, {5}, &response), APP_SUCCESS);
+        EXPECT_EQ(response, std::vector<uint8_t>{5});
+    }
+    EXPECT_EQ(device.calls, 1u);
+
+    // Different requests and uncacheable calls reach the device
+    client.CallApp(1, 1, {6}, &response);
+    client.CallApp(1, 2, {5}, &response);
+    client.CallApp(1, 2, {5}, &response);
+    EXPECT_EQ(device.calls, 4u);
+}
+
+TEST(InterceptorsTest, CallsAreSpacedOut) {
+    ScriptedDevice device;
+    auto client = Intercept(device, RateLimitInterceptor(5ms));
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 5; ++i) {
+        client.CallApp(1, 0, {}, nullptr);
+    }
+    EXPECT_GE(std::chrono::steady_clock::now() - start, 20ms);
+}
+
+} // namespace
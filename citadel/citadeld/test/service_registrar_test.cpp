@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <ServiceRegistrar.h>
+
+#include <binder/Binder.h>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+using ::android::BBinder;
+using ::android::IBinder;
+using ::android::sp;
+
+using ::nos::citadeld::ServiceRegistrar;
+
+using namespace std::chrono_literals;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Stands in for the service manager and counts how often it is asked for the
+// service, so the tests can tell the registrar has looked and not found it.
+class FakeServiceManager {
+  public:
+    sp<IBinder> CheckService() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _checks++;
+        _cv.notify_all();
+        return _service;
+    }
+
+    void AddService(const sp<IBinder>& service) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _service = service;
+    }
+
+    void RemoveService() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _service.clear();
+    }
+
+    int checks() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _checks;
+    }
+
+    // Wait until the service has been asked for count times in all
+    bool WaitForChecks(int count) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _cv.wait_for(lock, 5s, [&] { return _checks >= count; });
+    }
+
+  private:
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    sp<IBinder> _service;
+    int _checks = 0;
+};
+
+// Records what the service was registered with
+class RegistrationLog {
+  public:
+    bool Register(const sp<IBinder>& service) {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _service = service;
+            _count++;
+        }
+        _cv.notify_all();
+        return true;
+    }
+
+    // Wait for the count'th registration
+    bool WaitFor(int count) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _cv.wait_for(lock, 5s, [&] { return _count >= count; });
+    }
+
+    int count() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _count;
+    }
+
+    sp<IBinder> service() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _service;
+    }
+
+  private:
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    sp<IBinder> _service;
+    int _count = 0;
+};
+
+// The registrar counts a registration once the register function has
+// returned, so just after the log sees it the count may still be behind.
+uint64_t SettledRegistrations(const ServiceRegistrar& registrar,
+                              uint64_t expected) {
+    const Clock::time_point deadline = Clock::now() + 5s;
+    while (registrar.registrations() < expected && Clock::now() < deadline) {
+        std::this_thread::yield();
+    }
+    return registrar.registrations();
+}
+
+} // namespace
+
+TEST(ServiceRegistrarTest, registersOnceServiceIsPublished) {
+    FakeServiceManager sm;
+    RegistrationLog log;
+    ServiceRegistrar registrar(
+            [&] { return sm.CheckService(); },
+            [&](const sp<IBinder>& s) { return log.Register(s); });
+    registrar.RequestRegistration();
+
+    // Looked for more than once and not found, so nothing is registered
+    ASSERT_TRUE(sm.WaitForChecks(2));
+    EXPECT_EQ(log.count(), 0);
+
+    const sp<IBinder> service = new BBinder();
+    sm.AddService(service);
+    ASSERT_TRUE(log.WaitFor(1));
+    EXPECT_EQ(log.service(), service);
+    EXPECT_EQ(SettledRegistrations(registrar, 1), 1u);
+}
+
+TEST(ServiceRegistrarTest, reregistersAfterServiceRestart) {
+    FakeServiceManager sm;
+    RegistrationLog log;
+    ServiceRegistrar registrar(
+            [&] { return sm.CheckService(); },
+            [&](const sp<IBinder>& s) { return log.Register(s); });
+    sm.AddService(new BBinder());
+    registrar.RequestRegistration();
+    ASSERT_TRUE(log.WaitFor(1));
+
+    // Simulate the service dying and binderDied() asking to re-register
+    sm.RemoveService();
+    const int checks = sm.checks();
+    registrar.RequestRegistration();
+    ASSERT_TRUE(sm.WaitForChecks(checks + 2));
+    EXPECT_EQ(log.count(), 1);
+
+    const sp<IBinder> restarted = new BBinder();
+    sm.AddService(restarted);
+    ASSERT_TRUE(log.WaitFor(2));
+    EXPECT_EQ(log.service(), restarted);
+    EXPECT_EQ(SettledRegistrations(registrar, 2), 2u);
+}
+
+TEST(ServiceRegistrarTest, retriesWhenRegistrationIsRejected) {
+    FakeServiceManager sm;
+    std::atomic<int> attempts{0};
+    RegistrationLog log;
+    ServiceRegistrar registrar(
+            [&] { return sm.CheckService(); },
+            [&](const sp<IBinder>& s) {
+                return ++attempts < 3 ? false : log.Register(s);
+            });
+    sm.AddService(new BBinder());
+    registrar.RequestRegistration();
+
+    ASSERT_TRUE(log.WaitFor(1));
+    EXPECT_EQ(attempts, 3);
+    EXPECT_EQ(SettledRegistrations(registrar, 1), 1u);
+}
+
+TEST(ServiceRegistrarTest, destructionStopsLookingUp) {
+    FakeServiceManager sm;
+    {
+        ServiceRegistrar registrar(
+                [&] { return sm.CheckService(); },
+                [](const sp<IBinder>&) { return true; });
+        registrar.RequestRegistration();
+        ASSERT_TRUE(sm.WaitForChecks(2));
+    }
+    const int checks = sm.checks();
+
+    // Nothing is left polling on behalf of the registrar
+    std::this_thread::sleep_for(20ms);
+    EXPECT_EQ(sm.checks(), checks);
+}
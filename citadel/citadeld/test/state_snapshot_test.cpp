@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <StateSnapshot.h>
+
+#include <android-base/file.h>
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <vector>
+
+using ::nos::citadeld::StateSnapshot;
+
+namespace {
+
+struct Cursor {
+    uint64_t reset_count;
+    uint64_t uptime_usecs;
+};
+
+StateSnapshot MakeSnapshot() {
+    StateSnapshot snapshot(7);
+    const Cursor cursor{7, 123456};
+    const uint32_t stats[4] = {1, 2, 3, 4};
+    snapshot.Put(StateSnapshot::EVENT_CURSOR, &cursor, sizeof(cursor));
+    snapshot.Put(StateSnapshot::LOW_POWER_STATS, stats, sizeof(stats));
+    return snapshot;
+}
+
+TEST(StateSnapshotTest, RoundTrip) {
+    StateSnapshot parsed;
+    ASSERT_TRUE(StateSnapshot::Parse(MakeSnapshot().Serialize(), &parsed));
+    EXPECT_EQ(parsed.resetCount(), 7u);
+
+    Cursor cursor;
+    ASSERT_TRUE(parsed.Get(StateSnapshot::EVENT_CURSOR, &cursor, sizeof(cursor)));
+    EXPECT_EQ(cursor.reset_count, 7u);
+    EXPECT_EQ(cursor.uptime_usecs, 123456u);
+
+    uint32_t stats[4];
+    ASSERT_TRUE(parsed.Get(StateSnapshot::LOW_POWER_STATS, stats, sizeof(stats)));
+    EXPECT_EQ(stats[3], 4u);
+}
+
+TEST(StateSnapshotTest, SizeMismatchIsRejected) {
+    // A section from a build with a different struct layout isn't used
+    uint64_t smaller;
+    EXPECT_FALSE(MakeSnapshot().Get(StateSnapshot::EVENT_CURSOR, &smaller,
+                                    sizeof(smaller)));
+}
+
+TEST(StateSnapshotTest, CorruptionIsDetected) {
+    std::vector<uint8_t> bytes = MakeSnapshot().Serialize();
+    bytes.back() ^= 0x01;
+    StateSnapshot parsed;
+    EXPECT_FALSE(StateSnapshot::Parse(bytes, &parsed));
+}
+
+TEST(StateSnapshotTest, TruncationIsDetected) {
+    std::vector<uint8_t> bytes = MakeSnapshot().Serialize();
+    StateSnapshot parsed;
+    for (size_t len : {size_t(0), size_t(8), bytes.size() - 1}) {
+        EXPECT_FALSE(StateSnapshot::Parse(
+                std::vector<uint8_t>(bytes.begin(), bytes.begin() + len),
+                &parsed)) << len;
+    }
+}
+
+TEST(StateSnapshotTest, OtherVersionIsRejected) {
+    std::vector<uint8_t> bytes = MakeSnapshot().Serialize();
+    bytes[4] = StateSnapshot::kVersion + 1;
+    StateSnapshot parsed;
+    EXPECT_FALSE(StateSnapshot::Parse(bytes, &parsed));
+}
+
+TEST(StateSnapshotTest, FileRoundTrip) {
+    TemporaryDir dir;
+    const std::string path = std::string(dir.path) + "/state";
+
+    StateSnapshot parsed;
+    EXPECT_FALSE(StateSnapshot::ReadFromFile(path, &parsed));
+
+    ASSERT_TRUE(MakeSnapshot().WriteToFile(path));
+    ASSERT_TRUE(StateSnapshot::ReadFromFile(path, &parsed));
+    EXPECT_EQ(parsed.resetCount(), 7u);
+
+    // A newer snapshot replaces the old one
+    ASSERT_TRUE(StateSnapshot(8).WriteToFile(path));
+    ASSERT_TRUE(StateSnapshot::ReadFromFile(path, &parsed));
+    EXPECT_EQ(parsed.resetCount(), 8u);
+    Cursor cursor;
+    EXPECT_FALSE(parsed.Get(StateSnapshot::EVENT_CURSOR, &cursor, sizeof(cursor)));
+}
+
+} // namespace
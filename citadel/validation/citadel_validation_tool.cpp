@@ -14,10 +14,12 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <chrono>
 #include <iomanip>
 #include <iostream>
 #include <random>
+#include <vector>
 
 #include <android-base/endian.h>
 #include <android-base/logging.h>
@@ -31,6 +33,7 @@
 #include <app_nugget.h>
 #include <nos/debug.h>
 #include <nos/CitadeldProxyClient.h>
+#include <nos/DirectDeviceClient.h>
 
 using ::android::defaultServiceManager;
 using ::android::sp;
@@ -40,6 +43,7 @@ using ::android::base::ParseUint;
 using ::android::hardware::citadel::ICitadeld;
 
 using ::nos::CitadeldProxyClient;
+using ::nos::DirectDeviceClient;
 using ::nos::NuggetClientInterface;
 using ::nos::StatusCodeString;
 
@@ -267,7 +271,8 @@ int CmdHealthCheck(NuggetClientInterface& client) {
 int CmdReset(CitadeldProxyClient& client) {
     // Request a hard reset of the device
     bool success = false;
-    if (!client.Citadeld().reset(&success).isOk()) {
+    const sp<ICitadeld> citadeld = client.Citadeld();
+    if (citadeld == nullptr || !citadeld->reset(&success).isOk()) {
         std::cerr << "Failed to talk to citadeld\n";
         return EXIT_FAILURE;
     }
@@ -477,6 +482,115 @@ int CmdGetTemp(CitadeldProxyClient& client) {
 
 }
 
+/* A Nugget method that is cheap and safe to call repeatedly */
+struct LatencyMethod {
+    const char* name;
+    uint16_t param;
+    std::vector<uint8_t> request;
+    size_t responseSize;
+};
+
+std::vector<LatencyMethod> LatencyMethods() {
+    constexpr uint32_t PMU_PWRDN_SCRATCH16 = 0x400000d4; // Scratch 16
+
+    std::vector<uint8_t> read32(sizeof(uint32_t));
+    *reinterpret_cast<uint32_t*>(read32.data()) = PMU_PWRDN_SCRATCH16;
+
+    std::vector<uint8_t> write32(sizeof(nugget_app_write32));
+    nugget_app_write32* w32 = reinterpret_cast<nugget_app_write32*>(write32.data());
+    w32->address = PMU_PWRDN_SCRATCH16;
+    w32->value = 0;
+
+    return {
+        {"read32", NUGGET_PARAM_READ32, read32, sizeof(uint32_t)},
+        {"write32", NUGGET_PARAM_WRITE32, write32, 0},
+        {"cycles-since-boot", NUGGET_PARAM_CYCLES_SINCE_BOOT, {}, sizeof(uint32_t)},
+        {"low-power-stats", NUGGET_PARAM_GET_LOW_POWER_STATS, {},
+         sizeof(nugget_app_low_power_stats)},
+    };
+}
+
+/*
+ * Call a method count times and return the latency of each call, sorted.
+ * Returns an empty list if any of the calls fail.
+ */
+std::vector<std::chrono::nanoseconds> TimeMethod(NuggetClientInterface& client,
+                                                 const LatencyMethod& method,
+                                                 uint32_t count) {
+    using Clock = std::chrono::steady_clock;
+
+    std::vector<std::chrono::nanoseconds> latencies;
+    latencies.reserve(count);
+    std::vector<uint8_t> response;
+    for (uint32_t i = 0; i < count; ++i) {
+        response.clear();
+        response.reserve(method.responseSize);
+        const Clock::time_point start = Clock::now();
+        const uint32_t status = client.CallApp(APP_ID_NUGGET, method.param,
+                                               method.request, &response);
+        latencies.push_back(Clock::now() - start);
+        if (status != APP_SUCCESS) {
+            std::cerr << method.name << " failed: " << StatusCodeString(status)
+                      << "(" << status << ")\n";
+            return {};
+        }
+    }
+    std::sort(latencies.begin(), latencies.end());
+    return latencies;
+}
+
+std::string LatencySummary(const std::vector<std::chrono::nanoseconds>& latencies) {
+    if (latencies.empty()) {
+        return "failed";
+    }
+    const auto us = [](std::chrono::nanoseconds ns) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(ns).count();
+    };
+    std::stringstream ss;
+    ss << "p50 " << us(latencies[latencies.size() / 2]) << "us, p99 "
+       << us(latencies[latencies.size() * 99 / 100]) << "us";
+    return ss.str();
+}
+
+/*
+ * Compare the latency of calls that go via citadeld with the same calls made
+ * directly to the device. The difference is the cost of the extra binder hop
+ * through citadeld. Citadeld has to be running but otherwise idle; the kernel
+ * driver serializes its transactions with ours.
+ */
+int CmdLatency(CitadeldProxyClient& proxy, char** params) {
+    uint32_t count;
+    if (!ParseUint(params[0], &count) || count == 0) {
+        std::cerr << "Invalid count: \"" << params[0] << "\"\n";
+        return EXIT_FAILURE;
+    }
+
+    DirectDeviceClient direct;
+    direct.Open();
+    if (!direct.IsOpen()) {
+        std::cerr << "Failed to open Citadel directly\n";
+        return EXIT_FAILURE;
+    }
+
+    int ret = EXIT_SUCCESS;
+    for (const LatencyMethod& method : LatencyMethods()) {
+        const auto viaCitadeld = TimeMethod(proxy, method, count);
+        const auto viaDevice = TimeMethod(direct, method, count);
+        std::cout << method.name << ":\n"
+                  << "  citadeld: " << LatencySummary(viaCitadeld) << "\n"
+                  << "  direct:   " << LatencySummary(viaDevice) << "\n";
+        if (viaCitadeld.empty() || viaDevice.empty()) {
+            ret = EXIT_FAILURE;
+            continue;
+        }
+        const auto hop = viaCitadeld[count / 2] - viaDevice[count / 2];
+        std::cout << "  citadeld hop: "
+                  << std::chrono::duration_cast<std::chrono::microseconds>(hop).count()
+                  << "us at p50\n";
+    }
+    return ret;
+}
+
 } // namespace
 
 /**
@@ -513,6 +627,9 @@ int main(int argc, char** argv) {
         if (command == "get-temp" && param_count == 0) {
             return CmdGetTemp(citadeldProxy);
         }
+        if (command == "latency" && param_count == 1) {
+            return CmdLatency(citadeldProxy, params);
+        }
     }
 
     // Print usage if all else failed
@@ -523,6 +640,7 @@ int main(int argc, char** argv) {
     std::cerr << "  " << argv[0] << " enable-alerts      -- enable analog alert blocks\n";
     std::cerr << "  " << argv[0] << " disable-alerts     -- disable analog alert blocks\n";
     std::cerr << "  " << argv[0] << " get-temp           -- get temperature from temp sensor\n";
+    std::cerr << "  " << argv[0] << " latency [count]    -- compare call latency via citadeld and direct\n";
     std::cerr << "\n";
     std::cerr << "Returns 0 on success and non-0 if any failure were detected.\n";
     return EXIT_FAILURE;
@@ -14,12 +14,17 @@
  * limitations under the License.
  */
 
+#include <memory>
+
 #include <android-base/logging.h>
 #include <hidl/HidlTransportSupport.h>
 #include <utils/StrongPointer.h>
 
 #include <application.h>
-#include <nos/CitadeldProxyClient.h>
+#include <nos/DirectDeviceClient.h>
+#include <nos/IdempotentCalls.h>
+#include <nos/Interceptors.h>
+#include <nos/ServiceFootprint.h>
 
 #include <AuthSecret.h>
 
@@ -31,29 +36,40 @@ using ::android::hardware::joinRpcThreadpool;
 
 using ::android::hardware::authsecret::AuthSecret;
 
-using ::nos::CitadeldProxyClient;
+using ::nos::IdempotentCalls;
+using ::nos::InterceptHalCalls;
+using ::nos::LogServiceFootprint;
+using ::nos::MakeCitadelClient;
+using ::nos::NuggetClientInterface;
 
 int main() {
     LOG(INFO) << "AuthSecret HAL service starting";
 
-    // Connect to citadeld
-    CitadeldProxyClient citadeldProxy;
-    citadeldProxy.Open();
-    if (!citadeldProxy.IsOpen()) {
-        LOG(FATAL) << "Failed to open citadeld client";
+    // Connect to Citadel, via citadeld unless this image talks to it directly.
+    // None of its calls are retried if citadeld dies while they are in flight.
+    std::unique_ptr<NuggetClientInterface> citadel =
+            MakeCitadelClient("authsecret", IdempotentCalls());
+    citadel->Open();
+    if (!citadel->IsOpen()) {
+        LOG(FATAL) << "Failed to open Citadel client";
     }
 
+    // Trace, time and retry the calls the HAL makes
+    auto client = InterceptHalCalls(*citadel, "authsecret");
+
     // This thread will become the only thread of the daemon
     constexpr bool thisThreadWillJoinPool = true;
     configureRpcThreadpool(1, thisThreadWillJoinPool);
 
     // Start the HAL service
-    sp<AuthSecret> authsecret = new AuthSecret(citadeldProxy);
+    sp<AuthSecret> authsecret = new AuthSecret(client);
     const status_t status = authsecret->registerAsService();
     if (status != OK) {
       LOG(FATAL) << "Failed to register AuthSecret as a service (status: " << status << ")";
     }
 
+    LogServiceFootprint("AuthSecret HAL service");
+
     joinRpcThreadpool();
     return -1; // Should never be reached
 }
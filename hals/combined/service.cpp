@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <memory>
+
+#include <android-base/logging.h>
+#include <android-base/properties.h>
+#include <hidl/HidlTransportSupport.h>
+#include <utils/StrongPointer.h>
+
+#include <application.h>
+#include <nos/DirectDeviceClient.h>
+#include <nos/IdempotentCalls.h>
+#include <nos/Interceptors.h>
+#include <nos/ServiceFootprint.h>
+
+#include <AuthSecret.h>
+#include <KeymasterDevice.h>
+#include <Keymaster.client.h>
+#include <OemLock.h>
+#include <Weaver.h>
+#include <Weaver.client.h>
+
+using ::android::OK;
+using ::android::sp;
+using ::android::status_t;
+using ::android::base::GetUintProperty;
+using ::android::hardware::configureRpcThreadpool;
+using ::android::hardware::joinRpcThreadpool;
+
+using ::android::hardware::authsecret::AuthSecret;
+using ::android::hardware::keymaster::KeymasterDevice;
+using ::android::hardware::oemlock::OemLock;
+using ::android::hardware::weaver::Weaver;
+
+using ::nos::IdempotentCalls;
+using ::nos::InterceptHalCalls;
+using ::nos::LogServiceFootprint;
+using ::nos::MakeCitadelClient;
+using ::nos::NuggetClientInterface;
+
+using AvbClient = ::nugget::app::avb::Avb;
+using KeymasterClient = ::nugget::app::keymaster::Keymaster;
+using WeaverClient = ::nugget::app::weaver::Weaver;
+
+namespace {
+
+void CheckRegistered(const char* name, status_t status) {
+    if (status != OK) {
+        LOG(FATAL) << "Failed to register " << name << " as a service (status: "
+                   << status << ")";
+    }
+}
+
+// Number of binder threads serving the HALs, the same as for the keymaster
+// service on its own. Keymaster calls on different operations can run at the
+// same time and the other HALs keep no state between calls.
+constexpr char PROPERTY_THREADS[] = "ro.vendor.keymaster.citadel.threads";
+constexpr size_t kDefaultThreads = 4;
+constexpr size_t kMaxThreads = 16;
+
+} // namespace
+
+/**
+ * Hosts the keymaster, weaver, oemlock and authsecret HALs in one process
+ * rather than one each. They share the Citadel client and binder threads.
+ */
+int main() {
+    LOG(INFO) << "Citadel HAL services starting";
+
+    // Connect to Citadel, via citadeld unless this image talks to it directly
+    std::unique_ptr<NuggetClientInterface> citadel = MakeCitadelClient(
+            "combined", IdempotentCalls().Keymaster().Weaver().OemLock());
+    citadel->Open();
+    if (!citadel->IsOpen()) {
+        LOG(FATAL) << "Failed to open Citadel client";
+    }
+
+    // Each HAL's calls are traced under its own name
+    auto keymasterCalls = InterceptHalCalls(*citadel, "keymaster");
+    auto weaverCalls = InterceptHalCalls(*citadel, "weaver");
+    auto oemlockCalls = InterceptHalCalls(*citadel, "oemlock");
+    auto authsecretCalls = InterceptHalCalls(*citadel, "authsecret");
+
+    // This thread will become one of the threads of the daemon
+    const size_t threads = GetUintProperty<size_t>(PROPERTY_THREADS,
+                                                   kDefaultThreads, kMaxThreads);
+    constexpr bool thisThreadWillJoinPool = true;
+    configureRpcThreadpool(std::max<size_t>(threads, 1), thisThreadWillJoinPool);
+
+    // Keymaster is needed earliest in boot so it goes first
+    KeymasterClient keymasterClient{keymasterCalls};
+    sp<KeymasterDevice> keymaster = new KeymasterDevice{keymasterClient};
+    keymaster->LearnChunkSizes();
+    CheckRegistered("Keymaster", keymaster->registerAsService("strongbox"));
+
+    WeaverClient weaverClient{weaverCalls};
+    sp<Weaver> weaver = new Weaver{weaverClient};
+    CheckRegistered("Weaver", weaver->registerAsService());
+
+    AvbClient avbClient{oemlockCalls};
+    sp<OemLock> oemlock = new OemLock{avbClient};
+    CheckRegistered("OemLock", oemlock->registerAsService());
+
+    sp<AuthSecret> authsecret = new AuthSecret(authsecretCalls);
+    CheckRegistered("AuthSecret", authsecret->registerAsService());
+
+    LogServiceFootprint("Citadel HAL services");
+
+    joinRpcThreadpool();
+    return -1; // Should never be reached
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef NOS_HAL_IDEMPOTENT_CALLS_H
+#define NOS_HAL_IDEMPOTENT_CALLS_H
+
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <set>
+#include <utility>
+
+#include <android-base/logging.h>
+#include <google/protobuf/descriptor.h>
+
+#include <application.h>
+
+namespace nos {
+
+/**
+ * The calls a HAL service makes that only read state on Citadel, so can be
+ * made again if citadeld dies while they are in flight. Pass it to
+ * MakeCitadelClient().
+ *
+ * The generated app clients use a method's position in its proto service as
+ * the call's arg, so the methods are looked up by name rather than numbered
+ * by hand. A method that can't be found is left out, so it isn't retried.
+ */
+class IdempotentCalls {
+public:
+    IdempotentCalls() : _calls(std::make_shared<Calls>()) {}
+
+    IdempotentCalls& Add(uint32_t appId, const char* service,
+                         std::initializer_list<const char*> methods) {
+        const google::protobuf::ServiceDescriptor* descriptor =
+                google::protobuf::DescriptorPool::generated_pool()
+                        ->FindServiceByName(service);
+        if (descriptor == nullptr) {
+            LOG(ERROR) << "No service " << service << "; its calls won't be retried";
+            return *this;
+        }
+        for (const char* method : methods) {
+            const google::protobuf::MethodDescriptor* found =
+                    descriptor->FindMethodByName(method);
+            if (found == nullptr) {
+                LOG(ERROR) << "No method " << service << "." << method
+                           << "; it won't be retried";
+                continue;
+            }
+            _calls->emplace(appId, static_cast<uint16_t>(found->index()));
+        }
+        return *this;
+    }
+
+    /** Keymaster's reads of keys and of the device's state. */
+    IdempotentCalls& Keymaster() {
+        return Add(APP_ID_KEYMASTER, "nugget.app.keymaster.Keymaster",
+                   {"GetKeyCharacteristics", "ExportKey", "GetBootInfo",
+                    "GetHmacSharingParameters"});
+    }
+
+    /** Weaver's config. Reads count towards its throttling so aren't here. */
+    IdempotentCalls& Weaver() {
+        return Add(APP_ID_WEAVER, "nugget.app.weaver.Weaver", {"GetConfig"});
+    }
+
+    /** OemLock's reads of the lock state. */
+    IdempotentCalls& OemLock() {
+        return Add(APP_ID_AVB, "nugget.app.avb.Avb", {"GetLock"});
+    }
+
+    // Every AuthSecret call changes something on Citadel so it has none.
+
+    bool operator()(uint32_t appId, uint16_t arg) const {
+        return _calls->count(std::make_pair(appId, arg)) != 0;
+    }
+
+private:
+    using Calls = std::set<std::pair<uint32_t, uint16_t>>;
+
+    // Shared so copies, e.g. in a std::function, are cheap
+    std::shared_ptr<Calls> _calls;
+};
+
+} // namespace nos
+
+#endif // NOS_HAL_IDEMPOTENT_CALLS_H
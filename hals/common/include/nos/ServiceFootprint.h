@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NOS_HAL_SERVICE_FOOTPRINT_H
+#define NOS_HAL_SERVICE_FOOTPRINT_H
+
+#include <time.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/parseint.h>
+#include <android-base/strings.h>
+
+namespace nos {
+
+namespace footprint_internal {
+
+/* Milliseconds from the process being forked to now, or -1 if unknown. */
+inline int64_t MillisSinceProcessStart() {
+    std::string stat;
+    if (!::android::base::ReadFileToString("/proc/self/stat", &stat)) {
+        return -1;
+    }
+    // The command name can contain spaces so start after it. The first field
+    // after it is the 3rd and the start time, in clock ticks, is the 22nd.
+    const size_t nameEnd = stat.rfind(')');
+    if (nameEnd == std::string::npos || nameEnd + 2 > stat.size()) {
+        return -1;
+    }
+    const std::vector<std::string> fields =
+            ::android::base::Split(stat.substr(nameEnd + 2), " ");
+    uint64_t startTicks;
+    if (fields.size() < 20 ||
+        !::android::base::ParseUint(fields[19], &startTicks)) {
+        return -1;
+    }
+
+    timespec now;
+    clock_gettime(CLOCK_BOOTTIME, &now);
+    const int64_t nowMs = int64_t(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+    return nowMs - int64_t(startTicks * 1000 / sysconf(_SC_CLK_TCK));
+}
+
+/* The named "<key>: <n> kB" value from a /proc file, or -1 if absent. */
+inline int64_t ProcKilobytes(const char* path, const std::string& key) {
+    std::string contents;
+    if (!::android::base::ReadFileToString(path, &contents)) {
+        return -1;
+    }
+    for (const std::string& line : ::android::base::Split(contents, "\n")) {
+        if (::android::base::StartsWith(line, key + ":")) {
+            std::istringstream value(line.substr(key.size() + 1));
+            int64_t kb;
+            if (value >> kb) {
+                return kb;
+            }
+        }
+    }
+    return -1;
+}
+
+} // namespace footprint_internal
+
+/**
+ * Log how long the service took to come up, from being forked to having
+ * registered its interfaces, and how much memory it is using. Call once the
+ * service is ready. PSS is only reported where the kernel has smaps_rollup.
+ *
+ * RSS counts shared libraries in every process that maps them so PSS is the
+ * better measure when comparing one process against several.
+ */
+inline void LogServiceFootprint(const char* name) {
+    using namespace footprint_internal;
+    LOG(INFO) << name << " ready " << MillisSinceProcessStart()
+              << "ms after start; RSS " << ProcKilobytes("/proc/self/status", "VmRSS")
+              << "kB, PSS " << ProcKilobytes("/proc/self/smaps_rollup", "Pss")
+              << "kB";
+}
+
+} // namespace nos
+
+#endif // NOS_HAL_SERVICE_FOOTPRINT_H
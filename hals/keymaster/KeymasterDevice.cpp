@@ -16,11 +16,15 @@
 
 #include "KeymasterDevice.h"
 #include "buffer.h"
+#include "device_capabilities.h"
 #include "export_key.h"
-#include "certs.h"
+#include "attestation.h"
 #include "import_key.h"
 #include "import_wrapped_key.h"
+#include "key_blob_cache.h"
 #include "proto_utils.h"
+#include "public_key_operation.h"
+#include "thread_message.h"
 
 #include <Keymaster.client.h>
 #include <nos/debug.h>
@@ -34,7 +38,11 @@
 #include <android-base/properties.h>
 
 #include <algorithm>
+#include <memory>
+#include <vector>
 
+#include <inttypes.h>
+#include <stdio.h>
 #include <time.h>
 
 namespace android {
@@ -130,10 +138,15 @@ class Finalize {
     void release() { f_ = {}; }
 };
 
-inline std::string hidlVec2String(const hidl_vec<uint8_t>& value) {
-    return std::string(
-        reinterpret_cast<const std::string::value_type*>(
-            &value[0]), value.size());
+template <typename Stats>
+void dump_cache_stats(int fd, const char *name, const Stats& stats) {
+    const uint64_t lookups = stats.hits + stats.misses;
+    dprintf(fd,
+            "%s cache: %zu entries, %zu bytes\n"
+            "  hits %" PRIu64 " misses %" PRIu64 " (%" PRIu64 "%% hit rate)"
+            " evictions %" PRIu64 "\n",
+            name, stats.entries, stats.bytes, stats.hits, stats.misses,
+            lookups ? stats.hits * 100 / lookups : 0, stats.evictions);
 }
 
 }  // namespace
@@ -150,9 +163,12 @@ using ::android::hardware::Void;
 
 // HAL
 using ::android::hardware::keymaster::V4_0::Algorithm;
+using ::android::hardware::keymaster::V4_0::BlockMode;
+using ::android::hardware::keymaster::V4_0::Digest;
 using ::android::hardware::keymaster::V4_0::KeyCharacteristics;
 using ::android::hardware::keymaster::V4_0::KeyFormat;
 using ::android::hardware::keymaster::V4_0::HardwareAuthToken;
+using ::android::hardware::keymaster::V4_0::PaddingMode;
 using ::android::hardware::keymaster::V4_0::HardwareAuthenticatorType;
 using ::android::hardware::keymaster::V4_0::SecurityLevel;
 using ::android::hardware::keymaster::V4_0::Tag;
@@ -235,6 +251,21 @@ static ErrorCode status_to_error_code(uint32_t status)
     }
 }
 
+static bool key_algorithm(const KeyCharacteristics& characteristics,
+                          Algorithm *algorithm)
+{
+    for (const auto *params : {&characteristics.hardwareEnforced,
+                               &characteristics.softwareEnforced}) {
+        for (const KeyParameter& param : *params) {
+            if (param.tag == Tag::ALGORITHM) {
+                *algorithm = param.f.algorithm;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
 static uint64_t ms_since_epoch(void)
 {
     uint64_t seconds;
@@ -249,12 +280,15 @@ static uint64_t ms_since_epoch(void)
     return (seconds * 1000) + milli_seconds;
 }
 
+// A call failing to reach the app is how a Citadel reset shows up here, so
+// nothing remembered from before it is trusted afterwards.
 #define KM_CALL(meth, request, response) {                                    \
     const uint32_t status = _keymaster. meth (request, &response);            \
     const ErrorCode error_code = translate_error_code(response.error_code()); \
     if (status != APP_SUCCESS) {                                              \
         LOG(ERROR) << #meth << " : request failed with status: "              \
                    << nos::StatusCodeString(status);                          \
+        ClearCaches();                                                        \
         return status_to_error_code(status);                                  \
     }                                                                         \
     if (error_code != ErrorCode::OK) {                                        \
@@ -270,6 +304,7 @@ static uint64_t ms_since_epoch(void)
     if (status != APP_SUCCESS) {                                              \
         LOG(ERROR) << #meth << " : request failed with status: "              \
                    << nos::StatusCodeString(status);                          \
+        ClearCaches();                                                        \
         _hidl_cb(status_to_error_code(status), __VA_ARGS__);                  \
         return Void();                                                        \
     }                                                                         \
@@ -281,12 +316,33 @@ static uint64_t ms_since_epoch(void)
     }                                                                         \
 }
 
+// KM_CALLV that also learns what the device doesn't support from its error
+#define KM_CALLV_LEARN(meth, request, response, preflight, ...) {             \
+    const uint32_t status = _keymaster. meth (request, &response);            \
+    const ErrorCode error_code = translate_error_code(response.error_code()); \
+    if (status != APP_SUCCESS) {                                              \
+        LOG(ERROR) << #meth << " : request failed with status: "              \
+                   << nos::StatusCodeString(status);                          \
+        ClearCaches();                                                        \
+        _hidl_cb(status_to_error_code(status), __VA_ARGS__);                  \
+        return Void();                                                        \
+    }                                                                         \
+    if (error_code != ErrorCode::OK) {                                        \
+        LOG(ERROR) << #meth << " : device response error code: "              \
+                   << error_code;                                             \
+        _capabilities->learn(preflight, error_code);                          \
+        _hidl_cb(error_code, __VA_ARGS__);                                    \
+        return Void();                                                        \
+    }                                                                         \
+}
+
 #define KM_CALLV_ABORT(meth, request, response, ...) {                        \
     const uint32_t status = _keymaster. meth (request, &response);            \
     const ErrorCode error_code = translate_error_code(response.error_code()); \
     if (status != APP_SUCCESS) {                                              \
         LOG(ERROR) << #meth << " : request failed with status: "              \
                    << nos::StatusCodeString(status) << " aborting operation"; \
+        ClearCaches();                                                        \
         _hidl_cb(status_to_error_code(status), __VA_ARGS__);                  \
         abort(request.handle().handle());                                     \
         return Void();                                                        \
@@ -302,7 +358,10 @@ static uint64_t ms_since_epoch(void)
 // Methods from ::android::hardware::keymaster::V3_0::IKeymasterDevice follow.
 
 KeymasterDevice::KeymasterDevice(KeymasterClient& keymaster) :
-        _keymaster{keymaster} {
+        _keymaster{keymaster},
+        _characteristics_cache{new KeyBlobCache<KeyCharacteristics>()},
+        _export_cache{new KeyBlobCache<hidl_vec<uint8_t>>()},
+        _capabilities{new DeviceCapabilities()} {
     // Block until all of the properties have been created
     while (!(WaitForPropertyCreation(PROPERTY_OS_VERSION) &&
              WaitForPropertyCreation(PROPERTY_OS_PATCHLEVEL) &&
@@ -319,6 +378,8 @@ KeymasterDevice::KeymasterDevice(KeymasterClient& keymaster) :
     GetBootInfo();
 }
 
+KeymasterDevice::~KeymasterDevice() = default;
+
 Return<void> KeymasterDevice::getHardwareInfo(
         getHardwareInfo_cb _hidl_cb)
 {
@@ -336,8 +397,8 @@ Return<void> KeymasterDevice::getHmacSharingParameters(
 {
     LOG(VERBOSE) << "Running KeymasterDevice::getHmacSharingParameters";
 
-    GetHmacSharingParametersRequest request;
-    GetHmacSharingParametersResponse response;
+    KM_THREAD_MESSAGE(GetHmacSharingParametersRequest, request);
+    KM_THREAD_MESSAGE(GetHmacSharingParametersResponse, response);
     HmacSharingParameters result;
 
     KM_CALLV(GetHmacSharingParameters, request, response, result);
@@ -383,8 +444,8 @@ Return<void> KeymasterDevice::computeSharedHmac(
 {
     LOG(VERBOSE) << "Running KeymasterDevice::computeSharedHmac";
 
-    ComputeSharedHmacRequest request;
-    ComputeSharedHmacResponse response;
+    KM_THREAD_MESSAGE(ComputeSharedHmacRequest, request);
+    KM_THREAD_MESSAGE(ComputeSharedHmacResponse, response);
     hidl_vec<uint8_t> result;
 
     for (const HmacSharingParameters & param : params) {
@@ -441,8 +502,8 @@ Return<ErrorCode> KeymasterDevice::addRngEntropy(const hidl_vec<uint8_t>& data)
 
     const size_t chunk_size = 1024;
     for (size_t i = 0; i < data.size(); i += chunk_size) {
-        AddRngEntropyRequest request;
-        AddRngEntropyResponse response;
+        KM_THREAD_MESSAGE(AddRngEntropyRequest, request);
+        KM_THREAD_MESSAGE(AddRngEntropyResponse, response);
 
         request.set_data(&data[i], std::min(chunk_size, data.size() - i));
 
@@ -459,8 +520,8 @@ Return<void> KeymasterDevice::generateKey(
 {
     LOG(VERBOSE) << "Running KeymasterDevice::generateKey";
 
-    GenerateKeyRequest request;
-    GenerateKeyResponse response;
+    KM_THREAD_MESSAGE(GenerateKeyRequest, request);
+    KM_THREAD_MESSAGE(GenerateKeyResponse, response);
 
     hidl_vec<uint8_t> blob;
     KeyCharacteristics characteristics;
@@ -469,11 +530,18 @@ Return<void> KeymasterDevice::generateKey(
       _hidl_cb(ErrorCode::INVALID_ARGUMENT, blob, characteristics);
       return Void();
     }
+    const DeviceCapabilities::Request preflight{
+        DeviceCapabilities::Call::GENERATE_KEY, keyParams, nullptr, nullptr};
+    const ErrorCode preflight_error = _capabilities->check(preflight);
+    if (preflight_error != ErrorCode::OK) {
+        _hidl_cb(preflight_error, blob, characteristics);
+        return Void();
+    }
     request.set_creation_time_ms(ms_since_epoch());
 
     // Call device.
-    KM_CALLV(GenerateKey, request, response,
-             hidl_vec<uint8_t>{}, KeyCharacteristics());
+    KM_CALLV_LEARN(GenerateKey, request, response, preflight,
+                   hidl_vec<uint8_t>{}, KeyCharacteristics());
 
     blob.setToExternal(
         reinterpret_cast<uint8_t*>(
@@ -497,23 +565,15 @@ Return<void> KeymasterDevice::getKeyCharacteristics(
 {
     LOG(VERBOSE) << "Running KeymasterDevice::getKeyCharacteristics";
 
-    GetKeyCharacteristicsRequest request;
-    GetKeyCharacteristicsResponse response;
-
-    request.mutable_blob()->set_blob(&keyBlob[0], keyBlob.size());
-    request.set_client_id(&clientId[0], clientId.size());
-    request.set_app_data(&appData[0], appData.size());
-
-    // Call device.
-    KM_CALLV(GetKeyCharacteristics, request, response, KeyCharacteristics());
-
-    KeyCharacteristics characteristics;
-    pb_to_hidl_params(response.characteristics().software_enforced(),
-                      &characteristics.softwareEnforced);
-    pb_to_hidl_params(response.characteristics().tee_enforced(),
-                      &characteristics.hardwareEnforced);
+    std::shared_ptr<const KeyCharacteristics> characteristics;
+    const ErrorCode error_code =
+        GetCharacteristics(keyBlob, clientId, appData, &characteristics);
+    if (error_code != ErrorCode::OK) {
+        _hidl_cb(error_code, KeyCharacteristics());
+        return Void();
+    }
 
-    _hidl_cb(translate_error_code(response.error_code()), characteristics);
+    _hidl_cb(ErrorCode::OK, *characteristics);
     return Void();
 }
 
@@ -524,8 +584,8 @@ Return<void> KeymasterDevice::importKey(
     LOG(VERBOSE) << "Running KeymasterDevice::importKey";
 
     ErrorCode error;
-    ImportKeyRequest request;
-    ImportKeyResponse response;
+    KM_THREAD_MESSAGE(ImportKeyRequest, request);
+    KM_THREAD_MESSAGE(ImportKeyResponse, response);
 
     error = import_key_request(params, keyFormat, keyData, &request);
     if (error != ErrorCode::OK) {
@@ -534,10 +594,17 @@ Return<void> KeymasterDevice::importKey(
         _hidl_cb(error, hidl_vec<uint8_t>{}, KeyCharacteristics{});
         return Void();
     }
+    const DeviceCapabilities::Request preflight{
+        DeviceCapabilities::Call::IMPORT_KEY, params, nullptr, nullptr};
+    error = _capabilities->check(preflight);
+    if (error != ErrorCode::OK) {
+        _hidl_cb(error, hidl_vec<uint8_t>{}, KeyCharacteristics{});
+        return Void();
+    }
     request.set_creation_time_ms(ms_since_epoch());
 
-    KM_CALLV(ImportKey, request, response,
-             hidl_vec<uint8_t>{}, KeyCharacteristics{});
+    KM_CALLV_LEARN(ImportKey, request, response, preflight,
+                   hidl_vec<uint8_t>{}, KeyCharacteristics{});
 
     hidl_vec<uint8_t> blob;
     blob.setToExternal(
@@ -568,73 +635,20 @@ Return<void> KeymasterDevice::exportKey(
 {
     LOG(VERBOSE) << "Running KeymasterDevice::exportKey";
 
-    ExportKeyRequest request;
-    ExportKeyResponse response;
-
-    request.set_format((::nugget::app::keymaster::KeyFormat)exportFormat);
-    request.mutable_blob()->set_blob(&keyBlob[0], keyBlob.size());
-    request.set_client_id(&clientId[0], clientId.size());
-    request.set_app_data(&appData[0], appData.size());
-
-    KM_CALLV(ExportKey, request, response, hidl_vec<uint8_t>{});
-
-    hidl_vec<uint8_t> der;
-    ErrorCode error_code = export_key_der(response, &der);
+    std::shared_ptr<const hidl_vec<uint8_t>> der;
+    const ErrorCode error_code =
+        GetPublicKey(exportFormat, keyBlob, clientId, appData, &der);
     if (error_code != ErrorCode::OK) {
-        LOG(ERROR) << "KeymasterDevice::exportKey: DER conversion failed: "
-                   << error_code;
         _hidl_cb(error_code, hidl_vec<uint8_t>{});
         return Void();
     }
 
-    _hidl_cb(error_code, der);
+    _hidl_cb(ErrorCode::OK, *der);
     return Void();
 }
 
 #define ATTESTATION_APPLICATION_ID_MAX_SIZE 1024
 #define UTCTIME_STR_WITH_NUL_SIZE           14
-static size_t integer_size(uint64_t value)
-{
-        size_t octet_count = 1;
-        for (value >>= 8; value; value >>= 8) {
-                octet_count++;
-        }
-        return octet_count;
-}
-static size_t encoded_length_size(size_t length)
-{
-        if (length < 0x80) {
-                return 1;
-        }
-        return integer_size(length) + 1;
-}
-
-static uint8_t *asn1_encode_length(size_t length, const uint8_t *head, uint8_t *tail)
-{
-        if (!tail || tail < head + encoded_length_size(length)) {
-                return NULL;
-        }
-
-        if (length < 0x80) {
-                // Short length case
-                *(--tail) = length;
-        } else {
-                // Encode length
-                uint8_t length_len;
-                uint8_t *orig_tail = tail;
-                do {
-                        *(--tail) = length & 0xFF;
-                        length >>= 8;
-                } while (length);
-
-                // Encode length of length.  Assumes length < pow(128, 127).
-                // Should be good.
-                length_len = (orig_tail - tail);
-                *(--tail) = 0x80 | length_len;
-        }
-        return tail;
-}
-
 Return<void> KeymasterDevice::attestKey(
         const hidl_vec<uint8_t>& keyToAttest,
         const hidl_vec<KeyParameter>& attestParams,
@@ -642,71 +656,68 @@ Return<void> KeymasterDevice::attestKey(
 {
     LOG(VERBOSE) << "Running KeymasterDevice::attestKey";
 
-    StartAttestKeyRequest startRequest;
-    StartAttestKeyResponse startResponse;
+    KM_THREAD_MESSAGE(StartAttestKeyRequest, startRequest);
+    KM_THREAD_MESSAGE(StartAttestKeyResponse, startResponse);
 
     // Ensure that required parameters are present.
-    tag_map_t attest_tag_map;
-    if (hidl_params_to_map(attestParams, &attest_tag_map) != ErrorCode::OK) {
+    TagIndex attest_tag_index;
+    if (hidl_params_to_pb(attestParams, startRequest.mutable_params(),
+                          &attest_tag_index) != ErrorCode::OK) {
         _hidl_cb(ErrorCode::INVALID_ARGUMENT, hidl_vec<hidl_vec<uint8_t> >{});
       return Void();
     }
-    if (attest_tag_map.find(Tag::ATTESTATION_APPLICATION_ID) ==
-        attest_tag_map.end()) {
+    if (!attest_tag_index.contains(Tag::ATTESTATION_APPLICATION_ID)) {
         _hidl_cb(ErrorCode::ATTESTATION_APPLICATION_ID_MISSING,
                  hidl_vec<hidl_vec<uint8_t> >{});
       return Void();
     }
 
     hidl_vec<uint8_t> client_id;
-    if (attest_tag_map.find(Tag::APPLICATION_ID) != attest_tag_map.end()) {
-        client_id = attest_tag_map.find(Tag::APPLICATION_ID)->second[0].blob;
+    if (attest_tag_index.contains(Tag::APPLICATION_ID)) {
+        client_id = attest_tag_index.find(Tag::APPLICATION_ID)->blob;
     }
     hidl_vec<uint8_t> app_data;
-    if (attest_tag_map.find(Tag::APPLICATION_DATA) != attest_tag_map.end()) {
-        app_data = attest_tag_map.find(
-            Tag::APPLICATION_DATA)->second[0].blob;
+    if (attest_tag_index.contains(Tag::APPLICATION_DATA)) {
+        app_data = attest_tag_index.find(Tag::APPLICATION_DATA)->blob;
     }
 
-    GetKeyCharacteristicsRequest charRequest;
-    GetKeyCharacteristicsResponse charResponse;
-
-    charRequest.mutable_blob()->set_blob(&keyToAttest[0], keyToAttest.size());
-    charRequest.set_client_id(&client_id[0], client_id.size());
-    charRequest.set_app_data(&app_data[0], app_data.size());
-
-    // Call device.
-    KM_CALLV(GetKeyCharacteristics, charRequest,
-             charResponse, hidl_vec<hidl_vec<uint8_t> >{});
-
-    KeyCharacteristics characteristics;
-    pb_to_hidl_params(charResponse.characteristics().software_enforced(),
-                      &characteristics.softwareEnforced);
-    pb_to_hidl_params(charResponse.characteristics().tee_enforced(),
-                      &characteristics.hardwareEnforced);
+    std::shared_ptr<const KeyCharacteristics> characteristics;
+    const ErrorCode error_code = GetCharacteristics(
+        keyToAttest, client_id, app_data, &characteristics);
+    if (error_code != ErrorCode::OK) {
+        _hidl_cb(error_code, hidl_vec<hidl_vec<uint8_t> >{});
+        return Void();
+    }
+    Algorithm algorithm;
+    const DeviceCapabilities::Request preflight{
+        DeviceCapabilities::Call::ATTEST_KEY, attestParams,
+        key_algorithm(*characteristics, &algorithm) ? &algorithm : nullptr,
+        nullptr};
+    const ErrorCode preflight_error = _capabilities->check(preflight);
+    if (preflight_error != ErrorCode::OK) {
+        _hidl_cb(preflight_error, hidl_vec<hidl_vec<uint8_t> >{});
+        return Void();
+    }
 
-    tag_map_t char_tag_map;
-    if (hidl_params_to_map(characteristics.softwareEnforced,
-                           &attest_tag_map) != ErrorCode::OK) {
+    TagIndex char_tag_index;
+    if (hidl_params_to_index(characteristics->softwareEnforced,
+                             &char_tag_index) != ErrorCode::OK) {
         _hidl_cb(ErrorCode::INVALID_ARGUMENT, hidl_vec<hidl_vec<uint8_t> >{});
       return Void();
     }
 
     time_t not_before = 0;
-    if (char_tag_map.find(Tag::ACTIVE_DATETIME) != char_tag_map.end()) {
-        not_before = char_tag_map.find(
-            Tag::ACTIVE_DATETIME)->second[0].f.dateTime;
-    } else if (char_tag_map.find(Tag::CREATION_DATETIME) !=
-               char_tag_map.end()) {
-        not_before = char_tag_map.find(
-            Tag::CREATION_DATETIME)->second[0].f.dateTime;
+    if (char_tag_index.contains(Tag::ACTIVE_DATETIME)) {
+        not_before = char_tag_index.find(Tag::ACTIVE_DATETIME)->f.dateTime;
+    } else if (char_tag_index.contains(Tag::CREATION_DATETIME)) {
+        not_before = char_tag_index.find(Tag::CREATION_DATETIME)->f.dateTime;
     }
     // TODO: else: both ACTIVE and CREATION datetime are absent, is
     // this an error?
     time_t not_after = 0;
-    if (char_tag_map.find(Tag::USAGE_EXPIRE_DATETIME) != char_tag_map.end()) {
-        not_after = char_tag_map.find(
-            Tag::USAGE_EXPIRE_DATETIME)->second[0].f.dateTime;
+    if (char_tag_index.contains(Tag::USAGE_EXPIRE_DATETIME)) {
+        not_after = char_tag_index.find(
+            Tag::USAGE_EXPIRE_DATETIME)->f.dateTime;
     } else {
         not_after = 1842739199; // Batch cert expiry date: 2028-05-23:23:59:59.
     }
@@ -722,11 +733,6 @@ Return<void> KeymasterDevice::attestKey(
     }
 
     startRequest.mutable_blob()->set_blob(&keyToAttest[0], keyToAttest.size());
-    if (hidl_params_to_pb(
-            attestParams, startRequest.mutable_params()) != ErrorCode::OK) {
-      _hidl_cb(ErrorCode::INVALID_ARGUMENT, hidl_vec<hidl_vec<uint8_t> >{});
-      return Void();
-    }
 
     // Developer configs (i.e. nodelocked-RO), and PROTO devices will
     // fall back to TEST certs here, since BATCH certs will be
@@ -745,167 +751,47 @@ Return<void> KeymasterDevice::attestKey(
     // NOTE: citadel adds the AAID to the hash in the prologue for now. So if this
     // is ever changes the HASH_update call needs to move in the citadel firmware.
 
-    KM_CALLV(StartAttestKey, startRequest, startResponse,
-             hidl_vec<hidl_vec<uint8_t> >{});
+    KM_CALLV_LEARN(StartAttestKey, startRequest, startResponse, preflight,
+                   hidl_vec<hidl_vec<uint8_t> >{});
 
     uint64_t operationHandle = startResponse.handle().handle();
-    ContinueAttestKeyRequest continueRequest;
-    ContinueAttestKeyResponse continueResponse;
+    KM_THREAD_MESSAGE(ContinueAttestKeyRequest, continueRequest);
+    KM_THREAD_MESSAGE(ContinueAttestKeyResponse, continueResponse);
     // Prepare to abort the pending operation in event of an error.
     Finalize finalize([&] () { abort(operationHandle); });
 
     continueRequest.mutable_handle()->set_handle(operationHandle);
-    if (hidl_params_to_pb(
-            attestParams, continueRequest.mutable_params()) != ErrorCode::OK) {
-        LOG(ERROR) << "Failed to parse attest params";
-        _hidl_cb(ErrorCode::INVALID_ARGUMENT, hidl_vec<hidl_vec<uint8_t> >{});
-        return Void();
-    }
+    // Already translated for the start request
+    *continueRequest.mutable_params() = startRequest.params();
 
     KM_CALLV(ContinueAttestKey, continueRequest, continueResponse,
              hidl_vec<hidl_vec<uint8_t> >{});
 
-    FinishAttestKeyRequest finishRequest;
-    FinishAttestKeyResponse finishResponse;
+    KM_THREAD_MESSAGE(FinishAttestKeyRequest, finishRequest);
+    KM_THREAD_MESSAGE(FinishAttestKeyResponse, finishResponse);
 
     finishRequest.mutable_handle()->set_handle(operationHandle);
 
     KM_CALLV(FinishAttestKey, finishRequest, finishResponse,
              hidl_vec<hidl_vec<uint8_t> >{});
 
-    hidl_vec<uint8_t>& attestation_application_id =
-            attest_tag_map[Tag::ATTESTATION_APPLICATION_ID].begin()->blob;
-    size_t cert_len = startResponse.certificate_prologue().size()
-                    + attestation_application_id.size()
-                    + continueResponse.certificate_body().size()
-                    + finishResponse.certificate_epilogue().size();
-
-    std::stringstream ss;
-    {
-        char c = 0x30;
-        ss.write(&c, 1); // DER_SEQUENCE | DER_CONSTRUCTED
-
-        uint8_t buffer[10];
-        auto * cert_header = asn1_encode_length(cert_len, buffer, buffer + sizeof(buffer));
-
-        if (cert_header == nullptr) {
-            LOG(ERROR) << "Failed to generate attestation certificate sequence header";
-            _hidl_cb(ErrorCode::UNKNOWN_ERROR, hidl_vec<hidl_vec<uint8_t> >{});
-            return Void();
+    const hidl_vec<uint8_t>& attestation_application_id =
+            attest_tag_index.find(Tag::ATTESTATION_APPLICATION_ID)->blob;
+
+    // The attestation certificate then the batch chain, which is only
+    // referenced rather than copied.
+    hidl_vec<hidl_vec<uint8_t> > chain(4);
+    assemble_attestation_certificate(
+        startResponse.certificate_prologue(), attestation_application_id,
+        continueResponse.certificate_body(),
+        finishResponse.certificate_epilogue(), &chain[0]);
+    for (const KeyParameter &param : characteristics->hardwareEnforced) {
+        if (param.tag == Tag::ALGORITHM) {
+            attestation_batch_chain(finishResponse.nodelocked_ro(),
+                                    finishResponse.chip_fusing(),
+                                    param.f.algorithm, &chain);
+            break;
         }
-        ss.write(reinterpret_cast<char*>(cert_header), buffer + sizeof(buffer) - cert_header);
-    }
-
-    ss << startResponse.certificate_prologue();
-    ss.write(reinterpret_cast<const std::stringstream::char_type*>(
-            attestation_application_id.data()), attestation_application_id.size());
-    ss << continueResponse.certificate_body();
-    ss << finishResponse.certificate_epilogue();
-
-    if (!ss) {
-        LOG(ERROR) << "Failed to generate attestation certificate";
-        _hidl_cb(ErrorCode::UNKNOWN_ERROR, hidl_vec<hidl_vec<uint8_t> >{});
-        return Void();
-    }
-
-    vector<hidl_vec<uint8_t> > chain;
-    string attestation_str = ss.str();
-    {
-        hidl_vec<uint8_t> attestation_certificate;
-        attestation_certificate.setToExternal(
-                reinterpret_cast<uint8_t*>(
-                        const_cast<char*>(attestation_str.data())),
-                attestation_str.size(), false);
-
-        chain.push_back(std::move(attestation_certificate));
-
-        hidl_vec<uint8_t> batch_cert;
-        hidl_vec<uint8_t> intermediate_cert;
-        hidl_vec<uint8_t> root;
-
-        for (const KeyParameter &param : characteristics.hardwareEnforced) {
-            if (param.tag != Tag::ALGORITHM) {
-                continue;
-            }
-
-            // Node-locked RO implies that factory provisioned certs
-            // (if any), are inaccessible, so fallback to the TEST
-            // certs.  Similarly, PROTO chips were not provisioned
-            // with certs, and hence will fallback to TEST certs.
-            if (finishResponse.nodelocked_ro() ||
-                finishResponse.chip_fusing() == nosapp::FUSING_PROTO) {
-                if (param.f.algorithm == Algorithm::RSA) {
-                    batch_cert.setToExternal(
-                        const_cast<uint8_t*>(
-                            TEST_BATCH_RSA_CERT),
-                                      sizeof(TEST_BATCH_RSA_CERT));
-                    intermediate_cert.setToExternal(
-                        const_cast<uint8_t*>(
-                            TEST_BATCH_RSA_INT_CERT),
-                        sizeof(TEST_BATCH_RSA_INT_CERT));
-                    root.setToExternal(
-                        const_cast<uint8_t*>(
-                            TEST_BATCH_ROOT_CERT),
-                        sizeof(TEST_BATCH_ROOT_CERT));
-                } else {
-                    batch_cert.setToExternal(
-                        const_cast<uint8_t*>(
-                            TEST_BATCH_EC_CERT),
-                        sizeof(TEST_BATCH_EC_CERT));
-                    intermediate_cert.setToExternal(
-                        const_cast<uint8_t*>(
-                            TEST_BATCH_EC_INT_CERT),
-                        sizeof(TEST_BATCH_EC_INT_CERT));
-                    root.setToExternal(
-                        const_cast<uint8_t*>(
-                            TEST_BATCH_ROOT_CERT),
-                        sizeof(TEST_BATCH_ROOT_CERT));
-                }
-            } else if (finishResponse.chip_fusing() == nosapp::FUSING_DVT) {
-                if (param.f.algorithm == Algorithm::RSA) {
-                    batch_cert.setToExternal(
-                        const_cast<uint8_t*>(DEV_BATCH_RSA_CERT),
-                        sizeof(DEV_BATCH_RSA_CERT));
-                    intermediate_cert.setToExternal(
-                        const_cast<uint8_t*>(DEV_BATCH_RSA_INT_CERT),
-                        sizeof(DEV_BATCH_RSA_INT_CERT));
-                } else {
-                    batch_cert.setToExternal(
-                        const_cast<uint8_t*>(DEV_BATCH_EC_CERT),
-                        sizeof(DEV_BATCH_EC_CERT));
-                    intermediate_cert.setToExternal(
-                        const_cast<uint8_t*>(DEV_BATCH_EC_INT_CERT),
-                        sizeof(DEV_BATCH_EC_INT_CERT));
-                }
-                root.setToExternal(
-                    const_cast<uint8_t*>(DEV_BATCH_ROOT_CERT),
-                    sizeof(DEV_BATCH_ROOT_CERT));
-            } else {  // PVT!
-                if (param.f.algorithm == Algorithm::RSA) {
-                    batch_cert.setToExternal(
-                        const_cast<uint8_t*>(PROD_BATCH_RSA_CERT),
-                        sizeof(PROD_BATCH_RSA_CERT));
-                    intermediate_cert.setToExternal(
-                        const_cast<uint8_t*>(PROD_BATCH_RSA_INT_CERT),
-                        sizeof(PROD_BATCH_RSA_INT_CERT));
-                } else {
-                    batch_cert.setToExternal(
-                        const_cast<uint8_t*>(PROD_BATCH_EC_CERT),
-                        sizeof(PROD_BATCH_EC_CERT));
-                    intermediate_cert.setToExternal(
-                        const_cast<uint8_t*>(PROD_BATCH_EC_INT_CERT),
-                        sizeof(PROD_BATCH_EC_INT_CERT));
-                }
-                root.setToExternal(
-                    const_cast<uint8_t*>(PROD_BATCH_ROOT_CERT),
-                    sizeof(PROD_BATCH_ROOT_CERT));
-            }
-            break; // we found the ALGORITM tag so we can break the loop
-        }
-
-        chain.push_back(std::move(batch_cert));
-        chain.push_back(std::move(intermediate_cert));
-        chain.push_back(std::move(root));
     }
 
     _hidl_cb(ErrorCode::OK, chain);
@@ -920,8 +806,8 @@ Return<void> KeymasterDevice::upgradeKey(
 {
     LOG(VERBOSE) << "Running KeymasterDevice::upgradeKey";
 
-    UpgradeKeyRequest request;
-    UpgradeKeyResponse response;
+    KM_THREAD_MESSAGE(UpgradeKeyRequest, request);
+    KM_THREAD_MESSAGE(UpgradeKeyResponse, response);
 
     request.mutable_blob()->set_blob(&keyBlobToUpgrade[0],
                                      keyBlobToUpgrade.size());
@@ -934,6 +820,7 @@ Return<void> KeymasterDevice::upgradeKey(
     }
 
     KM_CALLV(UpgradeKey, request, response, hidl_vec<uint8_t>{});
+    InvalidateCaches(keyBlobToUpgrade);
 
     blob.setToExternal(
         reinterpret_cast<uint8_t*>(
@@ -948,12 +835,14 @@ Return<ErrorCode> KeymasterDevice::deleteKey(const hidl_vec<uint8_t>& keyBlob)
 {
     LOG(VERBOSE) << "Running KeymasterDevice::deleteKey";
 
-    DeleteKeyRequest request;
-    DeleteKeyResponse response;
+    KM_THREAD_MESSAGE(DeleteKeyRequest, request);
+    KM_THREAD_MESSAGE(DeleteKeyResponse, response);
 
     request.mutable_blob()->set_blob(&keyBlob[0], keyBlob.size());
 
     KM_CALL(DeleteKey, request, response);
+    // Only once the key is gone, or a concurrent lookup could cache it again
+    InvalidateCaches(keyBlob);
 
     return translate_error_code(response.error_code());
 }
@@ -962,10 +851,11 @@ Return<ErrorCode> KeymasterDevice::deleteAllKeys()
 {
     LOG(VERBOSE) << "Running KeymasterDevice::deleteAllKeys";
 
-    DeleteAllKeysRequest request;
-    DeleteAllKeysResponse response;
+    KM_THREAD_MESSAGE(DeleteAllKeysRequest, request);
+    KM_THREAD_MESSAGE(DeleteAllKeysResponse, response);
 
     KM_CALL(DeleteAllKeys, request, response);
+    ClearCaches();
 
     return translate_error_code(response.error_code());
 }
@@ -974,8 +864,8 @@ Return<ErrorCode> KeymasterDevice::destroyAttestationIds()
 {
     LOG(VERBOSE) << "Running KeymasterDevice::destroyAttestationIds";
 
-    DestroyAttestationIdsRequest request;
-    DestroyAttestationIdsResponse response;
+    KM_THREAD_MESSAGE(DestroyAttestationIdsRequest, request);
+    KM_THREAD_MESSAGE(DestroyAttestationIdsResponse, response);
 
     KM_CALL(DestroyAttestationIds, request, response);
 
@@ -990,8 +880,18 @@ Return<void> KeymasterDevice::begin(
 {
     LOG(VERBOSE) << "Running KeymasterDevice::begin";
 
-    BeginOperationRequest request;
-    BeginOperationResponse response;
+    if (purpose == KeyPurpose::VERIFY || purpose == KeyPurpose::ENCRYPT) {
+        uint64_t handle = 0;
+        const ErrorCode error_code =
+            BeginPublicKeyOperation(purpose, key, inParams, &handle);
+        if (error_code != ErrorCode::UNIMPLEMENTED) {
+            _hidl_cb(error_code, hidl_vec<KeyParameter>{}, handle);
+            return Void();
+        }
+    }
+
+    KM_THREAD_MESSAGE(BeginOperationRequest, request);
+    KM_THREAD_MESSAGE(BeginOperationResponse, response);
 
     request.set_purpose((::nugget::app::keymaster::KeyPurpose)purpose);
     request.mutable_blob()->set_blob(&key[0], key.size());
@@ -1003,20 +903,28 @@ Return<void> KeymasterDevice::begin(
                  response.handle().handle());
         return Void();
     }
-    if (hidl_params_to_pb(
-            inParams, request.mutable_params()) != ErrorCode::OK) {
+    TagIndex tag_index;
+    if (hidl_params_to_pb(inParams, request.mutable_params(),
+                          &tag_index) != ErrorCode::OK) {
       _hidl_cb(ErrorCode::INVALID_ARGUMENT, params,
                response.handle().handle());
       return Void();
     }
-    tag_map_t tag_map;
-    if (hidl_params_to_map(inParams, &tag_map) != ErrorCode::OK) {
-        _hidl_cb(ErrorCode::INVALID_ARGUMENT, params,
-                 response.handle().handle());
-      return Void();
+    // Only checked when the key's characteristics are already cached
+    Algorithm cached_algorithm;
+    const DeviceCapabilities::Request preflight{
+        DeviceCapabilities::Call::BEGIN, inParams,
+        CachedKeyAlgorithm(key, tag_index, &cached_algorithm) ?
+            &cached_algorithm : nullptr,
+        &purpose};
+    const ErrorCode preflight_error = _capabilities->check(preflight);
+    if (preflight_error != ErrorCode::OK) {
+        _hidl_cb(preflight_error, params, 0);
+        return Void();
     }
 
-    KM_CALLV(BeginOperation, request, response, hidl_vec<KeyParameter>{}, 0);
+    KM_CALLV_LEARN(BeginOperation, request, response, preflight,
+                   hidl_vec<KeyParameter>{}, 0);
 
     // Setup HAL buffering for this operation's data.
     Algorithm algorithm;
@@ -1030,7 +938,13 @@ Return<void> KeymasterDevice::begin(
                  response.handle().handle());
         return Void();
     }
-    ErrorCode error_code = buffer_begin(response.handle().handle(), algorithm);
+    // The block mode decides how much data the device takes at once
+    BlockMode block_mode = BlockMode::ECB;
+    if (tag_index.contains(Tag::BLOCK_MODE)) {
+        block_mode = tag_index.find(Tag::BLOCK_MODE)->f.blockMode;
+    }
+    ErrorCode error_code = buffer_begin(response.handle().handle(), algorithm,
+                                        block_mode);
     if (error_code != ErrorCode::OK) {
         if (this->abort(response.handle().handle()) != ErrorCode::OK) {
             LOG(ERROR) << "abort( " << response.handle().handle()
@@ -1058,8 +972,30 @@ Return<void> KeymasterDevice::update(
 {
     LOG(VERBOSE) << "Running KeymasterDevice::update";
 
-    UpdateOperationRequest request;
-    UpdateOperationResponse response;
+    if (public_key_operation(operationHandle)) {
+        uint32_t consumed = 0;
+        const ErrorCode error_code =
+            public_key_update(operationHandle, input, &consumed);
+        _hidl_cb(error_code, consumed, hidl_vec<KeyParameter>{},
+                 hidl_vec<uint8_t>{});
+        return Void();
+    }
+
+    OperationLock lock(operationHandle);
+    return UpdateLocked(operationHandle, inParams, input, authToken,
+                        verificationToken, _hidl_cb);
+}
+
+Return<void> KeymasterDevice::UpdateLocked(
+        uint64_t operationHandle,
+        const hidl_vec<KeyParameter>& inParams,
+        const hidl_vec<uint8_t>& input,
+        const HardwareAuthToken& authToken,
+        const VerificationToken& verificationToken,
+        update_cb _hidl_cb)
+{
+    KM_THREAD_MESSAGE(UpdateOperationRequest, request);
+    KM_THREAD_MESSAGE(UpdateOperationResponse, response);
 
     uint32_t consumed;
     hidl_vec<uint8_t> output;
@@ -1137,82 +1073,112 @@ Return<void> KeymasterDevice::finish(
 {
     LOG(VERBOSE) << "Running KeymasterDevice::finish";
 
-    FinishOperationRequest request;
-    FinishOperationResponse response;
+    if (public_key_operation(operationHandle)) {
+        hidl_vec<uint8_t> output;
+        const ErrorCode error_code =
+            public_key_finish(operationHandle, input, signature, &output);
+        _hidl_cb(error_code, hidl_vec<KeyParameter>{}, output);
+        return Void();
+    }
+
+    OperationLock lock(operationHandle);
+
+    KM_THREAD_MESSAGE(FinishOperationRequest, request);
+    KM_THREAD_MESSAGE(FinishOperationResponse, response);
 
     ErrorCode error_code;
+    hidl_vec<KeyParameter> params;
     hidl_vec<uint8_t> output;
 
-    // Consume any input data via update calls.
+    // The params and tokens are translated once. Params returned by each
+    // update replace those sent with the next request, as keystore would.
+    KM_THREAD_MESSAGE(UpdateOperationRequest, update_request);
+    KM_THREAD_MESSAGE(UpdateOperationResponse, update_response);
+    update_request.mutable_handle()->set_handle(operationHandle);
+    if (hidl_params_to_pb(
+            inParams, update_request.mutable_params()) != ErrorCode::OK) {
+      _hidl_cb(ErrorCode::INVALID_ARGUMENT, params, output);
+      return Void();
+    }
+    if (translate_auth_token(
+            authToken, update_request.mutable_auth_token()) != ErrorCode::OK) {
+        _hidl_cb(ErrorCode::INVALID_ARGUMENT, params, output);
+        return Void();
+    }
+    translate_verification_token(verificationToken,
+                                 update_request.mutable_verification_token());
+
+    Algorithm algorithm;
+    buffer_algorithm(operationHandle, &algorithm);
+
+    // Room for everything plus a padding block, a GCM tag or an RSA
+    // signature, so the output is only copied once.
+    std::vector<uint8_t> output_buf;
+    output_buf.reserve(input.size() + buffer_remaining(operationHandle) + 512);
+
+    // Consume any input data via updates.
     size_t consumed = 0;
-    hidl_vec<KeyParameter> input_params = inParams;
-    string update_output_str;
+    hidl_vec<uint8_t> blocks;
     while (consumed < input.size()) {
-        hidl_vec<KeyParameter> out_params;
-        update_cb _update_hidl_cb =
-            [&] (
-                ErrorCode error, uint32_t input_consumed,
-                const hidl_vec<KeyParameter>& params,
-                const hidl_vec<uint8_t>& update_output) {
-                    error_code = error;
-                    if (error == ErrorCode::OK) {
-                        consumed += input_consumed;
-                        input_params = params;  // Update the params.
-                        update_output_str += hidlVec2String(update_output);
-                    }
-            };
-
         hidl_vec<uint8_t> input_data;
         input_data.setToExternal(const_cast<uint8_t*>(&input.data()[consumed]),
                                  input.size() - consumed);
-        update(operationHandle, input_params, input_data, authToken,
-               verificationToken, _update_hidl_cb);
+        uint32_t input_consumed;
+        error_code = buffer_append(operationHandle, input_data, &input_consumed);
+        if (error_code == ErrorCode::OK) {
+            error_code = buffer_peek(operationHandle, &blocks);
+        }
         if (error_code != ErrorCode::OK) {
-            _hidl_cb(error_code,
-                     hidl_vec<KeyParameter>{}, hidl_vec<uint8_t>{});
+            _hidl_cb(error_code, params, output);
             return Void();
         }
+
+        update_request.set_input(blocks.data(), blocks.size());
+        KM_CALLV_ABORT(UpdateOperation, update_request, update_response,
+                       hidl_vec<KeyParameter>{}, hidl_vec<uint8_t>{});
+
+        if (buffer_advance(operationHandle,
+                           update_response.consumed()) != ErrorCode::OK) {
+            _hidl_cb(ErrorCode::UNKNOWN_ERROR, params, output);
+            return Void();
+        }
+        update_request.mutable_params()->Swap(update_response.mutable_params());
+        output_buf.insert(output_buf.end(),
+                          update_response.output().begin(),
+                          update_response.output().end());
+
+        // Special case ECDSA sign + Digest::NONE, which discards all but
+        // the left-most len(SHA256) bytes.
+        if (algorithm == Algorithm::EC && update_response.consumed() == 0 &&
+            buffer_remaining(operationHandle) >= SHA256_DIGEST_LENGTH) {
+            break;
+        }
+        consumed += input_consumed;
     }
 
     hidl_vec<uint8_t> data;
     error_code = buffer_final(operationHandle, &data);
     if (error_code != ErrorCode::OK) {
-        _hidl_cb(error_code,
-                 hidl_vec<KeyParameter>{}, hidl_vec<uint8_t>{});
+        _hidl_cb(error_code, params, output);
         return Void();
     }
 
     request.mutable_handle()->set_handle(operationHandle);
-
-    hidl_vec<KeyParameter> params;
-    if (hidl_params_to_pb(
-            input_params, request.mutable_params()) != ErrorCode::OK) {
-      _hidl_cb(ErrorCode::INVALID_ARGUMENT, params, output);
-      return Void();
-    }
-
-    request.set_input(&data[0], data.size());
-    request.set_signature(&signature[0], signature.size());
-
-    if (translate_auth_token(
-            authToken, request.mutable_auth_token()) != ErrorCode::OK) {
-        _hidl_cb(ErrorCode::INVALID_ARGUMENT, params, output);
-        return Void();
-    }
-    translate_verification_token(verificationToken,
-                                 request.mutable_verification_token());
+    request.mutable_params()->Swap(update_request.mutable_params());
+    request.set_input(data.data(), data.size());
+    request.set_signature(signature.data(), signature.size());
+    request.mutable_auth_token()->Swap(update_request.mutable_auth_token());
+    request.mutable_verification_token()->Swap(
+        update_request.mutable_verification_token());
 
     KM_CALLV_ABORT(FinishOperation, request, response,
                    hidl_vec<KeyParameter>{}, hidl_vec<uint8_t>{});
 
     pb_to_hidl_params(response.params(), &params);
-    // Concatenate accumulated output from Update().
-    update_output_str += string(
-        response.output().data(), response.output().size());
-    output.setToExternal(
-        reinterpret_cast<uint8_t*>(const_cast<char*>(
-                                       update_output_str.data())),
-        update_output_str.size(), false);
+    // Concatenate accumulated output from the updates.
+    output_buf.insert(output_buf.end(),
+                      response.output().begin(), response.output().end());
+    output.setToExternal(output_buf.data(), output_buf.size(), false);
 
     _hidl_cb(ErrorCode::OK, params, output);
     return Void();
@@ -1222,8 +1188,15 @@ Return<ErrorCode> KeymasterDevice::abort(uint64_t operationHandle)
 {
     LOG(VERBOSE) << "Running KeymasterDevice::abort";
 
-    AbortOperationRequest request;
-    AbortOperationResponse response;
+    if (public_key_operation(operationHandle)) {
+        return public_key_abort(operationHandle);
+    }
+    // The device forgets the operation whatever it answers, so the HAL does
+    // too; this also runs from the error paths of update() and finish().
+    buffer_final(operationHandle, nullptr);
+
+    KM_THREAD_MESSAGE(AbortOperationRequest, request);
+    KM_THREAD_MESSAGE(AbortOperationResponse, response);
 
     request.mutable_handle()->set_handle(operationHandle);
 
@@ -1244,8 +1217,8 @@ Return<void> KeymasterDevice::importWrappedKey(
     LOG(VERBOSE) << "Running KeymasterDevice::importWrappedKey";
 
     ErrorCode error;
-    ImportWrappedKeyRequest request;
-    ImportKeyResponse response;
+    KM_THREAD_MESSAGE(ImportWrappedKeyRequest, request);
+    KM_THREAD_MESSAGE(ImportKeyResponse, response);
 
     if (maskingKey.size() != KM_WRAPPER_MASKING_KEY_SIZE) {
         _hidl_cb(ErrorCode::INVALID_ARGUMENT, hidl_vec<uint8_t>{},
@@ -1290,10 +1263,26 @@ Return<void> KeymasterDevice::importWrappedKey(
     return Void();
 }
 
+// Methods from ::android::hidl::base::V1_0::IBase follow.
+Return<void> KeymasterDevice::debug(const hidl_handle& fd,
+                                    const hidl_vec<hidl_string>& /* options */)
+{
+    if (fd.getNativeHandle() == nullptr || fd->numFds < 1) {
+        return Void();
+    }
+
+    dump_cache_stats(fd->data[0], "Key characteristics",
+                     _characteristics_cache->stats());
+    dump_cache_stats(fd->data[0], "Exported key", _export_cache->stats());
+    dprintf(fd->data[0], "Unsupported parameters learned: %zu\n",
+            _capabilities->size());
+    return Void();
+}
+
 // Private methods.
-Return<ErrorCode> KeymasterDevice::SendSystemVersionInfo() const {
-    SetSystemVersionInfoRequest request;
-    SetSystemVersionInfoResponse response;
+Return<ErrorCode> KeymasterDevice::SendSystemVersionInfo() {
+    KM_THREAD_MESSAGE(SetSystemVersionInfoRequest, request);
+    KM_THREAD_MESSAGE(SetSystemVersionInfoResponse, response);
 
     request.set_system_version(_os_version);
     request.set_system_security_level(_os_patchlevel);
@@ -1303,9 +1292,293 @@ Return<ErrorCode> KeymasterDevice::SendSystemVersionInfo() const {
     return ErrorCode::OK;
 }
 
+namespace {
+
+// The streaming modes whose chunk size is probed. HMAC has no block mode.
+constexpr struct {
+    Algorithm algorithm;
+    BlockMode blockMode;
+} kChunkProbes[] = {
+    {Algorithm::AES, BlockMode::ECB},
+    {Algorithm::AES, BlockMode::CBC},
+    {Algorithm::AES, BlockMode::CTR},
+    {Algorithm::AES, BlockMode::GCM},
+    {Algorithm::TRIPLE_DES, BlockMode::ECB},
+    {Algorithm::TRIPLE_DES, BlockMode::CBC},
+    {Algorithm::HMAC, BlockMode::ECB},
+};
+
+// The chunk sizes tried after the one every mode takes, up to the largest the
+// protos carry. Each is a whole number of AES and 3DES blocks.
+constexpr size_t kProbeChunkSizes[] = {768, 1536, KM_MAX_PROTO_FIELD_SIZE};
+
+KeyParameter ProbeParam(Tag tag, uint32_t value) {
+    KeyParameter param;
+    param.tag = tag;
+    param.f.integer = value;
+    return param;
+}
+
+}  // namespace
+
+void KeymasterDevice::LearnChunkSizes() {
+    for (const auto& probe : kChunkProbes) {
+        const size_t size = ProbeChunkSize(probe.algorithm, probe.blockMode);
+        if (size != 0) {
+            LOG(INFO) << "Device takes " << size << " bytes per update for "
+                      << probe.algorithm << "/" << probe.blockMode;
+            buffer_set_chunk_size(probe.algorithm, probe.blockMode, size);
+        }
+    }
+}
+
+size_t KeymasterDevice::ProbeChunkSize(Algorithm algorithm,
+                                       BlockMode blockMode) {
+    const bool hmac = algorithm == Algorithm::HMAC;
+    const KeyPurpose purpose = hmac ? KeyPurpose::SIGN : KeyPurpose::ENCRYPT;
+    std::vector<KeyParameter> keyParams = {
+        ProbeParam(Tag::ALGORITHM, static_cast<uint32_t>(algorithm)),
+        ProbeParam(Tag::PURPOSE, static_cast<uint32_t>(purpose)),
+    };
+    std::vector<KeyParameter> beginParams;
+    if (hmac) {
+        keyParams.push_back(ProbeParam(Tag::KEY_SIZE, 256));
+        beginParams.push_back(ProbeParam(
+            Tag::DIGEST, static_cast<uint32_t>(Digest::SHA_2_256)));
+        beginParams.push_back(ProbeParam(Tag::MAC_LENGTH, 256));
+        keyParams.push_back(beginParams[0]);
+        keyParams.push_back(ProbeParam(Tag::MIN_MAC_LENGTH, 256));
+    } else {
+        keyParams.push_back(ProbeParam(
+            Tag::KEY_SIZE, algorithm == Algorithm::AES ? 128 : 168));
+        beginParams.push_back(ProbeParam(
+            Tag::BLOCK_MODE, static_cast<uint32_t>(blockMode)));
+        beginParams.push_back(ProbeParam(
+            Tag::PADDING, static_cast<uint32_t>(PaddingMode::NONE)));
+        keyParams.insert(keyParams.end(), beginParams.begin(),
+                         beginParams.end());
+        if (blockMode == BlockMode::GCM) {
+            beginParams.push_back(ProbeParam(Tag::MAC_LENGTH, 128));
+            keyParams.push_back(ProbeParam(Tag::MIN_MAC_LENGTH, 128));
+        }
+    }
+    KeyParameter noAuth;
+    noAuth.tag = Tag::NO_AUTH_REQUIRED;
+    noAuth.f.boolValue = true;
+    keyParams.push_back(noAuth);
+
+    // A throwaway key, so a probe that goes wrong can't hurt a client's
+    // operation. The device may not support every mode.
+    GenerateKeyRequest keyRequest;
+    GenerateKeyResponse keyResponse;
+    if (hidl_params_to_pb(hidl_vec<KeyParameter>(keyParams),
+                          keyRequest.mutable_params()) != ErrorCode::OK) {
+        return 0;
+    }
+    keyRequest.set_creation_time_ms(ms_since_epoch());
+    if (_keymaster.GenerateKey(keyRequest, &keyResponse) != APP_SUCCESS ||
+        translate_error_code(keyResponse.error_code()) != ErrorCode::OK) {
+        return 0;
+    }
+
+    BeginOperationRequest beginRequest;
+    BeginOperationResponse beginResponse;
+    beginRequest.set_purpose(static_cast<nosapp::KeyPurpose>(purpose));
+    *beginRequest.mutable_blob() = keyResponse.blob();
+    if (hidl_params_to_pb(hidl_vec<KeyParameter>(beginParams),
+                          beginRequest.mutable_params()) != ErrorCode::OK) {
+        return 0;
+    }
+    if (_keymaster.BeginOperation(beginRequest, &beginResponse) != APP_SUCCESS ||
+        translate_error_code(beginResponse.error_code()) != ErrorCode::OK) {
+        return 0;
+    }
+
+    // Each size is sent once. The first the device fails or doesn't take
+    // whole ends the probe; the operation is thrown away so isn't retried.
+    size_t taken = 0;
+    UpdateOperationRequest updateRequest;
+    UpdateOperationResponse updateResponse;
+    updateRequest.mutable_handle()->set_handle(beginResponse.handle().handle());
+    for (size_t size : kProbeChunkSizes) {
+        updateRequest.set_input(std::string(size, '\0'));
+        updateResponse.Clear();
+        if (_keymaster.UpdateOperation(updateRequest, &updateResponse) !=
+                APP_SUCCESS ||
+            translate_error_code(updateResponse.error_code()) != ErrorCode::OK ||
+            updateResponse.consumed() != size) {
+            break;
+        }
+        taken = size;
+    }
+
+    AbortOperationRequest abortRequest;
+    AbortOperationResponse abortResponse;
+    abortRequest.mutable_handle()->set_handle(beginResponse.handle().handle());
+    _keymaster.AbortOperation(abortRequest, &abortResponse);
+    return taken;
+}
+
+void KeymasterDevice::InvalidateCaches(const hidl_vec<uint8_t>& keyBlob) {
+    _characteristics_cache->invalidate(keyBlob);
+    _export_cache->invalidate(keyBlob);
+}
+
+void KeymasterDevice::ClearCaches() {
+    _characteristics_cache->clear();
+    _export_cache->clear();
+    _capabilities->clear();
+}
+
+ErrorCode KeymasterDevice::GetPublicKey(
+        KeyFormat exportFormat, const hidl_vec<uint8_t>& keyBlob,
+        const hidl_vec<uint8_t>& clientId, const hidl_vec<uint8_t>& appData,
+        std::shared_ptr<const hidl_vec<uint8_t>> *der) {
+    // A key's public half never changes, so the DER is only built once.
+    const uint32_t variant = static_cast<uint32_t>(exportFormat);
+    *der = _export_cache->lookup(keyBlob, clientId, appData, variant);
+    if (*der) {
+        return ErrorCode::OK;
+    }
+
+    KM_THREAD_MESSAGE(ExportKeyRequest, request);
+    KM_THREAD_MESSAGE(ExportKeyResponse, response);
+
+    request.set_format((::nugget::app::keymaster::KeyFormat)exportFormat);
+    request.mutable_blob()->set_blob(&keyBlob[0], keyBlob.size());
+    request.set_client_id(&clientId[0], clientId.size());
+    request.set_app_data(&appData[0], appData.size());
+
+    KM_CALL(ExportKey, request, response);
+
+    hidl_vec<uint8_t> converted;
+    ErrorCode error_code = export_key_der(response, &converted);
+    if (error_code != ErrorCode::OK) {
+        LOG(ERROR) << "KeymasterDevice::exportKey: DER conversion failed: "
+                   << error_code;
+        return error_code;
+    }
+
+    *der = _export_cache->insert(keyBlob, clientId, appData,
+                                 std::move(converted), variant);
+    return ErrorCode::OK;
+}
+
+bool KeymasterDevice::KeyIsCurrent(
+        const KeyCharacteristics& characteristics) const {
+    for (const auto* params : {&characteristics.hardwareEnforced,
+                               &characteristics.softwareEnforced}) {
+        for (const auto& param : *params) {
+            if ((param.tag == Tag::OS_VERSION &&
+                 param.f.integer != _os_version) ||
+                (param.tag == Tag::OS_PATCHLEVEL &&
+                 param.f.integer != _os_patchlevel) ||
+                (param.tag == Tag::VENDOR_PATCHLEVEL &&
+                 param.f.integer != _vendor_patchlevel)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+ErrorCode KeymasterDevice::BeginPublicKeyOperation(
+        KeyPurpose purpose, const hidl_vec<uint8_t>& keyBlob,
+        const hidl_vec<KeyParameter>& inParams, uint64_t *handle) {
+    TagIndex tag_index;
+    if (hidl_params_to_index(inParams, &tag_index) != ErrorCode::OK) {
+        return ErrorCode::UNIMPLEMENTED;
+    }
+    // AES and 3DES operations always give a block mode, so don't fetch
+    // their characteristics.
+    if (tag_index.contains(Tag::BLOCK_MODE)) {
+        return ErrorCode::UNIMPLEMENTED;
+    }
+    hidl_vec<uint8_t> client_id;
+    if (tag_index.contains(Tag::APPLICATION_ID)) {
+        client_id = tag_index.find(Tag::APPLICATION_ID)->blob;
+    }
+    hidl_vec<uint8_t> app_data;
+    if (tag_index.contains(Tag::APPLICATION_DATA)) {
+        app_data = tag_index.find(Tag::APPLICATION_DATA)->blob;
+    }
+
+    // Anything unexpected, including errors, is left for the device to
+    // report from its own begin().
+    std::shared_ptr<const KeyCharacteristics> characteristics;
+    if (GetCharacteristics(keyBlob, client_id, app_data,
+                           &characteristics) != ErrorCode::OK ||
+        !KeyIsCurrent(*characteristics) ||
+        !public_key_supported(purpose, inParams, *characteristics)) {
+        return ErrorCode::UNIMPLEMENTED;
+    }
+    std::shared_ptr<const hidl_vec<uint8_t>> der;
+    if (GetPublicKey(KeyFormat::X509, keyBlob, client_id, app_data,
+                     &der) != ErrorCode::OK) {
+        return ErrorCode::UNIMPLEMENTED;
+    }
+    const ErrorCode error_code = public_key_begin(
+        purpose, *der, inParams, *characteristics, handle);
+    // The HAL's own operation limit is reported. The device reports
+    // anything else wrong with the request from its begin().
+    if (error_code != ErrorCode::OK &&
+        error_code != ErrorCode::TOO_MANY_OPERATIONS) {
+        return ErrorCode::UNIMPLEMENTED;
+    }
+    return error_code;
+}
+
+bool KeymasterDevice::CachedKeyAlgorithm(
+        const hidl_vec<uint8_t>& keyBlob, const TagIndex& inParams,
+        Algorithm *algorithm) {
+    hidl_vec<uint8_t> client_id;
+    if (inParams.contains(Tag::APPLICATION_ID)) {
+        client_id = inParams.find(Tag::APPLICATION_ID)->blob;
+    }
+    hidl_vec<uint8_t> app_data;
+    if (inParams.contains(Tag::APPLICATION_DATA)) {
+        app_data = inParams.find(Tag::APPLICATION_DATA)->blob;
+    }
+    const std::shared_ptr<const KeyCharacteristics> characteristics =
+        _characteristics_cache->lookup(keyBlob, client_id, app_data);
+    return characteristics != nullptr &&
+           key_algorithm(*characteristics, algorithm);
+}
+
+ErrorCode KeymasterDevice::GetCharacteristics(
+        const hidl_vec<uint8_t>& keyBlob, const hidl_vec<uint8_t>& clientId,
+        const hidl_vec<uint8_t>& appData,
+        std::shared_ptr<const KeyCharacteristics> *characteristics) {
+    *characteristics =
+        _characteristics_cache->lookup(keyBlob, clientId, appData);
+    if (*characteristics) {
+        return ErrorCode::OK;
+    }
+
+    KM_THREAD_MESSAGE(GetKeyCharacteristicsRequest, request);
+    KM_THREAD_MESSAGE(GetKeyCharacteristicsResponse, response);
+
+    request.mutable_blob()->set_blob(&keyBlob[0], keyBlob.size());
+    request.set_client_id(&clientId[0], clientId.size());
+    request.set_app_data(&appData[0], appData.size());
+
+    // Call device.
+    KM_CALL(GetKeyCharacteristics, request, response);
+
+    KeyCharacteristics fetched;
+    pb_to_hidl_params(response.characteristics().software_enforced(),
+                      &fetched.softwareEnforced);
+    pb_to_hidl_params(response.characteristics().tee_enforced(),
+                      &fetched.hardwareEnforced);
+    // Copied, not moved, so the cached blobs stop pointing into response
+    *characteristics = _characteristics_cache->insert(
+        keyBlob, clientId, appData, fetched);
+    return ErrorCode::OK;
+}
+
 Return<ErrorCode> KeymasterDevice::GetBootInfo() {
-    GetBootInfoRequest request;
-    GetBootInfoResponse response;
+    KM_THREAD_MESSAGE(GetBootInfoRequest, request);
+    KM_THREAD_MESSAGE(GetBootInfoResponse, response);
 
     KM_CALL(GetBootInfo, request, response);
 
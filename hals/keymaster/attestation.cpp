@@ -0,0 +1,165 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "attestation.h"
+#include "certs.h"
+
+#include <Keymaster.client.h>
+
+#include <string.h>
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+
+// App
+namespace nosapp = ::nugget::app::keymaster;
+
+namespace {
+
+struct Cert {
+    const uint8_t *data;
+    size_t size;
+};
+
+#define CERT(name) Cert{name, sizeof(name)}
+
+struct BatchChain {
+    Cert batch;
+    Cert intermediate;
+    Cert root;
+};
+
+enum BatchCerts { TEST_CERTS, DEV_CERTS, PROD_CERTS, BATCH_CERTS_COUNT };
+enum ChainAlgorithm { CHAIN_RSA, CHAIN_EC, CHAIN_ALGORITHM_COUNT };
+
+// Indexed by BatchCerts then ChainAlgorithm
+const BatchChain kBatchChains[BATCH_CERTS_COUNT][CHAIN_ALGORITHM_COUNT] = {
+    {  // TEST_CERTS
+        {CERT(TEST_BATCH_RSA_CERT), CERT(TEST_BATCH_RSA_INT_CERT),
+         CERT(TEST_BATCH_ROOT_CERT)},
+        {CERT(TEST_BATCH_EC_CERT), CERT(TEST_BATCH_EC_INT_CERT),
+         CERT(TEST_BATCH_ROOT_CERT)},
+    },
+    {  // DEV_CERTS
+        {CERT(DEV_BATCH_RSA_CERT), CERT(DEV_BATCH_RSA_INT_CERT),
+         CERT(DEV_BATCH_ROOT_CERT)},
+        {CERT(DEV_BATCH_EC_CERT), CERT(DEV_BATCH_EC_INT_CERT),
+         CERT(DEV_BATCH_ROOT_CERT)},
+    },
+    {  // PROD_CERTS
+        {CERT(PROD_BATCH_RSA_CERT), CERT(PROD_BATCH_RSA_INT_CERT),
+         CERT(PROD_BATCH_ROOT_CERT)},
+        {CERT(PROD_BATCH_EC_CERT), CERT(PROD_BATCH_EC_INT_CERT),
+         CERT(PROD_BATCH_ROOT_CERT)},
+    },
+};
+
+#undef CERT
+
+void set_cert(const Cert& cert, hidl_vec<uint8_t> *out)
+{
+    out->setToExternal(const_cast<uint8_t*>(cert.data), cert.size,
+                       false /* shouldOwn */);
+}
+
+size_t integer_size(uint64_t value)
+{
+    size_t octet_count = 1;
+    for (value >>= 8; value; value >>= 8) {
+        octet_count++;
+    }
+    return octet_count;
+}
+
+size_t encoded_length_size(size_t length)
+{
+    if (length < 0x80) {
+        return 1;
+    }
+    return integer_size(length) + 1;
+}
+
+// Writes the DER encoding of the length and returns its end.
+uint8_t *asn1_encode_length(size_t length, uint8_t *head)
+{
+    if (length < 0x80) {
+        // Short length case
+        *head++ = length;
+        return head;
+    }
+
+    // Length of the length, then the length big-endian
+    const size_t length_len = integer_size(length);
+    *head++ = 0x80 | length_len;
+    for (size_t i = length_len; i > 0; i--) {
+        *head++ = (length >> ((i - 1) * 8)) & 0xFF;
+    }
+    return head;
+}
+
+uint8_t *append(uint8_t *head, const void *data, size_t size)
+{
+    memcpy(head, data, size);
+    return head + size;
+}
+
+}  // namespace
+
+void attestation_batch_chain(bool nodelocked_ro, uint32_t chip_fusing,
+                             Algorithm algorithm,
+                             hidl_vec<hidl_vec<uint8_t>> *chain)
+{
+    // Node-locked RO implies that factory provisioned certs
+    // (if any), are inaccessible, so fallback to the TEST
+    // certs.  Similarly, PROTO chips were not provisioned
+    // with certs, and hence will fallback to TEST certs.
+    BatchCerts certs = PROD_CERTS;
+    if (nodelocked_ro || chip_fusing == nosapp::FUSING_PROTO) {
+        certs = TEST_CERTS;
+    } else if (chip_fusing == nosapp::FUSING_DVT) {
+        certs = DEV_CERTS;
+    }
+    const BatchChain& batch_chain = kBatchChains[certs][
+        algorithm == Algorithm::RSA ? CHAIN_RSA : CHAIN_EC];
+
+    chain->resize(4);
+    set_cert(batch_chain.batch, &(*chain)[1]);
+    set_cert(batch_chain.intermediate, &(*chain)[2]);
+    set_cert(batch_chain.root, &(*chain)[3]);
+}
+
+void assemble_attestation_certificate(
+    const std::string& prologue, const hidl_vec<uint8_t>& application_id,
+    const std::string& body, const std::string& epilogue,
+    hidl_vec<uint8_t> *certificate)
+{
+    const size_t cert_len = prologue.size() + application_id.size()
+                          + body.size() + epilogue.size();
+
+    certificate->resize(1 + encoded_length_size(cert_len) + cert_len);
+    uint8_t *head = certificate->data();
+    *head++ = 0x30;  // DER_SEQUENCE | DER_CONSTRUCTED
+    head = asn1_encode_length(cert_len, head);
+    head = append(head, prologue.data(), prologue.size());
+    head = append(head, application_id.data(), application_id.size());
+    head = append(head, body.data(), body.size());
+    append(head, epilogue.data(), epilogue.size());
+}
+
+}  // namespace keymaster
+}  // namespace hardware
+}  // namespace android
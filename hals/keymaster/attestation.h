@@ -0,0 +1,50 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_KEYMASTER_ATTESTATION_H
+#define ANDROID_HARDWARE_KEYMASTER_ATTESTATION_H
+
+#include <android/hardware/keymaster/4.0/IKeymasterDevice.h>
+
+#include <string>
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+
+// HAL
+using ::android::hardware::keymaster::V4_0::Algorithm;
+using ::android::hardware::hidl_vec;
+
+// Fills in the batch, intermediate and root certificates that follow the
+// attestation certificate at the start of the chain. The certificates are chosen by the
+// chip's fusing and the key's algorithm and are not copied.
+void attestation_batch_chain(bool nodelocked_ro, uint32_t chip_fusing,
+                             Algorithm algorithm,
+                             hidl_vec<hidl_vec<uint8_t>> *chain);
+
+// Joins the pieces of the attestation certificate from the device under
+// their DER SEQUENCE header.
+void assemble_attestation_certificate(
+    const std::string& prologue, const hidl_vec<uint8_t>& application_id,
+    const std::string& body, const std::string& epilogue,
+    hidl_vec<uint8_t> *certificate);
+
+}  // namespace keymaster
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_KEYMASTER_ATTESTATION_H
@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_KEYMASTER_BENCHMARK_ALLOCATION_COUNTER_H
+#define ANDROID_HARDWARE_KEYMASTER_BENCHMARK_ALLOCATION_COUNTER_H
+
+#include <benchmark/benchmark.h>
+
+#include <cstddef>
+
+// Allocations made by the whole binary so far, counted by its replacement
+// of operator new.
+size_t allocation_count();
+
+// Reports the allocations made per iteration since the given count.
+inline void ReportAllocations(benchmark::State& state, size_t start) {
+    state.counters["allocs"] = benchmark::Counter(
+        allocation_count() - start, benchmark::Counter::kAvgIterations);
+}
+
+#endif  // ANDROID_HARDWARE_KEYMASTER_BENCHMARK_ALLOCATION_COUNTER_H
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "../attestation.h"
+
+#include <Keymaster.client.h>
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <vector>
+
+using ::android::hardware::hidl_vec;
+using ::android::hardware::keymaster::assemble_attestation_certificate;
+using ::android::hardware::keymaster::attestation_batch_chain;
+using ::android::hardware::keymaster::V4_0::Algorithm;
+
+namespace nosapp = ::nugget::app::keymaster;
+
+namespace {
+
+// Builds the chain attestKey() returns from pieces the size of those the
+// device sends for an EC key.
+void BM_AssembleAttestation(benchmark::State& state) {
+    const std::string prologue(320, 'p');
+    const hidl_vec<uint8_t> applicationId(std::vector<uint8_t>(96, 'a'));
+    const std::string body(640, 'b');
+    const std::string epilogue(80, 'e');
+
+    for (auto _ : state) {
+        hidl_vec<hidl_vec<uint8_t>> chain(4);
+        assemble_attestation_certificate(prologue, applicationId, body,
+                                         epilogue, &chain[0]);
+        attestation_batch_chain(false, nosapp::FUSING_DVT, Algorithm::EC,
+                                &chain);
+        benchmark::DoNotOptimize(chain.data());
+    }
+}
+BENCHMARK(BM_AssembleAttestation);
+
+}  // namespace
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "../buffer.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <vector>
+
+using ::android::hardware::hidl_vec;
+using ::android::hardware::keymaster::buffer_advance;
+using ::android::hardware::keymaster::buffer_append;
+using ::android::hardware::keymaster::buffer_begin;
+using ::android::hardware::keymaster::buffer_final;
+using ::android::hardware::keymaster::buffer_peek;
+using ::android::hardware::keymaster::buffer_remaining;
+using ::android::hardware::keymaster::buffer_set_chunk_size;
+using ::android::hardware::keymaster::V4_0::Algorithm;
+using ::android::hardware::keymaster::V4_0::BlockMode;
+
+namespace {
+
+constexpr size_t kMessageSize = 64 * 1024;
+
+// Streams a message through an operation the way update() and finish() do,
+// with the device consuming everything it is given. The argument is the size
+// of each update() from the client.
+void StreamMessage(benchmark::State& state, Algorithm algorithm) {
+    const size_t updateSize = state.range(0);
+    const hidl_vec<uint8_t> chunk(std::vector<uint8_t>(updateSize, 0xa5));
+    hidl_vec<uint8_t> blocks;
+    uint64_t handle = 1;
+
+    for (auto _ : state) {
+        buffer_begin(handle, algorithm);
+        for (size_t sent = 0; sent < kMessageSize;) {
+            uint32_t consumed;
+            buffer_append(handle, chunk, &consumed);
+            buffer_peek(handle, &blocks);
+            buffer_advance(handle, blocks.size());
+            sent += consumed;
+        }
+        buffer_final(handle, &blocks);
+        benchmark::DoNotOptimize(blocks.data());
+        handle++;
+    }
+    state.SetBytesProcessed(state.iterations() * kMessageSize);
+}
+
+void BM_AesStream(benchmark::State& state) {
+    StreamMessage(state, Algorithm::AES);
+}
+BENCHMARK(BM_AesStream)->Arg(16)->Arg(100)->Arg(384)->Arg(4096);
+
+void BM_HmacStream(benchmark::State& state) {
+    StreamMessage(state, Algorithm::HMAC);
+}
+BENCHMARK(BM_HmacStream)->Arg(16)->Arg(100)->Arg(384)->Arg(4096);
+
+// Looking an operation up among others that are also live.
+void BM_Lookup(benchmark::State& state) {
+    const uint64_t live = state.range(0);
+    for (uint64_t i = 0; i < live; ++i) {
+        buffer_begin(0x1000 + i * 7919, Algorithm::AES);
+    }
+
+    uint64_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(buffer_remaining(0x1000 + (i++ % live) * 7919));
+    }
+
+    for (uint64_t i = 0; i < live; ++i) {
+        buffer_final(0x1000 + i * 7919, nullptr);
+    }
+}
+BENCHMARK(BM_Lookup)->Arg(1)->Arg(4)->Arg(16);
+
+// Models the cost of each update() round trip to the device: a fixed part for
+// the HIDL, binder and SPI transactions and a part for moving the data over
+// SPI in both directions.
+constexpr double kRoundTripSeconds = 1.5e-3;
+constexpr double kSecondsPerByte = 2 * 8 / 10e6;  // 10 Mbit/s each way
+
+// Encrypts 1MiB on a device that takes up to the first argument's bytes per
+// call, reporting the simulated device throughput. The chunk size is what
+// LearnChunkSizes() finds for such a device.
+void BM_SimulatedDeviceStream(benchmark::State& state) {
+    constexpr size_t kLargeMessageSize = 1024 * 1024;
+    const size_t deviceMax = state.range(0);
+    const BlockMode blockMode = static_cast<BlockMode>(state.range(1));
+    buffer_set_chunk_size(Algorithm::AES, blockMode, deviceMax);
+    const hidl_vec<uint8_t> input(std::vector<uint8_t>(kLargeMessageSize, 0x5a));
+    hidl_vec<uint8_t> blocks;
+    uint64_t handle = 0x10000;
+
+    for (auto _ : state) {
+        size_t calls = 0;
+        size_t bytes = 0;
+        buffer_begin(handle, Algorithm::AES, blockMode);
+        for (size_t sent = 0; sent < input.size();) {
+            // Keystore passes everything not yet consumed to each update()
+            const hidl_vec<uint8_t> rest(input.begin() + sent, input.end());
+            uint32_t consumed;
+            buffer_append(handle, rest, &consumed);
+            buffer_peek(handle, &blocks);
+            const size_t taken = std::min(blocks.size(), deviceMax);
+            buffer_advance(handle, taken);
+            calls++;
+            bytes += 2 * taken;
+            sent += consumed;
+        }
+        buffer_final(handle, &blocks);
+        calls++;
+        bytes += 2 * blocks.size();
+        handle++;
+
+        state.SetIterationTime(calls * kRoundTripSeconds +
+                               bytes / 2 * kSecondsPerByte);
+    }
+    state.SetBytesProcessed(state.iterations() * kLargeMessageSize);
+}
+// Each device size uses its own mode since the chunk size is kept per mode
+BENCHMARK(BM_SimulatedDeviceStream)
+    ->Args({384, static_cast<int>(BlockMode::ECB)})
+    ->Args({1536, static_cast<int>(BlockMode::CTR)})
+    ->Args({2048, static_cast<int>(BlockMode::CBC)})
+    ->UseManualTime();
+
+}  // namespace
+
+BENCHMARK_MAIN();
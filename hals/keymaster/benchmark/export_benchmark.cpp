@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <MockKeymaster.client.h>
+#include <KeymasterDevice.h>
+
+#include <application.h>
+
+#include <benchmark/benchmark.h>
+#include <gmock/gmock.h>
+
+#include <openssl/bn.h>
+#include <openssl/ec.h>
+#include <openssl/nid.h>
+
+#include <cstring>
+#include <vector>
+
+using ::testing::_;
+using ::testing::Invoke;
+using ::testing::NiceMock;
+
+using ::android::hardware::hidl_vec;
+using ::android::hardware::keymaster::KeymasterDevice;
+using ::android::hardware::keymaster::V4_0::ErrorCode;
+using ::android::hardware::keymaster::V4_0::KeyFormat;
+
+using ::nugget::app::keymaster::ExportKeyRequest;
+using ::nugget::app::keymaster::ExportKeyResponse;
+using ::nugget::app::keymaster::MockKeymaster;
+
+namespace nosapp = ::nugget::app::keymaster;
+
+namespace {
+
+// What the device returns for a P-256 key. Device time isn't included, so a
+// cold export also costs a round trip to Citadel that a warm one saves.
+ExportKeyResponse MakeEcResponse() {
+    bssl::UniquePtr<EC_KEY> key(
+        EC_KEY_new_by_curve_name(NID_X9_62_prime256v1));
+    EC_KEY_generate_key(key.get());
+    bssl::UniquePtr<BIGNUM> x(BN_new());
+    bssl::UniquePtr<BIGNUM> y(BN_new());
+    EC_POINT_get_affine_coordinates_GFp(
+        EC_KEY_get0_group(key.get()), EC_KEY_get0_public_key(key.get()),
+        x.get(), y.get(), nullptr);
+
+    ExportKeyResponse response;
+    uint8_t coordinate[32];
+    response.set_algorithm(nosapp::Algorithm::EC);
+    response.mutable_ec()->set_curve_id(nosapp::EcCurve::P_256);
+    BN_bn2le_padded(coordinate, sizeof(coordinate), x.get());
+    response.mutable_ec()->set_x(coordinate, sizeof(coordinate));
+    BN_bn2le_padded(coordinate, sizeof(coordinate), y.get());
+    response.mutable_ec()->set_y(coordinate, sizeof(coordinate));
+    return response;
+}
+
+// A key blob about the size Citadel produces
+hidl_vec<uint8_t> MakeKeyBlob(uint64_t id) {
+    std::vector<uint8_t> blob(200, 0x5a);
+    memcpy(blob.data(), &id, sizeof(id));
+    return blob;
+}
+
+// Exports the same key each time after the first, or a different key each
+// time when cold.
+void ExportKey(benchmark::State& state, bool warm) {
+    const ExportKeyResponse response = MakeEcResponse();
+    NiceMock<MockKeymaster> mockService;
+    ON_CALL(mockService, ExportKey(_, _)).WillByDefault(Invoke(
+        [&](const ExportKeyRequest&, ExportKeyResponse* out) {
+            *out = response;
+            return APP_SUCCESS;
+        }));
+    KeymasterDevice hal{mockService};
+
+    uint64_t id = 0;
+    hidl_vec<uint8_t> keyBlob = MakeKeyBlob(id);
+    for (auto _ : state) {
+        if (!warm) {
+            state.PauseTiming();
+            keyBlob = MakeKeyBlob(++id);
+            state.ResumeTiming();
+        }
+        hal.exportKey(KeyFormat::X509, keyBlob, {}, {},
+                      [&](ErrorCode error, const hidl_vec<uint8_t>& der) {
+                          benchmark::DoNotOptimize(error);
+                          benchmark::DoNotOptimize(der.data());
+                      });
+    }
+}
+
+void BM_ExportKeyCold(benchmark::State& state) {
+    ExportKey(state, false);
+}
+BENCHMARK(BM_ExportKeyCold);
+
+void BM_ExportKeyWarm(benchmark::State& state) {
+    ExportKey(state, true);
+}
+BENCHMARK(BM_ExportKeyWarm);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "allocation_counter.h"
+
+#include <MockKeymaster.client.h>
+#include <KeymasterDevice.h>
+
+#include <application.h>
+
+#include <benchmark/benchmark.h>
+#include <gmock/gmock.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using ::testing::_;
+using ::testing::Invoke;
+using ::testing::NiceMock;
+
+using ::android::hardware::hidl_vec;
+using ::android::hardware::keymaster::KeymasterDevice;
+using ::android::hardware::keymaster::V4_0::ErrorCode;
+using ::android::hardware::keymaster::V4_0::HardwareAuthToken;
+using ::android::hardware::keymaster::V4_0::KeyParameter;
+using ::android::hardware::keymaster::V4_0::KeyPurpose;
+using ::android::hardware::keymaster::V4_0::VerificationToken;
+
+using ::nugget::app::keymaster::BeginOperationRequest;
+using ::nugget::app::keymaster::BeginOperationResponse;
+using ::nugget::app::keymaster::FinishOperationRequest;
+using ::nugget::app::keymaster::FinishOperationResponse;
+using ::nugget::app::keymaster::MockKeymaster;
+using ::nugget::app::keymaster::UpdateOperationRequest;
+using ::nugget::app::keymaster::UpdateOperationResponse;
+
+namespace nosapp = ::nugget::app::keymaster;
+
+using namespace std::chrono_literals;
+
+namespace {
+
+// An AES operation on a device that takes no time and echoes its input.
+// Allocations counted include the mock's own for each call.
+void BM_OperationCycle(benchmark::State& state) {
+    NiceMock<MockKeymaster> mockService;
+    uint64_t nextHandle = 0;
+    ON_CALL(mockService, BeginOperation(_, _)).WillByDefault(Invoke(
+        [&](const BeginOperationRequest&, BeginOperationResponse* response) {
+            response->mutable_handle()->set_handle(++nextHandle);
+            response->set_algorithm(nosapp::Algorithm::AES);
+            return APP_SUCCESS;
+        }));
+    ON_CALL(mockService, UpdateOperation(_, _)).WillByDefault(Invoke(
+        [](const UpdateOperationRequest& request,
+           UpdateOperationResponse* response) {
+            response->set_consumed(request.input().size());
+            response->set_output(request.input());
+            return APP_SUCCESS;
+        }));
+    ON_CALL(mockService, FinishOperation(_, _)).WillByDefault(Invoke(
+        [](const FinishOperationRequest& request,
+           FinishOperationResponse* response) {
+            response->set_output(request.input());
+            return APP_SUCCESS;
+        }));
+    KeymasterDevice hal{mockService};
+
+    const hidl_vec<uint8_t> key{1};
+    const hidl_vec<uint8_t> input(std::vector<uint8_t>(state.range(0), 0x5a));
+    auto cycle = [&] {
+        uint64_t handle = 0;
+        hal.begin(KeyPurpose::ENCRYPT, key, {}, HardwareAuthToken{},
+                  [&](ErrorCode, const hidl_vec<KeyParameter>&,
+                      uint64_t operationHandle) {
+                      handle = operationHandle;
+                  });
+        hal.update(handle, {}, input, HardwareAuthToken{},
+                   VerificationToken{},
+                   [](ErrorCode, uint32_t, const hidl_vec<KeyParameter>&,
+                      const hidl_vec<uint8_t>& output) {
+                       benchmark::DoNotOptimize(output.data());
+                   });
+        hal.finish(handle, {}, input, {}, HardwareAuthToken{},
+                   VerificationToken{},
+                   [](ErrorCode, const hidl_vec<KeyParameter>&,
+                      const hidl_vec<uint8_t>& output) {
+                       benchmark::DoNotOptimize(output.data());
+                   });
+    };
+    // The first cycle grows the thread's messages; leave it out.
+    cycle();
+    const size_t start = allocation_count();
+    for (auto _ : state) {
+        cycle();
+    }
+    ReportAllocations(state, start);
+}
+BENCHMARK(BM_OperationCycle)->Arg(64)->Arg(1024);
+
+// Set up by the first thread of BM_ConcurrentOperations for all of them
+std::unique_ptr<NiceMock<MockKeymaster>> slowService;
+std::unique_ptr<KeymasterDevice> slowHal;
+
+// AES operations from several threads at once on a device that takes 1ms
+// over each call and echoes its input. Calls on different operations don't
+// wait for each other, so operations per second should grow with the
+// number of threads.
+void BM_ConcurrentOperations(benchmark::State& state) {
+    if (state.thread_index == 0) {
+        slowService.reset(new NiceMock<MockKeymaster>());
+        static std::atomic<uint64_t> nextHandle{0};
+        ON_CALL(*slowService, BeginOperation(_, _)).WillByDefault(Invoke(
+            [](const BeginOperationRequest&,
+               BeginOperationResponse* response) {
+                response->mutable_handle()->set_handle(++nextHandle);
+                response->set_algorithm(nosapp::Algorithm::AES);
+                return APP_SUCCESS;
+            }));
+        ON_CALL(*slowService, UpdateOperation(_, _)).WillByDefault(Invoke(
+            [](const UpdateOperationRequest& request,
+               UpdateOperationResponse* response) {
+                std::this_thread::sleep_for(1ms);
+                response->set_consumed(request.input().size());
+                response->set_output(request.input());
+                return APP_SUCCESS;
+            }));
+        ON_CALL(*slowService, FinishOperation(_, _)).WillByDefault(Invoke(
+            [](const FinishOperationRequest& request,
+               FinishOperationResponse* response) {
+                std::this_thread::sleep_for(1ms);
+                response->set_output(request.input());
+                return APP_SUCCESS;
+            }));
+        slowHal.reset(new KeymasterDevice(*slowService));
+    }
+
+    // Long enough to take several updates
+    const hidl_vec<uint8_t> input(std::vector<uint8_t>(1000, 0x5a));
+    for (auto _ : state) {
+        uint64_t handle = 0;
+        slowHal->begin(KeyPurpose::ENCRYPT, hidl_vec<uint8_t>{1}, {},
+                       HardwareAuthToken{},
+                       [&](ErrorCode, const hidl_vec<KeyParameter>&,
+                           uint64_t operationHandle) {
+                           handle = operationHandle;
+                       });
+        slowHal->finish(handle, {}, input, {}, HardwareAuthToken{},
+                        VerificationToken{},
+                        [](ErrorCode, const hidl_vec<KeyParameter>&,
+                           const hidl_vec<uint8_t>& output) {
+                            benchmark::DoNotOptimize(output.data());
+                        });
+    }
+    state.SetItemsProcessed(state.iterations());
+
+    if (state.thread_index == 0) {
+        slowHal.reset();
+        slowService.reset();
+    }
+}
+BENCHMARK(BM_ConcurrentOperations)->Threads(1)->Threads(4)->UseRealTime();
+
+}  // namespace
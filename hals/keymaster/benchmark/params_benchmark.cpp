@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "../proto_utils.h"
+#include "allocation_counter.h"
+
+#include <Keymaster.client.h>
+
+#include <benchmark/benchmark.h>
+
+#include <map>
+#include <vector>
+
+using ::android::hardware::hidl_vec;
+using ::android::hardware::keymaster::hidl_params_to_index;
+using ::android::hardware::keymaster::hidl_params_to_pb;
+using ::android::hardware::keymaster::TagIndex;
+using ::android::hardware::keymaster::V4_0::Algorithm;
+using ::android::hardware::keymaster::V4_0::BlockMode;
+using ::android::hardware::keymaster::V4_0::Digest;
+using ::android::hardware::keymaster::V4_0::KeyParameter;
+using ::android::hardware::keymaster::V4_0::KeyPurpose;
+using ::android::hardware::keymaster::V4_0::PaddingMode;
+using ::android::hardware::keymaster::V4_0::Tag;
+
+namespace nosapp = ::nugget::app::keymaster;
+
+namespace {
+
+// The parameters an app typically passes to begin() for AES-GCM.
+hidl_vec<KeyParameter> BeginParams() {
+    std::vector<KeyParameter> params(8);
+    params[0].tag = Tag::PURPOSE;
+    params[0].f.purpose = KeyPurpose::ENCRYPT;
+    params[1].tag = Tag::ALGORITHM;
+    params[1].f.algorithm = Algorithm::AES;
+    params[2].tag = Tag::BLOCK_MODE;
+    params[2].f.blockMode = BlockMode::GCM;
+    params[3].tag = Tag::PADDING;
+    params[3].f.paddingMode = PaddingMode::NONE;
+    params[4].tag = Tag::DIGEST;
+    params[4].f.digest = Digest::NONE;
+    params[5].tag = Tag::MAC_LENGTH;
+    params[5].f.integer = 128;
+    params[6].tag = Tag::APPLICATION_ID;
+    params[6].blob = std::vector<uint8_t>(16, 'i');
+    params[7].tag = Tag::APPLICATION_DATA;
+    params[7].blob = std::vector<uint8_t>(16, 'd');
+    return hidl_vec<KeyParameter>(params);
+}
+
+// How the HAL indexed parameters before TagIndex: a tree node and a vector
+// per tag, with each KeyParameter copied in.
+void BM_TagMap(benchmark::State& state) {
+    const hidl_vec<KeyParameter> params = BeginParams();
+    const size_t start = allocation_count();
+    for (auto _ : state) {
+        std::map<Tag, std::vector<KeyParameter>> tag_map;
+        for (const KeyParameter& param : params) {
+            tag_map[param.tag].push_back(param);
+        }
+        benchmark::DoNotOptimize(tag_map.find(Tag::BLOCK_MODE));
+    }
+    ReportAllocations(state, start);
+}
+BENCHMARK(BM_TagMap);
+
+void BM_TagIndex(benchmark::State& state) {
+    const hidl_vec<KeyParameter> params = BeginParams();
+    const size_t start = allocation_count();
+    for (auto _ : state) {
+        TagIndex tag_index;
+        hidl_params_to_index(params, &tag_index);
+        benchmark::DoNotOptimize(tag_index.find(Tag::BLOCK_MODE));
+    }
+    ReportAllocations(state, start);
+}
+BENCHMARK(BM_TagIndex);
+
+// Translation and indexing together, as begin() does. The allocations are
+// the protobuf's own.
+void BM_ParamsOnePass(benchmark::State& state) {
+    const hidl_vec<KeyParameter> params = BeginParams();
+    const size_t start = allocation_count();
+    for (auto _ : state) {
+        nosapp::KeyParameters pb;
+        TagIndex tag_index;
+        hidl_params_to_pb(params, &pb, &tag_index);
+        benchmark::DoNotOptimize(tag_index.find(Tag::BLOCK_MODE));
+    }
+    ReportAllocations(state, start);
+}
+BENCHMARK(BM_ParamsOnePass);
+
+}  // namespace
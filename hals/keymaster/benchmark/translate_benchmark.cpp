@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "allocation_counter.h"
+#include "../enum_tables.h"
+#include "../proto_utils.h"
+
+#include <Keymaster.client.h>
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <vector>
+
+using ::android::hardware::hidl_vec;
+using ::android::hardware::keymaster::DigestTable;
+using ::android::hardware::keymaster::ErrorCodeTable;
+using ::android::hardware::keymaster::key_parameter_to_pb;
+using ::android::hardware::keymaster::pb_to_hidl_params;
+using ::android::hardware::keymaster::translate_error_code;
+using ::android::hardware::keymaster::V4_0::KeyParameter;
+using ::android::hardware::keymaster::V4_0::Tag;
+
+namespace nosapp = ::nugget::app::keymaster;
+
+namespace {
+
+// Every code the device can send, as translated after each call
+void BM_TranslateErrorCode(benchmark::State& state) {
+    std::vector<nosapp::ErrorCode> codes;
+    for (size_t i = 0; i < ErrorCodeTable::size(); ++i) {
+        codes.push_back(ErrorCodeTable::at(i).app);
+    }
+    for (auto _ : state) {
+        for (nosapp::ErrorCode code : codes) {
+            benchmark::DoNotOptimize(translate_error_code(code));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * codes.size());
+}
+BENCHMARK(BM_TranslateErrorCode);
+
+// Every digest to the app and back, as in the params of a begin() and the
+// characteristics that come back from the device
+void BM_TranslateDigestParams(benchmark::State& state) {
+    nosapp::KeyParameters pb;
+    for (size_t i = 0; i < DigestTable::size(); ++i) {
+        KeyParameter param;
+        param.tag = Tag::DIGEST;
+        param.f.digest = DigestTable::at(i).hal;
+        key_parameter_to_pb(param, pb.add_params());
+    }
+    hidl_vec<KeyParameter> params;
+    pb_to_hidl_params(pb, &params);
+
+    for (auto _ : state) {
+        for (const KeyParameter& param : params) {
+            nosapp::KeyParameter out;
+            key_parameter_to_pb(param, &out);
+            benchmark::DoNotOptimize(out.integer());
+        }
+        hidl_vec<KeyParameter> out;
+        pb_to_hidl_params(pb, &out);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * params.size());
+}
+BENCHMARK(BM_TranslateDigestParams);
+
+// The characteristics of a freshly attested key: a few integers and the
+// blobs the device echoes back. The blobs are views, so each call only
+// allocates the parameters themselves.
+void BM_PbToHidlParamsWithBlobs(benchmark::State& state) {
+    nosapp::KeyParameters pb;
+    for (nosapp::Tag tag : {nosapp::Tag::APPLICATION_ID,
+                            nosapp::Tag::ROOT_OF_TRUST,
+                            nosapp::Tag::ATTESTATION_CHALLENGE,
+                            nosapp::Tag::ATTESTATION_APPLICATION_ID}) {
+        nosapp::KeyParameter* param = pb.add_params();
+        param->set_tag(tag);
+        param->set_blob(std::string(128, 'x'));
+    }
+    for (nosapp::Tag tag : {nosapp::Tag::KEY_SIZE, nosapp::Tag::OS_VERSION,
+                            nosapp::Tag::OS_PATCHLEVEL}) {
+        nosapp::KeyParameter* param = pb.add_params();
+        param->set_tag(tag);
+        param->set_integer(1);
+    }
+
+    const size_t start = allocation_count();
+    for (auto _ : state) {
+        hidl_vec<KeyParameter> params;
+        pb_to_hidl_params(pb, &params);
+        benchmark::DoNotOptimize(params.data());
+    }
+    ReportAllocations(state, start);
+    state.SetItemsProcessed(state.iterations() * pb.params_size());
+}
+BENCHMARK(BM_PbToHidlParamsWithBlobs);
+
+}  // namespace
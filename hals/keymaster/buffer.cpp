@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include "KeymasterDevice.h"
 #include "buffer.h"
 #include "proto_utils.h"
 
@@ -23,7 +24,11 @@
 
 #include <openssl/rsa.h>
 
+#include <string.h>
+
 #include <map>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 namespace android {
@@ -32,19 +37,76 @@ namespace keymaster {
 
 // HAL
 using ::android::hardware::keymaster::V4_0::Algorithm;
+using ::android::hardware::keymaster::V4_0::BlockMode;
 using ::android::hardware::keymaster::V4_0::ErrorCode;
 
 // std
+using std::make_shared;
 using std::map;
+using std::mutex;
 using std::pair;
+using std::shared_ptr;
+using std::unique_lock;
 using std::vector;
 
-/* Stack space constrains the input/output size to RSA_MAX_BYTES (3k) */
-static const size_t kMaxChunkSize = 384;
+/* Stack space constrains the input/output size to RSA_MAX_BYTES (3k) but every
+ * mode is known to take this much at once. */
+static const size_t kMinChunkSize = 384;
+/* The largest bytes field the device's protos accept. */
+static const size_t kMaxChunkSize = KM_MAX_PROTO_FIELD_SIZE;
+
+// The chunk size for each streaming mode. It is only raised by what the
+// device took whole when probed and lowered if it is later found to take
+// less, so a live operation is never sent more than the device has taken.
+class ChunkSizes {
+public:
+    size_t get(Algorithm algorithm, BlockMode blockMode) {
+        if (!learns(algorithm)) {
+            return kMinChunkSize;
+        }
+        unique_lock<mutex> lock(_lock);
+        auto it = _sizes.find(key(algorithm, blockMode));
+        return it == _sizes.end() ? kMinChunkSize : it->second;
+    }
+
+    void set(Algorithm algorithm, BlockMode blockMode, size_t size) {
+        if (!learns(algorithm)) {
+            return;
+        }
+        unique_lock<mutex> lock(_lock);
+        _sizes[key(algorithm, blockMode)] =
+            std::max(std::min(size, kMaxChunkSize), kMinChunkSize);
+    }
+
+private:
+    // RSA and EC input is bounded by the key size and may not be consumed
+    // until finish() so there is nothing to learn.
+    static bool learns(Algorithm algorithm) {
+        return algorithm == Algorithm::AES ||
+            algorithm == Algorithm::TRIPLE_DES ||
+            algorithm == Algorithm::HMAC;
+    }
+
+    static pair<Algorithm, BlockMode> key(Algorithm algorithm,
+                                          BlockMode blockMode) {
+        if (algorithm == Algorithm::HMAC) {
+            blockMode = BlockMode::ECB;
+        }
+        return {algorithm, blockMode};
+    }
+
+    mutex _lock;
+    map<pair<Algorithm, BlockMode>, size_t> _sizes;
+};
+
+static ChunkSizes chunk_sizes;
 
 class Operation {
 public:
-    Operation(Algorithm algorithm) : _algorithm(algorithm), _buffer{} {
+    Operation(Algorithm algorithm, BlockMode blockMode)
+            : _algorithm(algorithm), _blockMode(blockMode),
+              _limit(chunk_sizes.get(algorithm, blockMode)), _head(0), _size(0),
+              _sent(0) {
         switch (_algorithm) {
         case Algorithm::AES:
             _blockSize = 16;
@@ -63,22 +125,37 @@ public:
     }
 
     size_t remaining() const {
-        return _buffer.size();
+        return _size;
     }
 
     void append(const hidl_vec<uint8_t>& input, uint32_t *consumed) {
-        const size_t count = std::min(
-            kMaxChunkSize - _buffer.size(), input.size());
-        _buffer.insert(_buffer.end(), input.begin(), input.begin() + count);
+        const size_t count =
+            _size < _limit ? std::min(_limit - _size, input.size()) : 0;
         *consumed = count;
+        if (count == 0) {
+            return;
+        }
+
+        // The free space may wrap around the end of the ring
+        const size_t tail = (_head + _size) % kMaxChunkSize;
+        const size_t first = std::min(count, kMaxChunkSize - tail);
+        memcpy(&_ring[tail], input.data(), first);
+        if (count > first) {
+            memcpy(&_ring[0], input.data() + first, count - first);
+        }
+        _size += count;
     }
 
     void peek(hidl_vec<uint8_t> *data) {
         // Retain at least one full block; this is done so that when
         // either GCM mode or PKCS7 padding are in use, the last block
         // will be available to be consumed by final().
-        if (_buffer.size() <= _blockSize) {
-            *data = vector<uint8_t>();
+        // More than the limit is only buffered after the device took less
+        // than it was sent and lowered it.
+        const size_t size = std::min(_size, _limit);
+        if (size <= _blockSize) {
+            _sent = 0;
+            data->resize(0);
             return;
         }
 
@@ -86,77 +163,250 @@ public:
         if (_blockSize == 0) {
             retain = 0;
         } else {
-            retain = (_buffer.size() % _blockSize) + _blockSize;
+            retain = (size % _blockSize) + _blockSize;
         }
-        const size_t count = _buffer.size() - retain;
-        *data = vector<uint8_t>(_buffer.begin(), _buffer.begin() + count);
+        _sent = size - retain;
+        copyOut(_sent, data);
     }
 
     ErrorCode advance(size_t count) {
-        if (count > _buffer.size()) {
+        if (count > _size) {
             LOG(ERROR) << "Attempt to advance " << count
-                       << " bytes, where occupancy is " << _buffer.size();
+                       << " bytes, where occupancy is " << _size;
             return ErrorCode::UNKNOWN_ERROR;
         }
-        _buffer.erase(_buffer.begin(), _buffer.begin() + count);
+        learn(count);
+        _head = (_head + count) % kMaxChunkSize;
+        _size -= count;
         return ErrorCode::OK;
     }
 
     void final(hidl_vec<uint8_t> *data) {
         if (data != NULL) {
-            *data = _buffer;
+            copyOut(_size, data);
         }
-        _buffer.clear();
+        _head = 0;
+        _size = 0;
     }
 
     Algorithm algorithm(void) {
         return _algorithm;
     }
 
+    mutex& lock() {
+        return _lock;
+    }
+
 private:
+    // Lower the chunk size if the device consumed only part of the last
+    // peek(). It may be holding data back for a reason of its own, so the
+    // size never drops below what every mode takes.
+    void learn(size_t consumed) {
+        if (_sent == 0 || consumed == 0 || consumed >= _sent) {
+            _sent = 0;
+            return;
+        }
+        const size_t aligned = _blockSize == 0 ?
+            consumed : consumed - consumed % _blockSize;
+        const size_t limit =
+            std::max(std::min(_limit, aligned + _blockSize * 2), kMinChunkSize);
+        _sent = 0;
+        if (limit != _limit) {
+            _limit = limit;
+            chunk_sizes.set(_algorithm, _blockMode, _limit);
+        }
+    }
+
+    // Copy the first count buffered bytes without consuming them.
+    void copyOut(size_t count, hidl_vec<uint8_t> *data) const {
+        data->resize(count);
+        const size_t first = std::min(count, kMaxChunkSize - _head);
+        if (first > 0) {
+            memcpy(data->data(), &_ring[_head], first);
+        }
+        if (count > first) {
+            memcpy(data->data() + first, &_ring[0], count - first);
+        }
+    }
+
+    mutex _lock;
     Algorithm _algorithm;
+    BlockMode _blockMode;
     size_t _blockSize;
-    vector<uint8_t> _buffer;
+    // Most input to buffer at once
+    size_t _limit;
+    // Pending input occupies _size bytes from _head, wrapping at the end
+    uint8_t _ring[kMaxChunkSize];
+    size_t _head;
+    size_t _size;
+    // What the last peek() handed out
+    size_t _sent;
 };
 
-static map<uint64_t, Operation>  buffer_map;
-typedef map<uint64_t, Operation>::iterator  buffer_item;
+// Open addressing hash table of the live operations. Citadel only allows a
+// handful at a time so the table stays small and a lookup is usually a
+// single probe.
+class OperationTable {
+public:
+    OperationTable() : _slots(kInitialSlots), _live(0), _used(0) {}
+
+    // Fails if the handle is already present.
+    bool insert(uint64_t handle, shared_ptr<Operation> op) {
+        if (find(handle) != nullptr) {
+            return false;
+        }
+        if ((_used + 1) * 4 > _slots.size() * 3) {
+            // Grow if mostly live, otherwise just clear out the tombstones
+            rehash(_live * 2 >= _slots.size() ? _slots.size() * 2
+                                              : _slots.size());
+        }
+        for (size_t i = slotFor(handle);; i = next(i)) {
+            Slot& slot = _slots[i];
+            if (slot.op == nullptr) {
+                if (!slot.tombstone) {
+                    _used++;
+                }
+                slot.handle = handle;
+                slot.op = std::move(op);
+                slot.tombstone = false;
+                _live++;
+                return true;
+            }
+        }
+    }
 
-ErrorCode buffer_begin(uint64_t handle, Algorithm algorithm)
+    shared_ptr<Operation> find(uint64_t handle) const {
+        const Slot* slot = lookup(handle);
+        return slot == nullptr ? nullptr : slot->op;
+    }
+
+    // Returns the removed operation, if there was one.
+    shared_ptr<Operation> remove(uint64_t handle) {
+        Slot* slot = const_cast<Slot*>(lookup(handle));
+        if (slot == nullptr) {
+            return nullptr;
+        }
+        shared_ptr<Operation> op = std::move(slot->op);
+        slot->op = nullptr;
+        slot->tombstone = true;
+        _live--;
+        return op;
+    }
+
+private:
+    static constexpr size_t kInitialSlots = 16;
+
+    struct Slot {
+        uint64_t handle = 0;
+        shared_ptr<Operation> op;
+        // Marks a removed entry that later probes have to step over
+        bool tombstone = false;
+    };
+
+    size_t slotFor(uint64_t handle) const {
+        // Fibonacci hashing spreads sequential handles too
+        return ((handle * 0x9e3779b97f4a7c15ull) >> 32) & (_slots.size() - 1);
+    }
+
+    size_t next(size_t i) const {
+        return (i + 1) & (_slots.size() - 1);
+    }
+
+    const Slot* lookup(uint64_t handle) const {
+        for (size_t i = slotFor(handle);; i = next(i)) {
+            const Slot& slot = _slots[i];
+            if (slot.op != nullptr && slot.handle == handle) {
+                return &slot;
+            }
+            if (slot.op == nullptr && !slot.tombstone) {
+                return nullptr;
+            }
+        }
+    }
+
+    void rehash(size_t size) {
+        vector<Slot> old(size);
+        old.swap(_slots);
+        _live = 0;
+        _used = 0;
+        for (Slot& slot : old) {
+            if (slot.op != nullptr) {
+                insert(slot.handle, std::move(slot.op));
+            }
+        }
+    }
+
+    // Always a power of two and never full so probes terminate
+    vector<Slot> _slots;
+    size_t _live;
+    size_t _used;
+};
+
+// Guards the table but not the operations in it, which have their own locks
+static mutex buffer_map_lock;
+static OperationTable buffer_map;
+
+static shared_ptr<Operation> find_operation(uint64_t handle)
 {
-    if (buffer_map.find(handle) != buffer_map.end()) {
+    unique_lock<mutex> lock(buffer_map_lock);
+    return buffer_map.find(handle);
+}
+
+OperationLock::OperationLock(uint64_t handle) : _op(find_operation(handle))
+{
+    if (_op != nullptr) {
+        _lock = unique_lock<mutex>(_op->lock());
+    }
+}
+
+OperationLock::~OperationLock() = default;
+
+size_t buffer_chunk_size(Algorithm algorithm, BlockMode blockMode)
+{
+    return chunk_sizes.get(algorithm, blockMode);
+}
+
+void buffer_set_chunk_size(Algorithm algorithm, BlockMode blockMode,
+                           size_t size)
+{
+    chunk_sizes.set(algorithm, blockMode, size);
+}
+
+ErrorCode buffer_begin(uint64_t handle, Algorithm algorithm,
+                       BlockMode blockMode)
+{
+    shared_ptr<Operation> op = make_shared<Operation>(algorithm, blockMode);
+    unique_lock<mutex> lock(buffer_map_lock);
+    if (!buffer_map.insert(handle, std::move(op))) {
         LOG(ERROR) << "Duplicate operation handle " << handle
                    << "returned by begin()";
-        // Final the existing op to potential mishandling of data.
-        buffer_final(handle, NULL);
+        // Drop the existing op to prevent potential mishandling of data.
+        buffer_map.remove(handle);
         return ErrorCode::UNKNOWN_ERROR;
     }
-
-    buffer_map.insert(
-        pair<uint64_t, Operation>(handle, Operation(algorithm)));
     return ErrorCode::OK;
 }
 
 size_t buffer_remaining(uint64_t handle) {
-    if (buffer_map.find(handle) == buffer_map.end()) {
+    shared_ptr<Operation> op = find_operation(handle);
+    if (op == nullptr) {
         LOG(ERROR) << "Remaining requested on absent operation: " << handle;
         return 0;
     }
 
-    const Operation &op = buffer_map.find(handle)->second;
-    return op.remaining();
+    return op->remaining();
 }
 
 ErrorCode buffer_append(uint64_t handle,
                         const hidl_vec<uint8_t>& input,
                         uint32_t *consumed)
 {
-    if (buffer_map.find(handle) == buffer_map.end()) {
+    shared_ptr<Operation> op = find_operation(handle);
+    if (op == nullptr) {
         LOG(ERROR) << "Append requested on absent operation: " << handle;
         return ErrorCode::UNKNOWN_ERROR;
     }
 
-    Operation *op = &buffer_map.find(handle)->second;
     op->append(input, consumed);
     return ErrorCode::OK;
 }
@@ -164,47 +414,55 @@ ErrorCode buffer_append(uint64_t handle,
 ErrorCode buffer_peek(uint64_t handle,
                       hidl_vec<uint8_t> *data)
 {
-    if (buffer_map.find(handle) == buffer_map.end()) {
+    shared_ptr<Operation> op = find_operation(handle);
+    if (op == nullptr) {
         LOG(ERROR) << "Read requested on absent operation: " << handle;
         return ErrorCode::UNKNOWN_ERROR;
     }
 
-    Operation *op = &buffer_map.find(handle)->second;
     op->peek(data);
     return ErrorCode::OK;
 }
 
 ErrorCode buffer_advance(uint64_t handle, size_t count)
 {
-    if (buffer_map.find(handle) == buffer_map.end()) {
+    shared_ptr<Operation> op = find_operation(handle);
+    if (op == nullptr) {
         LOG(ERROR) << "Read requested on absent operation: " << handle;
         return ErrorCode::UNKNOWN_ERROR;
     }
 
-    Operation *op = &buffer_map.find(handle)->second;
     return op->advance(count);
 }
 
 ErrorCode buffer_final(uint64_t handle,
                    hidl_vec<uint8_t> *data)
 {
-    if (buffer_map.find(handle) == buffer_map.end()) {
-        LOG(ERROR) << "Final requested on absent operation: " << handle;
+    shared_ptr<Operation> op;
+    {
+        unique_lock<mutex> lock(buffer_map_lock);
+        op = buffer_map.remove(handle);
+    }
+    if (op == nullptr) {
+        // abort() drops operations that may never have been buffered
+        if (data != NULL) {
+            LOG(ERROR) << "Final requested on absent operation: " << handle;
+        }
         return ErrorCode::UNKNOWN_ERROR;
     }
-    Operation *op = &buffer_map.find(handle)->second;
-    op->final(data);
-    buffer_map.erase(handle);
+    if (data != NULL) {
+        op->final(data);
+    }
     return ErrorCode::OK;
 }
 
 ErrorCode buffer_algorithm(uint64_t handle, Algorithm *algorithm)
 {
-    if (buffer_map.find(handle) == buffer_map.end()) {
+    shared_ptr<Operation> op = find_operation(handle);
+    if (op == nullptr) {
         LOG(ERROR) << "Algorithm requested on absent operation: " << handle;
         return ErrorCode::UNKNOWN_ERROR;
     }
-    Operation *op = &buffer_map.find(handle)->second;
     *algorithm = op->algorithm();
     return ErrorCode::OK;
 }
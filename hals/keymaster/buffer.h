@@ -21,6 +21,9 @@
 
 #include <Keymaster.client.h>
 
+#include <memory>
+#include <mutex>
+
 using ::nugget::app::keymaster::BeginOperationResponse;
 
 namespace android {
@@ -29,16 +32,50 @@ namespace keymaster {
 
 // HAL
 using ::android::hardware::keymaster::V4_0::Algorithm;
+using ::android::hardware::keymaster::V4_0::BlockMode;
 using ::android::hardware::keymaster::V4_0::ErrorCode;
 
+class Operation;
+
+// Serializes the HAL calls on one operation so that the steps of an update()
+// or finish() aren't interleaved with those of another call on it. Calls on
+// different operations proceed in parallel. The buffer_* functions other
+// than buffer_begin() must be called with the operation's lock held.
+class OperationLock {
+public:
+    explicit OperationLock(uint64_t handle);
+    ~OperationLock();
+
+    // False if there was no such operation
+    explicit operator bool() const { return _op != nullptr; }
+
+private:
+    // Keeps the operation alive if it is finished while locked
+    std::shared_ptr<Operation> _op;
+    std::unique_lock<std::mutex> _lock;
+};
+
+// How much input is buffered for each round trip to the device, per
+// algorithm and block mode. It starts at a size every mode accepts, is set
+// from what the device took when probed at startup and is lowered if the
+// device then consumes less. The block mode only matters for AES and 3DES.
+size_t buffer_chunk_size(Algorithm algorithm, BlockMode blockMode);
+// Record that the device takes size bytes at once in this mode. The size is
+// clamped to what every mode accepts and the largest the protos carry.
+void buffer_set_chunk_size(Algorithm algorithm, BlockMode blockMode,
+                           size_t size);
+
 size_t buffer_remaining(uint64_t handle);
-ErrorCode buffer_begin(uint64_t handle, Algorithm algorithm);
+ErrorCode buffer_begin(uint64_t handle, Algorithm algorithm,
+                       BlockMode blockMode = BlockMode::ECB);
 ErrorCode buffer_append(uint64_t handle,
                         const hidl_vec<uint8_t>& input,
                         uint32_t *consumed);
 ErrorCode buffer_peek(uint64_t handle,
                       hidl_vec<uint8_t> *data);
 ErrorCode buffer_advance(uint64_t handle, size_t count);
+// Removes the operation. With no data to return, it only drops the
+// operation, so it needn't hold the operation's lock.
 ErrorCode buffer_final(uint64_t handle,
                        hidl_vec<uint8_t> *data);
 ErrorCode buffer_algorithm(uint64_t handle,
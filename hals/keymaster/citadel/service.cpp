@@ -14,13 +14,20 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+#include <memory>
+
 #include <android-base/logging.h>
+#include <android-base/properties.h>
 #include <hidl/HidlTransportSupport.h>
 #include <utils/StrongPointer.h>
 
 #include <application.h>
 #include <nos/AppClient.h>
-#include <nos/CitadeldProxyClient.h>
+#include <nos/DirectDeviceClient.h>
+#include <nos/IdempotentCalls.h>
+#include <nos/Interceptors.h>
+#include <nos/ServiceFootprint.h>
 #include <nos/debug.h>
 
 #include <KeymasterDevice.h>
@@ -32,13 +39,18 @@
 using ::android::OK;
 using ::android::sp;
 using ::android::status_t;
+using ::android::base::GetUintProperty;
 using ::android::hardware::configureRpcThreadpool;
 using ::android::hardware::joinRpcThreadpool;
 
 using ::android::hardware::keymaster::KeymasterDevice;
 using ::android::hardware::keymaster::translate_error_code;
 
-using ::nos::CitadeldProxyClient;
+using ::nos::IdempotentCalls;
+using ::nos::InterceptHalCalls;
+using ::nos::LogServiceFootprint;
+using ::nos::MakeCitadelClient;
+using ::nos::NuggetClientInterface;
 using ::nos::AppClient;
 using ::nugget::app::keymaster::ProvisionPresharedSecretRequest;
 using ::nugget::app::keymaster::ProvisionPresharedSecretResponse;
@@ -48,23 +60,40 @@ using ::android::hardware::keymaster::V4_0::ErrorCode;
 
 using KeymasterClient = ::nugget::app::keymaster::Keymaster;
 
+namespace {
+
+// Number of binder threads serving the HAL. Calls on different operations can
+// run at the same time so one slow call doesn't hold up the others.
+constexpr char PROPERTY_THREADS[] = "ro.vendor.keymaster.citadel.threads";
+constexpr size_t kDefaultThreads = 4;
+constexpr size_t kMaxThreads = 16;
+
+} // namespace
+
 int main() {
     LOG(INFO) << "Keymaster HAL service starting";
 
-    // Connect to citadeld
-    CitadeldProxyClient citadeldProxy;
-    citadeldProxy.Open();
-    if (!citadeldProxy.IsOpen()) {
-        LOG(FATAL) << "Failed to open citadeld client";
+    // Connect to Citadel, via citadeld unless this image talks to it directly
+    std::unique_ptr<NuggetClientInterface> citadel =
+            MakeCitadelClient("keymaster", IdempotentCalls().Keymaster());
+    citadel->Open();
+    if (!citadel->IsOpen()) {
+        LOG(FATAL) << "Failed to open Citadel client";
     }
 
-    // This thread will become the only thread of the daemon
+    // Trace, time and retry the calls the HAL makes
+    auto client = InterceptHalCalls(*citadel, "keymaster");
+
+    // This thread will become one of the threads of the daemon
+    const size_t threads = GetUintProperty<size_t>(PROPERTY_THREADS,
+                                                   kDefaultThreads, kMaxThreads);
     constexpr bool thisThreadWillJoinPool = true;
-    configureRpcThreadpool(1, thisThreadWillJoinPool);
+    configureRpcThreadpool(std::max<size_t>(threads, 1), thisThreadWillJoinPool);
 
     // Start the HAL service
-    KeymasterClient keymasterClient{citadeldProxy};
+    KeymasterClient keymasterClient{client};
     sp<KeymasterDevice> keymaster = new KeymasterDevice{keymasterClient};
+    keymaster->LearnChunkSizes();
 
     const status_t status = keymaster->registerAsService("strongbox");
     if (status != OK) {
@@ -72,6 +101,8 @@ int main() {
                    << status << ")";
     }
 
+    LogServiceFootprint("Keymaster HAL service");
+
     joinRpcThreadpool();
     return -1; // Should never be reached
 }
@@ -0,0 +1,213 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "device_capabilities.h"
+
+#include <algorithm>
+#include <tuple>
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+
+namespace {
+
+// The parameter each error is about. UNSUPPORTED_MIN_MAC_LENGTH isn't here
+// as whether a MAC length is allowed also depends on the digest or block
+// mode, which aren't part of the scope.
+constexpr struct {
+    ErrorCode error;
+    Tag tag;
+} kErrorTags[] = {
+    {ErrorCode::UNSUPPORTED_PURPOSE, Tag::PURPOSE},
+    {ErrorCode::UNSUPPORTED_ALGORITHM, Tag::ALGORITHM},
+    {ErrorCode::UNSUPPORTED_KEY_SIZE, Tag::KEY_SIZE},
+    {ErrorCode::UNSUPPORTED_BLOCK_MODE, Tag::BLOCK_MODE},
+    {ErrorCode::UNSUPPORTED_DIGEST, Tag::DIGEST},
+    {ErrorCode::UNSUPPORTED_PADDING_MODE, Tag::PADDING},
+    {ErrorCode::UNSUPPORTED_EC_CURVE, Tag::EC_CURVE},
+};
+
+uint32_t param_value(const KeyParameter& param)
+{
+    switch (param.tag) {
+    case Tag::PURPOSE:
+        return static_cast<uint32_t>(param.f.purpose);
+    case Tag::ALGORITHM:
+        return static_cast<uint32_t>(param.f.algorithm);
+    case Tag::BLOCK_MODE:
+        return static_cast<uint32_t>(param.f.blockMode);
+    case Tag::DIGEST:
+        return static_cast<uint32_t>(param.f.digest);
+    case Tag::PADDING:
+        return static_cast<uint32_t>(param.f.paddingMode);
+    case Tag::EC_CURVE:
+        return static_cast<uint32_t>(param.f.ecCurve);
+    default:
+        return param.f.integer;
+    }
+}
+
+// Calls f with each of the request's values for the tag. The algorithm
+// and purpose of a call on a key stand in for its parameters.
+template <typename Request, typename F>
+void for_each_value(const Request& request, Tag tag, F f)
+{
+    if (tag == Tag::ALGORITHM && request.algorithm != nullptr) {
+        f(static_cast<uint32_t>(*request.algorithm));
+        return;
+    }
+    if (tag == Tag::PURPOSE && request.purpose != nullptr) {
+        f(static_cast<uint32_t>(*request.purpose));
+        return;
+    }
+    for (const KeyParameter& param : request.params) {
+        if (param.tag == tag) {
+            f(param_value(param));
+        }
+    }
+}
+
+}  // namespace
+
+bool DeviceCapabilities::Before(const Entry& a, const Entry& b)
+{
+    return std::tie(a.call, a.algorithm, a.purpose, a.tag, a.present,
+                    a.value) <
+           std::tie(b.call, b.algorithm, b.purpose, b.tag, b.present,
+                    b.value);
+}
+
+bool DeviceCapabilities::Scope(const Request& request, Entry *entry)
+{
+    entry->call = request.call;
+    entry->algorithm = kNone;
+    entry->purpose = kNone;
+    switch (request.call) {
+    case Call::GENERATE_KEY:
+    case Call::IMPORT_KEY:
+        for (const KeyParameter& param : request.params) {
+            if (param.tag == Tag::ALGORITHM) {
+                entry->algorithm = static_cast<uint32_t>(param.f.algorithm);
+                break;
+            }
+        }
+        return true;
+    case Call::BEGIN:
+        if (request.purpose == nullptr) {
+            return false;
+        }
+        entry->purpose = static_cast<uint32_t>(*request.purpose);
+        [[fallthrough]];
+    case Call::ATTEST_KEY:
+        if (request.algorithm == nullptr) {
+            return false;
+        }
+        entry->algorithm = static_cast<uint32_t>(*request.algorithm);
+        return true;
+    }
+    return false;
+}
+
+ErrorCode DeviceCapabilities::check(const Request& request) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    Entry probe;
+    if (_entries.empty() || !Scope(request, &probe)) {
+        return ErrorCode::OK;
+    }
+
+    ErrorCode error = ErrorCode::OK;
+    auto find = [&] {
+        const auto it = std::lower_bound(_entries.begin(), _entries.end(),
+                                         probe, Before);
+        if (it != _entries.end() && !Before(probe, *it)) {
+            error = it->error;
+        }
+    };
+    for (const auto& error_tag : kErrorTags) {
+        probe.tag = error_tag.tag;
+        probe.present = true;
+        bool any = false;
+        for_each_value(request, error_tag.tag, [&](uint32_t value) {
+            any = true;
+            if (error == ErrorCode::OK) {
+                probe.value = value;
+                find();
+            }
+        });
+        if (!any && request.call == Call::GENERATE_KEY) {
+            probe.present = false;
+            probe.value = 0;
+            find();
+        }
+        if (error != ErrorCode::OK) {
+            return error;
+        }
+    }
+    return ErrorCode::OK;
+}
+
+void DeviceCapabilities::learn(const Request& request, ErrorCode error)
+{
+    const auto error_tag = std::find_if(
+        std::begin(kErrorTags), std::end(kErrorTags),
+        [error](const auto& e) { return e.error == error; });
+    Entry entry;
+    if (error_tag == std::end(kErrorTags) || !Scope(request, &entry)) {
+        return;
+    }
+
+    entry.tag = error_tag->tag;
+    entry.error = error;
+    size_t count = 0;
+    for_each_value(request, entry.tag, [&](uint32_t value) {
+        count++;
+        entry.value = value;
+    });
+    if (count > 1 || (count == 0 && request.call != Call::GENERATE_KEY)) {
+        return;
+    }
+    entry.present = count == 1;
+    if (!entry.present) {
+        entry.value = 0;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    const auto it = std::lower_bound(_entries.begin(), _entries.end(),
+                                     entry, Before);
+    if (it != _entries.end() && !Before(entry, *it)) {
+        it->error = error;
+    } else if (_entries.size() < kMaxEntries) {
+        _entries.insert(it, entry);
+    }
+}
+
+void DeviceCapabilities::clear()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _entries.clear();
+}
+
+size_t DeviceCapabilities::size() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _entries.size();
+}
+
+}  // namespace keymaster
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_KEYMASTER_DEVICE_CAPABILITIES_H
+#define ANDROID_HARDWARE_KEYMASTER_DEVICE_CAPABILITIES_H
+
+#include <android/hardware/keymaster/4.0/IKeymasterDevice.h>
+
+#include <mutex>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+
+// HAL
+using ::android::hardware::keymaster::V4_0::Algorithm;
+using ::android::hardware::keymaster::V4_0::ErrorCode;
+using ::android::hardware::keymaster::V4_0::KeyParameter;
+using ::android::hardware::keymaster::V4_0::KeyPurpose;
+using ::android::hardware::keymaster::V4_0::Tag;
+using ::android::hardware::hidl_vec;
+
+// The parameter values the device has said it doesn't support. The
+// Keymaster app has no capability query and probing it by generating keys
+// would take seconds, so each value is learned from the first UNSUPPORTED_*
+// error a call gets for it. After that the same call with the same value
+// fails here, with the device's error, without a round trip to Citadel.
+//
+// An error is only learned when the request pins it to one value: a single
+// digest, say, rather than several. A missing parameter is only learned for
+// generateKey(), where nothing but the parameters decides the outcome, and
+// calls on an existing key only when its algorithm is known.
+//
+// Safe to call from several threads at once.
+class DeviceCapabilities {
+public:
+    enum class Call : uint8_t {
+        GENERATE_KEY,
+        IMPORT_KEY,
+        BEGIN,
+        ATTEST_KEY,
+    };
+
+    struct Request {
+        Call call;
+        const hidl_vec<KeyParameter>& params;
+        // The algorithm of the key a call is on, which isn't among its
+        // parameters; nullptr for calls that make a key or when unknown
+        const Algorithm *algorithm;
+        // For begin(); nullptr otherwise
+        const KeyPurpose *purpose;
+    };
+
+    // Bounds what a client sending invalid requests can make the HAL keep
+    static constexpr size_t kMaxEntries = 256;
+
+    // The error the device gave for one of the request's values, or OK
+    ErrorCode check(const Request& request) const;
+    // Remembers the device's error for the request if it is one of the
+    // UNSUPPORTED_* errors and the request pins it to one value
+    void learn(const Request& request, ErrorCode error);
+    // Forgets everything, as after a reset, which may have updated the app
+    void clear();
+    size_t size() const;
+
+private:
+    // kNone for an algorithm or purpose that isn't part of the scope
+    static constexpr uint32_t kNone = UINT32_MAX;
+
+    struct Entry {
+        Call call;
+        uint32_t algorithm;
+        uint32_t purpose;
+        Tag tag;
+        bool present;
+        uint32_t value;
+        ErrorCode error;
+    };
+
+    static bool Before(const Entry& a, const Entry& b);
+    // An entry for the request's call, algorithm and purpose, or false if
+    // the request can't be checked
+    static bool Scope(const Request& request, Entry *entry);
+
+    mutable std::mutex _mutex;
+    // Sorted by Before
+    std::vector<Entry> _entries;
+};
+
+}  // namespace keymaster
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_KEYMASTER_DEVICE_CAPABILITIES_H
@@ -0,0 +1,469 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef ANDROID_HARDWARE_KEYMASTER_ENUM_TABLES_H
+#define ANDROID_HARDWARE_KEYMASTER_ENUM_TABLES_H
+
+#include <android/hardware/keymaster/4.0/types.h>
+
+#include <Keymaster.client.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+
+namespace nosapp = ::nugget::app::keymaster;
+
+// A HAL enum value and the app's value for the same thing
+template <typename Hal, typename App>
+struct EnumPair {
+    Hal hal;
+    App app;
+};
+
+namespace enum_table_detail {
+
+// Keeps the indexes small; enums sparser than this need another approach.
+constexpr int64_t kMaxSpan = 1024;
+
+template <typename To>
+struct Slot {
+    To value;
+    bool present;
+};
+
+template <bool kHal, typename Pair>
+constexpr int64_t key(const Pair& pair)
+{
+    if constexpr (kHal) {
+        return static_cast<int64_t>(pair.hal);
+    } else {
+        return static_cast<int64_t>(pair.app);
+    }
+}
+
+template <bool kHal, const auto& kPairs>
+constexpr int64_t min_key()
+{
+    int64_t min = key<kHal>(kPairs[0]);
+    for (const auto& pair : kPairs) {
+        min = key<kHal>(pair) < min ? key<kHal>(pair) : min;
+    }
+    return min;
+}
+
+template <bool kHal, const auto& kPairs>
+constexpr int64_t span()
+{
+    int64_t max = key<kHal>(kPairs[0]);
+    for (const auto& pair : kPairs) {
+        max = key<kHal>(pair) > max ? key<kHal>(pair) : max;
+    }
+    return max - min_key<kHal, kPairs>() + 1;
+}
+
+template <bool kHal, const auto& kPairs>
+constexpr bool unique()
+{
+    for (size_t i = 0; i < std::size(kPairs); ++i) {
+        for (size_t j = i + 1; j < std::size(kPairs); ++j) {
+            if (key<kHal>(kPairs[i]) == key<kHal>(kPairs[j])) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// The translation of each value on one side, offset from the smallest
+template <bool kHal, const auto& kPairs>
+constexpr auto build_index()
+{
+    static_assert(span<kHal, kPairs>() <= kMaxSpan, "Values too sparse");
+    static_assert(unique<kHal, kPairs>(), "Value listed twice");
+
+    using To = std::conditional_t<kHal, decltype(kPairs[0].app),
+                                  decltype(kPairs[0].hal)>;
+    std::array<Slot<std::remove_cv_t<std::remove_reference_t<To>>>,
+               span<kHal, kPairs>()> index{};
+    for (const auto& pair : kPairs) {
+        auto& slot = index[key<kHal>(pair) - min_key<kHal, kPairs>()];
+        if constexpr (kHal) {
+            slot.value = pair.app;
+        } else {
+            slot.value = pair.hal;
+        }
+        slot.present = true;
+    }
+    return index;
+}
+
+template <typename Index, typename To>
+constexpr bool lookup(const Index& index, int64_t offset, To *out)
+{
+    if (offset < 0 || offset >= static_cast<int64_t>(index.size()) ||
+        !index[offset].present) {
+        return false;
+    }
+    *out = index[offset].value;
+    return true;
+}
+
+}  // namespace enum_table_detail
+
+// Translates between a HAL enum and the app's in either direction from a
+// single list of pairs, so the two can't disagree. Each lookup is a load
+// from an array indexed by value and built at compile time.
+template <const auto& kPairs>
+class EnumTable {
+    using Pair = std::remove_cv_t<std::remove_reference_t<decltype(kPairs[0])>>;
+
+public:
+    using Hal = decltype(Pair::hal);
+    using App = decltype(Pair::app);
+
+    static constexpr size_t size() { return std::size(kPairs); }
+    static constexpr const Pair& at(size_t i) { return kPairs[i]; }
+
+    // These return false for a value with no pair.
+    static constexpr bool to_app(Hal hal, App *app)
+    {
+        return enum_table_detail::lookup(
+            kHalIndex, static_cast<int64_t>(hal) - kHalMin, app);
+    }
+
+    static constexpr bool to_hal(App app, Hal *hal)
+    {
+        return enum_table_detail::lookup(
+            kAppIndex, static_cast<int64_t>(app) - kAppMin, hal);
+    }
+
+private:
+    static constexpr int64_t kHalMin =
+        enum_table_detail::min_key<true, kPairs>();
+    static constexpr int64_t kAppMin =
+        enum_table_detail::min_key<false, kPairs>();
+    static constexpr auto kHalIndex =
+        enum_table_detail::build_index<true, kPairs>();
+    static constexpr auto kAppIndex =
+        enum_table_detail::build_index<false, kPairs>();
+};
+
+inline constexpr EnumPair<V4_0::KeyPurpose, nosapp::KeyPurpose> kPurposes[] = {
+    {V4_0::KeyPurpose::ENCRYPT, nosapp::KeyPurpose::ENCRYPT},
+    {V4_0::KeyPurpose::DECRYPT, nosapp::KeyPurpose::DECRYPT},
+    {V4_0::KeyPurpose::SIGN, nosapp::KeyPurpose::SIGN},
+    {V4_0::KeyPurpose::VERIFY, nosapp::KeyPurpose::VERIFY},
+    {V4_0::KeyPurpose::WRAP_KEY, nosapp::KeyPurpose::WRAP_KEY},
+};
+using PurposeTable = EnumTable<kPurposes>;
+static_assert(PurposeTable::size() == nosapp::KeyPurpose::PURPOSE_MAX,
+              "A KeyPurpose is missing");
+
+inline constexpr EnumPair<V4_0::Algorithm, nosapp::Algorithm> kAlgorithms[] = {
+    {V4_0::Algorithm::RSA, nosapp::Algorithm::RSA},
+    {V4_0::Algorithm::EC, nosapp::Algorithm::EC},
+    {V4_0::Algorithm::AES, nosapp::Algorithm::AES},
+    {V4_0::Algorithm::TRIPLE_DES, nosapp::Algorithm::DES},
+    {V4_0::Algorithm::HMAC, nosapp::Algorithm::HMAC},
+};
+using AlgorithmTable = EnumTable<kAlgorithms>;
+static_assert(AlgorithmTable::size() == nosapp::Algorithm::ALGORITHM_MAX,
+              "An Algorithm is missing");
+
+inline constexpr EnumPair<V4_0::BlockMode, nosapp::BlockMode> kBlockModes[] = {
+    {V4_0::BlockMode::ECB, nosapp::BlockMode::ECB},
+    {V4_0::BlockMode::CBC, nosapp::BlockMode::CBC},
+    {V4_0::BlockMode::CTR, nosapp::BlockMode::CTR},
+    {V4_0::BlockMode::GCM, nosapp::BlockMode::GCM},
+};
+using BlockModeTable = EnumTable<kBlockModes>;
+static_assert(BlockModeTable::size() == nosapp::BlockMode::BLOCK_MODE_MAX,
+              "A BlockMode is missing");
+
+inline constexpr EnumPair<V4_0::Digest, nosapp::Digest> kDigests[] = {
+    {V4_0::Digest::NONE, nosapp::Digest::DIGEST_NONE},
+    {V4_0::Digest::MD5, nosapp::Digest::DIGEST_MD5},
+    {V4_0::Digest::SHA1, nosapp::Digest::DIGEST_SHA1},
+    {V4_0::Digest::SHA_2_224, nosapp::Digest::DIGEST_SHA_2_224},
+    {V4_0::Digest::SHA_2_256, nosapp::Digest::DIGEST_SHA_2_256},
+    {V4_0::Digest::SHA_2_384, nosapp::Digest::DIGEST_SHA_2_384},
+    {V4_0::Digest::SHA_2_512, nosapp::Digest::DIGEST_SHA_2_512},
+};
+using DigestTable = EnumTable<kDigests>;
+static_assert(DigestTable::size() == nosapp::Digest::DIGEST_MAX,
+              "A Digest is missing");
+
+inline constexpr EnumPair<V4_0::PaddingMode, nosapp::PaddingMode>
+kPaddingModes[] = {
+    {V4_0::PaddingMode::NONE, nosapp::PaddingMode::PADDING_NONE},
+    {V4_0::PaddingMode::RSA_OAEP, nosapp::PaddingMode::PADDING_RSA_OAEP},
+    {V4_0::PaddingMode::RSA_PSS, nosapp::PaddingMode::PADDING_RSA_PSS},
+    {V4_0::PaddingMode::RSA_PKCS1_1_5_ENCRYPT,
+     nosapp::PaddingMode::PADDING_RSA_PKCS1_1_5_ENCRYPT},
+    {V4_0::PaddingMode::RSA_PKCS1_1_5_SIGN,
+     nosapp::PaddingMode::PADDING_RSA_PKCS1_1_5_SIGN},
+    {V4_0::PaddingMode::PKCS7, nosapp::PaddingMode::PADDING_PKCS7},
+};
+using PaddingModeTable = EnumTable<kPaddingModes>;
+static_assert(PaddingModeTable::size() ==
+              nosapp::PaddingMode::PADDING_MODE_MAX,
+              "A PaddingMode is missing");
+
+inline constexpr EnumPair<V4_0::EcCurve, nosapp::EcCurve> kEcCurves[] = {
+    {V4_0::EcCurve::P_224, nosapp::EcCurve::P_224},
+    {V4_0::EcCurve::P_256, nosapp::EcCurve::P_256},
+    {V4_0::EcCurve::P_384, nosapp::EcCurve::P_384},
+    {V4_0::EcCurve::P_521, nosapp::EcCurve::P_521},
+};
+using EcCurveTable = EnumTable<kEcCurves>;
+static_assert(EcCurveTable::size() == nosapp::EcCurve::EC_CURVE_MAX,
+              "An EcCurve is missing");
+
+inline constexpr EnumPair<V4_0::KeyBlobUsageRequirements,
+                          nosapp::KeyBlobUsageRequirements>
+kKeyBlobUsageRequirements[] = {
+    {V4_0::KeyBlobUsageRequirements::STANDALONE,
+     nosapp::KeyBlobUsageRequirements::STANDALONE},
+    {V4_0::KeyBlobUsageRequirements::REQUIRES_FILE_SYSTEM,
+     nosapp::KeyBlobUsageRequirements::REQUIRES_FILE_SYSTEM},
+};
+using KeyBlobUsageRequirementsTable = EnumTable<kKeyBlobUsageRequirements>;
+static_assert(KeyBlobUsageRequirementsTable::size() ==
+              nosapp::KeyBlobUsageRequirements::KEY_USAGE_MAX,
+              "A KeyBlobUsageRequirements is missing");
+
+inline constexpr EnumPair<V4_0::KeyOrigin, nosapp::KeyOrigin> kKeyOrigins[] = {
+    {V4_0::KeyOrigin::GENERATED, nosapp::KeyOrigin::GENERATED},
+    {V4_0::KeyOrigin::DERIVED, nosapp::KeyOrigin::DERIVED},
+    {V4_0::KeyOrigin::IMPORTED, nosapp::KeyOrigin::IMPORTED},
+    {V4_0::KeyOrigin::UNKNOWN, nosapp::KeyOrigin::UNKNOWN},
+};
+using KeyOriginTable = EnumTable<kKeyOrigins>;
+static_assert(KeyOriginTable::size() == nosapp::KeyOrigin::KEY_ORIGIN_MAX,
+              "A KeyOrigin is missing");
+
+// The app has some private codes of its own, so this only runs one way in
+// practice.
+inline constexpr EnumPair<V4_0::ErrorCode, nosapp::ErrorCode> kErrorCodes[] = {
+    {V4_0::ErrorCode::OK, nosapp::ErrorCode::OK},
+    {V4_0::ErrorCode::ROOT_OF_TRUST_ALREADY_SET,
+     nosapp::ErrorCode::ROOT_OF_TRUST_ALREADY_SET},
+    {V4_0::ErrorCode::UNSUPPORTED_PURPOSE,
+     nosapp::ErrorCode::UNSUPPORTED_PURPOSE},
+    {V4_0::ErrorCode::INCOMPATIBLE_PURPOSE,
+     nosapp::ErrorCode::INCOMPATIBLE_PURPOSE},
+    {V4_0::ErrorCode::UNSUPPORTED_ALGORITHM,
+     nosapp::ErrorCode::UNSUPPORTED_ALGORITHM},
+    {V4_0::ErrorCode::INCOMPATIBLE_ALGORITHM,
+     nosapp::ErrorCode::INCOMPATIBLE_ALGORITHM},
+    {V4_0::ErrorCode::UNSUPPORTED_KEY_SIZE,
+     nosapp::ErrorCode::UNSUPPORTED_KEY_SIZE},
+    {V4_0::ErrorCode::UNSUPPORTED_BLOCK_MODE,
+     nosapp::ErrorCode::UNSUPPORTED_BLOCK_MODE},
+    {V4_0::ErrorCode::INCOMPATIBLE_BLOCK_MODE,
+     nosapp::ErrorCode::INCOMPATIBLE_BLOCK_MODE},
+    {V4_0::ErrorCode::UNSUPPORTED_MAC_LENGTH,
+     nosapp::ErrorCode::UNSUPPORTED_MAC_LENGTH},
+    {V4_0::ErrorCode::UNSUPPORTED_PADDING_MODE,
+     nosapp::ErrorCode::UNSUPPORTED_PADDING_MODE},
+    {V4_0::ErrorCode::INCOMPATIBLE_PADDING_MODE,
+     nosapp::ErrorCode::INCOMPATIBLE_PADDING_MODE},
+    {V4_0::ErrorCode::UNSUPPORTED_DIGEST,
+     nosapp::ErrorCode::UNSUPPORTED_DIGEST},
+    {V4_0::ErrorCode::INCOMPATIBLE_DIGEST,
+     nosapp::ErrorCode::INCOMPATIBLE_DIGEST},
+    {V4_0::ErrorCode::INVALID_EXPIRATION_TIME,
+     nosapp::ErrorCode::INVALID_EXPIRATION_TIME},
+    {V4_0::ErrorCode::INVALID_USER_ID, nosapp::ErrorCode::INVALID_USER_ID},
+    {V4_0::ErrorCode::INVALID_AUTHORIZATION_TIMEOUT,
+     nosapp::ErrorCode::INVALID_AUTHORIZATION_TIMEOUT},
+    {V4_0::ErrorCode::UNSUPPORTED_KEY_FORMAT,
+     nosapp::ErrorCode::UNSUPPORTED_KEY_FORMAT},
+    {V4_0::ErrorCode::INCOMPATIBLE_KEY_FORMAT,
+     nosapp::ErrorCode::INCOMPATIBLE_KEY_FORMAT},
+    {V4_0::ErrorCode::UNSUPPORTED_KEY_ENCRYPTION_ALGORITHM,
+     nosapp::ErrorCode::UNSUPPORTED_KEY_ENCRYPTION_ALGORITHM},
+    {V4_0::ErrorCode::UNSUPPORTED_KEY_VERIFICATION_ALGORITHM,
+     nosapp::ErrorCode::UNSUPPORTED_KEY_VERIFICATION_ALGORITHM},
+    {V4_0::ErrorCode::INVALID_INPUT_LENGTH,
+     nosapp::ErrorCode::INVALID_INPUT_LENGTH},
+    {V4_0::ErrorCode::KEY_EXPORT_OPTIONS_INVALID,
+     nosapp::ErrorCode::KEY_EXPORT_OPTIONS_INVALID},
+    {V4_0::ErrorCode::DELEGATION_NOT_ALLOWED,
+     nosapp::ErrorCode::DELEGATION_NOT_ALLOWED},
+    {V4_0::ErrorCode::KEY_NOT_YET_VALID, nosapp::ErrorCode::KEY_NOT_YET_VALID},
+    {V4_0::ErrorCode::KEY_EXPIRED, nosapp::ErrorCode::KEY_EXPIRED},
+    {V4_0::ErrorCode::KEY_USER_NOT_AUTHENTICATED,
+     nosapp::ErrorCode::KEY_USER_NOT_AUTHENTICATED},
+    {V4_0::ErrorCode::OUTPUT_PARAMETER_NULL,
+     nosapp::ErrorCode::OUTPUT_PARAMETER_NULL},
+    {V4_0::ErrorCode::INVALID_OPERATION_HANDLE,
+     nosapp::ErrorCode::INVALID_OPERATION_HANDLE},
+    {V4_0::ErrorCode::INSUFFICIENT_BUFFER_SPACE,
+     nosapp::ErrorCode::INSUFFICIENT_BUFFER_SPACE},
+    {V4_0::ErrorCode::VERIFICATION_FAILED,
+     nosapp::ErrorCode::VERIFICATION_FAILED},
+    {V4_0::ErrorCode::TOO_MANY_OPERATIONS,
+     nosapp::ErrorCode::TOO_MANY_OPERATIONS},
+    {V4_0::ErrorCode::UNEXPECTED_NULL_POINTER,
+     nosapp::ErrorCode::UNEXPECTED_NULL_POINTER},
+    {V4_0::ErrorCode::INVALID_KEY_BLOB, nosapp::ErrorCode::INVALID_KEY_BLOB},
+    {V4_0::ErrorCode::IMPORTED_KEY_NOT_ENCRYPTED,
+     nosapp::ErrorCode::IMPORTED_KEY_NOT_ENCRYPTED},
+    {V4_0::ErrorCode::IMPORTED_KEY_DECRYPTION_FAILED,
+     nosapp::ErrorCode::IMPORTED_KEY_DECRYPTION_FAILED},
+    {V4_0::ErrorCode::IMPORTED_KEY_NOT_SIGNED,
+     nosapp::ErrorCode::IMPORTED_KEY_NOT_SIGNED},
+    {V4_0::ErrorCode::IMPORTED_KEY_VERIFICATION_FAILED,
+     nosapp::ErrorCode::IMPORTED_KEY_VERIFICATION_FAILED},
+    {V4_0::ErrorCode::INVALID_ARGUMENT, nosapp::ErrorCode::INVALID_ARGUMENT},
+    {V4_0::ErrorCode::UNSUPPORTED_TAG, nosapp::ErrorCode::UNSUPPORTED_TAG},
+    {V4_0::ErrorCode::INVALID_TAG, nosapp::ErrorCode::INVALID_TAG},
+    {V4_0::ErrorCode::MEMORY_ALLOCATION_FAILED,
+     nosapp::ErrorCode::MEMORY_ALLOCATION_FAILED},
+    {V4_0::ErrorCode::IMPORT_PARAMETER_MISMATCH,
+     nosapp::ErrorCode::IMPORT_PARAMETER_MISMATCH},
+    {V4_0::ErrorCode::SECURE_HW_ACCESS_DENIED,
+     nosapp::ErrorCode::SECURE_HW_ACCESS_DENIED},
+    {V4_0::ErrorCode::OPERATION_CANCELLED,
+     nosapp::ErrorCode::OPERATION_CANCELLED},
+    {V4_0::ErrorCode::CONCURRENT_ACCESS_CONFLICT,
+     nosapp::ErrorCode::CONCURRENT_ACCESS_CONFLICT},
+    {V4_0::ErrorCode::SECURE_HW_BUSY, nosapp::ErrorCode::SECURE_HW_BUSY},
+    {V4_0::ErrorCode::SECURE_HW_COMMUNICATION_FAILED,
+     nosapp::ErrorCode::SECURE_HW_COMMUNICATION_FAILED},
+    {V4_0::ErrorCode::UNSUPPORTED_EC_FIELD,
+     nosapp::ErrorCode::UNSUPPORTED_EC_FIELD},
+    {V4_0::ErrorCode::MISSING_NONCE, nosapp::ErrorCode::MISSING_NONCE},
+    {V4_0::ErrorCode::INVALID_NONCE, nosapp::ErrorCode::INVALID_NONCE},
+    {V4_0::ErrorCode::MISSING_MAC_LENGTH,
+     nosapp::ErrorCode::MISSING_MAC_LENGTH},
+    {V4_0::ErrorCode::KEY_RATE_LIMIT_EXCEEDED,
+     nosapp::ErrorCode::KEY_RATE_LIMIT_EXCEEDED},
+    {V4_0::ErrorCode::CALLER_NONCE_PROHIBITED,
+     nosapp::ErrorCode::CALLER_NONCE_PROHIBITED},
+    {V4_0::ErrorCode::KEY_MAX_OPS_EXCEEDED,
+     nosapp::ErrorCode::KEY_MAX_OPS_EXCEEDED},
+    {V4_0::ErrorCode::INVALID_MAC_LENGTH,
+     nosapp::ErrorCode::INVALID_MAC_LENGTH},
+    {V4_0::ErrorCode::MISSING_MIN_MAC_LENGTH,
+     nosapp::ErrorCode::MISSING_MIN_MAC_LENGTH},
+    {V4_0::ErrorCode::UNSUPPORTED_MIN_MAC_LENGTH,
+     nosapp::ErrorCode::UNSUPPORTED_MIN_MAC_LENGTH},
+    {V4_0::ErrorCode::UNSUPPORTED_KDF, nosapp::ErrorCode::UNSUPPORTED_KDF},
+    {V4_0::ErrorCode::UNSUPPORTED_EC_CURVE,
+     nosapp::ErrorCode::UNSUPPORTED_EC_CURVE},
+    {V4_0::ErrorCode::KEY_REQUIRES_UPGRADE,
+     nosapp::ErrorCode::KEY_REQUIRES_UPGRADE},
+    {V4_0::ErrorCode::ATTESTATION_CHALLENGE_MISSING,
+     nosapp::ErrorCode::ATTESTATION_CHALLENGE_MISSING},
+    {V4_0::ErrorCode::KEYMASTER_NOT_CONFIGURED,
+     nosapp::ErrorCode::KEYMASTER_NOT_CONFIGURED},
+    {V4_0::ErrorCode::ATTESTATION_APPLICATION_ID_MISSING,
+     nosapp::ErrorCode::ATTESTATION_APPLICATION_ID_MISSING},
+    {V4_0::ErrorCode::CANNOT_ATTEST_IDS, nosapp::ErrorCode::CANNOT_ATTEST_IDS},
+    {V4_0::ErrorCode::UNIMPLEMENTED, nosapp::ErrorCode::UNIMPLEMENTED},
+    {V4_0::ErrorCode::VERSION_MISMATCH, nosapp::ErrorCode::VERSION_MISMATCH},
+    {V4_0::ErrorCode::ROLLBACK_RESISTANCE_UNAVAILABLE,
+     nosapp::ErrorCode::ROLLBACK_RESISTANCE_UNAVAILABLE},
+    {V4_0::ErrorCode::HARDWARE_TYPE_UNAVAILABLE,
+     nosapp::ErrorCode::HARDWARE_TYPE_UNAVAILABLE},
+    {V4_0::ErrorCode::PROOF_OF_PRESENCE_REQUIRED,
+     nosapp::ErrorCode::PROOF_OF_PRESENCE_REQUIRED},
+    {V4_0::ErrorCode::CONCURRENT_PROOF_OF_PRESENCE_REQUESTED,
+     nosapp::ErrorCode::CONCURRENT_PROOF_OF_PRESENCE_REQUESTED},
+    {V4_0::ErrorCode::UNKNOWN_ERROR, nosapp::ErrorCode::UNKNOWN_ERROR},
+    {V4_0::ErrorCode::NO_USER_CONFIRMATION,
+     nosapp::ErrorCode::NO_USER_CONFIRMATION},
+};
+using ErrorCodeTable = EnumTable<kErrorCodes>;
+
+// Every tag the HAL passes to the app. Tags are too sparse for an index;
+// translate_tag() works them out from their type and number instead and is
+// checked against this.
+inline constexpr EnumPair<V4_0::Tag, nosapp::Tag> kTags[] = {
+    {V4_0::Tag::INVALID, nosapp::Tag::TAG_INVALID},
+    {V4_0::Tag::PURPOSE, nosapp::Tag::PURPOSE},
+    {V4_0::Tag::ALGORITHM, nosapp::Tag::ALGORITHM},
+    {V4_0::Tag::KEY_SIZE, nosapp::Tag::KEY_SIZE},
+    {V4_0::Tag::BLOCK_MODE, nosapp::Tag::BLOCK_MODE},
+    {V4_0::Tag::DIGEST, nosapp::Tag::DIGEST},
+    {V4_0::Tag::PADDING, nosapp::Tag::PADDING},
+    {V4_0::Tag::CALLER_NONCE, nosapp::Tag::CALLER_NONCE},
+    {V4_0::Tag::MIN_MAC_LENGTH, nosapp::Tag::MIN_MAC_LENGTH},
+    {V4_0::Tag::EC_CURVE, nosapp::Tag::EC_CURVE},
+    {V4_0::Tag::RSA_PUBLIC_EXPONENT, nosapp::Tag::RSA_PUBLIC_EXPONENT},
+    {V4_0::Tag::INCLUDE_UNIQUE_ID, nosapp::Tag::INCLUDE_UNIQUE_ID},
+    {V4_0::Tag::BLOB_USAGE_REQUIREMENTS, nosapp::Tag::BLOB_USAGE_REQUIREMENTS},
+    {V4_0::Tag::BOOTLOADER_ONLY, nosapp::Tag::BOOTLOADER_ONLY},
+    {V4_0::Tag::ROLLBACK_RESISTANCE, nosapp::Tag::ROLLBACK_RESISTANCE},
+    {V4_0::Tag::ACTIVE_DATETIME, nosapp::Tag::ACTIVE_DATETIME},
+    {V4_0::Tag::ORIGINATION_EXPIRE_DATETIME,
+     nosapp::Tag::ORIGINATION_EXPIRE_DATETIME},
+    {V4_0::Tag::USAGE_EXPIRE_DATETIME, nosapp::Tag::USAGE_EXPIRE_DATETIME},
+    {V4_0::Tag::MIN_SECONDS_BETWEEN_OPS, nosapp::Tag::MIN_SECONDS_BETWEEN_OPS},
+    {V4_0::Tag::MAX_USES_PER_BOOT, nosapp::Tag::MAX_USES_PER_BOOT},
+    {V4_0::Tag::USER_SECURE_ID, nosapp::Tag::USER_SECURE_ID},
+    {V4_0::Tag::NO_AUTH_REQUIRED, nosapp::Tag::NO_AUTH_REQUIRED},
+    {V4_0::Tag::USER_AUTH_TYPE, nosapp::Tag::USER_AUTH_TYPE},
+    {V4_0::Tag::AUTH_TIMEOUT, nosapp::Tag::AUTH_TIMEOUT},
+    {V4_0::Tag::ALLOW_WHILE_ON_BODY, nosapp::Tag::ALLOW_WHILE_ON_BODY},
+    {V4_0::Tag::TRUSTED_USER_PRESENCE_REQUIRED,
+     nosapp::Tag::TRUSTED_USER_PRESENCE_REQUIRED},
+    {V4_0::Tag::TRUSTED_CONFIRMATION_REQUIRED,
+     nosapp::Tag::TRUSTED_CONFIRMATION_REQUIRED},
+    {V4_0::Tag::APPLICATION_ID, nosapp::Tag::APPLICATION_ID},
+    {V4_0::Tag::APPLICATION_DATA, nosapp::Tag::APPLICATION_DATA},
+    {V4_0::Tag::CREATION_DATETIME, nosapp::Tag::CREATION_DATETIME},
+    {V4_0::Tag::ORIGIN, nosapp::Tag::ORIGIN},
+    {V4_0::Tag::ROOT_OF_TRUST, nosapp::Tag::ROOT_OF_TRUST},
+    {V4_0::Tag::OS_VERSION, nosapp::Tag::OS_VERSION},
+    {V4_0::Tag::OS_PATCHLEVEL, nosapp::Tag::OS_PATCHLEVEL},
+    {V4_0::Tag::UNIQUE_ID, nosapp::Tag::UNIQUE_ID},
+    {V4_0::Tag::ATTESTATION_CHALLENGE, nosapp::Tag::ATTESTATION_CHALLENGE},
+    {V4_0::Tag::ATTESTATION_APPLICATION_ID,
+     nosapp::Tag::ATTESTATION_APPLICATION_ID},
+    {V4_0::Tag::ATTESTATION_ID_BRAND, nosapp::Tag::ATTESTATION_ID_BRAND},
+    {V4_0::Tag::ATTESTATION_ID_DEVICE, nosapp::Tag::ATTESTATION_ID_DEVICE},
+    {V4_0::Tag::ATTESTATION_ID_PRODUCT, nosapp::Tag::ATTESTATION_ID_PRODUCT},
+    {V4_0::Tag::ATTESTATION_ID_SERIAL, nosapp::Tag::ATTESTATION_ID_SERIAL},
+    {V4_0::Tag::ATTESTATION_ID_IMEI, nosapp::Tag::ATTESTATION_ID_IMEI},
+    {V4_0::Tag::ATTESTATION_ID_MEID, nosapp::Tag::ATTESTATION_ID_MEID},
+    {V4_0::Tag::ATTESTATION_ID_MANUFACTURER,
+     nosapp::Tag::ATTESTATION_ID_MANUFACTURER},
+    {V4_0::Tag::ATTESTATION_ID_MODEL, nosapp::Tag::ATTESTATION_ID_MODEL},
+    {V4_0::Tag::VENDOR_PATCHLEVEL, nosapp::Tag::VENDOR_PATCHLEVEL},
+    {V4_0::Tag::BOOT_PATCHLEVEL, nosapp::Tag::BOOT_PATCHLEVEL},
+    {V4_0::Tag::ASSOCIATED_DATA, nosapp::Tag::ASSOCIATED_DATA},
+    {V4_0::Tag::NONCE, nosapp::Tag::NONCE},
+    {V4_0::Tag::MAC_LENGTH, nosapp::Tag::MAC_LENGTH},
+    {V4_0::Tag::RESET_SINCE_ID_ROTATION, nosapp::Tag::RESET_SINCE_ID_ROTATION},
+    {V4_0::Tag::CONFIRMATION_TOKEN, nosapp::Tag::CONFIRMATION_TOKEN},
+};
+
+}  // namespace keymaster
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_KEYMASTER_ENUM_TABLES_H
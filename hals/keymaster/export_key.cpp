@@ -65,6 +65,9 @@ ErrorCode export_key_der(const ExportKeyResponse& response,
           LOG(ERROR) << "ExportKey: RSA_set0_key failed";
           return ErrorCode::UNKNOWN_ERROR;
       }
+      // Now owned by rsa.
+      n.release();
+      e.release();
 
       CBB cbb;
       uint8_t *data = new uint8_t[1024];  /* Plenty for RSA 4-k. */
@@ -57,20 +57,17 @@ static EVP_PKEY *evp_from_pkcs8_bytes(const uint8_t *bytes, size_t len)
     return EVP_PKCS82PKEY(pkcs8.get());
 }
 
-static ErrorCode import_key_rsa(const tag_map_t& params,
+static ErrorCode import_key_rsa(const TagIndex& params,
                                 const hidl_vec<uint8_t>& keyData,
                                 ImportKeyRequest *request)
 {
     const uint32_t *keySize = nullptr;
-    if (params.find(Tag::KEY_SIZE) != params.end()) {
-        const vector<KeyParameter>& v = params.find(Tag::KEY_SIZE)->second;
-        keySize = &v[0].f.integer;
+    if (params.contains(Tag::KEY_SIZE)) {
+        keySize = &params.find(Tag::KEY_SIZE)->f.integer;
     }
     const uint64_t *publicExponent = nullptr;
-    if (params.find(Tag::RSA_PUBLIC_EXPONENT) != params.end()) {
-        const vector<KeyParameter>& v =
-            params.find(Tag::RSA_PUBLIC_EXPONENT)->second;
-        publicExponent = &v[0].f.longInteger;
+    if (params.contains(Tag::RSA_PUBLIC_EXPONENT)) {
+        publicExponent = &params.find(Tag::RSA_PUBLIC_EXPONENT)->f.longInteger;
     }
 
     bssl::UniquePtr<EVP_PKEY> pkey;
@@ -134,19 +131,17 @@ static ErrorCode import_key_rsa(const tag_map_t& params,
     return ErrorCode::OK;
 }
 
-static ErrorCode import_key_ec(const tag_map_t& params,
+static ErrorCode import_key_ec(const TagIndex& params,
                                const hidl_vec<uint8_t>& keyData,
                                ImportKeyRequest *request)
 {
     const EcCurve *curve_id = nullptr;
-    if (params.find(Tag::EC_CURVE) != params.end()) {
-        const vector<KeyParameter>& v = params.find(Tag::EC_CURVE)->second;
-        curve_id = &v[0].f.ecCurve;
+    if (params.contains(Tag::EC_CURVE)) {
+        curve_id = &params.find(Tag::EC_CURVE)->f.ecCurve;
     }
     const uint32_t *key_size = nullptr;
-    if (params.find(Tag::KEY_SIZE) != params.end()) {
-        const vector<KeyParameter>& v = params.find(Tag::KEY_SIZE)->second;
-        key_size = &v[0].f.integer;
+    if (params.contains(Tag::KEY_SIZE)) {
+        key_size = &params.find(Tag::KEY_SIZE)->f.integer;
     }
 
     bssl::UniquePtr<EVP_PKEY> pkey;
@@ -243,7 +238,7 @@ static ErrorCode import_key_ec(const tag_map_t& params,
     return ErrorCode::OK;
 }
 
-static ErrorCode import_key_raw(const tag_map_t& params,
+static ErrorCode import_key_raw(const TagIndex& params,
                                 Algorithm algorithm,
                                 const hidl_vec<uint8_t>& keyData,
                                 ImportKeyRequest *request)
@@ -255,9 +250,8 @@ static ErrorCode import_key_raw(const tag_map_t& params,
     }
 
     const uint32_t *key_size = nullptr;
-    if (params.find(Tag::KEY_SIZE) != params.end()) {
-        const vector<KeyParameter>& v = params.find(Tag::KEY_SIZE)->second;
-        key_size = &v[0].f.integer;
+    if (params.contains(Tag::KEY_SIZE)) {
+        key_size = &params.find(Tag::KEY_SIZE)->f.integer;
     }
 
     if (algorithm != Algorithm::TRIPLE_DES) {
@@ -302,16 +296,15 @@ ErrorCode import_key_request(const hidl_vec<KeyParameter>& params,
     }
 
     ErrorCode error;
-    tag_map_t tag_map;
-    error = hidl_params_to_map(params, &tag_map);
+    TagIndex tag_index;
+    error = hidl_params_to_pb(params, request->mutable_params(), &tag_index);
     if (error != ErrorCode::OK) {
         return error;
     }
 
-    if (tag_map.find(Tag::ALGORITHM) != tag_map.end()) {
+    if (tag_index.contains(Tag::ALGORITHM)) {
         // Algorithm is a required parameter.
-        const vector<KeyParameter>& v = tag_map.find(Tag::ALGORITHM)->second;
-        algorithm = &v[0].f.algorithm;
+        algorithm = &tag_index.find(Tag::ALGORITHM)->f.algorithm;
     } else {
         LOG(ERROR) << "ImportKey request: Algorithm Tag missing";
         return ErrorCode::INVALID_ARGUMENT;
@@ -320,10 +313,10 @@ ErrorCode import_key_request(const hidl_vec<KeyParameter>& params,
     if (keyFormat == KeyFormat::PKCS8) {
         switch (*algorithm) {
         case Algorithm::RSA:
-            error = import_key_rsa(tag_map, keyData, request);
+            error = import_key_rsa(tag_index, keyData, request);
             break;
         case Algorithm::EC:
-            error = import_key_ec(tag_map, keyData, request);
+            error = import_key_ec(tag_index, keyData, request);
             break;
         default:
             LOG(ERROR) << "ImportKey request: unsupported algoritm: "
@@ -332,20 +325,13 @@ ErrorCode import_key_request(const hidl_vec<KeyParameter>& params,
             break;
         }
     } else {
-        error = import_key_raw(tag_map, *algorithm, keyData, request);
+        error = import_key_raw(tag_index, *algorithm, keyData, request);
     }
 
     if (error != ErrorCode::OK) {
         return error;
     }
 
-    error = map_params_to_pb(tag_map, request->mutable_params());
-    if (error != ErrorCode::OK) {
-        LOG(ERROR) << "ImportKey request: failed to map params to pb: "
-                   << (uint32_t) error;
-        return error;
-    }
-
     return ErrorCode::OK;
 }
 
@@ -21,21 +21,27 @@
 
 #include <Keymaster.client.h>
 
+#include <memory>
 #include <vector>
 
 namespace android {
 namespace hardware {
 namespace keymaster {
 
+using ::android::hardware::keymaster::V4_0::Algorithm;
+using ::android::hardware::keymaster::V4_0::BlockMode;
 using ::android::hardware::keymaster::V4_0::ErrorCode;
 using ::android::hardware::keymaster::V4_0::HardwareAuthToken;
 using ::android::hardware::keymaster::V4_0::HmacSharingParameters;
+using ::android::hardware::keymaster::V4_0::KeyCharacteristics;
 using ::android::hardware::keymaster::V4_0::IKeymasterDevice;
 using ::android::hardware::keymaster::V4_0::KeyFormat;
 using ::android::hardware::keymaster::V4_0::KeyParameter;
 using ::android::hardware::keymaster::V4_0::KeyPurpose;
 using ::android::hardware::keymaster::V4_0::VerificationToken;
 using ::android::hardware::Return;
+using ::android::hardware::hidl_handle;
+using ::android::hardware::hidl_string;
 using ::android::hardware::hidl_vec;
 using ::nugget::app::keymaster::BootColor;
 
@@ -43,9 +49,23 @@ using ::nugget::app::keymaster::BootColor;
 
 using KeymasterClient = ::nugget::app::keymaster::IKeymaster;
 
+class DeviceCapabilities;
+template <typename Value> class KeyBlobCache;
+class TagIndex;
+
+// Safe to call from several binder threads at once. The members set at
+// construction are read-only afterwards and the state of each operation is
+// guarded by its own lock, so calls only wait for others on the same operation.
 struct KeymasterDevice : public IKeymasterDevice {
     KeymasterDevice(KeymasterClient& keymaster);
-    ~KeymasterDevice() override = default;
+    ~KeymasterDevice() override;
+
+    // Finds how much input each streaming mode takes per update by sending
+    // growing chunks to operations on throwaway keys. Until then, and for
+    // modes the device fails, operations are sent the size every mode takes,
+    // so a client's update is never larger than the device has taken. Call
+    // once at startup, before serving.
+    void LearnChunkSizes();
 
     // Methods from ::android::hardware::keymaster::V4_0::IKeymasterDevice follow.
     Return<void> getHardwareInfo(getHardwareInfo_cb _hidl_cb) override;
@@ -106,8 +126,16 @@ struct KeymasterDevice : public IKeymasterDevice {
         finish_cb _hidl_cb) override;
     Return<ErrorCode> abort(uint64_t operationHandle) override;
 
+    // Methods from ::android::hidl::base::V1_0::IBase follow.
+    Return<void> debug(const hidl_handle& fd,
+                       const hidl_vec<hidl_string>& options) override;
+
 private:
     KeymasterClient& _keymaster;
+    std::unique_ptr<KeyBlobCache<KeyCharacteristics>> _characteristics_cache;
+    std::unique_ptr<KeyBlobCache<hidl_vec<uint8_t>>> _export_cache;
+    // What the device has rejected as unsupported, to reject it again here
+    std::unique_ptr<DeviceCapabilities> _capabilities;
     // These come from GetProperty.
     uint32_t _os_version;
     uint32_t _os_patchlevel;
@@ -119,8 +147,39 @@ private:
     std::vector<uint8_t> _boot_key;
     std::vector<uint8_t> _boot_hash;
 
-    Return<ErrorCode> SendSystemVersionInfo() const;
+    Return<ErrorCode> SendSystemVersionInfo();
     Return<ErrorCode> GetBootInfo();
+    // Forget what is cached for one key or for all of them
+    void InvalidateCaches(const hidl_vec<uint8_t>& keyBlob);
+    void ClearCaches();
+    // Largest chunk a throwaway operation in the mode took whole, or 0
+    size_t ProbeChunkSize(Algorithm algorithm, BlockMode blockMode);
+    // From the cache, or else the device and then cached
+    ErrorCode GetPublicKey(
+        KeyFormat exportFormat, const hidl_vec<uint8_t>& keyBlob,
+        const hidl_vec<uint8_t>& clientId, const hidl_vec<uint8_t>& appData,
+        std::shared_ptr<const hidl_vec<uint8_t>> *der);
+    // Whether the key was made or upgraded for this system version
+    bool KeyIsCurrent(const KeyCharacteristics& characteristics) const;
+    // Runs the operation in the HAL if it doesn't need the key's private
+    // half and the HAL can enforce the key's authorizations. UNIMPLEMENTED
+    // leaves it to the device.
+    ErrorCode BeginPublicKeyOperation(
+        KeyPurpose purpose, const hidl_vec<uint8_t>& keyBlob,
+        const hidl_vec<KeyParameter>& inParams, uint64_t *handle);
+    // The key's algorithm, if its characteristics are cached
+    bool CachedKeyAlgorithm(const hidl_vec<uint8_t>& keyBlob,
+                            const TagIndex& inParams, Algorithm *algorithm);
+    // From the cache, or else the device and then cached
+    ErrorCode GetCharacteristics(
+        const hidl_vec<uint8_t>& keyBlob, const hidl_vec<uint8_t>& clientId,
+        const hidl_vec<uint8_t>& appData,
+        std::shared_ptr<const KeyCharacteristics> *characteristics);
+    // update() for a caller that already holds the operation's lock
+    Return<void> UpdateLocked(
+        uint64_t operationHandle, const hidl_vec<KeyParameter>& inParams,
+        const hidl_vec<uint8_t>& input, const HardwareAuthToken& authToken,
+        const VerificationToken& verificationToken, update_cb _hidl_cb);
 };
 
 }  // namespace keymaster
@@ -0,0 +1,81 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "key_blob_cache.h"
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+
+using ::android::hardware::keymaster::V4_0::KeyParameter;
+
+namespace {
+
+size_t params_cost(const hidl_vec<KeyParameter>& params)
+{
+    size_t cost = params.size() * sizeof(KeyParameter);
+    for (const auto& param : params) {
+        cost += param.blob.size();
+    }
+    return cost;
+}
+
+void update_length_prefixed(SHA256_CTX *ctx, const hidl_vec<uint8_t>& data)
+{
+    const uint64_t size = data.size();
+    SHA256_Update(ctx, &size, sizeof(size));
+    SHA256_Update(ctx, data.data(), data.size());
+}
+
+}  // namespace
+
+KeyBlobDigest key_blob_digest(const hidl_vec<uint8_t>& keyBlob)
+{
+    KeyBlobDigest digest;
+    SHA256(keyBlob.data(), keyBlob.size(), digest.data());
+    return digest;
+}
+
+KeyBlobDigest key_blob_cache_key(const KeyBlobDigest& blob,
+                                 const hidl_vec<uint8_t>& clientId,
+                                 const hidl_vec<uint8_t>& appData,
+                                 uint32_t variant)
+{
+    SHA256_CTX ctx;
+    SHA256_Init(&ctx);
+    SHA256_Update(&ctx, blob.data(), blob.size());
+    update_length_prefixed(&ctx, clientId);
+    update_length_prefixed(&ctx, appData);
+    SHA256_Update(&ctx, &variant, sizeof(variant));
+    KeyBlobDigest digest;
+    SHA256_Final(digest.data(), &ctx);
+    return digest;
+}
+
+size_t key_blob_cache_cost(const KeyCharacteristics& characteristics)
+{
+    return params_cost(characteristics.softwareEnforced) +
+           params_cost(characteristics.hardwareEnforced);
+}
+
+size_t key_blob_cache_cost(const hidl_vec<uint8_t>& data)
+{
+    return data.size();
+}
+
+}  // namespace keymaster
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,188 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_KEYMASTER_KEY_BLOB_CACHE_H
+#define ANDROID_HARDWARE_KEYMASTER_KEY_BLOB_CACHE_H
+
+#include <android/hardware/keymaster/4.0/IKeymasterDevice.h>
+
+#include <openssl/sha.h>
+
+#include <array>
+#include <cstring>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+
+using ::android::hardware::hidl_vec;
+using ::android::hardware::keymaster::V4_0::KeyCharacteristics;
+
+using KeyBlobDigest = std::array<uint8_t, SHA256_DIGEST_LENGTH>;
+
+KeyBlobDigest key_blob_digest(const hidl_vec<uint8_t>& keyBlob);
+// Covers the blob's digest, the client ID, the app data and a variant, such
+// as the export format, for when one blob has several cached values.
+KeyBlobDigest key_blob_cache_key(const KeyBlobDigest& blob,
+                                 const hidl_vec<uint8_t>& clientId,
+                                 const hidl_vec<uint8_t>& appData,
+                                 uint32_t variant);
+
+// Approximate heap use of a cached value
+size_t key_blob_cache_cost(const KeyCharacteristics& characteristics);
+size_t key_blob_cache_cost(const hidl_vec<uint8_t>& data);
+
+// Remembers what the device reported for a key blob with a client ID and
+// app data so keystore's repeated requests don't each take a round trip to
+// Citadel. Entries are keyed by a SHA-256 of those inputs and the least
+// recently used are evicted to keep within a memory budget.
+//
+// Safe to call from several threads at once.
+template <typename Value>
+class KeyBlobCache {
+public:
+    static constexpr size_t kDefaultBudget = 64 * 1024;
+
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        size_t entries;
+        size_t bytes;
+    };
+
+    explicit KeyBlobCache(size_t budget = kDefaultBudget) : _budget(budget) {}
+
+    // Null if the value isn't cached
+    std::shared_ptr<const Value> lookup(
+        const hidl_vec<uint8_t>& keyBlob, const hidl_vec<uint8_t>& clientId,
+        const hidl_vec<uint8_t>& appData, uint32_t variant = 0) {
+        const KeyBlobDigest key = key_blob_cache_key(
+            key_blob_digest(keyBlob), clientId, appData, variant);
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        const auto it = _index.find(key);
+        if (it == _index.end()) {
+            _misses++;
+            return nullptr;
+        }
+        _hits++;
+        _lru.splice(_lru.begin(), _lru, it->second);
+        return it->second->value;
+    }
+
+    std::shared_ptr<const Value> insert(
+        const hidl_vec<uint8_t>& keyBlob, const hidl_vec<uint8_t>& clientId,
+        const hidl_vec<uint8_t>& appData, Value value, uint32_t variant = 0) {
+        const size_t cost = sizeof(Entry) + sizeof(Value) +
+                            key_blob_cache_cost(value);
+        auto shared = std::make_shared<const Value>(std::move(value));
+        if (cost > _budget) {
+            return shared;
+        }
+
+        const KeyBlobDigest blob = key_blob_digest(keyBlob);
+        const KeyBlobDigest key =
+            key_blob_cache_key(blob, clientId, appData, variant);
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        const auto it = _index.find(key);
+        if (it != _index.end()) {
+            // Another thread got here first
+            EraseLocked(it->second);
+        }
+        while (_bytes + cost > _budget) {
+            EraseLocked(std::prev(_lru.end()));
+            _evictions++;
+        }
+        _lru.push_front(Entry{key, blob, cost, shared});
+        _index.emplace(key, _lru.begin());
+        _bytes += cost;
+        return shared;
+    }
+
+    // Forgets the key blob for any client ID, app data and variant
+    void invalidate(const hidl_vec<uint8_t>& keyBlob) {
+        const KeyBlobDigest blob = key_blob_digest(keyBlob);
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (auto it = _lru.begin(); it != _lru.end();) {
+            const auto next = std::next(it);
+            if (it->blob == blob) {
+                EraseLocked(it);
+            }
+            it = next;
+        }
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _lru.clear();
+        _index.clear();
+        _bytes = 0;
+    }
+
+    Stats stats() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return Stats{_hits, _misses, _evictions, _lru.size(), _bytes};
+    }
+
+private:
+    struct DigestHash {
+        size_t operator()(const KeyBlobDigest& digest) const {
+            // The digest is already uniformly distributed
+            size_t hash;
+            memcpy(&hash, digest.data(), sizeof(hash));
+            return hash;
+        }
+    };
+
+    struct Entry {
+        KeyBlobDigest key;
+        KeyBlobDigest blob;
+        size_t cost;
+        std::shared_ptr<const Value> value;
+    };
+
+    void EraseLocked(typename std::list<Entry>::iterator entry) {
+        _bytes -= entry->cost;
+        _index.erase(entry->key);
+        _lru.erase(entry);
+    }
+
+    const size_t _budget;
+
+    mutable std::mutex _mutex;
+    // Most recently used first
+    std::list<Entry> _lru;
+    std::unordered_map<KeyBlobDigest, typename std::list<Entry>::iterator,
+                       DigestHash> _index;
+    size_t _bytes = 0;
+    uint64_t _hits = 0;
+    uint64_t _misses = 0;
+    uint64_t _evictions = 0;
+};
+
+}  // namespace keymaster
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_KEYMASTER_KEY_BLOB_CACHE_H
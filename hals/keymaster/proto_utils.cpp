@@ -15,11 +15,15 @@
  */
 
 #include "proto_utils.h"
+#include "enum_tables.h"
 
 #include <android-base/logging.h>
 #include <android/hardware/keymaster/4.0/types.h>
 #include <keymasterV4_0/key_param_output.h>
 
+#include <algorithm>
+#include <utility>
+
 namespace android {
 namespace hardware {
 namespace keymaster {
@@ -43,365 +47,143 @@ static TagType type_from_tag(Tag tag)
     return static_cast<TagType>(tag & (0xF << 28));
 }
 
-static nosapp::TagType type_from_tag(nosapp::Tag tag)
+// Both enums keep a tag's type in its top bits and its number in the low 16.
+static constexpr nosapp::Tag translate_tag(Tag tag)
 {
-    return static_cast<nosapp::TagType>(tag & (0xF << 16));
+    return static_cast<nosapp::Tag>(
+        ((static_cast<uint32_t>(tag) >> 28) << 16) |
+        (static_cast<uint32_t>(tag) & 0xffff));
 }
 
-static nosapp::Tag translate_tag(Tag tag)
+static constexpr Tag translate_tag(nosapp::Tag tag)
 {
-    enum TagType tag_type = type_from_tag(tag);
-
-    /* TODO:  This is gross.  The alternative is to have a complete table. */
-    return static_cast<nosapp::Tag>(
-        (((uint32_t)tag_type >> 28) << 16) | (tag & 0xffff));
+    return static_cast<Tag>(
+        ((static_cast<uint32_t>(tag) >> 16) << 28) |
+        (static_cast<uint32_t>(tag) & 0xffff));
 }
 
-static Tag translate_tag(nosapp::Tag tag)
+static constexpr bool tags_translate()
 {
-    enum nosapp::TagType tag_type = type_from_tag(tag);
-
-    /* TODO:  This is gross.  The alternative is to have a complete table. */
-    return static_cast<Tag>(
-        (((uint32_t)tag_type >> 16) << 28) | (tag & 0xffff));
+    for (const auto& pair : kTags) {
+        if (translate_tag(pair.hal) != pair.app ||
+            translate_tag(pair.app) != pair.hal) {
+            return false;
+        }
+    }
+    return true;
 }
+static_assert(tags_translate(), "translate_tag() disagrees with kTags");
 
 static nosapp::KeyPurpose translate_purpose(KeyPurpose purpose)
 {
-    switch (purpose) {
-    case KeyPurpose::ENCRYPT:
-        return nosapp::KeyPurpose::ENCRYPT;
-    case KeyPurpose::DECRYPT:
-        return nosapp::KeyPurpose::DECRYPT;
-    case KeyPurpose::SIGN:
-        return nosapp::KeyPurpose::SIGN;
-    case KeyPurpose::VERIFY:
-        return nosapp::KeyPurpose::VERIFY;
-    case KeyPurpose::WRAP_KEY:
-        return nosapp::KeyPurpose::WRAP_KEY;
-    default:
-        return nosapp::KeyPurpose::PURPOSE_MAX;
-    }
+    nosapp::KeyPurpose out = nosapp::KeyPurpose::PURPOSE_MAX;
+    PurposeTable::to_app(purpose, &out);
+    return out;
 }
 
 static ErrorCode translate_purpose(nosapp::KeyPurpose purpose, KeyPurpose *out)
 {
-    switch (purpose) {
-    case nosapp::KeyPurpose::ENCRYPT:
-        *out = KeyPurpose::ENCRYPT;
-        break;
-    case nosapp::KeyPurpose::DECRYPT:
-        *out = KeyPurpose::DECRYPT;
-        break;
-    case nosapp::KeyPurpose::SIGN:
-        *out = KeyPurpose::SIGN;
-        break;
-    case nosapp::KeyPurpose::VERIFY:
-        *out = KeyPurpose::VERIFY;
-        break;
-    case nosapp::KeyPurpose::WRAP_KEY:
-        *out = KeyPurpose::WRAP_KEY;
-        break;
-    default:
-        return ErrorCode::UNKNOWN_ERROR;
-    }
-
-    return ErrorCode::OK;
+    return PurposeTable::to_hal(purpose, out) ?
+        ErrorCode::OK : ErrorCode::UNKNOWN_ERROR;
 }
 
 static nosapp::Algorithm translate_algorithm(Algorithm algorithm)
 {
-    switch (algorithm) {
-    case Algorithm::RSA:
-        return nosapp::Algorithm::RSA;
-    case Algorithm::EC:
-        return nosapp::Algorithm::EC;
-    case Algorithm::AES:
-        return nosapp::Algorithm::AES;
-    case Algorithm::TRIPLE_DES:
-        return nosapp::Algorithm::DES;
-    case Algorithm::HMAC:
-        return nosapp::Algorithm::HMAC;
-    default:
-        return nosapp::Algorithm::ALGORITHM_MAX;
-    }
+    nosapp::Algorithm out = nosapp::Algorithm::ALGORITHM_MAX;
+    AlgorithmTable::to_app(algorithm, &out);
+    return out;
 }
 
 ErrorCode translate_algorithm(nosapp::Algorithm algorithm,
                               Algorithm *out)
 {
-    switch (algorithm) {
-    case nosapp::Algorithm::RSA:
-        *out = Algorithm::RSA;
-        break;
-    case nosapp::Algorithm::EC:
-        *out = Algorithm::EC;
-        break;
-    case nosapp::Algorithm::AES:
-        *out = Algorithm::AES;
-        break;
-    case nosapp::Algorithm::DES:
-        *out = Algorithm::TRIPLE_DES;
-        break;
-    case nosapp::Algorithm::HMAC:
-        *out = Algorithm::HMAC;
-        break;
-    default:
-        return ErrorCode::UNKNOWN_ERROR;
-    }
-
-    return ErrorCode::OK;
+    return AlgorithmTable::to_hal(algorithm, out) ?
+        ErrorCode::OK : ErrorCode::UNKNOWN_ERROR;
 }
 
 static nosapp::BlockMode translate_block_mode(BlockMode block_mode)
 {
-    switch (block_mode) {
-    case BlockMode::ECB:
-        return nosapp::BlockMode::ECB;
-    case BlockMode::CBC:
-        return nosapp::BlockMode::CBC;
-    case BlockMode::CTR:
-        return nosapp::BlockMode::CTR;
-    case BlockMode::GCM:
-        return nosapp::BlockMode::GCM;
-    default:
-        return nosapp::BlockMode::BLOCK_MODE_MAX;
-    }
+    nosapp::BlockMode out = nosapp::BlockMode::BLOCK_MODE_MAX;
+    BlockModeTable::to_app(block_mode, &out);
+    return out;
 }
 
 static ErrorCode translate_block_mode(nosapp::BlockMode block_mode,
                                       BlockMode *out)
 {
-    switch (block_mode) {
-    case nosapp::BlockMode::ECB:
-        *out = BlockMode::ECB;
-        break;
-    case nosapp::BlockMode::CBC:
-        *out = BlockMode::CBC;
-        break;
-    case nosapp::BlockMode::CTR:
-        *out = BlockMode::CTR;
-        break;
-    case nosapp::BlockMode::GCM:
-        *out = BlockMode::GCM;
-        break;
-    default:
-        return ErrorCode::UNKNOWN_ERROR;
-        break;
-    }
-
-    return ErrorCode::OK;
+    return BlockModeTable::to_hal(block_mode, out) ?
+        ErrorCode::OK : ErrorCode::UNKNOWN_ERROR;
 }
 
 static nosapp::Digest translate_digest(Digest digest)
 {
-    switch (digest) {
-    case Digest::NONE:
-        return nosapp::Digest::DIGEST_NONE;
-    case Digest::MD5:
-        return nosapp::Digest::DIGEST_MD5;
-    case Digest::SHA1:
-        return nosapp::Digest::DIGEST_SHA1;
-    case Digest::SHA_2_224:
-        return nosapp::Digest::DIGEST_SHA_2_224;
-    case Digest::SHA_2_256:
-        return nosapp::Digest::DIGEST_SHA_2_256;
-    case Digest::SHA_2_384:
-        return nosapp::Digest::DIGEST_SHA_2_384;
-    case Digest::SHA_2_512:
-        return nosapp::Digest::DIGEST_SHA_2_512;
-    default:
-        return nosapp::Digest::DIGEST_MAX;
-    }
+    nosapp::Digest out = nosapp::Digest::DIGEST_MAX;
+    DigestTable::to_app(digest, &out);
+    return out;
 }
 
 static ErrorCode translate_digest(nosapp::Digest digest,
                                   Digest *out)
 {
-    switch (digest) {
-    case nosapp::Digest::DIGEST_NONE:
-        *out = Digest::NONE;
-        break;
-    case nosapp::Digest::DIGEST_MD5:
-        *out = Digest::MD5;
-        break;
-    case nosapp::Digest::DIGEST_SHA1:
-        *out = Digest::SHA1;
-        break;
-    case nosapp::Digest::DIGEST_SHA_2_224:
-        *out = Digest::SHA_2_224;
-        break;
-    case nosapp::Digest::DIGEST_SHA_2_256:
-        *out = Digest::SHA_2_256;
-        break;
-    case nosapp::Digest::DIGEST_SHA_2_384:
-        *out = Digest::SHA_2_384;
-        break;
-    case nosapp::Digest::DIGEST_SHA_2_512:
-        *out = Digest::SHA_2_512;
-        break;
-    default:
-        return ErrorCode::UNKNOWN_ERROR;
-    }
-
-    return ErrorCode::OK;
+    return DigestTable::to_hal(digest, out) ?
+        ErrorCode::OK : ErrorCode::UNKNOWN_ERROR;
 }
 
 static nosapp::PaddingMode translate_padding_mode(PaddingMode padding_mode)
 {
-    switch (padding_mode) {
-    case PaddingMode::NONE:
-        return nosapp::PaddingMode::PADDING_NONE;
-    case PaddingMode::RSA_OAEP:
-        return nosapp::PaddingMode::PADDING_RSA_OAEP;
-    case PaddingMode::RSA_PSS:
-        return nosapp::PaddingMode::PADDING_RSA_PSS;
-    case PaddingMode::RSA_PKCS1_1_5_ENCRYPT:
-        return nosapp::PaddingMode::PADDING_RSA_PKCS1_1_5_ENCRYPT;
-    case PaddingMode::RSA_PKCS1_1_5_SIGN:
-        return nosapp::PaddingMode::PADDING_RSA_PKCS1_1_5_SIGN;
-    case PaddingMode::PKCS7:
-        return nosapp::PaddingMode::PADDING_PKCS7;
-    default:
-        return nosapp::PaddingMode::PADDING_MODE_MAX;
-    }
+    nosapp::PaddingMode out = nosapp::PaddingMode::PADDING_MODE_MAX;
+    PaddingModeTable::to_app(padding_mode, &out);
+    return out;
 }
 
 static ErrorCode translate_padding_mode(nosapp::PaddingMode padding_mode,
     PaddingMode *out)
 {
-    switch (padding_mode) {
-    case nosapp::PaddingMode::PADDING_NONE:
-        *out = PaddingMode::NONE;
-        break;
-    case nosapp::PaddingMode::PADDING_RSA_OAEP:
-        *out = PaddingMode::RSA_OAEP;
-        break;
-    case nosapp::PaddingMode::PADDING_RSA_PSS:
-        *out = PaddingMode::RSA_PSS;
-        break;
-    case nosapp::PaddingMode::PADDING_RSA_PKCS1_1_5_ENCRYPT:
-        *out = PaddingMode::RSA_PKCS1_1_5_ENCRYPT;
-        break;
-    case nosapp::PaddingMode::PADDING_RSA_PKCS1_1_5_SIGN:
-        *out = PaddingMode::RSA_PKCS1_1_5_SIGN;
-        break;
-    case nosapp::PaddingMode::PADDING_PKCS7:
-        *out = PaddingMode::PKCS7;
-        break;
-    default:
-        return ErrorCode::UNKNOWN_ERROR;
-    }
-
-    return ErrorCode::OK;
+    return PaddingModeTable::to_hal(padding_mode, out) ?
+        ErrorCode::OK : ErrorCode::UNKNOWN_ERROR;
 }
 
 static nosapp::EcCurve translate_ec_curve(EcCurve ec_curve)
 {
-    switch (ec_curve) {
-    case EcCurve::P_224:
-        return nosapp::EcCurve::P_224;
-    case EcCurve::P_256:
-        return nosapp::EcCurve::P_256;
-    case EcCurve::P_384:
-        return nosapp::EcCurve::P_384;
-    case EcCurve::P_521:
-        return nosapp::EcCurve::P_521;
-    default:
-        return nosapp::EcCurve::EC_CURVE_MAX;
-    }
+    nosapp::EcCurve out = nosapp::EcCurve::EC_CURVE_MAX;
+    EcCurveTable::to_app(ec_curve, &out);
+    return out;
 }
 
 ErrorCode translate_ec_curve(nosapp::EcCurve ec_curve, EcCurve *out)
 {
-    switch (ec_curve) {
-    case nosapp::EcCurve::P_224:
-        *out = EcCurve::P_224;
-        break;
-    case nosapp::EcCurve::P_256:
-        *out = EcCurve::P_256;
-        break;
-    case nosapp::EcCurve::P_384:
-        *out = EcCurve::P_384;
-        break;
-    case nosapp::EcCurve::P_521:
-        *out = EcCurve::P_521;
-        break;
-    default:
-        return ErrorCode::UNKNOWN_ERROR;
-    }
-
-    return ErrorCode::OK;
+    return EcCurveTable::to_hal(ec_curve, out) ?
+        ErrorCode::OK : ErrorCode::UNKNOWN_ERROR;
 }
 
 static nosapp::KeyBlobUsageRequirements translate_key_blob_usage_requirements(
     KeyBlobUsageRequirements usage)
 {
-    switch (usage) {
-    case KeyBlobUsageRequirements::STANDALONE:
-        return nosapp::KeyBlobUsageRequirements::STANDALONE;
-    case KeyBlobUsageRequirements::REQUIRES_FILE_SYSTEM:
-        return nosapp::KeyBlobUsageRequirements::REQUIRES_FILE_SYSTEM;
-    default:
-        return nosapp::KeyBlobUsageRequirements::KEY_USAGE_MAX;
-        break;
-    }
+    nosapp::KeyBlobUsageRequirements out =
+        nosapp::KeyBlobUsageRequirements::KEY_USAGE_MAX;
+    KeyBlobUsageRequirementsTable::to_app(usage, &out);
+    return out;
 }
 
 static ErrorCode translate_key_blob_usage_requirements(
     nosapp::KeyBlobUsageRequirements usage, KeyBlobUsageRequirements *out)
 {
-    switch (usage) {
-    case nosapp::KeyBlobUsageRequirements::STANDALONE:
-        *out = KeyBlobUsageRequirements::STANDALONE;
-        break;
-    case nosapp::KeyBlobUsageRequirements::REQUIRES_FILE_SYSTEM:
-        *out = KeyBlobUsageRequirements::REQUIRES_FILE_SYSTEM;
-        break;
-    default:
-        return ErrorCode::UNKNOWN_ERROR;
-    }
-
-    return ErrorCode::UNKNOWN_ERROR;
+    return KeyBlobUsageRequirementsTable::to_hal(usage, out) ?
+        ErrorCode::OK : ErrorCode::UNKNOWN_ERROR;
 }
 
 static nosapp::KeyOrigin translate_key_origin(KeyOrigin key_origin)
 {
-    switch (key_origin) {
-    case KeyOrigin::GENERATED:
-        return nosapp::KeyOrigin::GENERATED;
-    case KeyOrigin::DERIVED:
-        return nosapp::KeyOrigin::DERIVED;
-    case KeyOrigin::IMPORTED:
-        return nosapp::KeyOrigin::IMPORTED;
-    case KeyOrigin::UNKNOWN:
-        return nosapp::KeyOrigin::UNKNOWN;
-    default:
-        return nosapp::KeyOrigin::KEY_ORIGIN_MAX;
-    }
+    nosapp::KeyOrigin out = nosapp::KeyOrigin::KEY_ORIGIN_MAX;
+    KeyOriginTable::to_app(key_origin, &out);
+    return out;
 }
 
 static ErrorCode translate_key_origin(nosapp::KeyOrigin key_origin,
                                       KeyOrigin *out)
 {
-    switch (key_origin) {
-    case nosapp::KeyOrigin::GENERATED:
-        *out = KeyOrigin::GENERATED;
-        break;
-    case nosapp::KeyOrigin::DERIVED:
-        *out = KeyOrigin::DERIVED;
-        break;
-    case nosapp::KeyOrigin::IMPORTED:
-        *out = KeyOrigin::IMPORTED;
-        break;
-    case nosapp::KeyOrigin::UNKNOWN:
-        *out = KeyOrigin::UNKNOWN;
-        break;
-    default:
-        return ErrorCode::UNKNOWN_ERROR;
-    }
-
-    return ErrorCode::OK;
+    return KeyOriginTable::to_hal(key_origin, out) ?
+        ErrorCode::OK : ErrorCode::UNKNOWN_ERROR;
 }
 
 ErrorCode translate_auth_token(const HardwareAuthToken& auth_token,
@@ -770,60 +552,91 @@ ErrorCode hidl_params_to_pb(const hidl_vec<KeyParameter>& params,
     return ErrorCode::OK;
 }
 
-ErrorCode hidl_params_to_map(const hidl_vec<KeyParameter>& params,
-                             tag_map_t *tag_map)
+const KeyParameter *TagIndex::find(Tag tag) const
 {
-    for (size_t i = 0; i < params.size(); i++) {
-        switch (type_from_tag(params[i].tag)) {
-        case TagType::INVALID:
-            return ErrorCode::INVALID_ARGUMENT;
-            break;
-        case TagType::ENUM:
-        case TagType::UINT:
-        case TagType::ULONG:
-        case TagType::DATE:
-        case TagType::BOOL:
-        case TagType::BIGNUM:
-        case TagType::BYTES:
-            if (tag_map->find(params[i].tag) != tag_map->end()) {
-                // Duplicates not allowed for these tags types.
-                return ErrorCode::INVALID_ARGUMENT;
-            }
-            FALLTHROUGH_INTENDED;
-        case TagType::ENUM_REP:
-            FALLTHROUGH_INTENDED;
-        case TagType::UINT_REP:
-            FALLTHROUGH_INTENDED;
-        case TagType::ULONG_REP:
-            if (tag_map->find(params[i].tag) == tag_map->end()) {
-                vector<KeyParameter> v{params[i]};
-                tag_map->insert(
-                    std::pair<Tag, vector<KeyParameter> >(
-                        params[i].tag, v));
-            } else {
-                (*tag_map)[params[i].tag].push_back(params[i]);
-            }
-            break;
-        default:
-            /* Unrecognized TagType. */
+    const Entry *first = data();
+    const Entry *last = first + _size;
+    const Entry *it = std::lower_bound(first, last, Entry{tag, nullptr},
+                                       ByTag);
+    return it != last && it->tag == tag ? it->param : nullptr;
+}
+
+void TagIndex::reserve(size_t size)
+{
+    if (size > kInlineSize && _overflow.empty()) {
+        _overflow.reserve(size);
+        _overflow.assign(_inline, _inline + _size);
+    }
+}
+
+ErrorCode TagIndex::insert(const KeyParameter& param)
+{
+    bool repeatable;
+    switch (type_from_tag(param.tag)) {
+    case TagType::ENUM:
+    case TagType::UINT:
+    case TagType::ULONG:
+    case TagType::DATE:
+    case TagType::BOOL:
+    case TagType::BIGNUM:
+    case TagType::BYTES:
+        repeatable = false;
+        break;
+    case TagType::ENUM_REP:
+    case TagType::UINT_REP:
+    case TagType::ULONG_REP:
+        repeatable = true;
+        break;
+    default:
+        /* Unrecognized TagType. */
+        return ErrorCode::INVALID_ARGUMENT;
+    }
+
+    const Entry entry{param.tag, &param};
+    if (_size == kInlineSize && _overflow.empty()) {
+        _overflow.assign(_inline, _inline + _size);
+    }
+    // After any others with the tag, so find() gives the first one passed.
+    Entry *first = _overflow.empty() ? _inline : _overflow.data();
+    Entry *last = first + _size;
+    Entry *it = std::upper_bound(first, last, entry, ByTag);
+    if (!repeatable && it != first && (it - 1)->tag == param.tag) {
+        // Duplicates not allowed for these tags types.
+        return ErrorCode::INVALID_ARGUMENT;
+    }
+
+    if (_overflow.empty()) {
+        std::move_backward(it, last, last + 1);
+        *it = entry;
+    } else {
+        _overflow.insert(_overflow.begin() + (it - first), entry);
+    }
+    _size++;
+    return ErrorCode::OK;
+}
+
+ErrorCode hidl_params_to_pb(const hidl_vec<KeyParameter>& params,
+                            nosapp::KeyParameters *pb, TagIndex *index)
+{
+    pb->mutable_params()->Reserve(params.size());
+    index->reserve(params.size());
+    for (const KeyParameter& param : params) {
+        if (index->insert(param) != ErrorCode::OK ||
+            key_parameter_to_pb(param, pb->add_params()) != ErrorCode::OK) {
             return ErrorCode::INVALID_ARGUMENT;
-            break;
         }
     }
 
     return ErrorCode::OK;
 }
 
-ErrorCode map_params_to_pb(const tag_map_t& params,
-                           nosapp::KeyParameters *pbParams)
+ErrorCode hidl_params_to_index(const hidl_vec<KeyParameter>& params,
+                               TagIndex *index)
 {
-    for (const auto& it : params) {
-        for (const auto& pt : it.second) {
-            nosapp::KeyParameter *param = pbParams->add_params();
-            ErrorCode error = key_parameter_to_pb(pt, param);
-            if (error != ErrorCode::OK) {
-                return error;
-            }
+    index->reserve(params.size());
+    for (const KeyParameter& param : params) {
+        if (index->insert(param) != ErrorCode::OK) {
+            return ErrorCode::INVALID_ARGUMENT;
         }
     }
 
@@ -833,182 +646,29 @@ ErrorCode map_params_to_pb(const tag_map_t& params,
 ErrorCode pb_to_hidl_params(const nosapp::KeyParameters& pbParams,
                             hidl_vec<KeyParameter> *params)
 {
-    std::vector<KeyParameter> kpv;
-    for (size_t i = 0; i < (size_t)pbParams.params_size(); i++) {
-        KeyParameter kp;
-        const nosapp::KeyParameter& param = pbParams.params(i);
-
-        ErrorCode error = pb_to_key_parameter(param, &kp);
+    // Translated in place; blobs are left as views on pbParams.
+    hidl_vec<KeyParameter> kpv;
+    kpv.resize(pbParams.params_size());
+    for (size_t i = 0; i < kpv.size(); i++) {
+        ErrorCode error = pb_to_key_parameter(pbParams.params(i), &kpv[i]);
         if (error != ErrorCode::OK) {
             return ErrorCode::UNKNOWN_ERROR;
         }
-
-        kpv.push_back(kp);
     }
 
-    *params = kpv;
+    *params = std::move(kpv);
     return ErrorCode::OK;
 }
 
 ErrorCode translate_error_code(nosapp::ErrorCode error_code)
 {
-    switch (error_code) {
-    case nosapp::ErrorCode::OK:
-        return ErrorCode::OK;
-    case nosapp::ErrorCode::ROOT_OF_TRUST_ALREADY_SET:
-        return ErrorCode::ROOT_OF_TRUST_ALREADY_SET;
-    case nosapp::ErrorCode::UNSUPPORTED_PURPOSE:
-      return ErrorCode::UNSUPPORTED_PURPOSE;
-    case nosapp::ErrorCode::INCOMPATIBLE_PURPOSE:
-        return ErrorCode::INCOMPATIBLE_PURPOSE;
-    case nosapp::ErrorCode::UNSUPPORTED_ALGORITHM:
-        return ErrorCode::UNSUPPORTED_ALGORITHM;
-    case nosapp::ErrorCode::INCOMPATIBLE_ALGORITHM:
-        return ErrorCode::INCOMPATIBLE_ALGORITHM;
-    case nosapp::ErrorCode::UNSUPPORTED_KEY_SIZE:
-        return ErrorCode::UNSUPPORTED_KEY_SIZE;
-    case nosapp::ErrorCode::UNSUPPORTED_BLOCK_MODE:
-        return ErrorCode::UNSUPPORTED_BLOCK_MODE;
-    case nosapp::ErrorCode::INCOMPATIBLE_BLOCK_MODE:
-        return ErrorCode::INCOMPATIBLE_BLOCK_MODE;
-    case nosapp::ErrorCode::UNSUPPORTED_MAC_LENGTH:
-        return ErrorCode::UNSUPPORTED_MAC_LENGTH;
-    case nosapp::ErrorCode::UNSUPPORTED_PADDING_MODE:
-        return ErrorCode::UNSUPPORTED_PADDING_MODE;
-    case nosapp::ErrorCode::INCOMPATIBLE_PADDING_MODE:
-        return ErrorCode::INCOMPATIBLE_PADDING_MODE;
-    case nosapp::ErrorCode::UNSUPPORTED_DIGEST:
-        return ErrorCode::UNSUPPORTED_DIGEST;
-    case nosapp::ErrorCode::INCOMPATIBLE_DIGEST:
-        return ErrorCode::INCOMPATIBLE_DIGEST;
-    case nosapp::ErrorCode::INVALID_EXPIRATION_TIME:
-        return ErrorCode::INVALID_EXPIRATION_TIME;
-    case nosapp::ErrorCode::INVALID_USER_ID:
-        return ErrorCode::INVALID_USER_ID;
-    case nosapp::ErrorCode::INVALID_AUTHORIZATION_TIMEOUT:
-        return ErrorCode::INVALID_AUTHORIZATION_TIMEOUT;
-    case nosapp::ErrorCode::UNSUPPORTED_KEY_FORMAT:
-        return ErrorCode::UNSUPPORTED_KEY_FORMAT;
-    case nosapp::ErrorCode::INCOMPATIBLE_KEY_FORMAT:
-        return ErrorCode::INCOMPATIBLE_KEY_FORMAT;
-    case nosapp::ErrorCode::UNSUPPORTED_KEY_ENCRYPTION_ALGORITHM:
-        return ErrorCode::UNSUPPORTED_KEY_ENCRYPTION_ALGORITHM;
-    case nosapp::ErrorCode::UNSUPPORTED_KEY_VERIFICATION_ALGORITHM:
-        return ErrorCode::UNSUPPORTED_KEY_VERIFICATION_ALGORITHM;
-    case nosapp::ErrorCode::INVALID_INPUT_LENGTH:
-        return ErrorCode::INVALID_INPUT_LENGTH;
-    case nosapp::ErrorCode::KEY_EXPORT_OPTIONS_INVALID:
-        return ErrorCode::KEY_EXPORT_OPTIONS_INVALID;
-    case nosapp::ErrorCode::DELEGATION_NOT_ALLOWED:
-        return ErrorCode::DELEGATION_NOT_ALLOWED;
-    case nosapp::ErrorCode::KEY_NOT_YET_VALID:
-        return ErrorCode::KEY_NOT_YET_VALID;
-    case nosapp::ErrorCode::KEY_EXPIRED:
-        return ErrorCode::KEY_EXPIRED;
-    case nosapp::ErrorCode::KEY_USER_NOT_AUTHENTICATED:
-        return ErrorCode::KEY_USER_NOT_AUTHENTICATED;
-    case nosapp::ErrorCode::OUTPUT_PARAMETER_NULL:
-        return ErrorCode::OUTPUT_PARAMETER_NULL;
-    case nosapp::ErrorCode::INVALID_OPERATION_HANDLE:
-        return ErrorCode::INVALID_OPERATION_HANDLE;
-    case nosapp::ErrorCode::INSUFFICIENT_BUFFER_SPACE:
-        return ErrorCode::INSUFFICIENT_BUFFER_SPACE;
-    case nosapp::ErrorCode::VERIFICATION_FAILED:
-        return ErrorCode::VERIFICATION_FAILED;
-    case nosapp::ErrorCode::TOO_MANY_OPERATIONS:
-        return ErrorCode::TOO_MANY_OPERATIONS;
-    case nosapp::ErrorCode::UNEXPECTED_NULL_POINTER:
-        return ErrorCode::UNEXPECTED_NULL_POINTER;
-    case nosapp::ErrorCode::INVALID_KEY_BLOB:
-        return ErrorCode::INVALID_KEY_BLOB;
-    case nosapp::ErrorCode::IMPORTED_KEY_NOT_ENCRYPTED:
-        return ErrorCode::IMPORTED_KEY_NOT_ENCRYPTED;
-    case nosapp::ErrorCode::IMPORTED_KEY_DECRYPTION_FAILED:
-        return ErrorCode::IMPORTED_KEY_DECRYPTION_FAILED;
-    case nosapp::ErrorCode::IMPORTED_KEY_NOT_SIGNED:
-        return ErrorCode::IMPORTED_KEY_NOT_SIGNED;
-    case nosapp::ErrorCode::IMPORTED_KEY_VERIFICATION_FAILED:
-        return ErrorCode::IMPORTED_KEY_VERIFICATION_FAILED;
-    case nosapp::ErrorCode::INVALID_ARGUMENT:
-        return ErrorCode::INVALID_ARGUMENT;
-    case nosapp::ErrorCode::UNSUPPORTED_TAG:
-        return ErrorCode::UNSUPPORTED_TAG;
-    case nosapp::ErrorCode::INVALID_TAG:
-        return ErrorCode::INVALID_TAG;
-    case nosapp::ErrorCode::MEMORY_ALLOCATION_FAILED:
-        return ErrorCode::MEMORY_ALLOCATION_FAILED;
-    case nosapp::ErrorCode::IMPORT_PARAMETER_MISMATCH:
-        return ErrorCode::IMPORT_PARAMETER_MISMATCH;
-    case nosapp::ErrorCode::SECURE_HW_ACCESS_DENIED:
-        return ErrorCode::SECURE_HW_ACCESS_DENIED;
-    case nosapp::ErrorCode::OPERATION_CANCELLED:
-        return ErrorCode::OPERATION_CANCELLED;
-    case nosapp::ErrorCode::CONCURRENT_ACCESS_CONFLICT:
-        return ErrorCode::CONCURRENT_ACCESS_CONFLICT;
-    case nosapp::ErrorCode::SECURE_HW_BUSY:
-        return ErrorCode::SECURE_HW_BUSY;
-    case nosapp::ErrorCode::SECURE_HW_COMMUNICATION_FAILED:
-        return ErrorCode::SECURE_HW_COMMUNICATION_FAILED;
-    case nosapp::ErrorCode::UNSUPPORTED_EC_FIELD:
-        return ErrorCode::UNSUPPORTED_EC_FIELD;
-    case nosapp::ErrorCode::MISSING_NONCE:
-        return ErrorCode::MISSING_NONCE;
-    case nosapp::ErrorCode::INVALID_NONCE:
-        return ErrorCode::INVALID_NONCE;
-    case nosapp::ErrorCode::MISSING_MAC_LENGTH:
-        return ErrorCode::MISSING_MAC_LENGTH;
-    case nosapp::ErrorCode::KEY_RATE_LIMIT_EXCEEDED:
-        return ErrorCode::KEY_RATE_LIMIT_EXCEEDED;
-    case nosapp::ErrorCode::CALLER_NONCE_PROHIBITED:
-        return ErrorCode::CALLER_NONCE_PROHIBITED;
-    case nosapp::ErrorCode::KEY_MAX_OPS_EXCEEDED:
-        return ErrorCode::KEY_MAX_OPS_EXCEEDED;
-    case nosapp::ErrorCode::INVALID_MAC_LENGTH:
-        return ErrorCode::INVALID_MAC_LENGTH;
-    case nosapp::ErrorCode::MISSING_MIN_MAC_LENGTH:
-        return ErrorCode::MISSING_MIN_MAC_LENGTH;
-    case nosapp::ErrorCode::UNSUPPORTED_MIN_MAC_LENGTH:
-        return ErrorCode::UNSUPPORTED_MIN_MAC_LENGTH;
-    case nosapp::ErrorCode::UNSUPPORTED_KDF:
-        return ErrorCode::UNSUPPORTED_KDF;
-    case nosapp::ErrorCode::UNSUPPORTED_EC_CURVE:
-        return ErrorCode::UNSUPPORTED_EC_CURVE;
-    case nosapp::ErrorCode::KEY_REQUIRES_UPGRADE:
-        return ErrorCode::KEY_REQUIRES_UPGRADE;
-    case nosapp::ErrorCode::ATTESTATION_CHALLENGE_MISSING:
-        return ErrorCode::ATTESTATION_CHALLENGE_MISSING;
-    case nosapp::ErrorCode::KEYMASTER_NOT_CONFIGURED:
-        return ErrorCode::KEYMASTER_NOT_CONFIGURED;
-    case nosapp::ErrorCode::ATTESTATION_APPLICATION_ID_MISSING:
-        return ErrorCode::ATTESTATION_APPLICATION_ID_MISSING;
-    case nosapp::ErrorCode::CANNOT_ATTEST_IDS:
-        return ErrorCode::CANNOT_ATTEST_IDS;
-    case nosapp::ErrorCode::UNIMPLEMENTED:
-        return ErrorCode::UNIMPLEMENTED;
-    case nosapp::ErrorCode::VERSION_MISMATCH:
-        return ErrorCode::VERSION_MISMATCH;
-    case nosapp::ErrorCode::ROLLBACK_RESISTANCE_UNAVAILABLE:
-        return ErrorCode::ROLLBACK_RESISTANCE_UNAVAILABLE;
-    case nosapp::ErrorCode::HARDWARE_TYPE_UNAVAILABLE:
-        return ErrorCode::HARDWARE_TYPE_UNAVAILABLE;
-    case nosapp::ErrorCode::PROOF_OF_PRESENCE_REQUIRED:
-        return ErrorCode::PROOF_OF_PRESENCE_REQUIRED;
-    case nosapp::ErrorCode::CONCURRENT_PROOF_OF_PRESENCE_REQUESTED:
-        return ErrorCode::CONCURRENT_PROOF_OF_PRESENCE_REQUESTED;
-    case nosapp::ErrorCode::UNKNOWN_ERROR:
-        return ErrorCode::UNKNOWN_ERROR;
-    case nosapp::ErrorCode::NO_USER_CONFIRMATION:
-        return ErrorCode::NO_USER_CONFIRMATION;
-
-    /* Private error codes, unused by HAL. */
-    case nosapp::ErrorCode::INVALID_DEVICE_IDS:
-    case nosapp::ErrorCode::PRODUCTION_MODE_PROVISIONING:
-    case nosapp::ErrorCode::ErrorCode_INT_MIN_SENTINEL_DO_NOT_USE_:
-    case nosapp::ErrorCode::ErrorCode_INT_MAX_SENTINEL_DO_NOT_USE_:
-    default:
+    ErrorCode out;
+    if (!ErrorCodeTable::to_hal(error_code, &out)) {
+        /* Private error codes, unused by HAL. */
         LOG(ERROR) << "Unrecognized error_code: " << error_code;
         return ErrorCode::UNKNOWN_ERROR;
     }
+    return out;
 }
 
 }  // namespace keymaster
@@ -21,7 +21,6 @@
 
 #include <Keymaster.client.h>
 
-#include <map>
 #include <vector>
 
 namespace android {
@@ -40,22 +39,59 @@ using ::android::hardware::keymaster::V4_0::VerificationToken;
 using ::android::hardware::hidl_vec;
 
 // std
-using std::map;
 using std::vector;
 
 // App
 namespace nosapp = nugget::app::keymaster;
 
-typedef map<Tag, vector<KeyParameter>> tag_map_t;
+// The parameters of a request looked up by tag. It points into the
+// hidl_vec it was built from, which must outlive it, and is kept sorted by
+// tag in a fixed array so that typical requests need no allocation.
+class TagIndex {
+public:
+    TagIndex() = default;
+    TagIndex(const TagIndex&) = delete;
+    TagIndex& operator=(const TagIndex&) = delete;
+
+    // The first parameter with the tag, or nullptr if there is none
+    const KeyParameter *find(Tag tag) const;
+    bool contains(Tag tag) const { return find(tag) != nullptr; }
+
+    void reserve(size_t size);
+    // Fails if the tag is already present and may not be repeated
+    ErrorCode insert(const KeyParameter& param);
+
+private:
+    struct Entry {
+        Tag tag;
+        const KeyParameter *param;
+    };
+    // More than any request from the framework carries
+    static constexpr size_t kInlineSize = 16;
+
+    static bool ByTag(const Entry& a, const Entry& b) { return a.tag < b.tag; }
+    const Entry *data() const {
+        return _overflow.empty() ? _inline : _overflow.data();
+    }
+
+    Entry _inline[kInlineSize];
+    // Holds every entry once there are too many for _inline
+    vector<Entry> _overflow;
+    size_t _size = 0;
+};
 
 ErrorCode key_parameter_to_pb(const KeyParameter& param,
                               nosapp::KeyParameter *pb);
 ErrorCode hidl_params_to_pb(const hidl_vec<KeyParameter>& params,
                             nosapp::KeyParameters *pbParams);
-ErrorCode hidl_params_to_map(const hidl_vec<KeyParameter>& params,
-                             tag_map_t *tag_map);
-ErrorCode map_params_to_pb(const tag_map_t& params,
-                           nosapp::KeyParameters *pbParams);
+// Translates and indexes the parameters in one pass
+ErrorCode hidl_params_to_pb(const hidl_vec<KeyParameter>& params,
+                            nosapp::KeyParameters *pbParams,
+                            TagIndex *index);
+ErrorCode hidl_params_to_index(const hidl_vec<KeyParameter>& params,
+                               TagIndex *index);
+// The blobs of the parameters point into pbParams, so they are only valid
+// while it is; copy the parameters to keep them any longer.
 ErrorCode pb_to_hidl_params(const nosapp::KeyParameters& pbParams,
                             hidl_vec<KeyParameter> *params);
 ErrorCode translate_algorithm(nosapp::Algorithm algorithm,
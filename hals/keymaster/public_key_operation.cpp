@@ -0,0 +1,510 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "public_key_operation.h"
+
+#include <android-base/logging.h>
+
+#include <openssl/bn.h>
+#include <openssl/bytestring.h>
+#include <openssl/digest.h>
+#include <openssl/ec.h>
+#include <openssl/ec_key.h>
+#include <openssl/ecdsa.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/mem.h>
+#include <openssl/rand.h>
+#include <openssl/rsa.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+
+// HAL
+using ::android::hardware::keymaster::V4_0::Algorithm;
+using ::android::hardware::keymaster::V4_0::Digest;
+using ::android::hardware::keymaster::V4_0::PaddingMode;
+using ::android::hardware::keymaster::V4_0::Tag;
+
+// std
+using std::map;
+using std::shared_ptr;
+using std::vector;
+
+namespace {
+
+// Key tags that don't restrict when the key can be used, or that are checked
+// here. Keys with anything else are left to the device.
+const std::set<Tag> kHandledKeyTags = {
+    Tag::PURPOSE,
+    Tag::ALGORITHM,
+    Tag::KEY_SIZE,
+    Tag::DIGEST,
+    Tag::PADDING,
+    Tag::EC_CURVE,
+    Tag::RSA_PUBLIC_EXPONENT,
+    Tag::INCLUDE_UNIQUE_ID,
+    Tag::NO_AUTH_REQUIRED,
+    Tag::ALL_APPLICATIONS,
+    Tag::CREATION_DATETIME,
+    Tag::ORIGIN,
+    Tag::ROLLBACK_RESISTANCE,
+    Tag::OS_VERSION,
+    Tag::OS_PATCHLEVEL,
+    Tag::VENDOR_PATCHLEVEL,
+    Tag::ATTESTATION_APPLICATION_ID,
+};
+
+struct Request {
+    Algorithm algorithm;
+    Digest digest;
+    PaddingMode padding;
+};
+
+bool key_allows(const KeyCharacteristics& characteristics, Tag tag,
+                uint32_t value)
+{
+    for (const auto* params : {&characteristics.hardwareEnforced,
+                               &characteristics.softwareEnforced}) {
+        for (const auto& param : *params) {
+            if (param.tag == tag && param.f.integer == value) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Whether the request and key are within what is handled here.
+bool parse_request(KeyPurpose purpose, const hidl_vec<KeyParameter>& inParams,
+                   const KeyCharacteristics& characteristics,
+                   Request *request)
+{
+    bool have_algorithm = false;
+    for (const auto* params : {&characteristics.hardwareEnforced,
+                               &characteristics.softwareEnforced}) {
+        for (const auto& param : *params) {
+            if (kHandledKeyTags.count(param.tag) == 0) {
+                return false;
+            }
+            if (param.tag == Tag::ALGORITHM) {
+                request->algorithm = param.f.algorithm;
+                have_algorithm = true;
+            }
+        }
+    }
+    if (!have_algorithm ||
+        !key_allows(characteristics, Tag::PURPOSE,
+                    static_cast<uint32_t>(purpose))) {
+        return false;
+    }
+
+    bool have_digest = false;
+    bool have_padding = false;
+    for (const auto& param : inParams) {
+        switch (param.tag) {
+        case Tag::DIGEST:
+            if (have_digest) {
+                return false;
+            }
+            request->digest = param.f.digest;
+            have_digest = true;
+            break;
+        case Tag::PADDING:
+            if (have_padding) {
+                return false;
+            }
+            request->padding = param.f.paddingMode;
+            have_padding = true;
+            break;
+        case Tag::APPLICATION_ID:
+        case Tag::APPLICATION_DATA:
+            break;
+        default:
+            return false;
+        }
+    }
+
+    if (purpose == KeyPurpose::VERIFY && request->algorithm == Algorithm::EC) {
+        if (!have_digest || have_padding) {
+            return false;
+        }
+        request->padding = PaddingMode::NONE;
+    } else if (purpose == KeyPurpose::VERIFY &&
+               request->algorithm == Algorithm::RSA) {
+        if (!have_digest || !have_padding) {
+            return false;
+        }
+        switch (request->padding) {
+        case PaddingMode::NONE:
+            if (request->digest != Digest::NONE) {
+                return false;
+            }
+            break;
+        case PaddingMode::RSA_PKCS1_1_5_SIGN:
+            break;
+        case PaddingMode::RSA_PSS:
+            if (request->digest == Digest::NONE) {
+                return false;
+            }
+            break;
+        default:
+            return false;
+        }
+    } else if (purpose == KeyPurpose::ENCRYPT &&
+               request->algorithm == Algorithm::RSA) {
+        // OAEP is left to the device so that its choice of MGF1 digest
+        // always matches the one used to decrypt.
+        if (!have_padding ||
+            (request->padding != PaddingMode::NONE &&
+             request->padding != PaddingMode::RSA_PKCS1_1_5_ENCRYPT) ||
+            (have_digest && request->digest != Digest::NONE)) {
+            return false;
+        }
+        request->digest = Digest::NONE;
+    } else {
+        return false;
+    }
+
+    if (have_digest &&
+        !key_allows(characteristics, Tag::DIGEST,
+                    static_cast<uint32_t>(request->digest))) {
+        return false;
+    }
+    if (have_padding &&
+        !key_allows(characteristics, Tag::PADDING,
+                    static_cast<uint32_t>(request->padding))) {
+        return false;
+    }
+    return true;
+}
+
+const EVP_MD *digest_md(Digest digest)
+{
+    switch (digest) {
+    case Digest::MD5:
+        return EVP_md5();
+    case Digest::SHA1:
+        return EVP_sha1();
+    case Digest::SHA_2_224:
+        return EVP_sha224();
+    case Digest::SHA_2_256:
+        return EVP_sha256();
+    case Digest::SHA_2_384:
+        return EVP_sha384();
+    case Digest::SHA_2_512:
+        return EVP_sha512();
+    default:
+        return nullptr;
+    }
+}
+
+class PublicKeyOperation {
+public:
+    PublicKeyOperation(KeyPurpose purpose, const Request& request,
+                       bssl::UniquePtr<EVP_PKEY> key)
+        : _purpose(purpose), _request(request), _key(std::move(key)) {}
+
+    ErrorCode init() {
+        if (_request.digest == Digest::NONE) {
+            // Only the leftmost bits of the input to ECDSA are used and RSA
+            // input is limited to the size of the modulus. One byte more
+            // than that shows RSA input is too long.
+            _maxInput = EVP_PKEY_size(_key.get());
+            if (_request.algorithm == Algorithm::EC) {
+                const EC_GROUP *group =
+                    EC_KEY_get0_group(EVP_PKEY_get0_EC_KEY(_key.get()));
+                _maxInput = BN_num_bytes(EC_GROUP_get0_order(group));
+            } else {
+                _maxInput++;
+            }
+            return ErrorCode::OK;
+        }
+
+        const EVP_MD *md = digest_md(_request.digest);
+        if (md == nullptr) {
+            return ErrorCode::UNIMPLEMENTED;
+        }
+        if (_request.padding == PaddingMode::RSA_PSS &&
+            static_cast<size_t>(EVP_PKEY_size(_key.get())) <
+                2 * EVP_MD_size(md) + 2) {
+            // The device reports this
+            return ErrorCode::UNIMPLEMENTED;
+        }
+        EVP_PKEY_CTX *pctx;
+        if (!EVP_DigestVerifyInit(_mdCtx.get(), &pctx, md, nullptr,
+                                  _key.get())) {
+            return ErrorCode::UNKNOWN_ERROR;
+        }
+        if (_request.padding == PaddingMode::RSA_PKCS1_1_5_SIGN &&
+            !EVP_PKEY_CTX_set_rsa_padding(pctx, RSA_PKCS1_PADDING)) {
+            return ErrorCode::UNKNOWN_ERROR;
+        }
+        if (_request.padding == PaddingMode::RSA_PSS &&
+            (!EVP_PKEY_CTX_set_rsa_padding(pctx, RSA_PKCS1_PSS_PADDING) ||
+             !EVP_PKEY_CTX_set_rsa_pss_saltlen(pctx, -1 /* digest size */))) {
+            return ErrorCode::UNKNOWN_ERROR;
+        }
+        return ErrorCode::OK;
+    }
+
+    ErrorCode update(const hidl_vec<uint8_t>& input) {
+        if (_request.digest != Digest::NONE) {
+            return EVP_DigestVerifyUpdate(_mdCtx.get(), input.data(),
+                                          input.size())
+                ? ErrorCode::OK : ErrorCode::UNKNOWN_ERROR;
+        }
+        const size_t take = std::min(input.size(),
+                                     _maxInput - _input.size());
+        _input.insert(_input.end(), input.begin(), input.begin() + take);
+        return ErrorCode::OK;
+    }
+
+    ErrorCode finish(const hidl_vec<uint8_t>& signature,
+                     hidl_vec<uint8_t> *output) {
+        ErrorCode error_code;
+        if (_purpose == KeyPurpose::ENCRYPT) {
+            error_code = encrypt(output);
+        } else if (_request.digest != Digest::NONE) {
+            error_code = EVP_DigestVerifyFinal(_mdCtx.get(), signature.data(),
+                                               signature.size())
+                ? ErrorCode::OK : ErrorCode::VERIFICATION_FAILED;
+        } else if (_request.algorithm == Algorithm::EC) {
+            error_code = ECDSA_verify(0, _input.data(), _input.size(),
+                                      signature.data(), signature.size(),
+                                      EVP_PKEY_get0_EC_KEY(_key.get()))
+                ? ErrorCode::OK : ErrorCode::VERIFICATION_FAILED;
+        } else {
+            error_code = verifyRsaUndigested(signature);
+        }
+        ERR_clear_error();
+        return error_code;
+    }
+
+    std::mutex& lock() { return _mutex; }
+
+private:
+    // The RSA input, left-padded with zeros to the size of the modulus when
+    // unpadded. Fails if the input is too long.
+    bool rsaInput(size_t modulusSize, vector<uint8_t> *input) const {
+        if (_request.padding == PaddingMode::NONE) {
+            if (_input.size() > modulusSize) {
+                return false;
+            }
+            input->assign(modulusSize - _input.size(), 0);
+            input->insert(input->end(), _input.begin(), _input.end());
+            return true;
+        }
+        if (_input.size() + RSA_PKCS1_PADDING_SIZE > modulusSize) {
+            return false;
+        }
+        *input = _input;
+        return true;
+    }
+
+    int rsaPadding() const {
+        return _request.padding == PaddingMode::NONE
+            ? RSA_NO_PADDING : RSA_PKCS1_PADDING;
+    }
+
+    ErrorCode verifyRsaUndigested(const hidl_vec<uint8_t>& signature) {
+        RSA *rsa = EVP_PKEY_get0_RSA(_key.get());
+        const size_t modulusSize = RSA_size(rsa);
+        vector<uint8_t> expected;
+        if (!rsaInput(modulusSize, &expected)) {
+            return ErrorCode::INVALID_INPUT_LENGTH;
+        }
+        vector<uint8_t> recovered(modulusSize);
+        size_t recoveredSize;
+        if (!RSA_verify_raw(rsa, &recoveredSize, recovered.data(),
+                            recovered.size(), signature.data(),
+                            signature.size(), rsaPadding()) ||
+            recoveredSize != expected.size() ||
+            CRYPTO_memcmp(recovered.data(), expected.data(),
+                          expected.size()) != 0) {
+            return ErrorCode::VERIFICATION_FAILED;
+        }
+        return ErrorCode::OK;
+    }
+
+    ErrorCode encrypt(hidl_vec<uint8_t> *output) {
+        RSA *rsa = EVP_PKEY_get0_RSA(_key.get());
+        const size_t modulusSize = RSA_size(rsa);
+        vector<uint8_t> input;
+        if (!rsaInput(modulusSize, &input)) {
+            return ErrorCode::INVALID_INPUT_LENGTH;
+        }
+        output->resize(modulusSize);
+        size_t outputSize;
+        if (!RSA_encrypt(rsa, &outputSize, output->data(), output->size(),
+                         input.data(), input.size(), rsaPadding())) {
+            // Unpadded input no smaller than the modulus
+            output->resize(0);
+            return ErrorCode::INVALID_ARGUMENT;
+        }
+        output->resize(outputSize);
+        return ErrorCode::OK;
+    }
+
+    const KeyPurpose _purpose;
+    const Request _request;
+    const bssl::UniquePtr<EVP_PKEY> _key;
+    bssl::ScopedEVP_MD_CTX _mdCtx;
+    // Undigested input, up to _maxInput bytes
+    vector<uint8_t> _input;
+    size_t _maxInput = 0;
+    std::mutex _mutex;
+};
+
+// Each holds a parsed key and any buffered input, so a caller that never
+// finishes its operations can't make the HAL hold an unbounded number.
+constexpr size_t kMaxOperations = 32;
+
+std::mutex operations_lock;
+map<uint64_t, shared_ptr<PublicKeyOperation>> operations;
+
+shared_ptr<PublicKeyOperation> find_operation(uint64_t handle)
+{
+    std::lock_guard<std::mutex> lock(operations_lock);
+    const auto it = operations.find(handle);
+    return it == operations.end() ? nullptr : it->second;
+}
+
+shared_ptr<PublicKeyOperation> remove_operation(uint64_t handle)
+{
+    std::lock_guard<std::mutex> lock(operations_lock);
+    const auto it = operations.find(handle);
+    if (it == operations.end()) {
+        return nullptr;
+    }
+    shared_ptr<PublicKeyOperation> op = std::move(it->second);
+    operations.erase(it);
+    return op;
+}
+
+}  // namespace
+
+bool public_key_supported(KeyPurpose purpose,
+                          const hidl_vec<KeyParameter>& inParams,
+                          const KeyCharacteristics& characteristics)
+{
+    Request request;
+    return parse_request(purpose, inParams, characteristics, &request);
+}
+
+ErrorCode public_key_begin(KeyPurpose purpose,
+                           const hidl_vec<uint8_t>& publicKeyDer,
+                           const hidl_vec<KeyParameter>& inParams,
+                           const KeyCharacteristics& characteristics,
+                           uint64_t *handle)
+{
+    Request request;
+    if (!parse_request(purpose, inParams, characteristics, &request)) {
+        return ErrorCode::UNIMPLEMENTED;
+    }
+
+    CBS cbs;
+    CBS_init(&cbs, publicKeyDer.data(), publicKeyDer.size());
+    bssl::UniquePtr<EVP_PKEY> key(EVP_parse_public_key(&cbs));
+    ERR_clear_error();
+    if (!key) {
+        LOG(ERROR) << "public_key_begin: failed to parse the public key";
+        return ErrorCode::UNIMPLEMENTED;
+    }
+    const int expected_type = request.algorithm == Algorithm::RSA
+        ? EVP_PKEY_RSA : EVP_PKEY_EC;
+    if (EVP_PKEY_id(key.get()) != expected_type) {
+        return ErrorCode::UNIMPLEMENTED;
+    }
+
+    auto op = std::make_shared<PublicKeyOperation>(
+        purpose, request, std::move(key));
+    const ErrorCode error_code = op->init();
+    ERR_clear_error();
+    if (error_code != ErrorCode::OK) {
+        return error_code;
+    }
+
+    // Random like the device's handles, so the two are unlikely to clash
+    std::lock_guard<std::mutex> lock(operations_lock);
+    if (operations.size() >= kMaxOperations) {
+        LOG(ERROR) << "public_key_begin: too many operations";
+        return ErrorCode::TOO_MANY_OPERATIONS;
+    }
+    do {
+        RAND_bytes(reinterpret_cast<uint8_t *>(handle), sizeof(*handle));
+    } while (*handle == 0 || operations.count(*handle) != 0);
+    operations.emplace(*handle, std::move(op));
+    return ErrorCode::OK;
+}
+
+bool public_key_operation(uint64_t handle)
+{
+    return find_operation(handle) != nullptr;
+}
+
+ErrorCode public_key_update(uint64_t handle, const hidl_vec<uint8_t>& input,
+                            uint32_t *consumed)
+{
+    const shared_ptr<PublicKeyOperation> op = find_operation(handle);
+    if (op == nullptr) {
+        return ErrorCode::INVALID_OPERATION_HANDLE;
+    }
+
+    std::lock_guard<std::mutex> lock(op->lock());
+    const ErrorCode error_code = op->update(input);
+    if (error_code != ErrorCode::OK) {
+        remove_operation(handle);
+        return error_code;
+    }
+    *consumed = input.size();
+    return ErrorCode::OK;
+}
+
+ErrorCode public_key_finish(uint64_t handle, const hidl_vec<uint8_t>& input,
+                            const hidl_vec<uint8_t>& signature,
+                            hidl_vec<uint8_t> *output)
+{
+    const shared_ptr<PublicKeyOperation> op = remove_operation(handle);
+    if (op == nullptr) {
+        return ErrorCode::INVALID_OPERATION_HANDLE;
+    }
+
+    std::lock_guard<std::mutex> lock(op->lock());
+    const ErrorCode error_code = op->update(input);
+    if (error_code != ErrorCode::OK) {
+        return error_code;
+    }
+    return op->finish(signature, output);
+}
+
+ErrorCode public_key_abort(uint64_t handle)
+{
+    return remove_operation(handle) != nullptr
+        ? ErrorCode::OK : ErrorCode::INVALID_OPERATION_HANDLE;
+}
+
+}  // namespace keymaster
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,68 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_KEYMASTER_PUBLIC_KEY_OPERATION_H
+#define ANDROID_HARDWARE_KEYMASTER_PUBLIC_KEY_OPERATION_H
+
+#include <android/hardware/keymaster/4.0/IKeymasterDevice.h>
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+
+// HAL
+using ::android::hardware::keymaster::V4_0::ErrorCode;
+using ::android::hardware::keymaster::V4_0::KeyCharacteristics;
+using ::android::hardware::keymaster::V4_0::KeyParameter;
+using ::android::hardware::keymaster::V4_0::KeyPurpose;
+using ::android::hardware::hidl_vec;
+
+// RSA and EC verification and RSA encryption only need the public half of
+// the key, so the HAL runs them itself with BoringSSL rather than streaming
+// the data to Citadel.
+//
+// The HAL checks the key's purposes, digests and paddings. Keys with any
+// other restriction, such as user authentication, validity dates or usage
+// limits, and requests with parameters the HAL doesn't handle are left to
+// the device, which also gives the errors for anything not permitted.
+
+// Whether the operation can be run in the HAL.
+bool public_key_supported(KeyPurpose purpose,
+                          const hidl_vec<KeyParameter>& inParams,
+                          const KeyCharacteristics& characteristics);
+
+// Starts an operation with the key's X.509 SubjectPublicKeyInfo. Returns
+// UNIMPLEMENTED if the device should run it after all, and
+// TOO_MANY_OPERATIONS if the HAL already runs as many as it allows.
+ErrorCode public_key_begin(KeyPurpose purpose,
+                           const hidl_vec<uint8_t>& publicKeyDer,
+                           const hidl_vec<KeyParameter>& inParams,
+                           const KeyCharacteristics& characteristics,
+                           uint64_t *handle);
+// Whether the handle is for an operation run in the HAL.
+bool public_key_operation(uint64_t handle);
+ErrorCode public_key_update(uint64_t handle, const hidl_vec<uint8_t>& input,
+                            uint32_t *consumed);
+ErrorCode public_key_finish(uint64_t handle, const hidl_vec<uint8_t>& input,
+                            const hidl_vec<uint8_t>& signature,
+                            hidl_vec<uint8_t> *output);
+ErrorCode public_key_abort(uint64_t handle);
+
+}  // namespace keymaster
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_KEYMASTER_PUBLIC_KEY_OPERATION_H
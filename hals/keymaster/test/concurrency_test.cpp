@@ -0,0 +1,263 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <MockKeymaster.client.h>
+#include <KeymasterDevice.h>
+
+#include <application.h>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+using ::testing::_;
+using ::testing::Invoke;
+using ::testing::NiceMock;
+
+// Hardware
+using ::android::hardware::hidl_vec;
+using ::android::hardware::keymaster::KeymasterDevice;
+
+// HAL
+using ::android::hardware::keymaster::V4_0::ErrorCode;
+using ::android::hardware::keymaster::V4_0::HardwareAuthToken;
+using ::android::hardware::keymaster::V4_0::KeyParameter;
+using ::android::hardware::keymaster::V4_0::KeyPurpose;
+using ::android::hardware::keymaster::V4_0::VerificationToken;
+
+// App
+using ::nugget::app::keymaster::BeginOperationRequest;
+using ::nugget::app::keymaster::BeginOperationResponse;
+using ::nugget::app::keymaster::FinishOperationRequest;
+using ::nugget::app::keymaster::FinishOperationResponse;
+using ::nugget::app::keymaster::GenerateKeyRequest;
+using ::nugget::app::keymaster::GenerateKeyResponse;
+using ::nugget::app::keymaster::MockKeymaster;
+using ::nugget::app::keymaster::UpdateOperationRequest;
+using ::nugget::app::keymaster::UpdateOperationResponse;
+
+namespace nosapp = ::nugget::app::keymaster;
+
+using namespace std::chrono_literals;
+
+namespace {
+
+// Time the device takes for each operation call
+constexpr auto kCallTime = 1ms;
+// Longest a test waits for calls it expects to be in flight together. Only
+// reached if the HAL has wrongly serialized them.
+constexpr auto kRendezvousTimeout = 10s;
+
+// A device that runs calls concurrently, takes kCallTime over each step of
+// an AES operation and echoes the data it is given. It notes if two calls
+// on the same operation are ever in flight at once.
+class FakeKeymaster {
+public:
+    explicit FakeKeymaster(MockKeymaster* mock) {
+        ON_CALL(*mock, BeginOperation(_, _)).WillByDefault(Invoke(
+            [this](const BeginOperationRequest&,
+                   BeginOperationResponse* response) {
+                response->mutable_handle()->set_handle(++_nextHandle);
+                response->set_algorithm(nosapp::Algorithm::AES);
+                return APP_SUCCESS;
+            }));
+        ON_CALL(*mock, UpdateOperation(_, _)).WillByDefault(Invoke(
+            [this](const UpdateOperationRequest& request,
+                   UpdateOperationResponse* response) {
+                Enter(request.handle().handle());
+                std::this_thread::sleep_for(kCallTime);
+                response->set_consumed(request.input().size());
+                response->set_output(request.input());
+                Leave(request.handle().handle());
+                return APP_SUCCESS;
+            }));
+        ON_CALL(*mock, FinishOperation(_, _)).WillByDefault(Invoke(
+            [this](const FinishOperationRequest& request,
+                   FinishOperationResponse* response) {
+                Enter(request.handle().handle());
+                std::this_thread::sleep_for(kCallTime);
+                response->set_output(request.input());
+                Leave(request.handle().handle());
+                return APP_SUCCESS;
+            }));
+    }
+
+    bool overlapped() const { return _overlapped; }
+
+private:
+    void Enter(uint64_t handle) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (!_inFlight.insert(handle).second) {
+            _overlapped = true;
+        }
+    }
+
+    void Leave(uint64_t handle) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _inFlight.erase(handle);
+    }
+
+    std::atomic<uint64_t> _nextHandle{0};
+    std::mutex _mutex;
+    std::set<uint64_t> _inFlight;
+    std::atomic<bool> _overlapped{false};
+};
+
+uint64_t Begin(KeymasterDevice& hal) {
+    uint64_t handle = 0;
+    hal.begin(KeyPurpose::ENCRYPT, hidl_vec<uint8_t>{1}, {},
+              HardwareAuthToken{},
+              [&](ErrorCode error, const hidl_vec<KeyParameter>&,
+                  uint64_t operationHandle) {
+                  EXPECT_EQ(error, ErrorCode::OK);
+                  handle = operationHandle;
+              });
+    return handle;
+}
+
+// Encrypt the input with a fresh operation and return the output.
+std::vector<uint8_t> Encrypt(KeymasterDevice& hal,
+                             const std::vector<uint8_t>& input) {
+    const uint64_t handle = Begin(hal);
+    std::vector<uint8_t> output;
+    hal.finish(handle, {}, hidl_vec<uint8_t>(input), {}, HardwareAuthToken{},
+               VerificationToken{},
+               [&](ErrorCode error, const hidl_vec<KeyParameter>&,
+                   const hidl_vec<uint8_t>& out) {
+                   EXPECT_EQ(error, ErrorCode::OK);
+                   output = out;
+               });
+    return output;
+}
+
+TEST(KeymasterConcurrencyTest, OperationsRunInParallel) {
+    constexpr int kThreads = 4;
+    NiceMock<MockKeymaster> mockService;
+    FakeKeymaster device(&mockService);
+    // Every update waits for one on each of the other operations to arrive,
+    // which only happens if the HAL lets them all be in flight at once.
+    std::mutex mutex;
+    std::condition_variable arrived;
+    int waiting = 0;
+    bool together = false;
+    ON_CALL(mockService, UpdateOperation(_, _)).WillByDefault(Invoke(
+        [&](const UpdateOperationRequest& request,
+            UpdateOperationResponse* response) {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (++waiting == kThreads) {
+                together = true;
+                arrived.notify_all();
+            }
+            arrived.wait_for(lock, kRendezvousTimeout,
+                             [&] { return together; });
+            response->set_consumed(request.input().size());
+            response->set_output(request.input());
+            return APP_SUCCESS;
+        }));
+    KeymasterDevice hal{mockService};
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&, t] {
+            const std::vector<uint8_t> input(1000, uint8_t(t));
+            EXPECT_EQ(Encrypt(hal, input), input);
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_TRUE(together);
+    EXPECT_FALSE(device.overlapped());
+}
+
+TEST(KeymasterConcurrencyTest, SlowCallDoesNotBlockOperations) {
+    NiceMock<MockKeymaster> mockService;
+    FakeKeymaster device(&mockService);
+    // GenerateKey doesn't return until the operation below is done, or it
+    // gives up waiting for it.
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool generating = false;
+    bool encrypted = false;
+    ON_CALL(mockService, GenerateKey(_, _)).WillByDefault(Invoke(
+        [&](const GenerateKeyRequest&, GenerateKeyResponse*) {
+            std::unique_lock<std::mutex> lock(mutex);
+            generating = true;
+            changed.notify_all();
+            changed.wait_for(lock, kRendezvousTimeout,
+                             [&] { return encrypted; });
+            generating = false;
+            return APP_SUCCESS;
+        }));
+    KeymasterDevice hal{mockService};
+
+    std::thread generate([&hal] {
+        hal.generateKey({}, [](ErrorCode, const hidl_vec<uint8_t>&,
+                               const auto&) {});
+    });
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] { return generating; });
+    }
+    const std::vector<uint8_t> input(1000, 1);
+    EXPECT_EQ(Encrypt(hal, input), input);
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        EXPECT_TRUE(generating);
+        encrypted = true;
+        changed.notify_all();
+    }
+    generate.join();
+}
+
+TEST(KeymasterConcurrencyTest, CallsOnOneOperationAreSerialized) {
+    NiceMock<MockKeymaster> mockService;
+    FakeKeymaster device(&mockService);
+    KeymasterDevice hal{mockService};
+
+    const uint64_t handle = Begin(hal);
+    std::atomic<uint64_t> consumed{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < 20; ++i) {
+                hal.update(handle, {}, hidl_vec<uint8_t>(std::vector<uint8_t>(32)),
+                           HardwareAuthToken{}, VerificationToken{},
+                           [&](ErrorCode error, uint32_t inputConsumed,
+                               const hidl_vec<KeyParameter>&,
+                               const hidl_vec<uint8_t>&) {
+                               EXPECT_EQ(error, ErrorCode::OK);
+                               consumed += inputConsumed;
+                           });
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_FALSE(device.overlapped());
+    EXPECT_EQ(consumed, 4u * 20 * 32);
+}
+
+}  // namespace
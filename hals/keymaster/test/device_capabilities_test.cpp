@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <../device_capabilities.h>
+
+#include <MockKeymaster.client.h>
+#include <KeymasterDevice.h>
+
+#include <application.h>
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+using ::testing::_;
+using ::testing::Invoke;
+using ::testing::NiceMock;
+using ::testing::Return;
+
+// Hardware
+using ::android::hardware::hidl_vec;
+using ::android::hardware::keymaster::DeviceCapabilities;
+using ::android::hardware::keymaster::KeymasterDevice;
+
+// HAL
+using ::android::hardware::keymaster::V4_0::Algorithm;
+using ::android::hardware::keymaster::V4_0::Digest;
+using ::android::hardware::keymaster::V4_0::ErrorCode;
+using ::android::hardware::keymaster::V4_0::KeyCharacteristics;
+using ::android::hardware::keymaster::V4_0::KeyParameter;
+using ::android::hardware::keymaster::V4_0::KeyPurpose;
+using ::android::hardware::keymaster::V4_0::Tag;
+
+// App
+using ::nugget::app::keymaster::GenerateKeyRequest;
+using ::nugget::app::keymaster::GenerateKeyResponse;
+using ::nugget::app::keymaster::MockKeymaster;
+
+namespace nosapp = ::nugget::app::keymaster;
+
+namespace {
+
+using Call = DeviceCapabilities::Call;
+
+KeyParameter Param(Tag tag, uint32_t value) {
+    KeyParameter param;
+    param.tag = tag;
+    param.f.integer = value;
+    return param;
+}
+
+hidl_vec<KeyParameter> RsaParams(uint32_t keySize) {
+    return hidl_vec<KeyParameter>{
+        Param(Tag::ALGORITHM, static_cast<uint32_t>(Algorithm::RSA)),
+        Param(Tag::KEY_SIZE, keySize),
+    };
+}
+
+// Rejects RSA keys other than 2048 bits as the device does
+uint32_t GenerateRsa2048(const GenerateKeyRequest& request,
+                         GenerateKeyResponse* response) {
+    for (const nosapp::KeyParameter& param : request.params().params()) {
+        if (param.tag() == nosapp::Tag::KEY_SIZE && param.integer() != 2048) {
+            response->set_error_code(nosapp::ErrorCode::UNSUPPORTED_KEY_SIZE);
+        }
+    }
+    return APP_SUCCESS;
+}
+
+ErrorCode GenerateKey(KeymasterDevice& hal,
+                      const hidl_vec<KeyParameter>& params) {
+    ErrorCode result = ErrorCode::UNKNOWN_ERROR;
+    hal.generateKey(params, [&](ErrorCode error, const hidl_vec<uint8_t>&,
+                                const KeyCharacteristics&) {
+        result = error;
+    });
+    return result;
+}
+
+}  // namespace
+
+TEST(KeymasterCapabilitiesTest, UnsupportedKeySizeFailsLocally) {
+    NiceMock<MockKeymaster> mockService;
+    EXPECT_CALL(mockService, GenerateKey(_, _))
+        .Times(2)
+        .WillRepeatedly(Invoke(GenerateRsa2048));
+    KeymasterDevice hal{mockService};
+
+    EXPECT_EQ(GenerateKey(hal, RsaParams(1024)),
+              ErrorCode::UNSUPPORTED_KEY_SIZE);
+    EXPECT_EQ(GenerateKey(hal, RsaParams(1024)),
+              ErrorCode::UNSUPPORTED_KEY_SIZE);
+    EXPECT_EQ(GenerateKey(hal, RsaParams(2048)), ErrorCode::OK);
+}
+
+TEST(KeymasterCapabilitiesTest, ResetForgets) {
+    NiceMock<MockKeymaster> mockService;
+    EXPECT_CALL(mockService, GenerateKey(_, _))
+        .Times(2)
+        .WillRepeatedly(Invoke(GenerateRsa2048));
+    EXPECT_CALL(mockService, AddRngEntropy(_, _))
+        .WillOnce(Return(APP_ERROR_IO));
+    KeymasterDevice hal{mockService};
+
+    GenerateKey(hal, RsaParams(1024));
+    // As seen when Citadel is reset, perhaps with new firmware
+    EXPECT_NE(hal.addRngEntropy({1}), ErrorCode::OK);
+    GenerateKey(hal, RsaParams(1024));
+}
+
+TEST(KeymasterCapabilitiesTest, LearnsOnlyWhatTheErrorIsPinnedTo) {
+    DeviceCapabilities capabilities;
+    const hidl_vec<KeyParameter> oneDigest{
+        Param(Tag::ALGORITHM, static_cast<uint32_t>(Algorithm::HMAC)),
+        Param(Tag::DIGEST, static_cast<uint32_t>(Digest::MD5)),
+    };
+    const hidl_vec<KeyParameter> twoDigests{
+        Param(Tag::ALGORITHM, static_cast<uint32_t>(Algorithm::HMAC)),
+        Param(Tag::DIGEST, static_cast<uint32_t>(Digest::SHA1)),
+        Param(Tag::DIGEST, static_cast<uint32_t>(Digest::SHA_2_256)),
+    };
+
+    capabilities.learn({Call::GENERATE_KEY, twoDigests, nullptr, nullptr},
+                       ErrorCode::UNSUPPORTED_DIGEST);
+    EXPECT_EQ(capabilities.size(), 0u);
+    // Not one of the errors about a parameter
+    capabilities.learn({Call::GENERATE_KEY, oneDigest, nullptr, nullptr},
+                       ErrorCode::INVALID_ARGUMENT);
+    EXPECT_EQ(capabilities.size(), 0u);
+
+    capabilities.learn({Call::GENERATE_KEY, oneDigest, nullptr, nullptr},
+                       ErrorCode::UNSUPPORTED_DIGEST);
+    EXPECT_EQ(capabilities.check(
+                  {Call::GENERATE_KEY, oneDigest, nullptr, nullptr}),
+              ErrorCode::UNSUPPORTED_DIGEST);
+    EXPECT_EQ(capabilities.check(
+                  {Call::IMPORT_KEY, oneDigest, nullptr, nullptr}),
+              ErrorCode::OK);
+    EXPECT_EQ(capabilities.check(
+                  {Call::GENERATE_KEY, twoDigests, nullptr, nullptr}),
+              ErrorCode::OK);
+}
+
+TEST(KeymasterCapabilitiesTest, BeginNeedsTheKeyAlgorithm) {
+    DeviceCapabilities capabilities;
+    const hidl_vec<KeyParameter> params{
+        Param(Tag::DIGEST, static_cast<uint32_t>(Digest::MD5)),
+    };
+    const KeyPurpose sign = KeyPurpose::SIGN;
+    const KeyPurpose verify = KeyPurpose::VERIFY;
+    const Algorithm ec = Algorithm::EC;
+    const Algorithm rsa = Algorithm::RSA;
+
+    capabilities.learn({Call::BEGIN, params, nullptr, &sign},
+                       ErrorCode::UNSUPPORTED_DIGEST);
+    EXPECT_EQ(capabilities.size(), 0u);
+
+    capabilities.learn({Call::BEGIN, params, &ec, &sign},
+                       ErrorCode::UNSUPPORTED_DIGEST);
+    EXPECT_EQ(capabilities.check({Call::BEGIN, params, &ec, &sign}),
+              ErrorCode::UNSUPPORTED_DIGEST);
+    EXPECT_EQ(capabilities.check({Call::BEGIN, params, &rsa, &sign}),
+              ErrorCode::OK);
+    EXPECT_EQ(capabilities.check({Call::BEGIN, params, &ec, &verify}),
+              ErrorCode::OK);
+    EXPECT_EQ(capabilities.check({Call::BEGIN, params, nullptr, &sign}),
+              ErrorCode::OK);
+}
+
+TEST(KeymasterCapabilitiesTest, MissingParameterLearnedForGenerateOnly) {
+    DeviceCapabilities capabilities;
+    const hidl_vec<KeyParameter> noKeySize{
+        Param(Tag::ALGORITHM, static_cast<uint32_t>(Algorithm::RSA)),
+    };
+
+    // The key size of an imported key can come from its data
+    capabilities.learn({Call::IMPORT_KEY, noKeySize, nullptr, nullptr},
+                       ErrorCode::UNSUPPORTED_KEY_SIZE);
+    EXPECT_EQ(capabilities.size(), 0u);
+
+    capabilities.learn({Call::GENERATE_KEY, noKeySize, nullptr, nullptr},
+                       ErrorCode::UNSUPPORTED_KEY_SIZE);
+    EXPECT_EQ(capabilities.check(
+                  {Call::GENERATE_KEY, noKeySize, nullptr, nullptr}),
+              ErrorCode::UNSUPPORTED_KEY_SIZE);
+    EXPECT_EQ(capabilities.check(
+                  {Call::GENERATE_KEY, RsaParams(2048), nullptr, nullptr}),
+              ErrorCode::OK);
+}
+
+TEST(KeymasterCapabilitiesTest, MinMacLengthIsNotLearned) {
+    DeviceCapabilities capabilities;
+    const hidl_vec<KeyParameter> sha256{
+        Param(Tag::ALGORITHM, static_cast<uint32_t>(Algorithm::HMAC)),
+        Param(Tag::DIGEST, static_cast<uint32_t>(Digest::SHA_2_256)),
+        Param(Tag::MIN_MAC_LENGTH, 384),
+    };
+    const hidl_vec<KeyParameter> sha512{
+        Param(Tag::ALGORITHM, static_cast<uint32_t>(Algorithm::HMAC)),
+        Param(Tag::DIGEST, static_cast<uint32_t>(Digest::SHA_2_512)),
+        Param(Tag::MIN_MAC_LENGTH, 384),
+    };
+
+    // 384 bits is longer than a SHA-256 MAC but fine for SHA-512
+    capabilities.learn({Call::GENERATE_KEY, sha256, nullptr, nullptr},
+                       ErrorCode::UNSUPPORTED_MIN_MAC_LENGTH);
+    EXPECT_EQ(capabilities.size(), 0u);
+    EXPECT_EQ(capabilities.check(
+                  {Call::GENERATE_KEY, sha512, nullptr, nullptr}),
+              ErrorCode::OK);
+}
@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <../enum_tables.h>
+#include <../proto_utils.h>
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+// Hardware
+using ::android::hardware::hidl_vec;
+using ::android::hardware::keymaster::AlgorithmTable;
+using ::android::hardware::keymaster::BlockModeTable;
+using ::android::hardware::keymaster::DigestTable;
+using ::android::hardware::keymaster::EcCurveTable;
+using ::android::hardware::keymaster::ErrorCodeTable;
+using ::android::hardware::keymaster::KeyBlobUsageRequirementsTable;
+using ::android::hardware::keymaster::KeyOriginTable;
+using ::android::hardware::keymaster::kTags;
+using ::android::hardware::keymaster::PaddingModeTable;
+using ::android::hardware::keymaster::PurposeTable;
+using ::android::hardware::keymaster::key_parameter_to_pb;
+using ::android::hardware::keymaster::pb_to_hidl_params;
+using ::android::hardware::keymaster::translate_error_code;
+
+// HAL
+using ::android::hardware::keymaster::V4_0::ErrorCode;
+using ::android::hardware::keymaster::V4_0::KeyParameter;
+using ::android::hardware::keymaster::V4_0::Tag;
+
+namespace nosapp = ::nugget::app::keymaster;
+
+namespace {
+
+using Field = decltype(KeyParameter::f);
+
+// Each pair translates both ways, every app value below the app's _MAX has
+// a pair, and a KeyParameter with each value survives the trip to the app
+// and back.
+template <typename Table>
+void ExpectRoundTrip(int appMax, Tag tag,
+                     typename Table::Hal Field::*field) {
+    for (size_t i = 0; i < Table::size(); ++i) {
+        const auto& pair = Table::at(i);
+        typename Table::App app;
+        typename Table::Hal hal;
+        ASSERT_TRUE(Table::to_app(pair.hal, &app));
+        EXPECT_EQ(app, pair.app);
+        ASSERT_TRUE(Table::to_hal(pair.app, &hal));
+        EXPECT_EQ(hal, pair.hal);
+
+        KeyParameter param;
+        param.tag = tag;
+        param.f.*field = pair.hal;
+        nosapp::KeyParameters pb;
+        ASSERT_EQ(key_parameter_to_pb(param, pb.add_params()), ErrorCode::OK);
+        EXPECT_EQ(pb.params(0).integer(), static_cast<uint32_t>(pair.app));
+        hidl_vec<KeyParameter> params;
+        ASSERT_EQ(pb_to_hidl_params(pb, &params), ErrorCode::OK);
+        ASSERT_EQ(params.size(), 1u);
+        EXPECT_EQ(params[0].tag, tag);
+        EXPECT_EQ(params[0].f.*field, pair.hal);
+    }
+    for (int value = 0; value < appMax; ++value) {
+        typename Table::Hal hal;
+        EXPECT_TRUE(Table::to_hal(static_cast<typename Table::App>(value),
+                                  &hal)) << value;
+    }
+}
+
+TEST(EnumTablesTest, purposesRoundTrip) {
+    ExpectRoundTrip<PurposeTable>(nosapp::KeyPurpose::PURPOSE_MAX,
+                                  Tag::PURPOSE, &Field::purpose);
+}
+
+TEST(EnumTablesTest, algorithmsRoundTrip) {
+    ExpectRoundTrip<AlgorithmTable>(nosapp::Algorithm::ALGORITHM_MAX,
+                                    Tag::ALGORITHM, &Field::algorithm);
+}
+
+TEST(EnumTablesTest, blockModesRoundTrip) {
+    ExpectRoundTrip<BlockModeTable>(nosapp::BlockMode::BLOCK_MODE_MAX,
+                                    Tag::BLOCK_MODE, &Field::blockMode);
+}
+
+TEST(EnumTablesTest, digestsRoundTrip) {
+    ExpectRoundTrip<DigestTable>(nosapp::Digest::DIGEST_MAX,
+                                 Tag::DIGEST, &Field::digest);
+}
+
+TEST(EnumTablesTest, paddingModesRoundTrip) {
+    ExpectRoundTrip<PaddingModeTable>(nosapp::PaddingMode::PADDING_MODE_MAX,
+                                      Tag::PADDING, &Field::paddingMode);
+}
+
+TEST(EnumTablesTest, ecCurvesRoundTrip) {
+    ExpectRoundTrip<EcCurveTable>(nosapp::EcCurve::EC_CURVE_MAX,
+                                  Tag::EC_CURVE, &Field::ecCurve);
+}
+
+TEST(EnumTablesTest, keyBlobUsageRequirementsRoundTrip) {
+    ExpectRoundTrip<KeyBlobUsageRequirementsTable>(
+        nosapp::KeyBlobUsageRequirements::KEY_USAGE_MAX,
+        Tag::BLOB_USAGE_REQUIREMENTS, &Field::keyBlobUsageRequirements);
+}
+
+TEST(EnumTablesTest, keyOriginsRoundTrip) {
+    ExpectRoundTrip<KeyOriginTable>(nosapp::KeyOrigin::KEY_ORIGIN_MAX,
+                                    Tag::ORIGIN, &Field::origin);
+}
+
+TEST(EnumTablesTest, errorCodesTranslate) {
+    for (size_t i = 0; i < ErrorCodeTable::size(); ++i) {
+        EXPECT_EQ(translate_error_code(ErrorCodeTable::at(i).app),
+                  ErrorCodeTable::at(i).hal);
+    }
+    // Private to the app
+    EXPECT_EQ(translate_error_code(nosapp::ErrorCode::INVALID_DEVICE_IDS),
+              ErrorCode::UNKNOWN_ERROR);
+}
+
+TEST(EnumTablesTest, tagsTranslate) {
+    for (const auto& pair : kTags) {
+        if (pair.hal == Tag::INVALID) {
+            continue;
+        }
+        KeyParameter param;
+        param.tag = pair.hal;
+        param.blob = std::vector<uint8_t>{0};
+        nosapp::KeyParameter pb;
+        ASSERT_EQ(key_parameter_to_pb(param, &pb), ErrorCode::OK);
+        EXPECT_EQ(pb.tag(), pair.app);
+    }
+}
+
+}  // namespace
@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <MockKeymaster.client.h>
+#include <KeymasterDevice.h>
+
+#include <application.h>
+
+#include <gtest/gtest.h>
+
+#include <openssl/bn.h>
+#include <openssl/ec.h>
+#include <openssl/nid.h>
+
+using ::testing::_;
+using ::testing::Invoke;
+using ::testing::NiceMock;
+using ::testing::Return;
+
+// Hardware
+using ::android::hardware::hidl_vec;
+using ::android::hardware::keymaster::KeymasterDevice;
+
+// HAL
+using ::android::hardware::keymaster::V4_0::ErrorCode;
+using ::android::hardware::keymaster::V4_0::KeyCharacteristics;
+using ::android::hardware::keymaster::V4_0::KeyFormat;
+using ::android::hardware::keymaster::V4_0::Tag;
+
+// App
+using ::nugget::app::keymaster::DeleteKeyRequest;
+using ::nugget::app::keymaster::DeleteKeyResponse;
+using ::nugget::app::keymaster::ExportKeyRequest;
+using ::nugget::app::keymaster::ExportKeyResponse;
+using ::nugget::app::keymaster::GetKeyCharacteristicsRequest;
+using ::nugget::app::keymaster::GetKeyCharacteristicsResponse;
+using ::nugget::app::keymaster::MockKeymaster;
+
+namespace nosapp = ::nugget::app::keymaster;
+
+namespace {
+
+const hidl_vec<uint8_t> kKeyBlob{1, 2, 3, 4};
+const hidl_vec<uint8_t> kOtherKeyBlob{5, 6, 7, 8};
+
+ErrorCode GetCharacteristics(KeymasterDevice& hal,
+                             const hidl_vec<uint8_t>& keyBlob,
+                             const hidl_vec<uint8_t>& clientId = {}) {
+    ErrorCode result = ErrorCode::UNKNOWN_ERROR;
+    hal.getKeyCharacteristics(keyBlob, clientId, {},
+                              [&](ErrorCode error, const KeyCharacteristics&) {
+                                  result = error;
+                              });
+    return result;
+}
+
+// Responds with a freshly generated P-256 public key
+uint32_t ExportEcKey(const ExportKeyRequest&, ExportKeyResponse* response) {
+    bssl::UniquePtr<EC_KEY> key(
+        EC_KEY_new_by_curve_name(NID_X9_62_prime256v1));
+    EXPECT_TRUE(EC_KEY_generate_key(key.get()));
+    bssl::UniquePtr<BIGNUM> x(BN_new());
+    bssl::UniquePtr<BIGNUM> y(BN_new());
+    EXPECT_TRUE(EC_POINT_get_affine_coordinates_GFp(
+        EC_KEY_get0_group(key.get()), EC_KEY_get0_public_key(key.get()),
+        x.get(), y.get(), nullptr));
+
+    uint8_t coordinate[32];
+    response->set_algorithm(nosapp::Algorithm::EC);
+    response->mutable_ec()->set_curve_id(nosapp::EcCurve::P_256);
+    BN_bn2le_padded(coordinate, sizeof(coordinate), x.get());
+    response->mutable_ec()->set_x(coordinate, sizeof(coordinate));
+    BN_bn2le_padded(coordinate, sizeof(coordinate), y.get());
+    response->mutable_ec()->set_y(coordinate, sizeof(coordinate));
+    return APP_SUCCESS;
+}
+
+hidl_vec<uint8_t> ExportKey(KeymasterDevice& hal,
+                            const hidl_vec<uint8_t>& keyBlob,
+                            KeyFormat format = KeyFormat::X509) {
+    hidl_vec<uint8_t> result;
+    hal.exportKey(format, keyBlob, {}, {},
+                  [&](ErrorCode error, const hidl_vec<uint8_t>& der) {
+                      EXPECT_EQ(error, ErrorCode::OK);
+                      result = der;
+                  });
+    return result;
+}
+
+}  // namespace
+
+TEST(KeymasterKeyBlobCacheTest, RepeatedLookupIsCached) {
+    NiceMock<MockKeymaster> mockService;
+    EXPECT_CALL(mockService, GetKeyCharacteristics(_, _))
+        .Times(1)
+        .WillRepeatedly(Return(APP_SUCCESS));
+    KeymasterDevice hal{mockService};
+
+    EXPECT_EQ(GetCharacteristics(hal, kKeyBlob), ErrorCode::OK);
+    EXPECT_EQ(GetCharacteristics(hal, kKeyBlob), ErrorCode::OK);
+}
+
+TEST(KeymasterKeyBlobCacheTest, ClientIdIsPartOfTheKey) {
+    NiceMock<MockKeymaster> mockService;
+    EXPECT_CALL(mockService, GetKeyCharacteristics(_, _))
+        .Times(2)
+        .WillRepeatedly(Return(APP_SUCCESS));
+    KeymasterDevice hal{mockService};
+
+    EXPECT_EQ(GetCharacteristics(hal, kKeyBlob), ErrorCode::OK);
+    EXPECT_EQ(GetCharacteristics(hal, kKeyBlob, {42}), ErrorCode::OK);
+}
+
+TEST(KeymasterKeyBlobCacheTest, DeleteKeyInvalidates) {
+    NiceMock<MockKeymaster> mockService;
+    EXPECT_CALL(mockService, GetKeyCharacteristics(_, _))
+        .Times(3)
+        .WillRepeatedly(Return(APP_SUCCESS));
+    KeymasterDevice hal{mockService};
+
+    GetCharacteristics(hal, kKeyBlob);
+    GetCharacteristics(hal, kOtherKeyBlob);
+    EXPECT_EQ(hal.deleteKey(kKeyBlob), ErrorCode::OK);
+    GetCharacteristics(hal, kKeyBlob);
+    GetCharacteristics(hal, kOtherKeyBlob);
+}
+
+TEST(KeymasterKeyBlobCacheTest, FailedDeleteKeepsEntry) {
+    NiceMock<MockKeymaster> mockService;
+    EXPECT_CALL(mockService, GetKeyCharacteristics(_, _))
+        .Times(1)
+        .WillRepeatedly(Return(APP_SUCCESS));
+    ON_CALL(mockService, DeleteKey(_, _)).WillByDefault(Invoke(
+        [](const DeleteKeyRequest&, DeleteKeyResponse* response) {
+            response->set_error_code(nosapp::ErrorCode::INVALID_KEY_BLOB);
+            return APP_SUCCESS;
+        }));
+    KeymasterDevice hal{mockService};
+
+    GetCharacteristics(hal, kKeyBlob);
+    EXPECT_EQ(hal.deleteKey(kKeyBlob), ErrorCode::INVALID_KEY_BLOB);
+    GetCharacteristics(hal, kKeyBlob);
+}
+
+TEST(KeymasterKeyBlobCacheTest, DeleteAllKeysInvalidates) {
+    NiceMock<MockKeymaster> mockService;
+    EXPECT_CALL(mockService, GetKeyCharacteristics(_, _))
+        .Times(2)
+        .WillRepeatedly(Return(APP_SUCCESS));
+    KeymasterDevice hal{mockService};
+
+    GetCharacteristics(hal, kKeyBlob);
+    EXPECT_EQ(hal.deleteAllKeys(), ErrorCode::OK);
+    GetCharacteristics(hal, kKeyBlob);
+}
+
+TEST(KeymasterKeyBlobCacheTest, FailedCallInvalidates) {
+    NiceMock<MockKeymaster> mockService;
+    EXPECT_CALL(mockService, GetKeyCharacteristics(_, _))
+        .Times(2)
+        .WillRepeatedly(Return(APP_SUCCESS));
+    EXPECT_CALL(mockService, AddRngEntropy(_, _))
+        .WillOnce(Return(APP_ERROR_IO));
+    KeymasterDevice hal{mockService};
+
+    GetCharacteristics(hal, kKeyBlob);
+    // As seen when Citadel is reset
+    EXPECT_NE(hal.addRngEntropy({1}), ErrorCode::OK);
+    GetCharacteristics(hal, kKeyBlob);
+}
+
+TEST(KeymasterKeyBlobCacheTest, CachedBlobsOutliveTheResponse) {
+    NiceMock<MockKeymaster> mockService;
+    // Each key's root of trust is its blob
+    ON_CALL(mockService, GetKeyCharacteristics(_, _)).WillByDefault(Invoke(
+        [](const GetKeyCharacteristicsRequest& request,
+           GetKeyCharacteristicsResponse* response) {
+            nosapp::KeyParameter* param = response->mutable_characteristics()
+                ->mutable_tee_enforced()->add_params();
+            param->set_tag(nosapp::Tag::ROOT_OF_TRUST);
+            param->set_blob(request.blob().blob());
+            return APP_SUCCESS;
+        }));
+    KeymasterDevice hal{mockService};
+
+    auto rootOfTrust = [&](const hidl_vec<uint8_t>& keyBlob) {
+        hidl_vec<uint8_t> result;
+        hal.getKeyCharacteristics(
+            keyBlob, {}, {},
+            [&](ErrorCode error, const KeyCharacteristics& characteristics) {
+                ASSERT_EQ(error, ErrorCode::OK);
+                ASSERT_EQ(characteristics.hardwareEnforced.size(), 1u);
+                EXPECT_EQ(characteristics.hardwareEnforced[0].tag,
+                          Tag::ROOT_OF_TRUST);
+                result = characteristics.hardwareEnforced[0].blob;
+            });
+        return result;
+    };
+    EXPECT_EQ(rootOfTrust(kKeyBlob), kKeyBlob);
+    // Reuses the storage the first response had
+    EXPECT_EQ(rootOfTrust(kOtherKeyBlob), kOtherKeyBlob);
+    EXPECT_EQ(rootOfTrust(kKeyBlob), kKeyBlob);
+}
+
+TEST(KeymasterKeyBlobCacheTest, ExportIsCachedPerFormat) {
+    NiceMock<MockKeymaster> mockService;
+    EXPECT_CALL(mockService, ExportKey(_, _))
+        .Times(2)
+        .WillRepeatedly(Invoke(ExportEcKey));
+    KeymasterDevice hal{mockService};
+
+    const hidl_vec<uint8_t> der = ExportKey(hal, kKeyBlob);
+    EXPECT_GT(der.size(), 0u);
+    EXPECT_EQ(ExportKey(hal, kKeyBlob), der);
+    ExportKey(hal, kKeyBlob, KeyFormat::RAW);
+}
+
+TEST(KeymasterKeyBlobCacheTest, DeleteKeyInvalidatesExport) {
+    NiceMock<MockKeymaster> mockService;
+    EXPECT_CALL(mockService, ExportKey(_, _))
+        .Times(2)
+        .WillRepeatedly(Invoke(ExportEcKey));
+    KeymasterDevice hal{mockService};
+
+    const hidl_vec<uint8_t> der = ExportKey(hal, kKeyBlob);
+    EXPECT_EQ(hal.deleteKey(kKeyBlob), ErrorCode::OK);
+    // A new key was generated, so a fresh export differs
+    EXPECT_NE(ExportKey(hal, kKeyBlob), der);
+}
@@ -0,0 +1,251 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <../proto_utils.h>
+
+#include <MockKeymaster.client.h>
+#include <KeymasterDevice.h>
+
+#include <application.h>
+
+#include <gtest/gtest.h>
+
+#include <openssl/bn.h>
+#include <openssl/digest.h>
+#include <openssl/ec_key.h>
+#include <openssl/ecdsa.h>
+#include <openssl/nid.h>
+#include <openssl/sha.h>
+
+#include <vector>
+
+using ::testing::_;
+using ::testing::Invoke;
+using ::testing::NiceMock;
+using ::testing::Return;
+
+// Hardware
+using ::android::hardware::hidl_vec;
+using ::android::hardware::keymaster::KeymasterDevice;
+using ::android::hardware::keymaster::hidl_params_to_pb;
+
+// HAL
+using ::android::hardware::keymaster::V4_0::Algorithm;
+using ::android::hardware::keymaster::V4_0::Digest;
+using ::android::hardware::keymaster::V4_0::ErrorCode;
+using ::android::hardware::keymaster::V4_0::HardwareAuthToken;
+using ::android::hardware::keymaster::V4_0::KeyParameter;
+using ::android::hardware::keymaster::V4_0::KeyPurpose;
+using ::android::hardware::keymaster::V4_0::Tag;
+using ::android::hardware::keymaster::V4_0::VerificationToken;
+
+// App
+using ::nugget::app::keymaster::ExportKeyRequest;
+using ::nugget::app::keymaster::ExportKeyResponse;
+using ::nugget::app::keymaster::GetKeyCharacteristicsRequest;
+using ::nugget::app::keymaster::GetKeyCharacteristicsResponse;
+using ::nugget::app::keymaster::MockKeymaster;
+
+namespace nosapp = ::nugget::app::keymaster;
+
+namespace {
+
+const hidl_vec<uint8_t> kKeyBlob{1, 2, 3, 4};
+const std::vector<uint8_t> kMessage{'h', 'e', 'l', 'l', 'o'};
+
+KeyParameter Param(Tag tag, uint32_t value) {
+    KeyParameter param;
+    param.tag = tag;
+    param.f.integer = value;
+    return param;
+}
+
+// A device holding a P-256 verification key with the given authorizations.
+class EcKeyDevice {
+public:
+    explicit EcKeyDevice(MockKeymaster* mock,
+                         std::vector<KeyParameter> extraAuthorizations = {})
+            : _key(EC_KEY_new_by_curve_name(NID_X9_62_prime256v1)) {
+        EC_KEY_generate_key(_key.get());
+
+        std::vector<KeyParameter> authorizations = {
+            Param(Tag::ALGORITHM, static_cast<uint32_t>(Algorithm::EC)),
+            Param(Tag::PURPOSE, static_cast<uint32_t>(KeyPurpose::SIGN)),
+            Param(Tag::PURPOSE, static_cast<uint32_t>(KeyPurpose::VERIFY)),
+            Param(Tag::DIGEST, static_cast<uint32_t>(Digest::SHA_2_256)),
+        };
+        authorizations.insert(authorizations.end(),
+                              extraAuthorizations.begin(),
+                              extraAuthorizations.end());
+        _authorizations = authorizations;
+
+        ON_CALL(*mock, GetKeyCharacteristics(_, _)).WillByDefault(Invoke(
+            [this](const GetKeyCharacteristicsRequest&,
+                   GetKeyCharacteristicsResponse* response) {
+                hidl_params_to_pb(_authorizations,
+                                  response->mutable_characteristics()
+                                      ->mutable_tee_enforced());
+                return APP_SUCCESS;
+            }));
+        ON_CALL(*mock, ExportKey(_, _)).WillByDefault(Invoke(
+            [this](const ExportKeyRequest&, ExportKeyResponse* response) {
+                bssl::UniquePtr<BIGNUM> x(BN_new());
+                bssl::UniquePtr<BIGNUM> y(BN_new());
+                EC_POINT_get_affine_coordinates_GFp(
+                    EC_KEY_get0_group(_key.get()),
+                    EC_KEY_get0_public_key(_key.get()),
+                    x.get(), y.get(), nullptr);
+                uint8_t coordinate[32];
+                response->set_algorithm(nosapp::Algorithm::EC);
+                response->mutable_ec()->set_curve_id(nosapp::EcCurve::P_256);
+                BN_bn2le_padded(coordinate, sizeof(coordinate), x.get());
+                response->mutable_ec()->set_x(coordinate, sizeof(coordinate));
+                BN_bn2le_padded(coordinate, sizeof(coordinate), y.get());
+                response->mutable_ec()->set_y(coordinate, sizeof(coordinate));
+                return APP_SUCCESS;
+            }));
+    }
+
+    hidl_vec<uint8_t> Sign(const std::vector<uint8_t>& message) const {
+        uint8_t digest[SHA256_DIGEST_LENGTH];
+        SHA256(message.data(), message.size(), digest);
+        std::vector<uint8_t> signature(ECDSA_size(_key.get()));
+        unsigned int size;
+        ECDSA_sign(0, digest, sizeof(digest), signature.data(), &size,
+                   _key.get());
+        signature.resize(size);
+        return signature;
+    }
+
+private:
+    bssl::UniquePtr<EC_KEY> _key;
+    hidl_vec<KeyParameter> _authorizations;
+};
+
+uint64_t BeginVerify(KeymasterDevice& hal, Digest digest) {
+    uint64_t handle = 0;
+    hal.begin(KeyPurpose::VERIFY, kKeyBlob,
+              {Param(Tag::DIGEST, static_cast<uint32_t>(digest))},
+              HardwareAuthToken{},
+              [&](ErrorCode error, const hidl_vec<KeyParameter>&,
+                  uint64_t operationHandle) {
+                  EXPECT_EQ(error, ErrorCode::OK);
+                  handle = operationHandle;
+              });
+    return handle;
+}
+
+ErrorCode FinishVerify(KeymasterDevice& hal, uint64_t handle,
+                       const hidl_vec<uint8_t>& signature) {
+    ErrorCode result = ErrorCode::UNKNOWN_ERROR;
+    hal.finish(handle, {}, hidl_vec<uint8_t>(kMessage), signature,
+               HardwareAuthToken{}, VerificationToken{},
+               [&](ErrorCode error, const hidl_vec<KeyParameter>&,
+                   const hidl_vec<uint8_t>&) {
+                   result = error;
+               });
+    return result;
+}
+
+}  // namespace
+
+TEST(KeymasterPublicKeyOperationTest, VerifiesWithoutTheDevice) {
+    NiceMock<MockKeymaster> mockService;
+    EcKeyDevice device(&mockService);
+    EXPECT_CALL(mockService, BeginOperation(_, _)).Times(0);
+    EXPECT_CALL(mockService, FinishOperation(_, _)).Times(0);
+    KeymasterDevice hal{mockService};
+
+    const hidl_vec<uint8_t> signature = device.Sign(kMessage);
+    EXPECT_EQ(FinishVerify(hal, BeginVerify(hal, Digest::SHA_2_256),
+                           signature),
+              ErrorCode::OK);
+
+    hidl_vec<uint8_t> corrupted = signature;
+    corrupted[corrupted.size() - 1] ^= 1;
+    EXPECT_EQ(FinishVerify(hal, BeginVerify(hal, Digest::SHA_2_256),
+                           corrupted),
+              ErrorCode::VERIFICATION_FAILED);
+}
+
+TEST(KeymasterPublicKeyOperationTest, UnauthorizedDigestGoesToTheDevice) {
+    NiceMock<MockKeymaster> mockService;
+    EcKeyDevice device(&mockService);
+    EXPECT_CALL(mockService, BeginOperation(_, _))
+        .WillOnce(Return(APP_SUCCESS));
+    KeymasterDevice hal{mockService};
+
+    BeginVerify(hal, Digest::SHA_2_512);
+}
+
+TEST(KeymasterPublicKeyOperationTest, AuthBoundKeyGoesToTheDevice) {
+    NiceMock<MockKeymaster> mockService;
+    KeyParameter secureId;
+    secureId.tag = Tag::USER_SECURE_ID;
+    secureId.f.longInteger = 1234;
+    EcKeyDevice device(&mockService, {secureId});
+    EXPECT_CALL(mockService, BeginOperation(_, _))
+        .WillOnce(Return(APP_SUCCESS));
+    KeymasterDevice hal{mockService};
+
+    BeginVerify(hal, Digest::SHA_2_256);
+}
+
+TEST(KeymasterPublicKeyOperationTest, AbortForgetsTheOperation) {
+    NiceMock<MockKeymaster> mockService;
+    EcKeyDevice device(&mockService);
+    KeymasterDevice hal{mockService};
+
+    const uint64_t handle = BeginVerify(hal, Digest::SHA_2_256);
+    EXPECT_EQ(hal.abort(handle), ErrorCode::OK);
+    // Now unknown to the HAL, so passed on
+    EXPECT_CALL(mockService, AbortOperation(_, _))
+        .WillOnce(Return(APP_SUCCESS));
+    hal.abort(handle);
+}
+
+TEST(KeymasterPublicKeyOperationTest, OperationsAreBounded) {
+    NiceMock<MockKeymaster> mockService;
+    EcKeyDevice device(&mockService);
+    KeymasterDevice hal{mockService};
+    // None of them reach the device, even the one over the limit
+    EXPECT_CALL(mockService, BeginOperation(_, _)).Times(0);
+
+    std::vector<uint64_t> handles;
+    ErrorCode result = ErrorCode::OK;
+    while (result == ErrorCode::OK && handles.size() < 1000) {
+        hal.begin(KeyPurpose::VERIFY, kKeyBlob,
+                  {Param(Tag::DIGEST,
+                         static_cast<uint32_t>(Digest::SHA_2_256))},
+                  HardwareAuthToken{},
+                  [&](ErrorCode error, const hidl_vec<KeyParameter>&,
+                      uint64_t operationHandle) {
+                      result = error;
+                      if (error == ErrorCode::OK) {
+                          handles.push_back(operationHandle);
+                      }
+                  });
+    }
+    EXPECT_EQ(result, ErrorCode::TOO_MANY_OPERATIONS);
+    EXPECT_LT(handles.size(), 1000u);
+
+    // Ending one makes room for another
+    EXPECT_EQ(hal.abort(handles.back()), ErrorCode::OK);
+    handles.back() = BeginVerify(hal, Digest::SHA_2_256);
+    for (uint64_t handle : handles) {
+        EXPECT_EQ(hal.abort(handle), ErrorCode::OK);
+    }
+}
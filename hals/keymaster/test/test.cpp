@@ -17,24 +17,58 @@
 #include <MockKeymaster.client.h>
 #include <KeymasterDevice.h>
 
+#include <application.h>
+
 #include <gtest/gtest.h>
 
+#include "../buffer.h"
+#include "../thread_message.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
 #include <string>
+#include <vector>
 
 using ::std::string;
 
+using ::testing::_;
 using ::testing::Eq;
+using ::testing::Invoke;
+using ::testing::NiceMock;
 using ::testing::Return;
 
 // Hardware
+using ::android::hardware::hidl_vec;
 using ::android::hardware::keymaster::KeymasterDevice;
-using ::android::hardware::keymaster::KeymasterDevice;
+using ::android::hardware::keymaster::WipeMessage;
+using ::android::hardware::keymaster::buffer_chunk_size;
 
 // HAL
+using ::android::hardware::keymaster::V4_0::Algorithm;
+using ::android::hardware::keymaster::V4_0::BlockMode;
+using ::android::hardware::keymaster::V4_0::ErrorCode;
+using ::android::hardware::keymaster::V4_0::HardwareAuthToken;
+using ::android::hardware::keymaster::V4_0::KeyParameter;
+using ::android::hardware::keymaster::V4_0::KeyPurpose;
 using ::android::hardware::keymaster::V4_0::SecurityLevel;
+using ::android::hardware::keymaster::V4_0::VerificationToken;
 
 // App
+using ::nugget::app::keymaster::AbortOperationRequest;
+using ::nugget::app::keymaster::AbortOperationResponse;
+using ::nugget::app::keymaster::BeginOperationRequest;
+using ::nugget::app::keymaster::BeginOperationResponse;
+using ::nugget::app::keymaster::FinishOperationRequest;
+using ::nugget::app::keymaster::FinishOperationResponse;
+using ::nugget::app::keymaster::GenerateKeyRequest;
+using ::nugget::app::keymaster::GenerateKeyResponse;
+using ::nugget::app::keymaster::ImportKeyRequest;
 using ::nugget::app::keymaster::MockKeymaster;
+using ::nugget::app::keymaster::UpdateOperationRequest;
+using ::nugget::app::keymaster::UpdateOperationResponse;
+
+namespace nosapp = ::nugget::app::keymaster;
 
 // GetHardwareInfo
 
@@ -49,3 +83,188 @@ TEST(KeymasterHalTest, getHardwareInfoReturnsDefaults) {
         EXPECT_THAT(keymasterAuthorName, Eq("Google"));
     });
 }
+
+// Finish
+
+TEST(KeymasterHalTest, finishStreamsInputThroughUpdates) {
+    constexpr uint64_t kChallenge = 42;
+    NiceMock<MockKeymaster> mockService;
+    ON_CALL(mockService, BeginOperation(_, _)).WillByDefault(Invoke(
+        [](const BeginOperationRequest&, BeginOperationResponse* response) {
+            response->mutable_handle()->set_handle(1);
+            response->set_algorithm(nosapp::Algorithm::AES);
+            return APP_SUCCESS;
+        }));
+    // Take at most 100 bytes at a time and echo them
+    int updates = 0;
+    ON_CALL(mockService, UpdateOperation(_, _)).WillByDefault(Invoke(
+        [&](const UpdateOperationRequest& request,
+            UpdateOperationResponse* response) {
+            EXPECT_EQ(request.auth_token().challenge(), kChallenge);
+            const size_t consumed =
+                std::min<size_t>(request.input().size(), 100);
+            response->set_consumed(consumed);
+            response->set_output(request.input().substr(0, consumed));
+            updates++;
+            return APP_SUCCESS;
+        }));
+    ON_CALL(mockService, FinishOperation(_, _)).WillByDefault(Invoke(
+        [](const FinishOperationRequest& request,
+           FinishOperationResponse* response) {
+            EXPECT_EQ(request.auth_token().challenge(), kChallenge);
+            response->set_output(request.input());
+            return APP_SUCCESS;
+        }));
+    KeymasterDevice hal{mockService};
+
+    uint64_t handle = 0;
+    hal.begin(KeyPurpose::ENCRYPT, hidl_vec<uint8_t>{1}, {},
+              HardwareAuthToken{},
+              [&](ErrorCode error, const hidl_vec<KeyParameter>&,
+                  uint64_t operationHandle) {
+                  ASSERT_EQ(error, ErrorCode::OK);
+                  handle = operationHandle;
+              });
+
+    std::vector<uint8_t> input(10000);
+    for (size_t i = 0; i < input.size(); ++i) {
+        input[i] = i * 7;
+    }
+    HardwareAuthToken authToken;
+    authToken.challenge = kChallenge;
+    hal.finish(handle, {}, hidl_vec<uint8_t>(input), {}, authToken,
+               VerificationToken{},
+               [&](ErrorCode error, const hidl_vec<KeyParameter>&,
+                   const hidl_vec<uint8_t>& output) {
+                   EXPECT_EQ(error, ErrorCode::OK);
+                   EXPECT_EQ(std::vector<uint8_t>(output), input);
+               });
+    EXPECT_GE(updates, 100);
+}
+
+TEST(KeymasterHalTest, updateFailureIsNotResent) {
+    NiceMock<MockKeymaster> mockService;
+    ON_CALL(mockService, BeginOperation(_, _)).WillByDefault(Invoke(
+        [](const BeginOperationRequest&, BeginOperationResponse* response) {
+            response->mutable_handle()->set_handle(2);
+            response->set_algorithm(nosapp::Algorithm::HMAC);
+            return APP_SUCCESS;
+        }));
+    // The operation is over once an update fails
+    EXPECT_CALL(mockService, UpdateOperation(_, _)).WillOnce(Invoke(
+        [](const UpdateOperationRequest&, UpdateOperationResponse* response) {
+            response->set_error_code(
+                nosapp::ErrorCode::KEY_USER_NOT_AUTHENTICATED);
+            return APP_SUCCESS;
+        }));
+    KeymasterDevice hal{mockService};
+
+    uint64_t handle = 0;
+    hal.begin(KeyPurpose::SIGN, hidl_vec<uint8_t>{1}, {},
+              HardwareAuthToken{},
+              [&](ErrorCode error, const hidl_vec<KeyParameter>&,
+                  uint64_t operationHandle) {
+                  ASSERT_EQ(error, ErrorCode::OK);
+                  handle = operationHandle;
+              });
+
+    hal.update(handle, {}, hidl_vec<uint8_t>(std::vector<uint8_t>(10000)),
+               HardwareAuthToken{}, VerificationToken{},
+               [&](ErrorCode error, uint32_t, const hidl_vec<KeyParameter>&,
+                   const hidl_vec<uint8_t>&) {
+                   EXPECT_EQ(error, ErrorCode::KEY_USER_NOT_AUTHENTICATED);
+               });
+}
+
+// Chunk sizes
+
+TEST(KeymasterHalTest, learnChunkSizesProbesThrowawayOperations) {
+    NiceMock<MockKeymaster> mockService;
+    int generated = 0;
+    ON_CALL(mockService, GenerateKey(_, _)).WillByDefault(Invoke(
+        [&](const GenerateKeyRequest&, GenerateKeyResponse* response) {
+            response->mutable_blob()->set_blob("probe");
+            generated++;
+            return APP_SUCCESS;
+        }));
+    uint64_t nextHandle = 100;
+    ON_CALL(mockService, BeginOperation(_, _)).WillByDefault(Invoke(
+        [&](const BeginOperationRequest&, BeginOperationResponse* response) {
+            response->mutable_handle()->set_handle(nextHandle++);
+            return APP_SUCCESS;
+        }));
+    // Take anything up to 1000 bytes whole and fail anything larger. No
+    // operation is sent anything after it has failed.
+    std::map<uint64_t, int> failed;
+    ON_CALL(mockService, UpdateOperation(_, _)).WillByDefault(Invoke(
+        [&](const UpdateOperationRequest& request,
+            UpdateOperationResponse* response) {
+            EXPECT_EQ(failed[request.handle().handle()], 0);
+            if (request.input().size() > 1000) {
+                failed[request.handle().handle()]++;
+                response->set_error_code(
+                    nosapp::ErrorCode::INVALID_INPUT_LENGTH);
+                return APP_SUCCESS;
+            }
+            response->set_consumed(request.input().size());
+            return APP_SUCCESS;
+        }));
+    std::set<uint64_t> aborted;
+    ON_CALL(mockService, AbortOperation(_, _)).WillByDefault(Invoke(
+        [&](const AbortOperationRequest& request, AbortOperationResponse*) {
+            aborted.insert(request.handle().handle());
+            return APP_SUCCESS;
+        }));
+    KeymasterDevice hal{mockService};
+
+    hal.LearnChunkSizes();
+    EXPECT_GT(generated, 0);
+    EXPECT_EQ(aborted.size(), static_cast<size_t>(generated));
+    EXPECT_EQ(buffer_chunk_size(Algorithm::AES, BlockMode::CBC), 768u);
+    EXPECT_EQ(buffer_chunk_size(Algorithm::HMAC, BlockMode::ECB), 768u);
+}
+
+// Abort
+
+TEST(KeymasterHalTest, abortDropsBufferedOperation) {
+    NiceMock<MockKeymaster> mockService;
+    ON_CALL(mockService, BeginOperation(_, _)).WillByDefault(Invoke(
+        [](const BeginOperationRequest&, BeginOperationResponse* response) {
+            response->mutable_handle()->set_handle(1);
+            response->set_algorithm(nosapp::Algorithm::AES);
+            return APP_SUCCESS;
+        }));
+    EXPECT_CALL(mockService, UpdateOperation(_, _)).Times(0);
+    KeymasterDevice hal{mockService};
+
+    uint64_t handle = 0;
+    hal.begin(KeyPurpose::ENCRYPT, hidl_vec<uint8_t>{1}, {},
+              HardwareAuthToken{},
+              [&](ErrorCode error, const hidl_vec<KeyParameter>&,
+                  uint64_t operationHandle) {
+                  ASSERT_EQ(error, ErrorCode::OK);
+                  handle = operationHandle;
+              });
+    EXPECT_EQ(hal.abort(handle), ErrorCode::OK);
+
+    hal.update(handle, {}, hidl_vec<uint8_t>(std::vector<uint8_t>(16)),
+               HardwareAuthToken{}, VerificationToken{},
+               [](ErrorCode error, uint32_t, const hidl_vec<KeyParameter>&,
+                  const hidl_vec<uint8_t>&) {
+                   EXPECT_NE(error, ErrorCode::OK);
+               });
+}
+
+// Thread messages
+
+TEST(KeymasterHalTest, wipeMessageZeroesNestedStrings) {
+    ImportKeyRequest request;
+    request.mutable_symmetric_key()->set_material(string(32, 'k'));
+    request.mutable_params()->add_params()->set_blob(string(20, 'b'));
+
+    WipeMessage(&request);
+    EXPECT_EQ(request.symmetric_key().material().find_first_not_of('\0'),
+              string::npos);
+    EXPECT_EQ(request.params().params(0).blob().find_first_not_of('\0'),
+              string::npos);
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_KEYMASTER_THREAD_MESSAGE_H
+#define ANDROID_HARDWARE_KEYMASTER_THREAD_MESSAGE_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <google/protobuf/message.h>
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+
+// Overwrites every string in the message, and in the messages it holds,
+// with zeros up to the string's capacity. Cleared strings keep their
+// buffers, so without this keys and data from one call would stay in a
+// thread's message after it is returned.
+inline void WipeMessage(google::protobuf::Message* message)
+{
+    using google::protobuf::FieldDescriptor;
+    const google::protobuf::Reflection* reflection = message->GetReflection();
+    std::vector<const FieldDescriptor*> fields;
+    reflection->ListFields(*message, &fields);
+    for (const FieldDescriptor* field : fields) {
+        if (field->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE) {
+            if (field->is_repeated()) {
+                const int size = reflection->FieldSize(*message, field);
+                for (int i = 0; i < size; ++i) {
+                    WipeMessage(reflection->MutableRepeatedMessage(
+                        message, field, i));
+                }
+            } else {
+                WipeMessage(reflection->MutableMessage(message, field));
+            }
+        } else if (field->cpp_type() == FieldDescriptor::CPPTYPE_STRING) {
+            // The references are to the message's own strings, which it
+            // owns mutably; assigning within capacity doesn't reallocate.
+            std::string scratch;
+            const int size = field->is_repeated()
+                ? reflection->FieldSize(*message, field) : 1;
+            for (int i = 0; i < size; ++i) {
+                const std::string& value = field->is_repeated()
+                    ? reflection->GetRepeatedStringReference(
+                        *message, field, i, &scratch)
+                    : reflection->GetStringReference(*message, field, &scratch);
+                std::string& owned = const_cast<std::string&>(value);
+                owned.assign(owned.capacity(), '\0');
+            }
+        }
+    }
+}
+
+// Lends out the calling thread's message of the given type for as long as
+// it is in scope. Clearing a protobuf keeps the memory its strings and
+// repeated fields had grown, so after the first call of a kind a thread
+// builds and parses its messages with fewer allocations. The transport
+// bounds the size of every message, which bounds what is kept. A message is
+// wiped and cleared as it is returned so nothing from the call lingers.
+//
+// A nested lease of a type already lent out on the thread gets a message
+// of its own instead.
+template <typename Message>
+class ThreadMessage {
+public:
+    ThreadMessage() {
+        Slot& slot = ThreadSlot();
+        if (slot.lent) {
+            _owned.reset(new Message());
+            _message = _owned.get();
+        } else {
+            slot.lent = true;
+            _slot = &slot;
+            _message = &slot.message;
+        }
+    }
+
+    ~ThreadMessage() {
+        WipeMessage(_message);
+        if (_slot != nullptr) {
+            _slot->message.Clear();
+            _slot->lent = false;
+        }
+    }
+
+    ThreadMessage(const ThreadMessage&) = delete;
+    ThreadMessage& operator=(const ThreadMessage&) = delete;
+
+    Message& get() { return *_message; }
+
+private:
+    struct Slot {
+        Message message;
+        bool lent = false;
+    };
+
+    static Slot& ThreadSlot() {
+        thread_local Slot slot;
+        return slot;
+    }
+
+    Slot *_slot = nullptr;
+    std::unique_ptr<Message> _owned;
+    Message *_message;
+};
+
+// Declares a reference, name, to a message leased for the enclosing scope.
+#define KM_THREAD_MESSAGE(type, name)                                         \
+    ThreadMessage<type> name##_lease;                                         \
+    type& name = name##_lease.get()
+
+}  // namespace keymaster
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_KEYMASTER_THREAD_MESSAGE_H
@@ -14,13 +14,18 @@
  * limitations under the License.
  */
 
+#include <memory>
+
 #include <android-base/logging.h>
 #include <hidl/HidlTransportSupport.h>
 #include <utils/StrongPointer.h>
 
 #include <application.h>
 #include <nos/AppClient.h>
-#include <nos/CitadeldProxyClient.h>
+#include <nos/DirectDeviceClient.h>
+#include <nos/IdempotentCalls.h>
+#include <nos/Interceptors.h>
+#include <nos/ServiceFootprint.h>
 
 #include <OemLock.h>
 
@@ -32,7 +37,11 @@ using ::android::hardware::joinRpcThreadpool;
 
 using ::android::hardware::oemlock::OemLock;
 
-using ::nos::CitadeldProxyClient;
+using ::nos::IdempotentCalls;
+using ::nos::InterceptHalCalls;
+using ::nos::LogServiceFootprint;
+using ::nos::MakeCitadelClient;
+using ::nos::NuggetClientInterface;
 using ::nos::AppClient;
 
 using AvbClient = ::nugget::app::avb::Avb;
@@ -40,25 +49,31 @@ using AvbClient = ::nugget::app::avb::Avb;
 int main() {
     LOG(INFO) << "OemLock HAL service starting";
 
-    // Connect to Citadel
-    CitadeldProxyClient citadeldProxy;
-    citadeldProxy.Open();
-    if (!citadeldProxy.IsOpen()) {
-        LOG(FATAL) << "Failed to open citadeld client";
+    // Connect to Citadel, via citadeld unless this image talks to it directly
+    std::unique_ptr<NuggetClientInterface> citadel =
+            MakeCitadelClient("oemlock", IdempotentCalls().OemLock());
+    citadel->Open();
+    if (!citadel->IsOpen()) {
+        LOG(FATAL) << "Failed to open Citadel client";
     }
 
+    // Trace, time and retry the calls the HAL makes
+    auto client = InterceptHalCalls(*citadel, "oemlock");
+
     // This thread will become the only thread of the daemon
     constexpr bool thisThreadWillJoinPool = true;
     configureRpcThreadpool(1, thisThreadWillJoinPool);
 
     // Start the HAL service
-    AvbClient avbClient{citadeldProxy};
+    AvbClient avbClient{client};
     sp<OemLock> oemlock = new OemLock{avbClient};
     const status_t status = oemlock->registerAsService();
     if (status != OK) {
       LOG(FATAL) << "Failed to register OemLock as a service (status: " << status << ")";
     }
 
+    LogServiceFootprint("OemLock HAL service");
+
     joinRpcThreadpool();
     return -1; // Should never be reached
 }
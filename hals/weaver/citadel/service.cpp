@@ -14,13 +14,18 @@
  * limitations under the License.
  */
 
+#include <memory>
+
 #include <android-base/logging.h>
 #include <hidl/HidlTransportSupport.h>
 #include <utils/StrongPointer.h>
 
 #include <application.h>
 #include <nos/AppClient.h>
-#include <nos/CitadeldProxyClient.h>
+#include <nos/DirectDeviceClient.h>
+#include <nos/IdempotentCalls.h>
+#include <nos/Interceptors.h>
+#include <nos/ServiceFootprint.h>
 
 #include <Weaver.h>
 #include <Weaver.client.h>
@@ -33,7 +38,11 @@ using ::android::hardware::joinRpcThreadpool;
 
 using ::android::hardware::weaver::Weaver;
 
-using ::nos::CitadeldProxyClient;
+using ::nos::IdempotentCalls;
+using ::nos::InterceptHalCalls;
+using ::nos::LogServiceFootprint;
+using ::nos::MakeCitadelClient;
+using ::nos::NuggetClientInterface;
 using ::nos::AppClient;
 
 using WeaverClient = ::nugget::app::weaver::Weaver;
@@ -41,25 +50,31 @@ using WeaverClient = ::nugget::app::weaver::Weaver;
 int main() {
     LOG(INFO) << "Weaver HAL service starting";
 
-    // Connect to citadeld
-    CitadeldProxyClient citadeldProxy;
-    citadeldProxy.Open();
-    if (!citadeldProxy.IsOpen()) {
-        LOG(FATAL) << "Failed to open citadeld client";
+    // Connect to Citadel, via citadeld unless this image talks to it directly
+    std::unique_ptr<NuggetClientInterface> citadel =
+            MakeCitadelClient("weaver", IdempotentCalls().Weaver());
+    citadel->Open();
+    if (!citadel->IsOpen()) {
+        LOG(FATAL) << "Failed to open Citadel client";
     }
 
+    // Trace, time and retry the calls the HAL makes
+    auto client = InterceptHalCalls(*citadel, "weaver");
+
     // This thread will become the only thread of the daemon
     constexpr bool thisThreadWillJoinPool = true;
     configureRpcThreadpool(1, thisThreadWillJoinPool);
 
     // Start the HAL service
-    WeaverClient weaverClient{citadeldProxy};
+    WeaverClient weaverClient{client};
     sp<Weaver> weaver = new Weaver{weaverClient};
     const status_t status = weaver->registerAsService();
     if (status != OK) {
       LOG(FATAL) << "Failed to register Weaver as a service (status: " << status << ")";
     }
 
+    LogServiceFootprint("Weaver HAL service");
+
     joinRpcThreadpool();
     return -1; // Should never be reached
 }